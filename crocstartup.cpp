@@ -0,0 +1,102 @@
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "croc/api.h"
+
+// Measures how long it takes to go from croc_vm_open to running the first instruction of a script, and how much
+// memory each idle VM takes up. The VMs are all kept open until the end, like a pool of VMs would be. It also measures
+// how long croc_vm_reset takes, which is the cost of reusing a VM instead of opening a new one.
+
+typedef std::chrono::high_resolution_clock Clock;
+
+namespace
+{
+	Clock::time_point firstInstruction;
+
+	word_t _mark(CrocThread* t)
+	{
+		(void)t;
+		firstInstruction = Clock::now();
+		return 0;
+	}
+
+	double usSince(Clock::time_point start, Clock::time_point end)
+	{
+		return std::chrono::duration<double, std::micro>(end - start).count();
+	}
+
+	void runStatements(CrocThread* t, const char* code)
+	{
+		croc_pushString(t, code);
+		croc_compiler_compileStmtsEx(t, "startup");
+		croc_function_newScript(t, -1);
+		croc_pushNull(t);
+		croc_call(t, -2, 0);
+		croc_popTop(t);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int numVMs = argc > 1 ? atoi(argv[1]) : 100;
+
+	if(numVMs < 1)
+	{
+		fprintf(stderr, "Usage: %s [number of VMs]\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<CrocThread*> vms;
+	double openTime = 0, firstTime = 0, idleBytes = 0;
+
+	for(int i = 0; i < numVMs; i++)
+	{
+		auto start = Clock::now();
+		auto t = croc_vm_openDefault();
+		auto opened = Clock::now();
+
+		croc_function_new(t, "_mark", 0, &_mark, 0);
+		croc_newGlobal(t, "_mark");
+		runStatements(t, "_mark()");
+
+		openTime += usSince(start, opened);
+		firstTime += usSince(start, firstInstruction);
+		idleBytes += croc_vm_bytesAllocated(t);
+		vms.push_back(t);
+	}
+
+	// Reusing a VM instead of opening a new one: run something in it, then put it back the way it was.
+	auto t = vms[0];
+	croc_vm_setBaseline(t);
+	croc_vm_reset(t); // the first one cleans up the garbage from opening the VM
+	double resetTime = 0;
+
+	for(int i = 0; i < numVMs; i++)
+	{
+		runStatements(t, "global x = [1, 2, 3]; _mark()");
+		auto start = Clock::now();
+		croc_vm_reset(t);
+		resetTime += usSince(start, Clock::now());
+	}
+
+	// For comparison, what an idle VM would take if every safe library were loaded up front.
+	auto start = Clock::now();
+	runStatements(t, "foreach(name; modules.SafeStdlibNames) modules.load(name)");
+	auto loadAllTime = usSince(start, Clock::now());
+	croc_gc_collectFull(t);
+
+	printf("VMs:                            %d\n", numVMs);
+	printf("croc_vm_open:                   %10.1f us\n", openTime / numVMs);
+	printf("open to first instruction:      %10.1f us\n", firstTime / numVMs);
+	printf("idle VM size:                   %10.0f bytes\n", idleBytes / numVMs);
+	printf("croc_vm_reset:                  %10.1f us\n", resetTime / numVMs);
+	printf("loading all remaining stdlibs:  %10.1f us\n", loadAllTime);
+	printf("VM size with all stdlibs:       %10.0f bytes\n", (double)croc_vm_bytesAllocated(t));
+
+	for(auto vm: vms)
+		croc_vm_close(vm);
+
+	return 0;
+}
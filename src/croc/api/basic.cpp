@@ -188,7 +188,7 @@ extern "C"
 
 		if(auto tab = getTable(t, obj))
 		{
-			tab->idxa(t->vm->mem, *getValue(t, -1), Value::nullValue);
+			tab->idxa(t->vm, *getValue(t, -1), Value::nullValue);
 			croc_popTop(t_);
 		}
 		else if(auto ns = getNamespace(t, obj))
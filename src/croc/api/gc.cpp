@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include "croc/api.h"
+#include "croc/base/allocprofiler.hpp"
 #include "croc/base/gc.hpp"
 #include "croc/api/apichecks.hpp"
 #include "croc/internal/gc.hpp"
@@ -23,8 +24,13 @@ namespace
 		gcCycle(vm, fullCollect ? GCCycleType_Full : GCCycleType_Normal);
 		runFinalizers(t);
 
+		vm->mem.limitExempt++;
 		vm->stringTab.minimize(vm->mem);
 		vm->weakrefTab.minimize(vm->mem);
+		vm->mem.limitExempt--;
+
+		if(vm->mem.hardLimit != 0)
+			vm->mem.updateLimitCollectAt();
 
 		// This is.. possible? TODO: figure out how.
 		return beforeSize > vm->mem.totalBytes ? beforeSize - vm->mem.totalBytes : 0;
@@ -46,20 +52,88 @@ namespace
 
 		croc_popTop(t);
 	}
+
+	const char* SoftLimitCallback = "gc.softLimitCallback";
+
+	// Calls the soft limit callback the first time a collection leaves the heap over the soft limit. It won't be called
+	// again until the heap has gone back under the soft limit.
+	void checkSoftLimit(CrocThread* t)
+	{
+		auto &mem = Thread::from(t)->vm->mem;
+
+		if(mem.softLimit == 0)
+			return;
+		else if(mem.totalBytes <= mem.softLimit)
+		{
+			mem.softLimitHit = false;
+			return;
+		}
+		else if(mem.softLimitHit)
+			return;
+
+		mem.softLimitHit = true;
+		auto reg = croc_vm_pushRegistry(t);
+
+		if(croc_hasField(t, reg, SoftLimitCallback))
+		{
+			if(croc_isFunction(t, croc_field(t, reg, SoftLimitCallback)))
+			{
+				croc_pushNull(t);
+				croc_pushInt(t, cast(crocint_t)mem.totalBytes);
+				croc_pushInt(t, cast(crocint_t)mem.softLimit);
+				croc_call(t, -4, 0);
+			}
+			else
+				croc_popTop(t);
+		}
+
+		croc_popTop(t);
+	}
+
+	// The soft limit is checked before the post-GC callbacks run, since they can trigger collections of their own.
+	uword collect(CrocThread* t, bool fullCollect)
+	{
+		auto ret = gcInternal(Thread::from(t), fullCollect);
+		checkSoftLimit(t);
+		runPostGCCallbacks(t);
+		return ret;
+	}
 }
 
 extern "C"
 {
-	/** Runs a garbage collection cycle, but only if the VM decides it needs one. */
+	/** Runs a garbage collection cycle, but only if the VM decides it needs one.
+
+	If there is a hard memory limit (see \ref croc_gc_setLimit) and the heap is getting close to it, this runs a full
+	collection instead. If the heap is still over the hard limit after that, this throws a \c MemoryError. */
 	uword_t croc_gc_maybeCollect(CrocThread* t_)
 	{
 		auto t = Thread::from(t_);
+		auto &mem = t->vm->mem;
 
-		if(t->vm->mem.gcDisabled > 0)
+		if(mem.gcDisabled > 0)
 			return 0;
 
-		if(t->vm->mem.couldUseGC())
-			return croc_gc_collect(t_);
+		if(mem.limitError == LimitError_Thrown)
+		{
+			mem.limitError = LimitError_None;
+			mem.limitExempt--;
+		}
+
+		// Not while a MemoryError is being made, or making it would keep coming back here.
+		if(mem.nearHardLimit() && mem.limitExempt == 0)
+		{
+			auto ret = gcInternal(t, true);
+
+			if(mem.totalBytes > mem.hardLimit)
+				throwMemoryError(t, 0);
+
+			checkSoftLimit(t_);
+			runPostGCCallbacks(t_);
+			return ret;
+		}
+		else if(mem.couldUseGC())
+			return collect(t_, false);
 		else
 			return 0;
 	}
@@ -67,17 +141,13 @@ extern "C"
 	/** Forces a garbage collection cycle. */
 	uword_t croc_gc_collect(CrocThread* t_)
 	{
-		auto ret = gcInternal(Thread::from(t_), false);
-		runPostGCCallbacks(t_);
-		return ret;
+		return collect(t_, false);
 	}
 
 	/** Forces a full garbage collection cycle. This will also scan reference cycles for garbage. */
 	uword_t croc_gc_collectFull(CrocThread* t_)
 	{
-		auto ret = gcInternal(Thread::from(t_), true);
-		runPostGCCallbacks(t_);
-		return ret;
+		return collect(t_, true);
 	}
 
 	/** Sets various limits used by the garbage collector. Most have an effect on how often GC collections are run. You
@@ -132,6 +202,21 @@ extern "C"
 	(living or dead) can be scanned by the cycle collector as well. Thus the cycle collector must be run to reclaim ALL
 	dead objects.
 
+	- \c CrocGCLimit_HardLimit - The most memory, in bytes, that the VM may have allocated at once. Defaults to 0, which
+	means no limit. An allocation that would go over it throws a \c MemoryError instead, which can be caught like any
+	other exception. To keep that from happening when there's garbage that could be freed, \ref croc_gc_maybeCollect
+	runs a full collection whenever the heap gets more than halfway from its size after the last collection to the hard
+	limit. The GC's own bookkeeping doesn't count against the limit, so the heap can sometimes go a little over it.
+	Neither does the allocator's overhead: only the objects and arrays themselves are counted, not the unused parts of
+	the slab chunks and nursery pages that small objects are carved out of, or the free chunks and pages kept around for
+	reuse. The memory that the process really uses can be more than the limit by that much. Empty chunks and pages past
+	a small number are given back, so this overhead doesn't keep growing as the heap's mix of object sizes changes.
+
+	- \c CrocGCLimit_SoftLimit - A memory size, in bytes, that the host would like the VM to stay under. Defaults to 0,
+	which means no limit. Going over it runs a collection at the next safe point, and if the heap is still over the soft
+	limit after that, the callback set with \ref croc_gc_setSoftLimitCallback is called. It's only called once each time
+	the heap goes over the soft limit.
+
 	\endparblock
 
 	\param lim is the value of the limit.
@@ -148,6 +233,8 @@ extern "C"
 			case CrocGCLimit_NurserySizeCutoff:    p = &t->vm->mem.nurserySizeCutoff;  break;
 			case CrocGCLimit_CycleCollectInterval: p = &t->vm->mem.nextCycleCollect;   break;
 			case CrocGCLimit_CycleMetadataLimit:   p = &t->vm->mem.cycleMetadataLimit; break;
+			case CrocGCLimit_HardLimit:            p = &t->vm->mem.hardLimit;          break;
+			case CrocGCLimit_SoftLimit:            p = &t->vm->mem.softLimit;          break;
 			default:
 				croc_eh_throwStd(t_, "ValueError", "Invalid limit type");
 				assert(false);
@@ -156,6 +243,12 @@ extern "C"
 
 		auto ret = *p;
 		*p = lim;
+
+		if(type == CrocGCLimit_HardLimit)
+			t->vm->mem.updateLimitCollectAt();
+		else if(type == CrocGCLimit_SoftLimit)
+			t->vm->mem.softLimitHit = false;
+
 		return ret;
 	}
 
@@ -173,8 +266,319 @@ extern "C"
 			case CrocGCLimit_NurserySizeCutoff:    return t->vm->mem.nurserySizeCutoff;
 			case CrocGCLimit_CycleCollectInterval: return t->vm->mem.nextCycleCollect;
 			case CrocGCLimit_CycleMetadataLimit:   return t->vm->mem.cycleMetadataLimit;
+			case CrocGCLimit_HardLimit:            return t->vm->mem.hardLimit;
+			case CrocGCLimit_SoftLimit:            return t->vm->mem.softLimit;
 			default:
 				return croc_eh_throwStd(t_, "ValueError", "Invalid limit type");
 		}
 	}
-}
\ No newline at end of file
+
+	/** Sets the function that's called when the heap goes over the soft limit (\c CrocGCLimit_SoftLimit in
+	\ref croc_gc_setLimit). It's called after a collection, with two parameters: the number of bytes allocated and the
+	soft limit. This is the host's chance to shed load, like dropping caches or refusing new work, before the hard limit
+	is reached. Errors thrown by it propagate out of whatever triggered the collection.
+
+	\param cb is the stack index of the callback function, or of \c null to remove the callback. */
+	void croc_gc_setSoftLimitCallback(CrocThread* t_, word_t cb)
+	{
+		auto t = Thread::from(t_);
+		cb = croc_absIndex(t_, cb);
+
+		if(!croc_isFunction(t_, cb) && !croc_isNull(t_, cb))
+			API_PARAM_TYPE_ERROR(cb, "cb", "function|null");
+
+		croc_vm_pushRegistry(t_);
+		croc_dup(t_, cb);
+		croc_fielda(t_, -2, SoftLimitCallback);
+		croc_popTop(t_);
+	}
+
+	/** Sets a budget on how long the cycle collector is allowed to run during a normal GC cycle. When there is a lot of
+	potential cyclic garbage buffered, collecting it all at once can cause a long pause. With a budget, the cycle
+	collector works through the buffer a batch of objects at a time and stops once the budget is used up, and the next
+	GC cycle continues where it left off. The budget is checked between batches, so a pause can go over it by up to one
+	batch's worth of work. Full collections (\ref croc_gc_collectFull) always run the cycle collector to completion.
+
+	\param type
+	\parblock
+	is the budget type to set. The values are as follows:
+
+	- \c CrocGCBudget_Time - The time, in microseconds, that one GC cycle can spend collecting cycles.
+
+	- \c CrocGCBudget_Objects - The number of objects that one GC cycle's cycle collection can visit.
+
+	Both default to 0, which means unlimited. If both are set, the cycle collector stops when either runs out.
+	\endparblock
+
+	\param budget is the value of the budget.
+	\returns the previous value of the budget that you set. */
+	uword_t croc_gc_setPauseBudget(CrocThread* t_, CrocGCBudget type, uword_t budget)
+	{
+		auto t = Thread::from(t_);
+		uword_t* p;
+
+		switch(type)
+		{
+			case CrocGCBudget_Time:    p = &t->vm->mem.cyclePauseTime;    break;
+			case CrocGCBudget_Objects: p = &t->vm->mem.cyclePauseObjects; break;
+			default:
+				croc_eh_throwStd(t_, "ValueError", "Invalid budget type");
+				assert(false);
+				p = nullptr;
+		}
+
+		auto ret = *p;
+		*p = budget;
+		return ret;
+	}
+
+	/** Gets GC pause budgets as explained above.
+	\param type is the type of budget to get.
+	\returns the current value of that budget. */
+	uword_t croc_gc_getPauseBudget(CrocThread* t_, CrocGCBudget type)
+	{
+		auto t = Thread::from(t_);
+
+		switch(type)
+		{
+			case CrocGCBudget_Time:    return t->vm->mem.cyclePauseTime;
+			case CrocGCBudget_Objects: return t->vm->mem.cyclePauseObjects;
+			default:
+				return croc_eh_throwStd(t_, "ValueError", "Invalid budget type");
+		}
+	}
+
+	/** Turns concurrent cycle collection on or off. It's off by default.
+
+	When it's on, normal GC cycles don't look for cyclic garbage themselves. Instead, they take a snapshot of the part of
+	the heap that the possible cycle roots can reach, and a background thread does the expensive part of the cycle
+	collection on that. A later GC cycle checks what the thread found against the heap as it is then, and frees the
+	cycles that are still garbage. This uses another core, and cyclic garbage lives a little longer, but the GC cycles
+	themselves take less time. Full collections (\ref croc_gc_collectFull) still collect cycles themselves, as do GC
+	cycles that find cyclic garbage with finalizers.
+
+	Turning it off takes effect at the next GC cycle, which waits for the background thread to finish.
+
+	\param enable is whether concurrent cycle collection should be on.
+	\returns whether it was on before. */
+	int croc_gc_setConcurrentCycles(CrocThread* t_, int enable)
+	{
+#ifdef CROC_NO_CONCURRENT_CYCLES
+		if(enable)
+			croc_eh_throwStd(t_, "ApiError", "Croc was compiled without concurrent cycle collection");
+
+		return false;
+#else
+		auto t = Thread::from(t_);
+		auto ret = t->vm->mem.concurrentCycles;
+		t->vm->mem.concurrentCycles = enable != 0;
+		return ret;
+#endif
+	}
+
+	/** \returns whether concurrent cycle collection is on, as explained above. */
+	int croc_gc_getConcurrentCycles(CrocThread* t_)
+	{
+		return Thread::from(t_)->vm->mem.concurrentCycles;
+	}
+
+	/** Tells the GC to tune its own limits towards a goal. After every GC cycle, the GC measures how long the cycle took,
+	how much of the time is being spent in the GC, and how much of the nursery survives, and resizes the nursery
+	(\c CrocGCLimit_NurseryLimit, and \c CrocGCLimit_MetadataLimit along with it) to get closer to the goal. It also
+	changes how often cycles are collected (\c CrocGCLimit_CycleCollectInterval and
+	\c CrocGCLimit_CycleMetadataLimit) depending on how much garbage each cycle collection finds. The limits you set with
+	\ref croc_gc_setLimit are where the tuning starts from, and \ref croc_gc_getLimit returns the values it has chosen.
+
+	\param goal
+	\parblock
+	is what to tune for. The values are as follows:
+
+	- \c CrocGCGoal_None - Don't tune anything; the limits stay where they're set. This is the default.
+
+	- \c CrocGCGoal_Pause - Keep GC pauses under \a target microseconds, using as big a nursery as that allows. This also
+	sets the cycle collector's time budget (see \ref croc_gc_setPauseBudget) to half of \a target.
+
+	- \c CrocGCGoal_Throughput - Keep the time spent in the GC under \a target percent of the total, which must be
+	between 1 and 99. When the GC is well under that, the nursery is shrunk to save memory.
+	\endparblock
+
+	\param target is the goal's target, as explained above. It's ignored for \c CrocGCGoal_None. */
+	void croc_gc_setGoal(CrocThread* t_, CrocGCGoal goal, uword_t target)
+	{
+		auto t = Thread::from(t_);
+
+		switch(goal)
+		{
+			case CrocGCGoal_None:
+				target = 0;
+				break;
+
+			case CrocGCGoal_Pause:
+				if(target == 0)
+					croc_eh_throwStd(t_, "RangeError", "Pause goal must be at least 1 microsecond");
+				break;
+
+			case CrocGCGoal_Throughput:
+				if(target < 1 || target > 99)
+					croc_eh_throwStd(t_, "RangeError", "Throughput goal must be between 1 and 99 percent");
+				break;
+
+			default:
+				croc_eh_throwStd(t_, "ValueError", "Invalid goal type");
+		}
+
+		t->vm->mem.gcGoal = goal;
+		t->vm->mem.gcGoalTarget = target;
+	}
+
+	/** Gets the goal the GC is tuning its limits for, as explained above.
+	\param[out] target if not null, is set to the goal's target.
+	\returns the goal. */
+	CrocGCGoal croc_gc_getGoal(CrocThread* t_, uword_t* target)
+	{
+		auto t = Thread::from(t_);
+
+		if(target)
+			*target = t->vm->mem.gcGoalTarget;
+
+		return t->vm->mem.gcGoal;
+	}
+
+	/** Gets statistics about the GC: how many GC cycles there have been, how long they took and how that breaks down
+	into their phases, and how many objects have been promoted out of the nursery, freed, and so on. The counts and times
+	are totals since the VM was opened or since the last \ref croc_gc_resetStats; the byte counts are as of now. See
+	\ref CrocGCStats for what's in it.
+
+	Timing the GC's phases is always on; it's cheap next to the phases themselves.
+
+	\param[out] stats is filled in with the stats. */
+	void croc_gc_getStats(CrocThread* t_, CrocGCStats* stats)
+	{
+		auto &mem = Thread::from(t_)->vm->mem;
+		*stats = mem.stats;
+		stats->nurseryBytes = mem.nurseryBytes;
+		stats->rcBytes = mem.totalBytes - mem.nurseryBytes;
+	}
+
+	/** Resets the counts and times returned by \ref croc_gc_getStats to 0. */
+	void croc_gc_resetStats(CrocThread* t_)
+	{
+		memset(&Thread::from(t_)->vm->mem.stats, 0, sizeof(CrocGCStats));
+	}
+
+	/** Turns the GC event log on or off. The event log keeps a \ref CrocGCEvent for each of the most recent GC cycles, so
+	that you can see what individual cycles did, rather than just the totals that \ref croc_gc_getStats gives. It's off
+	by default.
+
+	Changing the size throws away any events that are already in the log.
+
+	\param size is how many GC cycles to keep events for. 0 turns the event log off.
+	\returns the previous size. */
+	uword_t croc_gc_setEventLogSize(CrocThread* t_, uword_t size)
+	{
+		auto &mem = Thread::from(t_)->vm->mem;
+		auto ret = mem.gcEventLogSize;
+		mem.resizeEventLog(size);
+		return ret;
+	}
+
+	/** \returns the size of the GC event log, or 0 if it's off. */
+	uword_t croc_gc_getEventLogSize(CrocThread* t_)
+	{
+		return Thread::from(t_)->vm->mem.gcEventLogSize;
+	}
+
+	/** Copies events out of the GC event log, oldest first.
+
+	\param[out] events is where to put them.
+	\param len is how many will fit in \a events. If there are more events than that in the log, the most recent
+		\a len are copied.
+	\returns how many were copied. */
+	uword_t croc_gc_getEvents(CrocThread* t_, CrocGCEvent* events, uword_t len)
+	{
+		auto &mem = Thread::from(t_)->vm->mem;
+		auto num = len < mem.gcEventCount ? len : mem.gcEventCount;
+
+		if(num == 0)
+			return 0;
+
+		auto first = (mem.gcEventNext + mem.gcEventLogSize - num) % mem.gcEventLogSize;
+
+		for(uword i = 0; i < num; i++)
+			events[i] = mem.gcEvents[(first + i) % mem.gcEventLogSize];
+
+		return num;
+	}
+
+	/** Starts the allocation profiler. While it's running, it records the call stack of every GC object that's allocated
+	(the innermost 64 frames of the running thread), and keeps totals of how many objects and bytes have been
+	allocated from each call stack and type. It also keeps track of which of those objects are still alive, so you can
+	see where the memory that's in use came from. Use \ref croc_gc_pushProfile to get the results.
+
+	This slows down allocation a lot and uses memory of its own, so it's only meant to be turned on while you're looking
+	for something. If it was stopped, it picks up where it left off. */
+	void croc_gc_startProfiler(CrocThread* t_)
+	{
+		auto vm = Thread::from(t_)->vm;
+
+		if(vm->mem.profiler == nullptr)
+			vm->mem.profiler = AllocProfiler::create(vm->mem, vm);
+
+		vm->mem.profiler->running = true;
+	}
+
+	/** Stops the allocation profiler from recording new allocations. What it's recorded so far is kept, and it still
+	keeps track of when the objects it's recorded are freed. */
+	void croc_gc_stopProfiler(CrocThread* t_)
+	{
+		auto &mem = Thread::from(t_)->vm->mem;
+
+		if(mem.profiler != nullptr)
+		{
+			mem.profiler->flush(mem);
+			mem.profiler->running = false;
+		}
+	}
+
+	/** Throws away everything the allocation profiler has recorded, and stops it. */
+	void croc_gc_resetProfiler(CrocThread* t_)
+	{
+		auto &mem = Thread::from(t_)->vm->mem;
+
+		if(mem.profiler != nullptr)
+		{
+			AllocProfiler::free(mem, mem.profiler);
+			mem.profiler = nullptr;
+		}
+	}
+
+	/** \returns nonzero if the allocation profiler is recording allocations. */
+	int croc_gc_isProfiling(CrocThread* t_)
+	{
+		auto &mem = Thread::from(t_)->vm->mem;
+		return mem.profiler != nullptr && mem.profiler->running;
+	}
+
+	/** Pushes a string of what the allocation profiler has recorded, in the "folded stacks" format that flame graph tools
+	(such as \c flamegraph.pl, \c inferno, and speedscope) read. Each line is one allocation site: its frames from
+	outermost to innermost separated by semicolons, then the type of object in square brackets as the last frame, then a
+	space and the number. Script frames look like <tt>name (file:line)</tt> and native frames look like
+	<tt>name (native)</tt>.
+
+	\param metric is which number to write for each site. Sites whose number is 0 are left out, so for example
+		\c CrocAllocMetric_LiveBytes only lists where the objects that are still alive were allocated.
+	\returns the stack index of the pushed string, which is empty if the profiler has never been started. */
+	word_t croc_gc_pushProfile(CrocThread* t_, CrocAllocMetric metric)
+	{
+		auto &mem = Thread::from(t_)->vm->mem;
+
+		if(metric < CrocAllocMetric_AllocBytes || metric > CrocAllocMetric_LiveCount)
+			croc_eh_throwStd(t_, "ValueError", "Invalid metric");
+
+		if(mem.profiler == nullptr)
+			return croc_pushString(t_, "");
+
+		auto text = mem.profiler->folded(mem, metric);
+		return croc_pushStringn(t_, text.ptr, text.length);
+	}
+}
@@ -12,6 +12,11 @@ extern "C"
 	<b>This is not garbage-collected; you are entirely responsible for managing this memory.</b> It will, however, be
 	tracked for memory leaks if the library was compiled with the CROC_LEAK_DETECTOR option.
 
+	Like any allocation, this throws a \c MemoryError if it would take the VM over its hard limit (see \ref
+	croc_gc_setLimit), and so does \ref croc_mem_resize when growing a block. Blocks you're holding aren't freed when an
+	exception unwinds past your code, so a temporary buffer that has to live across calls that can throw should be a
+	memblock on the stack instead, which the GC will free.
+
 	\param size is the number of bytes to allocate.
 	\returns a pointer to the allocated memory. */
 	void* croc_mem_alloc(CrocThread* t_, uword_t size)
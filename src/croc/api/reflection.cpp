@@ -4,6 +4,7 @@
 #include "croc/internal/basic.hpp"
 #include "croc/internal/calls.hpp"
 #include "croc/internal/stack.hpp"
+#include "croc/internal/variables.hpp"
 #include "croc/types/base.hpp"
 
 using namespace croc;
@@ -58,14 +59,16 @@ extern "C"
 
 	namespace
 	{
-		int hasFieldImpl(Value v, String* name)
+		int hasFieldImpl(Thread* t, Value v, String* name)
 		{
 			switch(v.type)
 			{
 				case CrocType_Table:     return v.mTable->get(Value::from(name)) != nullptr;
 				case CrocType_Class:     return v.mClass->getField(name) != nullptr;
 				case CrocType_Instance:  return v.mInstance->getField(name) != nullptr;
-				case CrocType_Namespace: return v.mNamespace->get(name) != nullptr;
+				case CrocType_Namespace:
+					return v.mNamespace->get(name) != nullptr ||
+						(loadLazyGlobal(t, v.mNamespace, name) && v.mNamespace->get(name) != nullptr);
 				default:                 return false;
 			}
 		}
@@ -91,7 +94,7 @@ extern "C"
 		auto t = Thread::from(t_);
 		auto v = *getValue(t, obj);
 		auto name = String::create(t->vm, atoda(fieldName));
-		return hasFieldImpl(v, name);
+		return hasFieldImpl(t, v, name);
 	}
 
 	/** \returns nonzero if the object in slot \c obj has a field named the string in slot \c name. Does not take \c
@@ -101,7 +104,7 @@ extern "C"
 		auto t = Thread::from(t_);
 		auto v = *getValue(t, obj);
 		API_CHECK_PARAM(nameStr, name, String, "field name");
-		return hasFieldImpl(v, nameStr);
+		return hasFieldImpl(t, v, nameStr);
 	}
 
 	/** \returns nonzero if the object in slot \c obj can have the method named \c methodName called on it. Does not
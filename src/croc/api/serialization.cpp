@@ -0,0 +1,82 @@
+#include "croc/api.h"
+#include "croc/api/apichecks.hpp"
+#include "croc/internal/serialization.hpp"
+#include "croc/internal/stack.hpp"
+#include "croc/types/base.hpp"
+
+using namespace croc;
+
+namespace
+{
+	void checkTransients(Thread* t, word slot)
+	{
+		auto type = croc_type(*t, slot);
+
+		if(type != CrocType_Table && type != CrocType_Instance)
+			API_PARAM_TYPE_ERROR(slot, "transients", "table|instance");
+	}
+}
+
+extern "C"
+{
+	/** Serializes the graph of objects rooted at \c val into a binary format which \ref croc_ser_deserializeGraph can
+	turn back into an equivalent graph. This is what the \c serialization library's \c serializeGraph uses.
+
+	The serialization is done natively; script code only gets involved for instances with \c opSerialize methods and for
+	transients tables which are instances. See the \c serialization library's docs for what can be serialized and how
+	\c opSerialize and the transients table work.
+
+	\param val is the stack index of the root of the graph.
+	\param transients is the stack index of the transients table, which maps values to be left out of the data to
+		replacement values which are written in their place. It can be a table or an instance which defines
+		\c opIndex. Use an empty table if you have no transients.
+	\param output is the stack index of where the data goes. If it's a memblock, the data is appended to the end of it,
+		and it's grown as needed; this is the fastest way to serialize. Otherwise it must be an output stream (an
+		instance of \c stream.Stream which is writable), and the data is written to it in large chunks and flushed at
+		the end.
+
+	\throws[ValueError] if \c val is the same as the transients table, or if something in the graph can't be
+		serialized (like a native function).
+	\throws[TypeError] if a nativeobj or thread is in the graph and not in the transients table. */
+	void croc_ser_serializeGraph(CrocThread* t_, word_t val, word_t transients, word_t output)
+	{
+		auto t = Thread::from(t_);
+		API_CHECK_NUM_PARAMS(3);
+		val = croc_absIndex(t_, val);
+		transients = croc_absIndex(t_, transients);
+		output = croc_absIndex(t_, output);
+		checkTransients(t, transients);
+
+		if(!croc_isMemblock(t_, output) && !croc_isInstance(t_, output))
+			API_PARAM_TYPE_ERROR(output, "output", "memblock|instance");
+
+		serializeGraph(t, val, transients, output);
+	}
+
+	/** The inverse of \ref croc_ser_serializeGraph. Reads a graph of objects and pushes its root.
+
+	\param transients is the stack index of the transients table. It should be the inverse of the one which was used to
+		serialize the data, mapping the replacement values back to the original values.
+	\param input is the stack index of where the data comes from. If it's a memblock, the data is read from the
+		beginning of it. Otherwise it must be an input stream (an instance of \c stream.Stream which is readable).
+		If the stream is seekable, it's read in large chunks, and left positioned just after the data when this
+		returns; if not, it's read only as far as it needs to be, a few bytes at a time.
+
+	\returns the stack index of the pushed value.
+
+	\throws[ValueError] if the data is malformed, was serialized on an incompatible platform, or refers to a transient
+		which isn't in the transients table. */
+	word_t croc_ser_deserializeGraph(CrocThread* t_, word_t transients, word_t input)
+	{
+		auto t = Thread::from(t_);
+		API_CHECK_NUM_PARAMS(2);
+		transients = croc_absIndex(t_, transients);
+		input = croc_absIndex(t_, input);
+		checkTransients(t, transients);
+
+		if(!croc_isMemblock(t_, input) && !croc_isInstance(t_, input))
+			API_PARAM_TYPE_ERROR(input, "input", "memblock|instance");
+
+		return deserializeGraph(t, transients, input);
+	}
+}
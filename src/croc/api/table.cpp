@@ -21,6 +21,36 @@ extern "C"
 		return push(t, Value::from(Table::create(t->vm->mem, size)));
 	}
 
+	/** Creates a new empty weak table and pushes it onto the stack. See \ref CrocWeakMode for what the modes mean. The
+	mode can't be changed after the table is made. Other than that, weak tables are just tables, and can be used anywhere
+	a table can.
+
+	Key-value pairs are removed from weak tables during garbage collection, so if a collection can happen while you're
+	iterating over one, some pairs may be skipped.
+
+	\param mode is how the table holds its keys and values. \c CrocWeakMode_None makes a normal table.
+	\param size is the same as for \ref croc_table_new.
+
+	\returns the stack index of the pushed value. */
+	word_t croc_table_newWeak(CrocThread* t_, CrocWeakMode mode, uword_t size)
+	{
+		auto t = Thread::from(t_);
+
+		if(mode < CrocWeakMode_None || mode > CrocWeakMode_Ephemeron)
+			croc_eh_throwStd(t_, "ValueError", "Invalid weak mode");
+
+		croc_gc_maybeCollect(t_);
+		return push(t, Value::from(Table::createWeak(t->vm, mode, size)));
+	}
+
+	/** \returns the weak mode of the table in slot \c tab, which is \c CrocWeakMode_None for normal tables. */
+	CrocWeakMode croc_table_getWeakMode(CrocThread* t_, word_t tab)
+	{
+		auto t = Thread::from(t_);
+		API_CHECK_PARAM(tabObj, tab, Table, "tab");
+		return cast(CrocWeakMode)tabObj->weakMode;
+	}
+
 	/** Removes all key-value pairs from the table at slot \c idx. */
 	void croc_table_clear(CrocThread* t_, word_t tab)
 	{
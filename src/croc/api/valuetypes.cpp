@@ -131,8 +131,13 @@ extern "C"
 			uword_t cpLen;
 			auto ok = verifyUtf8(arr, cpLen);
 
+			// arr would leak if this ran into the memory limit.
 			if(ok == UtfError_OK)
+			{
+				t->vm->mem.limitExempt++;
 				ret = push(t, Value::from(String::createUnverified(t->vm, arr, cpLen)));
+				t->vm->mem.limitExempt--;
+			}
 
 			arr.free(t->vm->mem);
 
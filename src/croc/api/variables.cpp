@@ -115,7 +115,8 @@ extern "C"
 		auto t = Thread::from(t_);
 		API_CHECK_NUM_PARAMS(1);
 		API_CHECK_PARAM(name, -1, String, "global name");
-		t->stack[t->stackIndex - 1] = getGlobalImpl(t, name, getEnv(t));
+		auto val = getGlobalImpl(t, name, getEnv(t)); // can load a module, which can move the stack
+		t->stack[t->stackIndex - 1] = val;
 		return croc_getStackSize(t_) - 1;
 	}
 
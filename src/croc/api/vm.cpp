@@ -4,11 +4,15 @@
 
 #include "croc/api.h"
 #include "croc/types/base.hpp"
+#include "croc/base/allocprofiler.hpp"
+#include "croc/base/cycledetector.hpp"
 #include "croc/base/gc.hpp"
 #include "croc/addons/all.hpp"
 #include "croc/api/apichecks.hpp"
+#include "croc/internal/baseline.hpp"
 #include "croc/internal/eh.hpp"
 #include "croc/internal/gc.hpp"
+#include "croc/internal/snapshot.hpp"
 #include "croc/internal/stack.hpp"
 #include "croc/stdlib/all.hpp"
 
@@ -23,6 +27,7 @@ namespace
 		vm->globals->clear(vm->mem);
 		vm->registry->clear(vm->mem);
 		vm->refTab.clear(vm->mem);
+		vm->baseline = nullptr;
 
 		for(auto t = vm->allThreads; t != nullptr; t = t->next)
 		{
@@ -46,7 +51,10 @@ namespace
 			limit++;
 		} while(!vm->toFinalize.isEmpty());
 
-		gcCycle(vm, GCCycleType_NoRoots);
+		// Emptying weak tables can leave decrements for the next cycle.
+		do
+			gcCycle(vm, GCCycleType_NoRoots);
+		while(!vm->mem.decBuffer.isEmpty());
 
 		if(!vm->toFinalize.isEmpty())
 			assert(false); // TODO:
@@ -54,6 +62,90 @@ namespace
 			// you did. Stop doing that.");
 	}
 
+#ifdef CROC_OPCODE_PAIR_STATS
+	const uword NumPairsToPrint = 40;
+
+	// Prints the most frequently executed opcode pairs to stderr, along with how much of the total they make up. This is
+	// meant for deciding which pairs are worth turning into superinstructions.
+	void printOpcodePairs(VM* vm)
+	{
+		struct Pair { uword prev, cur; uint64_t count; };
+		Pair top[NumPairsToPrint] = {};
+		uint64_t total = 0;
+
+		for(uword prev = 0; prev <= Op_NUM_OPCODES; prev++)
+		{
+			for(uword cur = 0; cur < Op_NUM_OPCODES; cur++)
+			{
+				auto count = vm->opPairCounts[prev][cur];
+				total += count;
+
+				if(count <= top[NumPairsToPrint - 1].count)
+					continue;
+
+				// insertion sort into the top list
+				uword i = NumPairsToPrint - 1;
+
+				for(; i > 0 && top[i - 1].count < count; i--)
+					top[i] = top[i - 1];
+
+				top[i] = {prev, cur, count};
+			}
+		}
+
+		if(total == 0)
+			return;
+
+		fprintf(stderr, "-----Opcode pairs (%llu instructions)-----\n", cast(unsigned long long)total);
+
+		for(auto &p: top)
+		{
+			if(p.count == 0)
+				break;
+
+			fprintf(stderr, "%6.2f%% %12llu  %s -> %s\n", (p.count * 100.0) / total, cast(unsigned long long)p.count,
+				p.prev == Op_NUM_OPCODES ? "(start)" : OpNames[p.prev], OpNames[p.cur]);
+		}
+	}
+#endif
+
+	// Sets up everything in a VM except the libraries. The GC is left disabled.
+	Thread* openVM(CrocMemFunc memFunc, void* ctx)
+	{
+		auto vm = cast(VM*)memFunc(ctx, nullptr, 0, sizeof(VM));
+		memset(vm, 0, sizeof(VM));
+
+		vm->mem.init(memFunc, ctx);
+		vm->mem.limitHook = &memoryLimitHook;
+		vm->mem.limitCtx = vm;
+		vm->disableGC();
+
+		vm->metaTabs = DArray<Namespace*>::alloc(vm->mem, CrocType_NUMTYPES);
+		vm->mainThread = Thread::create(vm);
+		vm->metaStrings = DArray<String*>::alloc(vm->mem, MM_NUMMETAMETHODS + 2);
+
+		for(uword i = 0; i < MM_NUMMETAMETHODS; i++)
+			vm->metaStrings[i] = String::create(vm, atoda(MetaNames[i]));
+
+		vm->ctorString = String::create(vm, ATODA("constructor"));
+		vm->finalizerString = String::create(vm, ATODA("finalizer"));
+		vm->metaStrings[vm->metaStrings.length - 2] = vm->ctorString;
+		vm->metaStrings[vm->metaStrings.length - 1] = vm->finalizerString;
+
+		vm->curThread = vm->mainThread;
+		vm->globals = Namespace::create(vm->mem, String::create(vm, ATODA("")));
+		vm->registry = Namespace::create(vm->mem, String::create(vm, ATODA("<registry>")));
+		vm->unhandledEx = Function::create(vm->mem, vm->globals, String::create(vm, ATODA("defaultUnhandledEx")), 1,
+			defaultUnhandledEx, 0);
+		vm->ehFrames = DArray<NativeEHFrame>::alloc(vm->mem, 10);
+		vm->rng.seed();
+#ifdef CROC_OPCODE_PAIR_STATS
+		vm->lastOpcode = Op_NUM_OPCODES;
+#endif
+
+		return vm->mainThread;
+	}
+
 	const char* CompiledInAddons[] =
 	{
 #ifdef CROC_PCRE_ADDON
@@ -108,7 +200,12 @@ extern "C"
 	permitting). While it's not safe for multiple threads to access a single VM without synchronization, accessing
 	separate VMs from separate threads is perfectly fine.
 
-	The safe standard libraries will already be loaded into the global namespace.
+	The safe standard libraries will already be available. The core ones are loaded into the global namespace right
+	away; the rest (such as \c json, \c console, \c repl, and \c serialization) are loaded the first time they're
+	imported or their global is accessed, which keeps startup fast and idle VMs small. Accessing the global means
+	getting it by name, or getting it as a field (or calling it as a method) of the global namespace, or looking for it
+	with \ref croc_hasField. The \c in operator and iterating over the global namespace don't load anything, so
+	libraries which haven't been loaded yet don't show up in either.
 
 	When you're done with a VM, you should call \ref croc_vm_close to free the memory and call any pending finalizers.
 
@@ -119,34 +216,8 @@ extern "C"
 	this. */
 	CrocThread* croc_vm_open(CrocMemFunc memFunc, void* ctx)
 	{
-		auto vm = cast(VM*)memFunc(ctx, nullptr, 0, sizeof(VM));
-		memset(vm, 0, sizeof(VM));
-
-		vm->mem.init(memFunc, ctx);
-		vm->disableGC();
-
-		vm->metaTabs = DArray<Namespace*>::alloc(vm->mem, CrocType_NUMTYPES);
-		vm->mainThread = Thread::create(vm);
-
-		auto t = vm->mainThread;
-
-		vm->metaStrings = DArray<String*>::alloc(vm->mem, MM_NUMMETAMETHODS + 2);
-
-		for(uword i = 0; i < MM_NUMMETAMETHODS; i++)
-			vm->metaStrings[i] = String::create(vm, atoda(MetaNames[i]));
-
-		vm->ctorString = String::create(vm, ATODA("constructor"));
-		vm->finalizerString = String::create(vm, ATODA("finalizer"));
-		vm->metaStrings[vm->metaStrings.length - 2] = vm->ctorString;
-		vm->metaStrings[vm->metaStrings.length - 1] = vm->finalizerString;
-
-		vm->curThread = vm->mainThread;
-		vm->globals = Namespace::create(vm->mem, String::create(vm, ATODA("")));
-		vm->registry = Namespace::create(vm->mem, String::create(vm, ATODA("<registry>")));
-		vm->unhandledEx = Function::create(vm->mem, vm->globals, String::create(vm, ATODA("defaultUnhandledEx")), 1,
-			defaultUnhandledEx, 0);
-		vm->ehFrames = DArray<NativeEHFrame>::alloc(vm->mem, 10);
-		vm->rng.seed();
+		auto t = openVM(memFunc, ctx);
+		auto vm = t->vm;
 
 		// _G = _G._G = _G._G._G = _G._G._G._G = ...
 		push(t, Value::from(vm->globals));
@@ -162,9 +233,9 @@ extern "C"
 		// Safe libs
 		initMiscLib(*t);
 		initStringLib(*t);
+#ifdef CROC_BUILTIN_DOCS
 		initDocsLib(*t); // depends on the stringlib because of how the doc parser is implemented
 
-#ifdef CROC_BUILTIN_DOCS
 		// Go back and document the libs that we loaded before the doc lib
 		docExceptionsLib(*t);
 		docGCLib(*t);
@@ -179,20 +250,26 @@ extern "C"
 		initTextLib(*t); // depends on memblock
 		initStreamLib(*t); // depends on math, object, text
 		initArrayLib(*t);
+		initPathLib(*t);
+		initThreadLib(*t); // sets the thread metatable, so can't wait until it's imported
+
+		initModulesLib(*t); // depends on path
+
+		// The rest aren't loaded until they're imported or their globals are accessed. Their loaders go in
+		// modules.customLoaders, so these have to come after the modules lib.
+#ifndef CROC_BUILTIN_DOCS
+		initDocsLib(*t);
+#endif
 		initAsciiLib(*t);
 		initCompilerLib(*t);
 		initConsoleLib(*t); // depends on stream
 		initEnvLib(*t);
 		initJSONLib(*t); // depends on stream
-		initPathLib(*t);
 		initReplLib(*t);
 		initSerializationLib(*t); // depends on .. lots of libs :P
-		initThreadLib(*t);
 		initTimeLib(*t);
 		initDoctoolsLibs(*t);
 
-		initModulesLib(*t);
-
 #ifdef CROC_BUILTIN_DOCS
 		croc_compiler_setFlags(*t, CrocCompilerFlags_All);
 #endif
@@ -205,6 +282,111 @@ extern "C"
 		return *t;
 	}
 
+	/** Opens a new Croc VM from a snapshot made with \ref croc_vm_snapshot, and returns a pointer to its main thread.
+	This is like \ref croc_vm_open, but instead of loading the standard libraries, everything that was reachable from
+	the snapshotted VM's globals, registry, and other roots is recreated just as it was, without running any script code.
+	This is much faster than loading the libraries (and whatever else you set up) from scratch.
+
+	The snapshot data is only read, not kept, so you can free it (or unmap it, if you memory-mapped a snapshot file)
+	as soon as this returns.
+
+	A snapshot can only be opened by the same build of the Croc library that made it, and only if it's loaded into the
+	same program, since native functions are stored by their address relative to the library. Native functions from
+	other shared libraries can't be restored correctly. Nativeobjs are restored as the same pointers they were, so they
+	should only refer to things that are the same in every process, like the standard stream handles.
+
+	\param memFunc is the memory allocation function, as with \ref croc_vm_open.
+	\param ctx is the context pointer passed to memFunc.
+	\param data points to the snapshot.
+	\param size is the size of the snapshot in bytes.
+	\returns the new VM's main thread, or NULL if the snapshot was made by an incompatible build or is damaged. */
+	CrocThread* croc_vm_openSnapshot(CrocMemFunc memFunc, void* ctx, const void* data, uword_t size)
+	{
+		auto t = openVM(memFunc, ctx);
+
+		if(!readSnapshot(t, crocstr::n(cast(const uint8_t*)data, size)))
+		{
+			t->vm->enableGC();
+			croc_vm_close(*t);
+			return nullptr;
+		}
+
+		// Unlike croc_vm_open, there's no garbage to clean up, so no collection.
+		t->vm->enableGC();
+		assert(t->stackIndex == 1);
+		return *t;
+	}
+
+	/** Makes a snapshot of the given thread's VM, which can be used to open identical VMs with \ref
+	croc_vm_openSnapshot. This includes everything reachable from the globals, the registry, the type metatables, and
+	native references: all the loaded modules, classes, functions, and so on. It doesn't include anything on the
+	main thread's stack, and the only thread it can include is the main thread, so a restored VM always starts out with
+	no code running.
+
+	The snapshot can be written to a file and opened later by the same program, as long as it's using the same Croc
+	library.
+
+	Nativeobjs can't be checked, so they're written as their pointer values and restored as the same pointers. That's
+	fine for values that mean the same thing in every process, like the console library's stream handles (file
+	descriptors, on POSIX), but a nativeobj that points to memory or to a resource of this process will be dangling in
+	the restored VM. Remove any such nativeobjs from reachable objects before making a snapshot.
+
+	\returns the stack index of a new memblock holding the snapshot.
+	\throws[ValueError] if something reachable can't be snapshotted: a thread other than the main thread, a memblock
+		which views native memory, or a closure over a local of a function that's still running. */
+	word_t croc_vm_snapshot(CrocThread* t)
+	{
+		return writeSnapshot(Thread::from(t));
+	}
+
+	/** Opens a new VM which is a copy of the given thread's VM, by snapshotting it (see \ref croc_vm_snapshot) and
+	opening the snapshot. The new VM's baseline is set to its starting state, so it can be handed out, used, and put back
+	the way it was with \ref croc_vm_reset.
+
+	\param memFunc is the new VM's memory allocation function, as with \ref croc_vm_open.
+	\param ctx is the context pointer passed to memFunc.
+	\returns the new VM's main thread, or NULL if the snapshot couldn't be opened (see \ref croc_vm_openSnapshot).
+	\throws[ValueError] if the given VM can't be snapshotted. */
+	CrocThread* croc_vm_fork(CrocThread* t, CrocMemFunc memFunc, void* ctx)
+	{
+		croc_vm_snapshot(t);
+		uword_t size;
+		auto data = croc_memblock_getDatan(t, -1, &size);
+		auto ret = croc_vm_openSnapshot(memFunc, ctx, data, size);
+		croc_popTop(t);
+
+		if(ret != nullptr)
+			recordBaseline(Thread::from(ret));
+
+		return ret;
+	}
+
+	/** Records the current state of the given thread's VM as its baseline, which \ref croc_vm_reset puts it back to.
+	This is usually called once, after the VM has been opened and set up. Calling it again replaces the old baseline.
+
+	The baseline is a shallow copy of every namespace, table, and array that can be reached from the globals, the
+	registry, and the type metatables without going through any other kind of object. That covers all the loaded
+	modules, \c modules.loaded, and the libraries' registry entries. Weak tables are left out. */
+	void croc_vm_setBaseline(CrocThread* t)
+	{
+		recordBaseline(Thread::from(t));
+	}
+
+	/** Puts the given thread's VM back the way it was when \ref croc_vm_setBaseline was called, and collects all the
+	garbage left over. This is much faster than closing the VM and opening a new one, and the memory for the stacks, the
+	string table, and the allocator is kept around to be reused.
+
+	The globals, registry, type metatables, unhandled exception handler, and every container recorded in the baseline
+	get back their old contents, and the main thread's stack is emptied. Modules that were imported since then are
+	forgotten, and will be loaded again the next time they're imported. Changes to other kinds of objects, like the
+	fields of classes and instances or the upvalues of functions, are \em not undone.
+
+	\throws[StateError] if no baseline has been set, or if \c t is not the main thread or code is running on it. */
+	void croc_vm_reset(CrocThread* t)
+	{
+		resetToBaseline(Thread::from(t));
+	}
+
 	/** \returns an array of names of addons that were compiled into this Croc library. The array is terminated with a
 	NULL entry. This is a constant array, so no need to worry about ownership. */
 	const char** croc_vm_includedAddons()
@@ -220,18 +402,38 @@ extern "C"
 	{
 		auto vm = Thread::from(t)->vm;
 
+#ifdef CROC_OPCODE_PAIR_STATS
+		printOpcodePairs(vm);
+#endif
+		if(vm->mem.profiler != nullptr)
+		{
+			AllocProfiler::free(vm->mem, vm->mem.profiler);
+			vm->mem.profiler = nullptr;
+		}
+
+		// Finalizers run by freeAll can't be allowed to run out of memory.
+		vm->mem.hardLimit = 0;
 		freeAll(vm);
+#ifndef CROC_NO_CONCURRENT_CYCLES
+		if(vm->cycleDetector != nullptr)
+			CycleDetector::free(vm->mem, vm->cycleDetector);
+#endif
 		vm->metaTabs.free(vm->mem);
 		vm->metaStrings.free(vm->mem);
 		vm->stringTab.clear(vm->mem);
 		vm->weakrefTab.clear(vm->mem);
+		vm->weakTables.clear(vm->mem);
+		vm->deadWeak.clear(vm->mem);
+		Table::freeWeakHolders(vm);
 		vm->refTab.clear(vm->mem);
 		vm->stdExceptions.clear(vm->mem);
 		vm->roots[0].clear(vm->mem);
 		vm->roots[1].clear(vm->mem);
 		vm->cycleRoots.clear(vm->mem);
+		vm->cycleBatch.clear(vm->mem);
 		vm->toFree.clear(vm->mem);
 		vm->toFinalize.clear(vm->mem);
+		vm->newEphemeronKeys.clear(vm->mem);
 		vm->ehFrames.free(vm->mem);
 		vm->mem.cleanup();
 
@@ -246,7 +448,8 @@ extern "C"
 		vm->mem.memFunc(vm->mem.ctx, vm, sizeof(VM), 0);
 	}
 
-	/** Loads unsafe standard libraries into the global namespace of the given thread's VM.
+	/** Makes unsafe standard libraries available in the given thread's VM. Like the non-core safe libraries, each one
+	is loaded into the global namespace the first time it's imported or its global is accessed.
 
 	\param libs controls which libraries are loaded, and should be an or-ing together of members of the \ref
 		CrocUnsafeLib enum. */
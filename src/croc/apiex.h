@@ -187,6 +187,31 @@ CROCAPI char*  croc_ex_buffer_prepare     (CrocStrBuffer* b, uword_t size);
 CROCAPI void   croc_ex_buffer_addPrepared (CrocStrBuffer* b);
 /**@}*/
 /*====================================================================================================================*/
+/** @defgroup ExVMPool VM pools
+@ingroup Ex
+Keeping a pool of ready-to-use VMs which are all copies of one VM. */
+/**@{*/
+
+/** A pool of VMs which are copies of a base VM. Although the members are defined so you can allocate this structure
+wherever you like, treat it as if it were an opaque type! Only pass it to the pool functions. */
+typedef struct CrocVMPool
+{
+	CrocThread* base;
+	CrocMemFunc memFunc;
+	void* ctx;
+	char* snapshot;
+	uword_t snapshotSize;
+	CrocThread** idle;
+	uword_t numIdle;
+	uword_t maxIdle;
+} CrocVMPool;
+
+CROCAPI void        croc_ex_pool_init    (CrocVMPool* p, CrocThread* base, CrocMemFunc memFunc, void* ctx, uword_t maxIdle);
+CROCAPI CrocThread* croc_ex_pool_acquire (CrocVMPool* p);
+CROCAPI void        croc_ex_pool_release (CrocVMPool* p, CrocThread* t);
+CROCAPI void        croc_ex_pool_free    (CrocVMPool* p);
+/**@}*/
+/*====================================================================================================================*/
 /** @defgroup ExLibrary Library helpers
 @ingroup Ex
 Helpers for making native libraries. */
@@ -18,6 +18,11 @@ Creating, setting up, and destroying Croc VMs. */
 /**@{*/
 CROCAPI void*        croc_DefaultMemFunc               (void* ctx, void* p, uword_t oldSize, uword_t newSize);
 CROCAPI CrocThread*  croc_vm_open                      (CrocMemFunc memFunc, void* ctx);
+CROCAPI CrocThread*  croc_vm_openSnapshot              (CrocMemFunc memFunc, void* ctx, const void* data, uword_t size);
+CROCAPI word_t       croc_vm_snapshot                  (CrocThread* t);
+CROCAPI CrocThread*  croc_vm_fork                      (CrocThread* t, CrocMemFunc memFunc, void* ctx);
+CROCAPI void         croc_vm_setBaseline               (CrocThread* t);
+CROCAPI void         croc_vm_reset                     (CrocThread* t);
 CROCAPI const char** croc_vm_includedAddons            ();
 CROCAPI void         croc_vm_close                     (CrocThread* t);
 CROCAPI void         croc_vm_loadUnsafeLibs            (CrocThread* t, CrocUnsafeLib libs);
@@ -88,6 +93,23 @@ CROCAPI uword_t croc_gc_collect      (CrocThread* t);
 CROCAPI uword_t croc_gc_collectFull  (CrocThread* t);
 CROCAPI uword_t croc_gc_setLimit     (CrocThread* t, CrocGCLimit type, uword_t lim);
 CROCAPI uword_t croc_gc_getLimit     (CrocThread* t, CrocGCLimit type);
+CROCAPI void    croc_gc_setSoftLimitCallback(CrocThread* t, word_t cb);
+CROCAPI uword_t croc_gc_setPauseBudget(CrocThread* t, CrocGCBudget type, uword_t budget);
+CROCAPI uword_t croc_gc_getPauseBudget(CrocThread* t, CrocGCBudget type);
+CROCAPI int     croc_gc_setConcurrentCycles(CrocThread* t, int enable);
+CROCAPI int     croc_gc_getConcurrentCycles(CrocThread* t);
+CROCAPI void    croc_gc_setGoal      (CrocThread* t, CrocGCGoal goal, uword_t target);
+CROCAPI CrocGCGoal croc_gc_getGoal   (CrocThread* t, uword_t* target);
+CROCAPI void    croc_gc_getStats     (CrocThread* t, CrocGCStats* stats);
+CROCAPI void    croc_gc_resetStats   (CrocThread* t);
+CROCAPI uword_t croc_gc_setEventLogSize(CrocThread* t, uword_t size);
+CROCAPI uword_t croc_gc_getEventLogSize(CrocThread* t);
+CROCAPI uword_t croc_gc_getEvents    (CrocThread* t, CrocGCEvent* events, uword_t len);
+CROCAPI void    croc_gc_startProfiler(CrocThread* t);
+CROCAPI void    croc_gc_stopProfiler (CrocThread* t);
+CROCAPI void    croc_gc_resetProfiler(CrocThread* t);
+CROCAPI int     croc_gc_isProfiling  (CrocThread* t);
+CROCAPI word_t  croc_gc_pushProfile  (CrocThread* t, CrocAllocMetric metric);
 /**@}*/
 /*====================================================================================================================*/
 /** @defgroup EH Exceptions
@@ -261,6 +283,8 @@ Functions which operate on tables. */
 /**@{*/
 CROCAPI word_t croc_table_new   (CrocThread* t, uword_t size);
 CROCAPI void   croc_table_clear (CrocThread* t, word_t tab);
+CROCAPI word_t croc_table_newWeak(CrocThread* t, CrocWeakMode mode, uword_t size);
+CROCAPI CrocWeakMode croc_table_getWeakMode(CrocThread* t, word_t tab);
 /**@}*/
 /*====================================================================================================================*/
 /** @defgroup Namespaces Namespaces
@@ -457,6 +481,14 @@ CROCAPI word_t  croc_compiler_parseDocCommentText  (CrocThread* t);
 			croc_eh_throw(_compilerThread_);\
 	} while(0)
 /**@}*/
+/*====================================================================================================================*/
+/** @defgroup Serialization Serialization
+@ingroup API
+Native serialization of object graphs, as used by the \c serialization library. */
+/**@{*/
+CROCAPI void   croc_ser_serializeGraph   (CrocThread* t, word_t val, word_t transients, word_t output);
+CROCAPI word_t croc_ser_deserializeGraph (CrocThread* t, word_t transients, word_t input);
+/**@}*/
 
 #ifdef __cplusplus
 } /* extern "C" */
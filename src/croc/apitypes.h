@@ -120,9 +120,101 @@ typedef enum CrocGCLimit
 	CrocGCLimit_MetadataLimit,        /**< . */
 	CrocGCLimit_NurserySizeCutoff,    /**< . */
 	CrocGCLimit_CycleCollectInterval, /**< . */
-	CrocGCLimit_CycleMetadataLimit    /**< . */
+	CrocGCLimit_CycleMetadataLimit,   /**< . */
+	CrocGCLimit_HardLimit,            /**< . */
+	CrocGCLimit_SoftLimit             /**< . */
 } CrocGCLimit;
 
+/** An enumeration of the ways the cycle collector's pause can be limited. Read about what they mean in the
+\ref croc_gc_setPauseBudget docs. */
+typedef enum CrocGCBudget
+{
+	CrocGCBudget_Time,   /**< . */
+	CrocGCBudget_Objects /**< . */
+} CrocGCBudget;
+
+/** An enumeration of the things the GC can tune its limits for. Read about what they mean in the \ref croc_gc_setGoal
+docs. */
+typedef enum CrocGCGoal
+{
+	CrocGCGoal_None,      /**< . */
+	CrocGCGoal_Pause,     /**< . */
+	CrocGCGoal_Throughput /**< . */
+} CrocGCGoal;
+
+/** An enumeration of the phases of a GC cycle, used to index the phase times in \ref CrocGCStats and
+\ref CrocGCEvent. */
+typedef enum CrocGCPhase
+{
+	CrocGCPhase_Roots,     /**< Scanning the roots, and incrementing and decrementing the root buffers. */
+	CrocGCPhase_ModBuffer, /**< Processing the modified buffer, which includes moving objects out of the nursery. */
+	CrocGCPhase_DecBuffer, /**< Processing the decrement buffer, which is where most objects are freed. */
+	CrocGCPhase_Nursery,   /**< Sweeping the nursery. */
+	CrocGCPhase_Cycles,    /**< Cycle collection. */
+
+	CrocGCPhase_NUMPHASES  /**< The number of phases. */
+} CrocGCPhase;
+
+/** Statistics about the GC, as filled in by \ref croc_gc_getStats. Times are in nanoseconds, and the counts are totals
+since the VM was opened (or the stats were last reset with \ref croc_gc_resetStats). */
+typedef struct CrocGCStats
+{
+	uint64_t cycles;                              /**< How many GC cycles there have been. */
+	uint64_t totalTime;                           /**< How long they took altogether. */
+	uint64_t maxTime;                             /**< How long the longest one took. */
+	uint64_t lastTime;                            /**< How long the most recent one took. */
+	uint64_t phaseTime[CrocGCPhase_NUMPHASES];    /**< How long each phase took altogether. */
+	uint64_t lastPhaseTime[CrocGCPhase_NUMPHASES];/**< How long each phase of the most recent GC cycle took. */
+	uint64_t promoted;                            /**< How many objects have been moved out of the nursery. */
+	uint64_t freed;                               /**< How many objects have been freed. */
+	uint64_t finalized;                           /**< How many objects have been queued to be finalized. */
+	uint64_t cycleCollected;                      /**< How many of the freed objects were freed by cycle collection. */
+	uword_t nurseryBytes;                         /**< How many bytes are allocated in the nursery right now. */
+	uword_t rcBytes;                              /**< How many bytes are allocated outside the nursery right now. */
+} CrocGCStats;
+
+/** A record of one GC cycle, as kept by the GC event log (see \ref croc_gc_setEventLogSize). Times are in
+nanoseconds. */
+typedef struct CrocGCEvent
+{
+	uint64_t cycle;                               /**< Which GC cycle this was, counting from 1. */
+	uint64_t startTime;                           /**< When it started, on a monotonic clock with an arbitrary epoch. */
+	uint64_t time;                                /**< How long it took. */
+	uint64_t phaseTime[CrocGCPhase_NUMPHASES];    /**< How long each phase took. */
+	uword_t promoted;                             /**< How many objects it moved out of the nursery. */
+	uword_t freed;                                /**< How many objects it freed. */
+	uword_t finalized;                            /**< How many objects it queued to be finalized. */
+	uword_t cycleCollected;                       /**< How many of the freed objects were freed by cycle collection. */
+	uword_t nurseryBytes;                         /**< How many bytes were in the nursery when it started. */
+	uword_t rcBytes;                              /**< How many bytes were allocated outside the nursery after it. */
+	int full;                                     /**< Nonzero if it was a full collection. */
+} CrocGCEvent;
+
+/** An enumeration of the values the allocation profiler keeps for each allocation site, used to choose which one
+\ref croc_gc_pushProfile writes out. */
+typedef enum CrocAllocMetric
+{
+	CrocAllocMetric_AllocBytes, /**< How many bytes have been allocated from the site. */
+	CrocAllocMetric_AllocCount, /**< How many objects have been allocated from the site. */
+	CrocAllocMetric_LiveBytes,  /**< How many bytes allocated from the site are still alive. */
+	CrocAllocMetric_LiveCount   /**< How many objects allocated from the site are still alive. */
+} CrocAllocMetric;
+
+/** An enumeration of the kinds of weak tables, as made by \ref croc_table_newWeak. Only references to objects of
+reference types (tables, namespaces, arrays, memblocks, functions, funcdefs, classes, instances, and threads) are weak;
+other values, including strings, are held normally. When an object that's weakly held dies, every key-value pair that
+weakly holds it is removed from the table. */
+typedef enum CrocWeakMode
+{
+	CrocWeakMode_None,       /**< A normal table. */
+	CrocWeakMode_Keys,       /**< Weak keys and strong values. */
+	CrocWeakMode_Values,     /**< Strong keys and weak values. */
+	CrocWeakMode_KeysValues, /**< Weak keys and weak values. */
+	CrocWeakMode_Ephemeron   /**< Weak keys, and values that are only kept alive as long as their keys are. Unlike with
+	                         \c CrocWeakMode_Keys, a value that refers back to its own key doesn't keep the pair alive
+	                         forever. */
+} CrocWeakMode;
+
 /** An enumeration of the possible states Croc threads can be in. */
 typedef enum CrocThreadState
 {
@@ -0,0 +1,308 @@
+#include <new>
+#include <stdio.h>
+#include <string.h>
+
+#include "croc/base/allocprofiler.hpp"
+#include "croc/util/misc.hpp"
+
+#ifdef CROC_LEAK_DETECTOR
+#  define PROFILERTYPEID ,typeid(AllocProfiler)
+#else
+#  define PROFILERTYPEID
+#endif
+
+namespace croc
+{
+	namespace
+	{
+		template<typename T>
+		void growFor(Memory& mem, DArray<T>& arr, uword len)
+		{
+			if(len > arr.length)
+				arr.resize(mem, len < 16 ? 16 : largerPow2(len));
+		}
+
+		uint64_t metricOf(const AllocSite& site, CrocAllocMetric metric)
+		{
+			switch(metric)
+			{
+				case CrocAllocMetric_AllocBytes: return site.allocBytes;
+				case CrocAllocMetric_AllocCount: return site.allocCount;
+				case CrocAllocMetric_LiveBytes:  return site.liveBytes;
+				case CrocAllocMetric_LiveCount:  return site.liveCount;
+				default: assert(false); return 0; // dummy
+			}
+		}
+	}
+
+	AllocProfiler* AllocProfiler::create(Memory& mem, VM* vm)
+	{
+		auto ret = new(mem.allocRaw(sizeof(AllocProfiler) PROFILERTYPEID)) AllocProfiler();
+		ret->vm = vm;
+		ret->running = false;
+		ret->sites = DArray<AllocSite>();
+		ret->numSites = 0;
+		ret->siteFrames = DArray<uword>();
+		ret->numSiteFrames = 0;
+		ret->labels = DArray<ProfLabel>();
+		ret->numLabels = 0;
+		ret->text = DArray<char>();
+		ret->textLength = 0;
+		ret->output = DArray<char>();
+		ret->outputLength = 0;
+		ret->labelIndex.init();
+		ret->siteIndex.init();
+		ret->live.init();
+		ret->pending = nullptr;
+		ret->stackLength = 0;
+		return ret;
+	}
+
+	void AllocProfiler::free(Memory& mem, AllocProfiler* p)
+	{
+		p->sites.free(mem);
+		p->siteFrames.free(mem);
+		p->labels.free(mem);
+		p->text.free(mem);
+		p->output.free(mem);
+		p->labelIndex.clear(mem);
+		p->siteIndex.clear(mem);
+		p->live.clear(mem);
+		p->~AllocProfiler();
+
+		void* ptr = p;
+		size_t size = sizeof(AllocProfiler);
+		mem.freeRaw(ptr, size PROFILERTYPEID);
+	}
+
+	// Called for every GC object allocated. Records the current call stack, but leaves the object pending until its type
+	// has been filled in.
+	void AllocProfiler::allocated(Memory& mem, GCObject* obj)
+	{
+		flush(mem);
+
+		if(!running)
+			return;
+
+		stackLength = 0;
+		auto t = vm->curThread;
+
+		if(t != nullptr)
+		{
+			for(auto i = t->arIndex; i > 0 && stackLength < CROC_PROFILER_MAX_DEPTH; i--)
+			{
+				auto func = t->actRecs[i - 1].func;
+
+				if(func == nullptr)
+					continue;
+
+				auto &frame = stack[stackLength];
+
+				if(func->isNative)
+				{
+					frame.code = cast(uintptr_t)func->nativeFunc;
+					frame.pc = 0;
+				}
+				else
+				{
+					auto def = func->scriptFunc;
+					auto pc = t->actRecs[i - 1].pc;
+					frame.code = cast(uintptr_t)def;
+					frame.pc = (pc > def->code.ptr) ? (pc - def->code.ptr - 1) : 0;
+				}
+
+				stackFuncs[stackLength++] = func;
+			}
+		}
+
+		pending = obj;
+	}
+
+	// Called for every GC object just before it's freed.
+	void AllocProfiler::freed(Memory& mem, GCObject* obj)
+	{
+		flush(mem);
+
+		if(auto site = live.lookup(obj))
+		{
+			sites[*site].liveCount--;
+			sites[*site].liveBytes -= obj->memSize;
+			live.remove(obj);
+		}
+
+		if(obj->type == CrocType_Funcdef)
+		{
+			auto code = cast(uintptr_t)obj;
+
+			for(uword i = 0; i < numLabels; i++)
+			{
+				if(labels[i].frame.code == code)
+				{
+					labelIndex.remove(labels[i].frame);
+					labels[i].frame.code = 0;
+				}
+			}
+		}
+	}
+
+	// Records the pending allocation, if there is one.
+	void AllocProfiler::flush(Memory& mem)
+	{
+		if(pending == nullptr)
+			return;
+
+		auto obj = pending;
+		pending = nullptr;
+
+		auto idx = siteFor(mem, obj->type);
+		auto &site = sites[idx];
+		site.allocCount++;
+		site.allocBytes += obj->memSize;
+		site.liveCount++;
+		site.liveBytes += obj->memSize;
+		*live.insert(mem, obj) = idx;
+	}
+
+	// Writes out the profile in the "folded stacks" format that flame graph tools take: one line per site, with the
+	// frames from outermost to innermost separated by semicolons, then the object type as a last frame, then a space and
+	// the site's value for the given metric. Sites whose value is 0 are left out. The returned text is only good until
+	// the next call.
+	DArray<char> AllocProfiler::folded(Memory& mem, CrocAllocMetric metric)
+	{
+		flush(mem);
+		outputLength = 0;
+
+		for(uword i = 0; i < numSites; i++)
+		{
+			auto &site = sites[i];
+			auto value = metricOf(site, metric);
+
+			if(value == 0)
+				continue;
+
+			for(uword j = site.numFrames; j > 0; j--)
+			{
+				auto &label = labels[siteFrames[site.firstFrame + j - 1]];
+				addOutput(mem, text.ptr + label.start, label.length);
+				addOutput(mem, ";", 1);
+			}
+
+			char buf[64];
+			auto len = snprintf(buf, sizeof(buf), "[%s] %" CROC_UINTEGER_FORMAT "\n", typeToString(site.type), value);
+			addOutput(mem, buf, cast(uword)len);
+		}
+
+		return DArray<char>::n(output.ptr, outputLength);
+	}
+
+	// =================================================================================================================
+	// Private
+	// =================================================================================================================
+
+	// Finds or makes the site for the pending call stack and the given type. Sites are looked up by a hash of their
+	// frames and type; if two different sites have the same hash, the later one moves to the next hash value along.
+	uword AllocProfiler::siteFor(Memory& mem, CrocType type)
+	{
+		uint64_t hash = 14695981039346656037ULL;
+		auto mix = [&hash](uint64_t v) { hash = (hash ^ v) * 1099511628211ULL; };
+
+		for(uword i = 0; i < stackLength; i++)
+		{
+			mix(stack[i].code);
+			mix(stack[i].pc);
+		}
+
+		mix(type);
+
+		for(auto idx = siteIndex.lookup(hash); idx != nullptr; idx = siteIndex.lookup(++hash))
+		{
+			if(siteMatches(*idx, type))
+				return *idx;
+		}
+
+		growFor(mem, siteFrames, numSiteFrames + stackLength);
+
+		for(uword i = 0; i < stackLength; i++)
+			siteFrames[numSiteFrames + i] = labelFor(mem, i);
+
+		growFor(mem, sites, numSites + 1);
+		auto &site = sites[numSites];
+		site.firstFrame = numSiteFrames;
+		site.numFrames = stackLength;
+		site.type = type;
+		site.allocCount = 0;
+		site.allocBytes = 0;
+		site.liveCount = 0;
+		site.liveBytes = 0;
+		numSiteFrames += stackLength;
+		*siteIndex.insert(mem, hash) = numSites;
+		return numSites++;
+	}
+
+	bool AllocProfiler::siteMatches(uword idx, CrocType type)
+	{
+		auto &site = sites[idx];
+
+		if(site.type != type || site.numFrames != stackLength)
+			return false;
+
+		for(uword i = 0; i < stackLength; i++)
+		{
+			if(!(labels[siteFrames[site.firstFrame + i]].frame == stack[i]))
+				return false;
+		}
+
+		return true;
+	}
+
+	// Finds or makes the label for the given frame of the pending call stack. Labels look like "name (file:line)" for
+	// script functions and "name (native)" for native ones.
+	uword AllocProfiler::labelFor(Memory& mem, uword i)
+	{
+		if(auto idx = labelIndex.lookup(stack[i]))
+			return *idx;
+
+		auto func = stackFuncs[i];
+		auto start = textLength;
+		char buf[32];
+		addText(mem, func->name->toCString(), func->name->length);
+
+		if(func->isNative)
+			addText(mem, " (native)", 9);
+		else
+		{
+			auto def = func->scriptFunc;
+			auto line = stack[i].pc < def->lineInfo.length ? def->lineInfo[stack[i].pc] : 0;
+			addText(mem, " (", 2);
+			addText(mem, def->locFile->toCString(), def->locFile->length);
+			auto len = snprintf(buf, sizeof(buf), ":%" CROC_SIZE_T_FORMAT ")", cast(size_t)line);
+			addText(mem, buf, cast(uword)len);
+		}
+
+		growFor(mem, labels, numLabels + 1);
+		auto &label = labels[numLabels];
+		label.frame = stack[i];
+		label.start = start;
+		label.length = textLength - start;
+		*labelIndex.insert(mem, stack[i]) = numLabels;
+		return numLabels++;
+	}
+
+	// Semicolons separate frames in the output, so they're replaced in names.
+	void AllocProfiler::addText(Memory& mem, const char* str, uword len)
+	{
+		growFor(mem, text, textLength + len);
+
+		for(uword i = 0; i < len; i++)
+			text[textLength + i] = str[i] == ';' ? ':' : str[i];
+
+		textLength += len;
+	}
+
+	void AllocProfiler::addOutput(Memory& mem, const char* str, uword len)
+	{
+		growFor(mem, output, outputLength + len);
+		memcpy(output.ptr + outputLength, str, len);
+		outputLength += len;
+	}
+}
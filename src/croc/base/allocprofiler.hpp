@@ -0,0 +1,113 @@
+#ifndef CROC_BASE_ALLOCPROFILER_HPP
+#define CROC_BASE_ALLOCPROFILER_HPP
+
+#include "croc/apitypes.h"
+#include "croc/base/darray.hpp"
+#include "croc/base/gcobject.hpp"
+#include "croc/base/hash.hpp"
+#include "croc/base/memory.hpp"
+#include "croc/types/base.hpp"
+
+// How many of the innermost stack frames are recorded for each allocation.
+#define CROC_PROFILER_MAX_DEPTH 64
+
+namespace croc
+{
+	// One frame of an allocation's call stack: the funcdef and the index of the instruction for script functions, or the
+	// native function and 0 for native ones.
+	struct ProfFrame
+	{
+		uintptr_t code;
+		uword pc;
+
+		inline bool operator==(const ProfFrame& other) const
+		{
+			return code == other.code && pc == other.pc;
+		}
+
+		inline hash_t toHash() const
+		{
+			return cast(hash_t)((cast(uint64_t)code >> 4) ^ (cast(uint64_t)code >> 32) ^ (pc * 0x9E3779B1u));
+		}
+	};
+
+	// GC objects are all aligned, so hashing them by their low bits would put them all in the same few buckets.
+	struct ObjectHasher
+	{
+		template<typename T> static inline hash_t toHash(const T* t)
+		{
+			auto p = cast(uint64_t)cast(uintptr_t)*t;
+			return cast(hash_t)((p >> 4) ^ (p >> 32));
+		}
+	};
+
+	// What the profiler knows about a frame: where its name is in the text buffer. A label whose funcdef has been freed
+	// has its code set to 0, so that it never matches another funcdef allocated at the same address.
+	struct ProfLabel
+	{
+		ProfFrame frame;
+		uword start;
+		uword length;
+	};
+
+	// Everything allocated with one call stack and one type.
+	struct AllocSite
+	{
+		uword firstFrame; // the site's labels are siteFrames[firstFrame .. firstFrame + numFrames], innermost first
+		uword numFrames;
+		CrocType type;
+		uint64_t allocCount;
+		uint64_t allocBytes;
+		uint64_t liveCount;
+		uint64_t liveBytes;
+	};
+
+	// Records where every GC object is allocated from, and keeps track of which of them are still alive. The memory
+	// manager calls allocated and freed if the profiler is on; see Memory::profiler.
+	//
+	// An object's type isn't filled in until after it's been allocated, so the most recent allocation is left pending
+	// (with its call stack) until the next time the profiler hears from the memory manager. Since that includes frees,
+	// nothing on the pending call stack can go away before it's been recorded.
+	struct AllocProfiler
+	{
+		VM* vm;
+		bool running;
+
+		DArray<AllocSite> sites;
+		uword numSites;
+		DArray<uword> siteFrames;
+		uword numSiteFrames;
+		DArray<ProfLabel> labels;
+		uword numLabels;
+		DArray<char> text;
+		uword textLength;
+		DArray<char> output;
+		uword outputLength;
+
+		Hash<ProfFrame, uword, MethodHasher> labelIndex;
+		Hash<uint64_t, uword> siteIndex;
+		Hash<GCObject*, uword, ObjectHasher> live;
+
+		GCObject* pending;
+		ProfFrame stack[CROC_PROFILER_MAX_DEPTH];
+		Function* stackFuncs[CROC_PROFILER_MAX_DEPTH];
+		uword stackLength;
+
+		static AllocProfiler* create(Memory& mem, VM* vm);
+		static void free(Memory& mem, AllocProfiler* p);
+
+		void allocated(Memory& mem, GCObject* obj);
+		void freed(Memory& mem, GCObject* obj);
+		void flush(Memory& mem);
+		DArray<char> folded(Memory& mem, CrocAllocMetric metric);
+
+	private:
+		uword siteFor(Memory& mem, CrocType type);
+		bool siteMatches(uword site, CrocType type);
+		uword labelFor(Memory& mem, uword frame);
+		void addText(Memory& mem, const char* str, uword len);
+		void addOutput(Memory& mem, const char* str, uword len);
+	};
+}
+
+#endif
@@ -0,0 +1,276 @@
+#ifndef CROC_NO_CONCURRENT_CYCLES
+
+#include <new>
+
+#include "croc/base/cycledetector.hpp"
+#include "croc/util/misc.hpp"
+
+#ifdef CROC_LEAK_DETECTOR
+#  define DETECTORTYPEID ,typeid(CycleDetector)
+#else
+#  define DETECTORTYPEID
+#endif
+
+namespace croc
+{
+	namespace
+	{
+		template<typename T>
+		void growFor(Memory& mem, DArray<T>& arr, uword len)
+		{
+			if(len > arr.length)
+				arr.resize(mem, len < 16 ? 16 : largerPow2(len));
+		}
+	}
+
+	CycleDetector* CycleDetector::create(Memory& mem)
+	{
+		auto ret = new(mem.allocRaw(sizeof(CycleDetector) DETECTORTYPEID)) CycleDetector();
+		ret->objects = DArray<GCObject*>();
+		ret->counts = DArray<uint32_t>();
+		ret->finalizable = DArray<uint8_t>();
+		ret->edgeStart = DArray<uword>();
+		ret->edges = DArray<uword>();
+		ret->stack = DArray<uword>();
+		ret->marks = DArray<uint8_t>();
+		ret->numObjects = 0;
+		ret->numRoots = 0;
+		ret->numEdges = 0;
+		ret->mCurrent = 0;
+		ret->ids.init();
+		ret->needSyncPass = false;
+		ret->mState = State_Idle;
+		ret->mStopping = false;
+		ret->mCountsRestored = true;
+		ret->mThread = std::thread(&CycleDetector::run, ret);
+		return ret;
+	}
+
+	void CycleDetector::free(Memory& mem, CycleDetector* d)
+	{
+		assert(d->mState != State_Working);
+
+		{
+			std::lock_guard<std::mutex> lock(d->mLock);
+			d->mStopping = true;
+		}
+
+		d->mCond.notify_all();
+		d->mThread.join();
+		d->reset(mem);
+		d->objects.free(mem);
+		d->counts.free(mem);
+		d->finalizable.free(mem);
+		d->edgeStart.free(mem);
+		d->edges.free(mem);
+		d->stack.free(mem);
+		d->marks.free(mem);
+		d->~CycleDetector();
+
+		void* p = d;
+		size_t size = sizeof(CycleDetector);
+		mem.freeRaw(p, size DETECTORTYPEID);
+	}
+
+	// Adds an object to the snapshot and returns its index. Nothing but the GC looks at reference counts, so until the
+	// thread puts it back (see run), the object's refCount holds its index instead, which is a lot cheaper to look up
+	// than a hash.
+	uword CycleDetector::addObject(Memory& mem, GCObject* obj)
+	{
+		assert(mState == State_Idle);
+		auto idx = numObjects++;
+		assert(idx == cast(uint32_t)idx);
+		growFor(mem, objects, numObjects);
+		growFor(mem, counts, numObjects);
+		growFor(mem, finalizable, numObjects);
+		objects[idx] = obj;
+		counts[idx] = obj->refCount;
+		finalizable[idx] = GCOBJ_FINALIZABLE(obj) && !GCOBJ_FINALIZED(obj);
+		obj->refCount = cast(uint32_t)idx;
+		return idx;
+	}
+
+	// Starts the list of references out of the object at index from. Objects have to be started in order.
+	void CycleDetector::startEdges(Memory& mem, uword from)
+	{
+		growFor(mem, edgeStart, from + 2);
+		edgeStart[from] = numEdges;
+		edgeStart[from + 1] = numEdges;
+		mCurrent = from;
+	}
+
+	void CycleDetector::growEdges(Memory& mem)
+	{
+		growFor(mem, edges, numEdges + 1);
+	}
+
+	// Hands the snapshot to the thread.
+	void CycleDetector::start(Memory& mem)
+	{
+		assert(mState == State_Idle);
+		assert(numObjects > 0 && mCurrent == numObjects - 1);
+		growFor(mem, marks, numObjects);
+		marks.slice(0, numObjects).zeroFill();
+		growFor(mem, stack, numObjects);
+
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			mState = State_Working;
+			mCountsRestored = false;
+		}
+
+		mCond.notify_all();
+	}
+
+	// Whether there's no snapshot being worked on or waiting to be collected.
+	bool CycleDetector::isIdle()
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		return mState == State_Idle;
+	}
+
+	// Waits for the thread to put back the reference counts that addObject borrowed. The GC has to call this before it
+	// touches any reference counts. It's the first thing the thread does, so this hardly ever has to wait.
+	void CycleDetector::waitForCounts()
+	{
+		std::unique_lock<std::mutex> lock(mLock);
+		mCond.wait(lock, [this] { return mCountsRestored; });
+	}
+
+	// Whether the thread has finished with the snapshot. If wait is true, waits for it to finish, unless there's no
+	// snapshot at all.
+	bool CycleDetector::isDone(bool wait)
+	{
+		std::unique_lock<std::mutex> lock(mLock);
+
+		if(wait)
+			mCond.wait(lock, [this] { return mState != State_Working; });
+
+		return mState == State_Done;
+	}
+
+	// Throws the snapshot away once the GC is done with the results. The arrays are kept for the next snapshot, which is
+	// usually about as big.
+	void CycleDetector::reset(Memory& mem)
+	{
+		ids.clear(mem);
+		numObjects = 0;
+		numRoots = 0;
+		numEdges = 0;
+
+		std::lock_guard<std::mutex> lock(mLock);
+		mState = State_Idle;
+	}
+
+	void CycleDetector::run()
+	{
+		std::unique_lock<std::mutex> lock(mLock);
+
+		while(true)
+		{
+			mCond.wait(lock, [this] { return mStopping || mState == State_Working; });
+
+			if(mStopping)
+				return;
+
+			lock.unlock();
+
+			// The mutator can be running, but it never looks at reference counts, and the GC waits for this.
+			for(uword i = 0; i < numObjects; i++)
+				objects[i]->refCount = counts[i];
+
+			lock.lock();
+			mCountsRestored = true;
+			mCond.notify_all();
+			lock.unlock();
+
+			detect();
+			lock.lock();
+			mState = State_Done;
+			mCond.notify_all();
+		}
+	}
+
+	// The same mark, scan, and collect as the synchronous collector, but on the snapshot. Scanning doesn't have to
+	// start from the roots: after marking, everything in the snapshot is grey, and what ends up black is exactly what
+	// can be reached from an object that still has a nonzero count, in whatever order that's found.
+	void CycleDetector::detect()
+	{
+		for(uword i = 0; i < numRoots; i++)
+			markGray(i);
+
+		for(uword i = 0; i < numObjects; i++)
+		{
+			if(marks[i] == CycleMark_Grey && counts[i] > 0)
+				scanBlack(i);
+		}
+
+		for(uword i = 0; i < numObjects; i++)
+		{
+			if(marks[i] == CycleMark_Grey && finalizable[i])
+			{
+				scanBlack(i);
+				marks[i] = CycleMark_Finalize;
+			}
+		}
+
+		for(uword i = 0; i < numObjects; i++)
+		{
+			if(marks[i] == CycleMark_Grey)
+				marks[i] = CycleMark_White;
+		}
+	}
+
+	void CycleDetector::markGray(uword root)
+	{
+		if(marks[root] == CycleMark_Grey)
+			return;
+
+		uword sp = 0;
+		marks[root] = CycleMark_Grey;
+		stack[sp++] = root;
+
+		while(sp > 0)
+		{
+			auto idx = stack[--sp];
+
+			for(auto e = edgeStart[idx]; e < edgeStart[idx + 1]; e++)
+			{
+				auto to = edges[e];
+				counts[to]--;
+
+				if(marks[to] != CycleMark_Grey)
+				{
+					marks[to] = CycleMark_Grey;
+					stack[sp++] = to;
+				}
+			}
+		}
+	}
+
+	void CycleDetector::scanBlack(uword root)
+	{
+		uword sp = 0;
+		marks[root] = CycleMark_Black;
+		stack[sp++] = root;
+
+		while(sp > 0)
+		{
+			auto idx = stack[--sp];
+
+			for(auto e = edgeStart[idx]; e < edgeStart[idx + 1]; e++)
+			{
+				auto to = edges[e];
+				counts[to]++;
+
+				if(marks[to] == CycleMark_Grey)
+				{
+					marks[to] = CycleMark_Black;
+					stack[sp++] = to;
+				}
+			}
+		}
+	}
+}
+
+#endif
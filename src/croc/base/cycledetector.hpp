@@ -0,0 +1,110 @@
+#ifndef CROC_BASE_CYCLEDETECTOR_HPP
+#define CROC_BASE_CYCLEDETECTOR_HPP
+
+#ifndef CROC_NO_CONCURRENT_CYCLES
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "croc/base/darray.hpp"
+#include "croc/base/gcobject.hpp"
+#include "croc/base/hash.hpp"
+#include "croc/base/memory.hpp"
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+	// What the detector thread decided about each object in a snapshot.
+	enum CycleMark
+	{
+		CycleMark_Black,
+		CycleMark_Grey,
+		CycleMark_White,    // looks like cyclic garbage
+		CycleMark_Finalize  // looks like cyclic garbage, but has to be finalized first
+	};
+
+	// Runs the trial deletion part of cycle collection on a background thread. The heap can't be looked at from another
+	// thread while the mutator runs, so the GC takes a snapshot of the part of the heap reachable from the possible cycle
+	// roots (just the reference counts and the references between the objects) and the thread works on that. Everything
+	// in a snapshot is kept alive by being cycle-logged until the results are collected. See gc.cpp for the rest.
+	//
+	// While the snapshot is being taken, the objects' reference count fields hold their indices in it instead. The thread
+	// puts the real counts back before it starts on the snapshot, which saves the mutator another pass over the objects.
+	struct CycleDetector
+	{
+		// Written by the GC before the thread starts, and not touched by it until the thread is done.
+		DArray<GCObject*> objects;    // the first numRoots are the possible cycle roots
+		DArray<uint32_t> counts;      // reference counts; the thread does trial deletion on these
+		DArray<uint8_t> finalizable;  // whether each object still needs to be finalized
+		DArray<uword> edgeStart;      // the references out of object i are edges[edgeStart[i] .. edgeStart[i + 1]]
+		DArray<uword> edges;
+		DArray<uword> stack;
+		uword numObjects;
+		uword numRoots;
+		uword numEdges;
+		Hash<GCObject*, uword> ids;   // candidate to index into objects; only used by finishConcurrentCycles
+
+		// Written by the thread.
+		DArray<uint8_t> marks;        // CycleMark for each object
+
+		// Set when the detector found garbage that has to be finalized, which only the synchronous collector can do.
+		bool needSyncPass;
+
+	private:
+		enum State
+		{
+			State_Idle,
+			State_Working,
+			State_Done
+		};
+
+		std::thread mThread;
+		std::mutex mLock;
+		std::condition_variable mCond;
+		State mState;
+		bool mStopping;
+		bool mCountsRestored;
+		uword mCurrent;
+
+	public:
+		static CycleDetector* create(Memory& mem);
+		static void free(Memory& mem, CycleDetector* d);
+
+		uword addObject(Memory& mem, GCObject* obj);
+		void startEdges(Memory& mem, uword from);
+		void start(Memory& mem);
+		void waitForCounts();
+		bool isIdle();
+		bool isDone(bool wait);
+		void reset(Memory& mem);
+
+		// Whether obj has been added to the snapshot, and if so, its index. Only works from the first addObject until
+		// start is called; see addObject.
+		inline bool find(GCObject* obj, uword& idx)
+		{
+			idx = obj->refCount;
+			return GCOBJ_CYCLELOGGED(obj) && idx < numObjects && objects[idx] == obj;
+		}
+
+		// Adds a reference from the object most recently started with startEdges to the object at index to.
+		inline void addEdge(Memory& mem, uword to)
+		{
+			if(numEdges == edges.length)
+				growEdges(mem);
+
+			edges[numEdges++] = to;
+			edgeStart[mCurrent + 1] = numEdges;
+		}
+
+	private:
+		void growEdges(Memory& mem);
+		void run();
+		void detect();
+		void markGray(uword root);
+		void scanBlack(uword root);
+	};
+}
+
+#endif
+#endif
@@ -1,69 +1,87 @@
 #ifndef CROC_BASE_DEQUE_HPP
 #define CROC_BASE_DEQUE_HPP
 
-#include <functional>
-
 #include "croc/base/gcobject.hpp"
 // #include "croc/base/memory.hpp"
 #include "croc/base/sanity.hpp"
 
+// Deques are made of chunks this big (header included), which hold this many items.
+#define CROC_DEQUE_CHUNK_SIZE 4096
+#define CROC_DEQUE_CHUNK_ITEMS ((CROC_DEQUE_CHUNK_SIZE - sizeof(void*) - 2 * sizeof(uint32_t)) / sizeof(GCObject*))
+
 namespace croc
 {
 	struct Memory;
 
+	// A piece of a deque. Its items are items[start .. end].
+	struct DequeChunk
+	{
+		DequeChunk* next;
+		uint32_t start;
+		uint32_t end;
+		GCObject* items[CROC_DEQUE_CHUNK_ITEMS];
+	};
+
+	static_assert(sizeof(DequeChunk) <= CROC_DEQUE_CHUNK_SIZE, "deque chunk is too big");
+
+	// A FIFO queue of GC objects, kept as a linked list of chunks. Adding never moves what's already there, appending
+	// one deque to another just links the other's chunks onto the end, and chunks that empty out go back to a pool in
+	// the Memory (see Memory::freeDequeChunks) so that the GC's buffers can reuse them from one cycle to the next.
+	//
+	// Every chunk in the list has at least one item in it, except when the deque is empty, in which case there's at
+	// most one chunk.
 	struct Deque
 	{
 	private:
-		GCObject** mDataPtr;
-		size_t mDataLen;
-		size_t mStart;
-		size_t mEnd;
+		DequeChunk* mHead;
+		DequeChunk* mTail;
 		size_t mSize;
 
 	public:
 		void init();
-		void prealloc(Memory& mem, size_t size);
-		void add(Memory& mem, GCObject* t);
-		GCObject* remove();
-		void append(Memory& mem, GCObject** ptr, size_t len);
-		void append(Memory& mem, Deque& other);
-
-		inline bool   isEmpty()  const { return mSize == 0; }
-		inline bool   isFull()   const { return mSize == mDataLen; }
-		inline size_t length()   const { return mSize; }
-		inline size_t capacity() const { return mDataLen; }
-
-		void reset();
+		void append(Deque& other);
 		void clear(Memory& mem);
-		void minimize(Memory& mem);
 
-		void foreach(std::function<void(GCObject*)> dg);
+		inline void add(Memory& mem, GCObject* obj)
+		{
+			if(mTail == nullptr || mTail->end == CROC_DEQUE_CHUNK_ITEMS)
+				addChunk(mem);
+
+			mTail->items[mTail->end++] = obj;
+			mSize++;
+		}
 
-		struct Iterator
+		inline GCObject* remove(Memory& mem)
 		{
-			friend class Deque;
-
-		private:
-			Deque* mDeque;
-			size_t mIdx;
-			bool mDead;
-#ifndef NDEBUG
-			size_t mStartSize, mStartLength;
-#endif
-			Iterator(Deque* d);
+			assert(!isEmpty());
+
+			auto chunk = mHead;
+			auto ret = chunk->items[chunk->start++];
+			mSize--;
 
-		public:
-			inline bool hasNext() const { return !mDead; }
+			if(chunk->start == chunk->end)
+				removeHead(mem);
 
-			GCObject* next();
-			void removeCurrent();
-		};
+			return ret;
+		}
 
-		Iterator iterator();
+		inline bool   isEmpty()  const { return mSize == 0; }
+		inline size_t length()   const { return mSize; }
+
+		// Calls dg on every item, first to last. dg can't add to or remove from the deque.
+		template<typename F>
+		inline void foreach(F dg)
+		{
+			for(auto chunk = mHead; chunk != nullptr; chunk = chunk->next)
+			{
+				for(auto i = chunk->start, end = chunk->end; i < end; i++)
+					dg(chunk->items[i]);
+			}
+		}
 
 	private:
-		void enlargeArray(Memory& mem);
-		void resizeArray(Memory& mem, size_t newSize);
+		void addChunk(Memory& mem);
+		void removeHead(Memory& mem);
 	};
 }
 
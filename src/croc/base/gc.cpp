@@ -1,3 +1,6 @@
+#include <chrono>
+
+#include "croc/base/cycledetector.hpp"
 #include "croc/base/gc.hpp"
 #include "croc/base/gcobject.hpp"
 #include "croc/base/memory.hpp"
@@ -8,10 +11,24 @@ namespace croc
 {
 	namespace
 	{
+		// Called when an object dies, which can be a while before it's freed. If it's weakly held, it's remembered so
+		// that the weak tables can be cleaned out at the end of the cycle, before the mutator can see it again. If it's a
+		// weak table, it's forgotten about, since its references are being let go of.
+		void noteDeath(VM* vm, GCObject* o)
+		{
+			if(GCOBJ_WEAKLYHELD(o))
+				*vm->deadWeak.insert(vm->mem, o) = o->type;
+
+			if(o->type == CrocType_Table && (cast(Table*)o)->weakMode != CrocWeakMode_None)
+				vm->weakTables.remove(cast(Table*)o);
+		}
+
 		// Free an object.
 		void free(VM* vm, GCObject* o)
 		{
 			// debug(FREES) printf("FREE: {} at {}", CrocValue.typeStrings[(cast(CrocBaseObject*)o).mType], o).flush;
+			vm->mem.stats.freed++;
+			noteDeath(vm, o);
 
 			if(auto r = vm->weakrefTab.lookup(cast(GCObject*)o))
 			{
@@ -51,37 +68,146 @@ namespace croc
 		// =============================================================================================================
 		// Cycle collection
 
-		void markGray(GCObject* obj)
+		// Like visitObj, but for the synchronous cycle collector, which treats the values in ephemeron tables as being
+		// referenced by their keys rather than by the tables. That way a value which refers back to its own key doesn't
+		// keep the pair alive. Other weak tables are just like visitObj.
+		template<typename F>
+		void visitCycleEdges(VM* vm, GCObject* obj, F callback)
+		{
+			if(obj->type == CrocType_Table && (cast(Table*)obj)->weakMode == CrocWeakMode_Ephemeron)
+			{
+				auto tab = cast(Table*)obj;
+
+				for(auto n: tab->data)
+				{
+					if(tab->weakKey(n->key))
+						continue;
+
+					if(n->key.isGCObject())
+						callback(n->key.toGCObject());
+
+					if(n->value.isGCObject())
+						callback(n->value.toGCObject());
+				}
+			}
+			else
+				visitObj(obj, false, callback);
+
+			if(GCOBJ_EPHEMERONKEY(obj))
+			{
+				auto key = Value::from(obj);
+
+				for(auto n: vm->weakTables)
+				{
+					if(n->key->weakMode != CrocWeakMode_Ephemeron)
+						continue;
+
+					if(auto v = n->key->get(key))
+					{
+						if(v->isGCObject())
+							callback(v->toGCObject());
+					}
+				}
+			}
+		}
+
+		// When an ephemeron table or key is collected as part of a cycle, the references that visitCycleEdges made up
+		// for it have to be collected too. These are taken out of the tables first (without touching any reference
+		// counts, since collecting the values accounts for the references to them) so that they're only collected once.
+		// A table's values whose keys are still alive, or already dead, are really referenced by the table, and are
+		// just decremented.
+		void collectEphemerons(VM* vm, GCObject* obj, DArray<GCObject*>& values, DArray<GCObject*>& decrements)
+		{
+			uword numValues = 0, numDecrements = 0;
+
+			auto add = [&](DArray<GCObject*>& arr, uword& len, GCObject* v)
+			{
+				if(len == arr.length)
+					arr.resize(vm->mem, len < 8 ? 8 : len * 2);
+
+				arr[len++] = v;
+			};
+
+			if(obj->type == CrocType_Table && (cast(Table*)obj)->weakMode == CrocWeakMode_Ephemeron)
+			{
+				// noteDeath has already taken it out of weakTables, so nothing else will touch these.
+				auto tab = cast(Table*)obj;
+
+				for(auto n: tab->data)
+				{
+					if(!tab->weakKey(n->key) || !n->value.isGCObject())
+						continue;
+
+					auto k = n->key.toGCObject();
+
+					if(vm->deadWeak.lookup(k) == nullptr && GCOBJ_COLOR(k) == GCFlags_White)
+						add(values, numValues, n->value.toGCObject());
+					else
+						add(decrements, numDecrements, n->value.toGCObject());
+				}
+			}
+
+			if(GCOBJ_EPHEMERONKEY(obj))
+			{
+				auto key = Value::from(obj);
+
+				for(auto n: vm->weakTables)
+				{
+					auto tab = n->key;
+
+					if(tab->weakMode != CrocWeakMode_Ephemeron)
+						continue;
+
+					if(auto v = tab->get(key))
+					{
+						if(v->isGCObject())
+							add(values, numValues, v->toGCObject());
+
+						tab->data.remove(key);
+					}
+				}
+			}
+
+			values.resize(vm->mem, numValues);
+			decrements.resize(vm->mem, numDecrements);
+		}
+
+		void markGray(VM* vm, GCObject* obj)
 		{
 			assert(GCOBJ_INRC(obj));
 			assert(GCOBJ_COLOR(obj) != GCFlags_Green);
 			assert(obj->type != CrocType_String);
 
-			if(GCOBJ_COLOR(obj) != GCFlags_Grey)
+			// Anything in the root buffer holds a reference from it that trial deletion never takes away, so it'll be
+			// scanned black, and so will everything reachable from it. Not going any further saves walking most of the
+			// heap from every batch of roots.
+			if(GCOBJ_COLOR(obj) != GCFlags_Grey && !GCOBJ_ISROOT(obj))
 			{
 				GCOBJ_SETCOLOR(obj, GCFlags_Grey);
+				vm->cycleVisited++;
 
-				visitObj(obj, false, [](GCObject* slot)
+				visitCycleEdges(vm, obj, [&](GCObject* slot)
 				{
 					if(GCOBJ_COLOR(slot) != GCFlags_Green)
 					{
 						slot->refCount--;
 						assert(slot->refCount != cast(uint32_t)-1);
-						markGray(slot);
+						markGray(vm, slot);
 					}
 				});
 			}
 		}
 
-		void cycleScanBlack(GCObject* obj)
+		void cycleScanBlack(VM* vm, GCObject* obj)
 		{
 			assert(GCOBJ_INRC(obj));
 			assert(GCOBJ_COLOR(obj) != GCFlags_Green);
 			assert(obj->type != CrocType_String);
 
 			GCOBJ_SETCOLOR(obj, GCFlags_Black);
+			vm->cycleVisited++;
 
-			visitObj(obj, false, [](GCObject* slot)
+			visitCycleEdges(vm, obj, [&](GCObject* slot)
 			{
 				auto color = GCOBJ_COLOR(slot);
 
@@ -89,8 +215,10 @@ namespace croc
 				{
 					slot->refCount++;
 
-					if(color != GCFlags_Black)
-						cycleScanBlack(slot);
+					// Only grey and white objects had their children's counts taken away by markGray. Root objects it
+					// stopped at can be purple, and have to be left alone.
+					if(color == GCFlags_Grey || color == GCFlags_White)
+						cycleScanBlack(vm, slot);
 				}
 			});
 		}
@@ -102,19 +230,20 @@ namespace croc
 			if(GCOBJ_COLOR(obj) == GCFlags_Grey)
 			{
 				if(obj->refCount > 0)
-					cycleScanBlack(obj);
+					cycleScanBlack(vm, obj);
 				else if(GCOBJ_FINALIZABLE(obj) && !GCOBJ_FINALIZED(obj))
 				{
 					obj->refCount = 1;
 					// debug(FINALIZE) printf("Putting {} on toFinalize", obj);
 					vm->toFinalize.add(vm->mem, obj);
-					cycleScanBlack(obj);
+					vm->mem.stats.finalized++;
+					cycleScanBlack(vm, obj);
 				}
 				else
 				{
 					GCOBJ_SETCOLOR(obj, GCFlags_White);
 
-					visitObj(obj, false, [&](GCObject* slot)
+					visitCycleEdges(vm, obj, [&](GCObject* slot)
 					{
 						cycleScan(vm, slot);
 					});
@@ -136,7 +265,7 @@ namespace croc
 				if(--obj->refCount == 0)
 					free(vm, obj);
 			}
-			else if(color == GCFlags_White && !GCOBJ_CYCLELOGGED(obj))
+			else if(color == GCFlags_White)
 			{
 				// Is this even possible since we mark it black in the previous phase?
 				// if((obj.gcflags & GCFlags_Finalizable) && (obj.gcflags & GCFlags_Finalized) == 0)
@@ -144,57 +273,468 @@ namespace croc
 				// 		 ~ (cast(CrocInstance*)obj).parent.name.toString() ~ ") in cycle!");
 
 				GCOBJ_SETCOLOR(obj, GCFlags_Black);
+				vm->cycleVisited++;
+				noteDeath(vm, obj);
+
+				if(GCOBJ_EPHEMERONKEY(obj) || (obj->type == CrocType_Table &&
+					(cast(Table*)obj)->weakMode == CrocWeakMode_Ephemeron))
+				{
+					auto values = DArray<GCObject*>::n(nullptr, 0);
+					auto decrements = DArray<GCObject*>::n(nullptr, 0);
+					collectEphemerons(vm, obj, values, decrements);
+
+					for(auto v: decrements)
+						vm->mem.decBuffer.add(vm->mem, v);
+
+					for(auto v: values)
+						collectCycleWhite(vm, v);
+
+					values.free(vm->mem);
+					decrements.free(vm->mem);
+				}
 
-				visitObj(obj, false, [&](GCObject* slot)
+				visitCycleEdges(vm, obj, [&](GCObject* slot)
 				{
 					collectCycleWhite(vm, slot);
 				});
 
-				vm->toFree.add(vm->mem, obj);
+				// If it's logged, it's a root that isn't in this batch. It's black with a refcount of 0 now, so it'll be
+				// freed when its batch is taken, rather than leaving a dangling pointer in the root buffer.
+				if(!GCOBJ_CYCLELOGGED(obj))
+					vm->toFree.add(vm->mem, obj);
+			}
+		}
+
+		// How many possible cycle roots are processed at a time. The budget is only checked between batches.
+		const size_t CycleBatchSize = 64;
+
+		// Runs the cycle collector over the root buffer, a batch of roots at a time. Each batch is a complete run of
+		// mark, scan, and collect over the part of the heap reachable from its roots, and the mutator can't run in the
+		// middle of a batch, so it's safe to stop between batches. The rest of the roots stay logged in the root buffer
+		// for the next cycle collection, just as if it hadn't been run. If budgeted is true, stops once the pause budget
+		// has been used up. Returns whether the root buffer was emptied.
+		bool collectCycles(VM* vm, bool budgeted)
+		{
+			auto &cycleRoots = vm->cycleRoots;
+			auto &batch = vm->cycleBatch;
+			auto timeBudget = vm->mem.cyclePauseTime;
+			auto objBudget = vm->mem.cyclePauseObjects;
+			auto start = std::chrono::steady_clock::now();
+			vm->cycleVisited = 0;
+
+			while(!cycleRoots.isEmpty())
+			{
+				// Take the next batch of roots. Ones that aren't purple anymore are dropped (or freed, if they died while
+				// logged) here, but still count towards the batch size, since that can take a while too.
+				for(size_t i = 0; i < CycleBatchSize && !cycleRoots.isEmpty(); i++)
+				{
+					auto obj = cycleRoots.remove(vm->mem);
+					assert(GCOBJ_INRC(obj));
+					vm->cycleVisited++;
+
+					if(GCOBJ_COLOR(obj) == GCFlags_Purple && GCOBJ_ISROOT(obj))
+					{
+						// Can't be garbage; see markGray. It has to be made black, or it'd never be logged again.
+						GCOBJ_SETCOLOR(obj, GCFlags_Black);
+						GCOBJ_CYCLEUNLOG(obj);
+					}
+					else if(GCOBJ_COLOR(obj) == GCFlags_Purple)
+						batch.add(vm->mem, obj);
+					else
+					{
+						GCOBJ_CYCLEUNLOG(obj);
+
+						if(GCOBJ_COLOR(obj) == GCFlags_Black && obj->refCount == 0)
+							free(vm, obj);
+					}
+				}
+
+				// Mark
+				batch.foreach([&](GCObject* obj)
+				{
+					markGray(vm, obj);
+				});
+
+				// Scan
+				batch.foreach([&](GCObject* obj)
+				{
+					cycleScan(vm, obj);
+				});
+
+				// Collect. The whole batch is unlogged first, so that any roots in it which are reached from other roots
+				// are freed along with them.
+				batch.foreach([&](GCObject* obj)
+				{
+					GCOBJ_CYCLEUNLOG(obj);
+				});
+
+				while(!batch.isEmpty())
+					collectCycleWhite(vm, batch.remove(vm->mem));
+
+				// Free
+				while(!vm->toFree.isEmpty())
+				{
+					auto obj = vm->toFree.remove(vm->mem);
+					free(vm, obj);
+				}
+
+				if(budgeted)
+				{
+					if(objBudget != 0 && vm->cycleVisited >= objBudget)
+						break;
+
+					if(timeBudget != 0 && cast(size_t)std::chrono::duration_cast<std::chrono::microseconds>(
+						std::chrono::steady_clock::now() - start).count() >= timeBudget)
+						break;
+				}
 			}
+
+			return cycleRoots.isEmpty();
 		}
 
-		void collectCycles(VM* vm)
+#ifndef CROC_NO_CONCURRENT_CYCLES
+		// Takes everything in the root buffer and gives the cycle detector thread a snapshot of the part of the heap
+		// reachable from it. Root buffer entries are handled as in collectCycles. Everything in the snapshot is
+		// cycle-logged, which keeps it from being freed until finishConcurrentCycles is done with it.
+		void startConcurrentCycles(VM* vm)
 		{
 			auto &cycleRoots = vm->cycleRoots;
+			auto &d = *vm->cycleDetector;
 
-			// Mark
-			for(auto it = cycleRoots.iterator(); it.hasNext(); )
+			while(!cycleRoots.isEmpty())
 			{
-				auto obj = it.next();
+				auto obj = cycleRoots.remove(vm->mem);
 				assert(GCOBJ_INRC(obj));
 
-				if(GCOBJ_COLOR(obj) == GCFlags_Purple)
-					markGray(obj);
+				if(GCOBJ_COLOR(obj) == GCFlags_Purple && GCOBJ_ISROOT(obj))
+				{
+					GCOBJ_SETCOLOR(obj, GCFlags_Black);
+					GCOBJ_CYCLEUNLOG(obj);
+				}
+				else if(GCOBJ_COLOR(obj) == GCFlags_Purple)
+				{
+					// Made black so that if it's decremented again while the thread works, it turns purple, and
+					// finishConcurrentCycles knows to look at it again.
+					GCOBJ_SETCOLOR(obj, GCFlags_Black);
+					d.addObject(vm->mem, obj);
+				}
 				else
 				{
 					GCOBJ_CYCLEUNLOG(obj);
-					it.removeCurrent();
 
 					if(GCOBJ_COLOR(obj) == GCFlags_Black && obj->refCount == 0)
 						free(vm, obj);
 				}
 			}
 
-			// Scan
-			cycleRoots.foreach([&](GCObject* obj)
+			if(d.numObjects == 0)
+				return;
+
+			d.numRoots = d.numObjects;
+
+			// numObjects grows as new objects are found, so this is a breadth-first walk.
+			for(uword i = 0; i < d.numObjects; i++)
 			{
-				cycleScan(vm, obj);
-			});
+				d.startEdges(vm->mem, i);
 
-			// Collect
-			while(!cycleRoots.isEmpty())
+				visitObj(d.objects[i], false, [&](GCObject* slot)
+				{
+					// Same as where markGray stops.
+					if(GCOBJ_COLOR(slot) == GCFlags_Green || GCOBJ_ISROOT(slot))
+						return;
+
+					uword idx;
+
+					if(!d.find(slot, idx))
+					{
+						assert(!GCOBJ_CYCLELOGGED(slot));
+						GCOBJ_CYCLELOG(slot);
+						idx = d.addObject(vm->mem, slot);
+					}
+
+					d.addEdge(vm->mem, idx);
+				});
+			}
+
+			vm->cycleVisited += d.numObjects;
+			d.start(vm->mem);
+		}
+
+		// If the cycle detector thread is done with its snapshot (or wait is true, in which case this waits for it),
+		// frees the garbage it found.
+		//
+		// The snapshot can be out of date by now, so the thread's results are only candidates. A set of objects is
+		// garbage if every reference to every object in it comes from inside the set. This has to run after the new
+		// roots have been incremented, but before the decrement buffer is processed: every reference that exists has
+		// been counted by then, so a count can only be too high, never too low, and checking "the count equals the
+		// number of references from inside the set" can only reject garbage, never accept something that's alive. It
+		// also means the references from freed objects can simply be put on the decrement buffer.
+		void finishConcurrentCycles(VM* vm, bool wait)
+		{
+			auto &d = *vm->cycleDetector;
+
+			if(!d.isDone(wait))
+				return;
+
+			auto &decBuffer = vm->mem.decBuffer;
+			auto n = d.numObjects;
+			// The thread is done with these, so they're reused for counting internal references and for listing the
+			// candidates. Only the candidates are looked at until the last loop, which is the only one that has to touch
+			// every object in the snapshot.
+			auto counts = d.counts;
+			auto cands = d.edgeStart;
+			uword numCands = 0;
+			uword sp = 0;
+
+			// Colour the candidates white. Ones whose counts hit 0 since the snapshot have already had their references
+			// decremented, so they're left to be freed below.
+			for(uword i = 0; i < n; i++)
 			{
-				auto obj = cycleRoots.remove();
-				GCOBJ_CYCLEUNLOG(obj);
-				collectCycleWhite(vm, obj);
+				if(d.marks[i] == CycleMark_White && d.objects[i]->refCount > 0)
+				{
+					GCOBJ_SETCOLOR(d.objects[i], GCFlags_White);
+					*d.ids.insert(vm->mem, d.objects[i]) = i;
+					counts[i] = 0;
+					cands[numCands++] = i;
+				}
 			}
 
-			// Free
-			while(!vm->toFree.isEmpty())
+			for(uword c = 0; c < numCands; c++)
 			{
-				auto obj = vm->toFree.remove();
-				free(vm, obj);
+				visitObj(d.objects[cands[c]], false, [&](GCObject* slot)
+				{
+					if(GCOBJ_COLOR(slot) == GCFlags_White)
+						counts[*d.ids.lookup(slot)]++;
+				});
+			}
+
+			// Anything referenced from outside the set is alive, and so is everything it references.
+			for(uword c = 0; c < numCands; c++)
+			{
+				auto i = cands[c];
+				auto obj = d.objects[i];
+
+				if(GCOBJ_COLOR(obj) == GCFlags_White && counts[i] != obj->refCount)
+				{
+					GCOBJ_SETCOLOR(obj, GCFlags_Black);
+					d.stack[sp++] = i;
+				}
+			}
+
+			while(sp > 0)
+			{
+				visitObj(d.objects[d.stack[--sp]], false, [&](GCObject* slot)
+				{
+					if(GCOBJ_COLOR(slot) == GCFlags_White)
+					{
+						GCOBJ_SETCOLOR(slot, GCFlags_Black);
+						d.stack[sp++] = *d.ids.lookup(slot);
+					}
+				});
+			}
+
+			// What's still white is garbage. Drop its references to everything else, then free it and let go of the
+			// rest of the snapshot.
+			for(uword c = 0; c < numCands; c++)
+			{
+				if(GCOBJ_COLOR(d.objects[cands[c]]) == GCFlags_White)
+				{
+					visitObj(d.objects[cands[c]], false, [&](GCObject* slot)
+					{
+						if(GCOBJ_COLOR(slot) != GCFlags_White)
+							decBuffer.add(vm->mem, slot);
+					});
+				}
+			}
+
+			for(uword i = 0; i < n; i++)
+			{
+				auto obj = d.objects[i];
+
+				if(GCOBJ_COLOR(obj) == GCFlags_White)
+					free(vm, obj);
+				else if(obj->refCount == 0)
+				{
+					assert(GCOBJ_COLOR(obj) == GCFlags_Black);
+					free(vm, obj);
+				}
+				else if(d.marks[i] != CycleMark_Black || GCOBJ_COLOR(obj) == GCFlags_Purple)
+				{
+					// Still a possible cycle root: it was one before, or it's a candidate that turned out to be alive
+					// and is worth another look, or it needs finalizing, which the synchronous collector will do.
+					if(d.marks[i] == CycleMark_Finalize)
+						d.needSyncPass = true;
+
+					GCOBJ_SETCOLOR(obj, GCFlags_Purple);
+					vm->cycleRoots.add(vm->mem, obj);
+				}
+				else
+					GCOBJ_CYCLEUNLOG(obj);
+			}
+
+			d.reset(vm->mem);
+		}
+#endif
+
+		// Adds a GC cycle to the stats, and to the event log if it's on.
+		void recordStats(VM* vm, const CrocGCStats& before, uint64_t start, uint64_t end, uint64_t* phaseTime,
+			size_t nurseryBytes, uint64_t cycleCollected, bool full)
+		{
+			auto &mem = vm->mem;
+			auto &stats = mem.stats;
+			auto time = end - start;
+
+			stats.cycles++;
+			stats.totalTime += time;
+			stats.lastTime = time;
+			stats.cycleCollected += cycleCollected;
+
+			if(time > stats.maxTime)
+				stats.maxTime = time;
+
+			for(uword i = 0; i < CrocGCPhase_NUMPHASES; i++)
+			{
+				stats.phaseTime[i] += phaseTime[i];
+				stats.lastPhaseTime[i] = phaseTime[i];
+			}
+
+			if(mem.gcEventLogSize == 0)
+				return;
+
+			auto &e = mem.gcEvents[mem.gcEventNext];
+			e.cycle = stats.cycles;
+			e.startTime = start;
+			e.time = time;
+
+			for(uword i = 0; i < CrocGCPhase_NUMPHASES; i++)
+				e.phaseTime[i] = phaseTime[i];
+
+			e.promoted = stats.promoted - before.promoted;
+			e.freed = stats.freed - before.freed;
+			e.finalized = stats.finalized - before.finalized;
+			e.cycleCollected = cycleCollected;
+			e.nurseryBytes = nurseryBytes;
+			e.rcBytes = mem.totalBytes - mem.nurseryBytes;
+			e.full = full;
+
+			mem.gcEventNext = (mem.gcEventNext + 1) % mem.gcEventLogSize;
+
+			if(mem.gcEventCount < mem.gcEventLogSize)
+				mem.gcEventCount++;
+		}
+
+		// Adaptive limit tuning.
+		const double TuningSmoothing = 0.25;   // how much each GC cycle's measurements count towards the averages
+		const size_t MinNurseryLimit = 64 * 1024;
+		const size_t MaxNurseryLimit = 32 * 1024 * 1024;
+		const size_t MinCycleMetadataLimit = 32 * 1024;
+		const size_t MaxCycleMetadataLimit = 8 * 1024 * 1024;
+		const size_t MinCycleCollectInterval = 5;
+		const size_t MaxCycleCollectInterval = 800;
+
+		uint64_t nanoTime()
+		{
+			return cast(uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		template<typename T>
+		T clamp(T val, T lo, T hi)
+		{
+			return val < lo ? lo : val > hi ? hi : val;
+		}
+
+		// Updates the measurements that the tuning goes by, and if there's a goal, resizes the nursery and changes how
+		// often cycles are collected to get closer to it. The nursery is the main knob: a bigger one means fewer GC
+		// cycles, but each one has more to do. The metadata limit is kept in proportion to it. How often cycles are
+		// collected goes by how much each cycle collection actually frees.
+		void adaptLimits(VM* vm, uint64_t start, uint64_t end, size_t nurseryBytes, bool cycleCollect,
+			size_t cycleFreed, size_t heapSize)
+		{
+			auto &mem = vm->mem;
+			auto pause = cast(double)(end - start) / 1000;
+			auto mutatorTime = mem.lastCycleEnd == 0 ? 0.0 : cast(double)(start - mem.lastCycleEnd) / 1000;
+			auto gcFraction = pause + mutatorTime > 0 ? pause / (pause + mutatorTime) : 0.0;
+			auto survival = nurseryBytes > 0 ? cast(double)mem.promotedBytes / nurseryBytes : 0.0;
+
+			if(survival > 1)
+				survival = 1; // things allocated outside the nursery can be promoted too
+
+			if(mem.lastCycleEnd == 0)
+			{
+				mem.avgPause = pause;
+				mem.avgGCFraction = gcFraction;
+				mem.avgSurvival = survival;
+			}
+			else
+			{
+				mem.avgPause += (pause - mem.avgPause) * TuningSmoothing;
+				mem.avgGCFraction += (gcFraction - mem.avgGCFraction) * TuningSmoothing;
+				mem.avgSurvival += (survival - mem.avgSurvival) * TuningSmoothing;
+			}
+
+			mem.lastCycleEnd = end;
+			mem.promotedBytes = 0;
+
+			if(mem.gcGoal == CrocGCGoal_None)
+				return;
+
+			auto nursery = cast(double)mem.nurseryLimit;
+			auto target = cast(double)mem.gcGoalTarget;
+
+			switch(mem.gcGoal)
+			{
+				case CrocGCGoal_Pause:
+					// Pauses mostly scale with how much survives the nursery, so shrink it in proportion to how far over
+					// the goal they are, and grow it slowly while there's plenty of room. The cycle collector gets half of
+					// the goal as its budget.
+					if(mem.avgPause > target)
+						nursery *= target / mem.avgPause < 0.5 ? 0.5 : target / mem.avgPause;
+					else if(mem.avgPause < target / 2)
+						nursery *= 1.25;
+
+					mem.cyclePauseTime = mem.gcGoalTarget / 2 > 0 ? mem.gcGoalTarget / 2 : 1;
+					break;
+
+				case CrocGCGoal_Throughput:
+					// The target is a percentage of time spent in the GC. Fewer, bigger GC cycles spend less time in
+					// total, and also give more objects the chance to die before they're promoted. If the GC is cheap
+					// and hardly anything survives, give some memory back.
+					target /= 100;
+
+					if(mem.avgGCFraction > target)
+						nursery *= 1.5;
+					else if(mem.avgGCFraction < target / 4 && mem.avgSurvival < 0.1)
+						nursery *= 0.9;
+					break;
+
+				default: assert(false);
+			}
+
+			mem.nurseryLimit = clamp(cast(size_t)nursery, MinNurseryLimit, MaxNurseryLimit);
+			mem.metadataLimit = mem.nurseryLimit / 4;
+
+			if(cycleCollect && heapSize > 0)
+			{
+				auto yield = cast(double)cycleFreed / heapSize;
+
+				if(yield < 0.01)
+				{
+					mem.nextCycleCollect = clamp(mem.nextCycleCollect * 2, MinCycleCollectInterval,
+						MaxCycleCollectInterval);
+					mem.cycleMetadataLimit = clamp(mem.cycleMetadataLimit * 2, MinCycleMetadataLimit,
+						MaxCycleMetadataLimit);
+				}
+				else if(yield > 0.1)
+				{
+					mem.nextCycleCollect = clamp(mem.nextCycleCollect / 2, MinCycleCollectInterval,
+						MaxCycleCollectInterval);
+					mem.cycleMetadataLimit = clamp(mem.cycleMetadataLimit / 2, MinCycleMetadataLimit,
+						MaxCycleMetadataLimit);
+				}
+
+				if(mem.cycleCollectCountdown > mem.nextCycleCollect)
+					mem.cycleCollectCountdown = mem.nextCycleCollect;
 			}
 		}
 	} // end anonymous namespace
@@ -215,6 +755,29 @@ namespace croc
 
 		vm->inGCCycle = true;
 
+		auto startTime = nanoTime();
+
+#ifndef CROC_NO_CONCURRENT_CYCLES
+		if(vm->cycleDetector != nullptr)
+			vm->cycleDetector->waitForCounts();
+#endif
+
+		auto startNursery = vm->mem.nurseryBytes;
+		size_t cycleFreed = 0;
+		size_t heapSize = vm->mem.totalBytes;
+		auto startStats = vm->mem.stats;
+		uint64_t cycleCollected = 0;
+		uint64_t phaseTime[CrocGCPhase_NUMPHASES] = {};
+		auto lapTime = startTime;
+
+		// Adds the time since the last lap to a phase.
+		auto lap = [&](CrocGCPhase phase)
+		{
+			auto now = nanoTime();
+			phaseTime[phase] += now - lapTime;
+			lapTime = now;
+		};
+
 		auto &modBuffer = vm->mem.modBuffer;
 		auto &decBuffer = vm->mem.decBuffer;
 		auto &cycleRoots = vm->cycleRoots;
@@ -231,6 +794,11 @@ namespace croc
 		// it out. Regardless of whether it's a nursery object or not, put it in the new root buffer. debug(PHASES)
 		// printf("ROOTS").flush;
 
+		oldRoots.foreach([](GCObject* obj)
+		{
+			GCOBJ_CLEARROOT(obj);
+		});
+
 		if(cycleType != GCCycleType_NoRoots)
 		{
 			visitRoots(vm, [&](GCObject* obj)
@@ -238,17 +806,20 @@ namespace croc
 				if(!GCOBJ_INRC(obj))
 					vm->mem.makeRC(obj);
 
+				GCOBJ_SETROOT(obj);
 				newRoots.add(vm->mem, obj);
 			});
 		}
 
+		lap(CrocGCPhase_Roots);
+
 		// PROCESS MODIFIED BUFFER. Go through the modified buffer, unlogging each. For each object pointed to by an
 		// object, if it's in the nursery, move it out. Increment all the reference counts (spurious increments to RC
 		// space objects will be undone by the queued decrements created during the mutation phase by the write
 		// barrier). debug(PHASES) printf("MODBUFFER").flush;
 		while(!modBuffer.isEmpty())
 		{
-			auto obj = modBuffer.remove();
+			auto obj = modBuffer.remove(vm->mem);
 			assert(GCOBJ_COLOR(obj) != GCFlags_Green);
 
 			// debug(INCDEC)
@@ -256,6 +827,19 @@ namespace croc
 
 			GCOBJ_UNLOG(obj);
 
+			// Ephemeron keys can only be collected by the cycle collector if they're logged as possible cycle roots,
+			// but when a key is only referenced by its own value, it may never have been decremented.
+			if(obj->type == CrocType_Table && (cast(Table*)obj)->weakMode == CrocWeakMode_Ephemeron)
+			{
+				auto tab = cast(Table*)obj;
+
+				for(auto n: tab->data.modifiedNodes())
+				{
+					if(IS_VAL_MODIFIED(n) && tab->weakKey(n->key))
+						vm->newEphemeronKeys.add(vm->mem, n->key.toGCObject());
+				}
+			}
+
 			visitObj(obj, true, [&](GCObject* slot)
 			{
 				if(!GCOBJ_INRC(slot))
@@ -267,10 +851,28 @@ namespace croc
 			});
 		}
 
+		// Keys which are still in the nursery now have nothing but weak references, and will be freed below.
+		while(!vm->newEphemeronKeys.isEmpty())
+		{
+			auto obj = vm->newEphemeronKeys.remove(vm->mem);
+
+			if(GCOBJ_INRC(obj) && GCOBJ_COLOR(obj) != GCFlags_Green)
+			{
+				GCOBJ_SETCOLOR(obj, GCFlags_Purple);
+
+				if(!GCOBJ_CYCLELOGGED(obj))
+				{
+					GCOBJ_CYCLELOG(obj);
+					cycleRoots.add(vm->mem, obj);
+				}
+			}
+		}
+
+		lap(CrocGCPhase_ModBuffer);
+
 		// PROCESS OLD ROOT BUFFER. Move all objects from the old root buffer into the decrement buffer.
 		// debug(PHASES) printf("OLDROOTS").flush;
-		decBuffer.append(vm->mem, oldRoots);
-		oldRoots.reset();
+		decBuffer.append(oldRoots);
 
 		// PROCESS NEW ROOT BUFFER. Go through the new root buffer, incrementing their RCs, and put them all in the old
 		// root buffer.
@@ -286,6 +888,30 @@ namespace croc
 		vm->oldRootIdx = 1 - vm->oldRootIdx;
 		}
 
+		lap(CrocGCPhase_Roots);
+
+#ifndef CROC_NO_CONCURRENT_CYCLES
+		// COLLECT DETECTED CYCLES. If the cycle detector thread has finished, free the garbage it found. Anything other
+		// than a normal collection waits for it, and so does turning concurrent cycle collection off.
+		if(vm->cycleDetector != nullptr)
+		{
+			auto before = vm->mem.totalBytes;
+			auto freedBefore = vm->mem.stats.freed;
+			finishConcurrentCycles(vm, cycleType != GCCycleType_Normal || !vm->mem.concurrentCycles);
+			// Collecting allocates too (buffer chunks, the set of dead weakly-held objects), so the heap can grow.
+			cycleFreed += before > vm->mem.totalBytes ? before - vm->mem.totalBytes : 0;
+			cycleCollected += vm->mem.stats.freed - freedBefore;
+
+			if(!vm->mem.concurrentCycles)
+			{
+				CycleDetector::free(vm->mem, vm->cycleDetector);
+				vm->cycleDetector = nullptr;
+			}
+		}
+
+		lap(CrocGCPhase_Cycles);
+#endif
+
 		// PROCESS DECREMENT BUFFER. Go through the decrement buffer, decrementing their RCs. If an RC hits 0, if it's
 		// not finalizable, queue decrements for any RC objects it points to, and if it isn't logged for cycles and
 		// didn't just move out of the nursery, free it. If it is finalizable, put it on the finalize list. If an RC is
@@ -296,7 +922,7 @@ namespace croc
 
 		while(!decBuffer.isEmpty())
 		{
-			auto obj = decBuffer.remove();
+			auto obj = decBuffer.remove(vm->mem);
 			assert(GCOBJ_INRC(obj));
 			// debug(INCDEC) printf("About to decrement {}, rc will be {}", obj, obj.refCount - 1).flush;
 
@@ -310,9 +936,12 @@ namespace croc
 					obj->refCount = 1;
 					// debug(FINALIZE) printf("Putting {} on toFinalize", obj);
 					toFinalize.add(vm->mem, obj);
+					vm->mem.stats.finalized++;
 				}
 				else
 				{
+					noteDeath(vm, obj);
+
 					visitObj(obj, false, [&](GCObject* slot)
 					{
 						decBuffer.add(vm->mem, slot);
@@ -347,13 +976,15 @@ namespace croc
 			}
 		}
 
+		lap(CrocGCPhase_DecBuffer);
+
 		// NURSERY PHASE. Go through the nursery objects, clearing the "just moved" flag from living ones, and freeing
 		// those that weren't moved out (so long as they're not logged by the cycle logger). Then empty the nursery
 		// list.
 
 		// debug(PHASES) printf("NURSERY").flush;
 
-		vm->mem.nursery.foreach([&](GCObject* obj)
+		vm->mem.foreachNursery([&](GCObject* obj)
 		{
 			if(GCOBJ_INRC(obj) && obj->refCount > 0)
 				GCOBJ_CLEARJUSTMOVED(obj);
@@ -367,34 +998,78 @@ namespace croc
 		});
 
 		vm->mem.clearNurserySpace();
+		lap(CrocGCPhase_Nursery);
 
 		// CYCLE DETECT. Mark, scan, and collect as described in Bacon and Rajan.
 		bool cycleCollect =
 			(cycleRoots.length() * sizeof(GCObject*)) >= vm->mem.cycleMetadataLimit ||
 			cycleType != GCCycleType_Normal ||
-			vm->mem.cycleCollectCountdown == 0;
+			vm->mem.cycleCollectCountdown == 0 ||
+			vm->mem.cycleCollectUnfinished;
 
 		if(cycleCollect)
 		{
 			vm->mem.cycleCollectCountdown = vm->mem.nextCycleCollect;
 			// debug(BEGINEND) printf("CYCLES").flush;
-			collectCycles(vm);
+#ifndef CROC_NO_CONCURRENT_CYCLES
+			if(vm->mem.concurrentCycles && cycleType == GCCycleType_Normal &&
+				(vm->cycleDetector == nullptr || !vm->cycleDetector->needSyncPass))
+			{
+				if(vm->cycleDetector == nullptr)
+					vm->cycleDetector = CycleDetector::create(vm->mem);
+
+				// If the thread is still busy with the last snapshot, try again next time.
+				if(vm->cycleDetector->isIdle())
+				{
+					vm->cycleVisited = 0;
+					startConcurrentCycles(vm);
+					vm->mem.cycleCollectUnfinished = false;
+				}
+				else
+					vm->mem.cycleCollectUnfinished = true;
+			}
+			else
+#endif
+			{
+				auto before = vm->mem.totalBytes;
+				auto freedBefore = vm->mem.stats.freed;
+				vm->mem.cycleCollectUnfinished = !collectCycles(vm, cycleType == GCCycleType_Normal);
+				cycleFreed += before > vm->mem.totalBytes ? before - vm->mem.totalBytes : 0;
+				cycleCollected += vm->mem.stats.freed - freedBefore;
+
+#ifndef CROC_NO_CONCURRENT_CYCLES
+				if(vm->cycleDetector != nullptr && !vm->mem.cycleCollectUnfinished)
+					vm->cycleDetector->needSyncPass = false;
+#endif
+			}
 		}
 		else
 			vm->mem.cycleCollectCountdown--;
 
+		// WEAK TABLES. Take out every key-value pair which weakly held something that died during this cycle. The
+		// decrements for their other halves are left in the decrement buffer for the next cycle.
+		if(vm->deadWeak.length() > 0)
+		{
+			Table::removeDead(vm);
+			vm->deadWeak.clear(vm->mem);
+		}
+
 		assert(modBuffer.isEmpty());
-		assert(decBuffer.isEmpty());
 		assert(vm->roots[1 - vm->oldRootIdx].isEmpty());
 
 #ifndef NDEBUG
-		if(cycleCollect)
+		if(cycleCollect && !vm->mem.cycleCollectUnfinished)
 		{
 			assert(cycleRoots.isEmpty());
 			assert(vm->toFree.isEmpty());
 		}
 #endif
 
+		lap(CrocGCPhase_Cycles);
+		recordStats(vm, startStats, startTime, lapTime, phaseTime, startNursery, cycleCollected,
+			cycleType != GCCycleType_Normal);
+		adaptLimits(vm, startTime, lapTime, startNursery, cycleCollect, cycleFreed, heapSize);
+		vm->mem.trimDequeChunks();
 		vm->inGCCycle = false;
 
 		// debug(BEGINEND) printf("======================= END {} =================================", counter).flush;
@@ -38,6 +38,24 @@
 #define GCOBJ_CYCLELOG(o) SET_FLAG((o)->gcflags, GCFlags_CycleLogged)
 #define GCOBJ_CYCLEUNLOG(o) CLEAR_FLAG((o)->gcflags, GCFlags_CycleLogged)
 
+// Offset of the object from the start of the nursery page it was bump-allocated in, or of the slab chunk it was
+// allocated in if it's GCOBJ_INSLAB, in units of CROC_SLAB_GRANULARITY; 0 if it's neither.
+#define GCOBJ_PAGEOFFSET_SHIFT 13
+#define GCOBJ_PAGEOFFSET(o) ((o)->gcflags >> GCOBJ_PAGEOFFSET_SHIFT)
+#define GCOBJ_INSLAB(o) TEST_FLAG((o)->gcflags, GCFlags_InSlab)
+
+// Set on objects in the current root buffer. They're definitely alive, so the cycle collector doesn't look past them.
+#define GCOBJ_ISROOT(o) TEST_FLAG((o)->gcflags, GCFlags_Root)
+#define GCOBJ_SETROOT(o) SET_FLAG((o)->gcflags, GCFlags_Root)
+#define GCOBJ_CLEARROOT(o) CLEAR_FLAG((o)->gcflags, GCFlags_Root)
+
+// Set on objects that have ever been a weak key or value in a weak table (or a key in an ephemeron table), so the GC
+// knows it has to take them out of those tables when they die. See Table::weakMode.
+#define GCOBJ_WEAKLYHELD(o) TEST_FLAG((o)->gcflags, GCFlags_WeaklyHeld)
+#define GCOBJ_SETWEAKLYHELD(o) SET_FLAG((o)->gcflags, GCFlags_WeaklyHeld)
+#define GCOBJ_EPHEMERONKEY(o) TEST_FLAG((o)->gcflags, GCFlags_EphemeronKey)
+#define GCOBJ_SETEPHEMERONKEY(o) SET_FLAG((o)->gcflags, GCFlags_EphemeronKey)
+
 #define GCOBJ_FINALIZABLE(o) TEST_FLAG((o)->gcflags, GCFlags_Finalizable)
 #define GCOBJ_FINALIZED(o) TEST_FLAG((o)->gcflags, GCFlags_Finalized)
 #define GCOBJ_SETFINALIZED(o) SET_FLAG((o)->gcflags, GCFlags_Finalized)
@@ -61,7 +79,16 @@ namespace croc
 		GCFlags_Finalizable = (1 << 6), // 0b0_01000000
 		GCFlags_Finalized =   (1 << 7), // 0b0_10000000
 
-		GCFlags_JustMoved =   (1 << 8)  // 0b1_00000000
+		GCFlags_JustMoved =   (1 << 8), // 0b1_00000000
+
+		GCFlags_Root =        (1 << 9),
+
+		GCFlags_WeaklyHeld =  (1 << 10),
+		GCFlags_EphemeronKey = (1 << 11),
+
+		GCFlags_InSlab =      (1 << 12)
+
+		// The rest of the bits are the offset of the object into its nursery page or slab chunk; see GCOBJ_PAGEOFFSET.
 	};
 
 	struct GCObject
@@ -185,7 +185,11 @@ namespace croc
 
 		bool remove(K key)
 		{
-			auto hash = Hasher::toHash(&key);
+			return remove(key, Hasher::toHash(&key));
+		}
+
+		bool remove(K key, hash_t hash)
+		{
 			auto nodes = mNodes;
 			auto n = &mNodes[hash & mHashMask];
 
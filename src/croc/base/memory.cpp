@@ -1,8 +1,10 @@
-#include <string.h>
-
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "croc/apitypes.h"
+#include "croc/base/allocprofiler.hpp"
+#include "croc/base/darray.hpp"
 #include "croc/base/deque.hpp"
 #include "croc/base/gcobject.hpp"
 #include "croc/base/leakdetector.hpp"
@@ -15,6 +17,18 @@
 #  define STOMPYSTOMP(ptr, len) {}
 #endif
 
+#ifdef CROC_LEAK_DETECTOR
+#  define CHUNKTYPEID ,typeid(DequeChunk)
+#else
+#  define CHUNKTYPEID
+#endif
+
+#ifndef CROC_NO_SLAB_ALLOCATOR
+#  define SLAB_ROUND(size) (((size) + CROC_SLAB_GRANULARITY - 1) & ~cast(size_t)(CROC_SLAB_GRANULARITY - 1))
+#  define PAGE_HEADER_SIZE SLAB_ROUND(sizeof(NurseryPage))
+#  define CHUNK_HEADER_SIZE SLAB_ROUND(sizeof(SlabChunk))
+#endif
+
 namespace croc
 {
 	void Memory::init(CrocMemFunc func, void* context)
@@ -25,7 +39,9 @@ namespace croc
 		LEAK_DETECT(leaks.init());
 		modBuffer.init();
 		decBuffer.init();
+#ifdef CROC_NO_SLAB_ALLOCATOR
 		nursery.init();
+#endif
 
 		gcDisabled = 0;
 		totalBytes = 0;
@@ -36,6 +52,47 @@ namespace croc
 		cycleCollectCountdown = 0;
 		nextCycleCollect = 50;
 		cycleMetadataLimit = 128 * 1024;
+		cyclePauseTime = 0;
+		cyclePauseObjects = 0;
+		cycleCollectUnfinished = false;
+		concurrentCycles = false;
+		gcGoal = CrocGCGoal_None;
+		gcGoalTarget = 0;
+		lastCycleEnd = 0;
+		promotedBytes = 0;
+		avgPause = 0;
+		avgGCFraction = 0;
+		avgSurvival = 0;
+		memset(&stats, 0, sizeof(stats));
+		gcEvents = nullptr;
+		gcEventLogSize = 0;
+		gcEventNext = 0;
+		gcEventCount = 0;
+		profiler = nullptr;
+		lastLayoutID = 0;
+		dequeChunkPool = nullptr;
+		numPooledDequeChunks = 0;
+		numDequeChunks = 0;
+		hardLimit = 0;
+		softLimit = 0;
+		limitCollectAt = 0;
+		limitExempt = 0;
+		limitError = LimitError_None;
+		softLimitHit = false;
+		limitHook = nullptr;
+		limitCtx = nullptr;
+#ifndef CROC_NO_SLAB_ALLOCATOR
+		memset(slabChunks, 0, sizeof(slabChunks));
+		slabFullChunks = nullptr;
+		slabFreeChunks = nullptr;
+		numSlabFreeChunks = 0;
+		slabBytes = 0;
+		activePages = nullptr;
+		pinnedPages = nullptr;
+		freePages = nullptr;
+		numFreePages = 0;
+		pageBytes = 0;
+#endif
 	}
 
 	// ------------------------------------------------------------
@@ -46,9 +103,49 @@ namespace croc
 		nurseryLimit = newSize;
 	}
 
+	// Calls dg on every object allocated in the nursery since it was last cleared. dg is allowed to free the object.
+	void Memory::foreachNursery(std::function<void(GCObject*)> dg)
+	{
+#ifdef CROC_NO_SLAB_ALLOCATOR
+		nursery.foreach(dg);
+#else
+		for(auto page = activePages; page != nullptr; page = page->next)
+		{
+			for(auto p = cast(uint8_t*)page + PAGE_HEADER_SIZE; p < page->top; )
+			{
+				auto obj = cast(GCObject*)p;
+				p += SLAB_ROUND(obj->memSize); // before dg gets a chance to free it
+				dg(obj);
+			}
+		}
+#endif
+	}
+
 	void Memory::clearNurserySpace()
 	{
+#ifdef CROC_NO_SLAB_ALLOCATOR
 		nursery.clear(*this);
+#else
+		while(activePages != nullptr)
+		{
+			auto page = activePages;
+			activePages = page->next;
+			page->active = false;
+
+			if(page->live == 0)
+				releasePage(page);
+			else
+			{
+				page->prev = nullptr;
+				page->next = pinnedPages;
+
+				if(pinnedPages != nullptr)
+					pinnedPages->prev = page;
+
+				pinnedPages = page;
+			}
+		}
+#endif
 		nurseryBytes = 0;
 		LEAK_DETECT(leaks.clearNursery());
 	}
@@ -58,6 +155,96 @@ namespace croc
 		clearNurserySpace();
 		modBuffer.clear(*this);
 		decBuffer.clear(*this);
+		assert(numPooledDequeChunks == numDequeChunks); // every deque should have been cleared by now
+
+		while(dequeChunkPool != nullptr)
+		{
+			void* p = dequeChunkPool;
+			size_t size = CROC_DEQUE_CHUNK_SIZE;
+			dequeChunkPool = dequeChunkPool->next;
+			freeRaw(p, size CHUNKTYPEID);
+		}
+
+		numPooledDequeChunks = 0;
+		numDequeChunks = 0;
+#ifndef CROC_NO_SLAB_ALLOCATOR
+		freeSlabs();
+		freePageList(pinnedPages);
+		freePageList(freePages);
+		numFreePages = 0;
+#endif
+		resizeEventLog(0);
+	}
+
+	// Resizes the GC event log, throwing away what's in it. A size of 0 turns it off.
+	void Memory::resizeEventLog(size_t size)
+	{
+		if(gcEventLogSize > 0)
+			DArray<CrocGCEvent>::n(gcEvents, gcEventLogSize).free(*this);
+
+		gcEvents = size > 0 ? DArray<CrocGCEvent>::alloc(*this, size).ptr : nullptr;
+		gcEventLogSize = size;
+		gcEventNext = 0;
+		gcEventCount = 0;
+	}
+
+	void Memory::updateLimitCollectAt()
+	{
+		limitCollectAt = totalBytes < hardLimit ? totalBytes + (hardLimit - totalBytes) / 2 : hardLimit;
+	}
+
+	// ------------------------------------------------------------
+	// Deque chunks
+
+	DequeChunk* Memory::allocDequeChunk()
+	{
+		DequeChunk* ret;
+
+		if(dequeChunkPool != nullptr)
+		{
+			ret = dequeChunkPool;
+			dequeChunkPool = ret->next;
+			numPooledDequeChunks--;
+		}
+		else
+		{
+			// The GC's buffers are added to in places that can't deal with an error, so they don't count against the
+			// memory limit.
+			limitExempt++;
+			ret = cast(DequeChunk*)allocRaw(CROC_DEQUE_CHUNK_SIZE CHUNKTYPEID);
+			limitExempt--;
+			numDequeChunks++;
+		}
+
+		ret->next = nullptr;
+		ret->start = 0;
+		ret->end = 0;
+		return ret;
+	}
+
+	void Memory::releaseDequeChunk(DequeChunk* chunk)
+	{
+		chunk->next = dequeChunkPool;
+		dequeChunkPool = chunk;
+		numPooledDequeChunks++;
+	}
+
+	// Called at the end of each GC cycle. The buffers tend to need about as many chunks from one cycle to the next, so
+	// the pool keeps as many chunks as are in use (or metadataLimit's worth, if that's more) and frees the rest.
+	void Memory::trimDequeChunks()
+	{
+		auto inUse = numDequeChunks - numPooledDequeChunks;
+		auto keep = inUse > metadataLimit / CROC_DEQUE_CHUNK_SIZE ? inUse : metadataLimit / CROC_DEQUE_CHUNK_SIZE;
+
+		while(numPooledDequeChunks > keep)
+		{
+			void* p = dequeChunkPool;
+			size_t size = CROC_DEQUE_CHUNK_SIZE;
+			dequeChunkPool = dequeChunkPool->next;
+			freeRaw(p, size CHUNKTYPEID);
+			numPooledDequeChunks--;
+			numDequeChunks--;
+		}
 	}
 
 	// ------------------------------------------------------------
@@ -65,20 +252,43 @@ namespace croc
 
 	GCObject* Memory::allocate(size_t size, bool acyclic TYPEID_PARAM)
 	{
+		checkLimit(size);
+
 		if(size >= nurserySizeCutoff || gcDisabled > 0)
 			return allocateRC(size, acyclic TYPEID_ARG);
 		else
 		{
+#ifdef CROC_NO_SLAB_ALLOCATOR
 			GCObject* ret = allocateGCObject(size, acyclic, 0);
-			nurseryBytes += size;
 			nursery.add(*this, ret);
+#else
+			// The nursery size cutoff can be set to anything, so it might not fit in a page.
+			if(SLAB_ROUND(size) > CROC_NURSERY_PAGE_SIZE - PAGE_HEADER_SIZE)
+				return allocateRC(size, acyclic TYPEID_ARG);
+
+			GCObject* ret = allocateInPage(size, acyclic);
+
+			// Couldn't get a new page; the object can still go in RC space.
+			if(ret == nullptr)
+				return allocateRC(size, acyclic TYPEID_ARG);
+#endif
+			nurseryBytes += size;
 			LEAK_DETECT(leaks.newNursery(ret, size, ti));
+
+			if(profiler != nullptr)
+			{
+				limitExempt++;
+				profiler->allocated(*this, ret);
+				limitExempt--;
+			}
+
 			return ret;
 		}
 	}
 
 	GCObject* Memory::allocateFinalizable(size_t size TYPEID_PARAM)
 	{
+		checkLimit(size);
 		GCObject* ret = allocateRC(size, false TYPEID_ARG);
 		SET_FLAG(ret->gcflags, GCFlags_Finalizable);
 		return ret;
@@ -91,6 +301,8 @@ namespace croc
 		LEAK_DETECT(leaks.makeRC(obj));
 
 		obj->refCount = 0;
+		promotedBytes += obj->memSize;
+		stats.promoted++;
 
 		if(GCOBJ_COLOR(obj) != GCFlags_Green)
 			modBuffer.add(*this, obj);
@@ -100,6 +312,13 @@ namespace croc
 
 	void Memory::free(GCObject* o TYPEID_PARAM)
 	{
+		if(profiler != nullptr)
+		{
+			limitExempt++;
+			profiler->freed(*this, o);
+			limitExempt--;
+		}
+
 #ifdef CROC_LEAK_DETECTOR
 		if(GCOBJ_INRC(o))
 			leaks.freeRC(o, ti);
@@ -107,7 +326,23 @@ namespace croc
 			leaks.freeNursery(o, ti);
 #endif
 		size_t sz = o->memSize;
+#ifndef CROC_NO_SLAB_ALLOCATOR
+		auto pageOffset = GCOBJ_PAGEOFFSET(o);
+		auto inSlab = GCOBJ_INSLAB(o);
+#endif
 		STOMPYSTOMP((cast(uint8_t*)o), sz);
+#ifndef CROC_NO_SLAB_ALLOCATOR
+		if(inSlab)
+		{
+			slabFree(o, pageOffset, sz);
+			return;
+		}
+		else if(pageOffset != 0)
+		{
+			freeInPage(o, pageOffset, sz);
+			return;
+		}
+#endif
 		realloc(o, sz, 0);
 	}
 
@@ -119,6 +354,7 @@ namespace croc
 		if(size == 0)
 			return nullptr;
 
+		checkLimit(size);
 		void* ret = realloc(nullptr, 0, size);
 		LEAK_DETECT(leaks.newRaw(ret, size, ti));
 		return ret;
@@ -136,6 +372,8 @@ namespace croc
 		}
 		else if(newLen == len)
 			return;
+		else if(newLen > len)
+			checkLimit(newLen - len);
 
 		size_t oldLen = len;
 #ifdef CROC_STOMP_MEMORY
@@ -183,12 +421,33 @@ namespace croc
 		nurseryBytes += size; // yes, this is right; this prevents large RC objects from never triggering collections.
 
 		LEAK_DETECT(leaks.newRC(ret, size, ti));
+
+		if(profiler != nullptr)
+		{
+			limitExempt++;
+			profiler->allocated(*this, ret);
+			limitExempt--;
+		}
+
 		return ret;
 	}
 
 	GCObject* Memory::allocateGCObject(size_t size, bool acyclic, uint32_t gcflags)
 	{
+#ifndef CROC_NO_SLAB_ALLOCATOR
+		GCObject* ret;
+
+		if(size <= CROC_SLAB_MAX_SIZE)
+		{
+			uint32_t chunkOffset;
+			ret = cast(GCObject*)slabAlloc(size, chunkOffset);
+			gcflags |= GCFlags_InSlab | (chunkOffset << GCOBJ_PAGEOFFSET_SHIFT);
+		}
+		else
+			ret = cast(GCObject*)realloc(nullptr, 0, size);
+#else
 		GCObject* ret = cast(GCObject*)realloc(nullptr, 0, size);
+#endif
 		memset(ret, 0, size);
 		ret->memSize = size;
 		ret->gcflags = gcflags | (acyclic ? GCFlags_Green : 0);
@@ -200,7 +459,7 @@ namespace croc
 		void* ret = memFunc(ctx, p, oldSize, newSize);
 
 		if(ret == nullptr && newSize != 0)
-			assert(false); // TODO:
+			outOfMemory(newSize);
 
 		totalBytes += newSize - oldSize;
 
@@ -208,4 +467,251 @@ namespace croc
 
 		return ret;
 	}
-}
\ No newline at end of file
+
+	// Called when the memory function fails. limitHook throws a MemoryError if it can, under the same conditions as
+	// checkLimit; if it can't, there's no way to go on.
+	void Memory::outOfMemory(size_t size)
+	{
+		if(limitExempt == 0 && gcDisabled == 0 && limitHook != nullptr)
+			limitHook(limitCtx, size);
+
+		fprintf(stderr, "Fatal -- out of memory (could not allocate %" CROC_SIZE_T_FORMAT " bytes)\n", size);
+		abort();
+	}
+
+#ifndef CROC_NO_SLAB_ALLOCATOR
+	namespace
+	{
+		void linkChunk(SlabChunk*& list, SlabChunk* chunk)
+		{
+			chunk->prev = nullptr;
+			chunk->next = list;
+
+			if(list != nullptr)
+				list->prev = chunk;
+
+			list = chunk;
+		}
+
+		void unlinkChunk(SlabChunk*& list, SlabChunk* chunk)
+		{
+			if(chunk->prev != nullptr)
+				chunk->prev->next = chunk->next;
+			else
+				list = chunk->next;
+
+			if(chunk->next != nullptr)
+				chunk->next->prev = chunk->prev;
+		}
+
+		void freeChunkList(Memory& mem, SlabChunk* list)
+		{
+			while(list != nullptr)
+			{
+				auto next = list->next;
+				mem.memFunc(mem.ctx, list, CROC_SLAB_CHUNK_SIZE, 0);
+				list = next;
+			}
+		}
+	}
+
+	// chunkOffset is set to the slot's offset from the start of its chunk, for slabFree.
+	void* Memory::slabAlloc(size_t size, uint32_t& chunkOffset)
+	{
+		auto cls = (size - 1) / CROC_SLAB_GRANULARITY;
+		auto chunk = slabChunks[cls];
+
+		if(chunk == nullptr)
+		{
+			if(slabFreeChunks != nullptr)
+			{
+				chunk = slabFreeChunks;
+				slabFreeChunks = chunk->next;
+				numSlabFreeChunks--;
+			}
+			else
+			{
+				chunk = cast(SlabChunk*)memFunc(ctx, nullptr, 0, CROC_SLAB_CHUNK_SIZE);
+
+				if(chunk == nullptr)
+					outOfMemory(size);
+
+				slabBytes += CROC_SLAB_CHUNK_SIZE;
+			}
+
+			// Thread the chunk's slots onto its free list, last to first, so they're handed out in address order.
+			auto slotSize = (cls + 1) * CROC_SLAB_GRANULARITY;
+			auto numSlots = (CROC_SLAB_CHUNK_SIZE - CHUNK_HEADER_SIZE) / slotSize;
+			auto slot = cast(uint8_t*)chunk + CHUNK_HEADER_SIZE + (numSlots - 1) * slotSize;
+			chunk->freeList = nullptr;
+
+			for(size_t i = 0; i < numSlots; i++, slot -= slotSize)
+			{
+				*cast(void**)slot = chunk->freeList;
+				chunk->freeList = slot;
+			}
+
+			chunk->live = 0;
+			chunk->cls = cast(uint32_t)cls;
+			linkChunk(slabChunks[cls], chunk);
+		}
+
+		auto ret = chunk->freeList;
+		chunk->freeList = *cast(void**)ret;
+		chunk->live++;
+
+		if(chunk->freeList == nullptr)
+		{
+			unlinkChunk(slabChunks[cls], chunk);
+			linkChunk(slabFullChunks, chunk);
+		}
+
+		chunkOffset = cast(uint32_t)((cast(uint8_t*)ret - cast(uint8_t*)chunk) / CROC_SLAB_GRANULARITY);
+		totalBytes += size;
+		return ret;
+	}
+
+	// A chunk that's left empty is kept for reuse, up to CROC_SLAB_FREE_CHUNKS of them, or given back, unless it's the
+	// only chunk its size class has left. The pool is shared, so freeing one size class's objects makes room for another.
+	void Memory::slabFree(void* p, size_t chunkOffset, size_t size)
+	{
+		auto chunk = cast(SlabChunk*)(cast(uint8_t*)p - chunkOffset * CROC_SLAB_GRANULARITY);
+		auto &list = slabChunks[chunk->cls];
+		assert(chunk->live > 0);
+		totalBytes -= size;
+
+		if(chunk->freeList == nullptr)
+		{
+			unlinkChunk(slabFullChunks, chunk);
+			linkChunk(list, chunk);
+		}
+
+		*cast(void**)p = chunk->freeList;
+		chunk->freeList = p;
+
+		if(--chunk->live == 0 && (chunk->prev != nullptr || chunk->next != nullptr))
+		{
+			unlinkChunk(list, chunk);
+
+			if(numSlabFreeChunks < CROC_SLAB_FREE_CHUNKS)
+			{
+				chunk->next = slabFreeChunks;
+				slabFreeChunks = chunk;
+				numSlabFreeChunks++;
+			}
+			else
+			{
+				memFunc(ctx, chunk, CROC_SLAB_CHUNK_SIZE, 0);
+				slabBytes -= CROC_SLAB_CHUNK_SIZE;
+			}
+		}
+	}
+
+	// Only called when the VM is closed, after every object has been freed.
+	void Memory::freeSlabs()
+	{
+		for(auto list: slabChunks)
+			freeChunkList(*this, list);
+
+		freeChunkList(*this, slabFullChunks);
+		freeChunkList(*this, slabFreeChunks);
+		memset(slabChunks, 0, sizeof(slabChunks));
+		slabFullChunks = nullptr;
+		slabFreeChunks = nullptr;
+		numSlabFreeChunks = 0;
+		slabBytes = 0;
+	}
+
+	// Returns null if there's no room in the active page and a new one couldn't be allocated.
+	GCObject* Memory::allocateInPage(size_t size, bool acyclic)
+	{
+		auto rounded = SLAB_ROUND(size);
+		auto page = activePages;
+
+		if(page == nullptr || page->top + rounded > cast(uint8_t*)page + CROC_NURSERY_PAGE_SIZE)
+		{
+			if(freePages != nullptr)
+			{
+				page = freePages;
+				freePages = page->next;
+				numFreePages--;
+			}
+			else
+			{
+				page = cast(NurseryPage*)memFunc(ctx, nullptr, 0, CROC_NURSERY_PAGE_SIZE);
+
+				if(page == nullptr)
+					return nullptr;
+
+				pageBytes += CROC_NURSERY_PAGE_SIZE;
+			}
+
+			page->next = activePages;
+			page->prev = nullptr;
+			page->top = cast(uint8_t*)page + PAGE_HEADER_SIZE;
+			page->live = 0;
+			page->active = true;
+			activePages = page;
+		}
+
+		auto ret = cast(GCObject*)page->top;
+		page->top += rounded;
+		page->live++;
+		totalBytes += size;
+
+		auto offset = cast(uint32_t)((cast(uint8_t*)ret - cast(uint8_t*)page) / CROC_SLAB_GRANULARITY);
+		memset(ret, 0, size);
+		ret->memSize = size;
+		ret->gcflags = (offset << GCOBJ_PAGEOFFSET_SHIFT) | (acyclic ? GCFlags_Green : 0);
+		return ret;
+	}
+
+	// The object's memory isn't reused on its own. Once every object on its page is gone, the page is, unless it's still
+	// part of the nursery, in which case clearNurserySpace will take care of it.
+	void Memory::freeInPage(void* p, size_t pageOffset, size_t size)
+	{
+		auto page = cast(NurseryPage*)(cast(uint8_t*)p - pageOffset * CROC_SLAB_GRANULARITY);
+		assert(page->live > 0);
+		totalBytes -= size;
+
+		if(--page->live == 0 && !page->active)
+		{
+			if(page->prev != nullptr)
+				page->prev->next = page->next;
+			else
+				pinnedPages = page->next;
+
+			if(page->next != nullptr)
+				page->next->prev = page->prev;
+
+			releasePage(page);
+		}
+	}
+
+	void Memory::releasePage(NurseryPage* page)
+	{
+		if((numFreePages + 1) * CROC_NURSERY_PAGE_SIZE <= nurseryLimit)
+		{
+			page->next = freePages;
+			freePages = page;
+			numFreePages++;
+		}
+		else
+		{
+			memFunc(ctx, page, CROC_NURSERY_PAGE_SIZE, 0);
+			pageBytes -= CROC_NURSERY_PAGE_SIZE;
+		}
+	}
+
+	void Memory::freePageList(NurseryPage*& list)
+	{
+		while(list != nullptr)
+		{
+			auto next = list->next;
+			memFunc(ctx, list, CROC_NURSERY_PAGE_SIZE, 0);
+			pageBytes -= CROC_NURSERY_PAGE_SIZE;
+			list = next;
+		}
+	}
+#endif
+}
@@ -1,14 +1,66 @@
 #ifndef CROC_BASE_MEMORY_HPP
 #define CROC_BASE_MEMORY_HPP
 
+#include <functional>
+
 #include "croc/apitypes.h"
 #include "croc/base/deque.hpp"
 #include "croc/base/gcobject.hpp"
 #include "croc/base/leakdetector.hpp"
 #include "croc/base/sanity.hpp"
 
+#ifndef CROC_NO_SLAB_ALLOCATOR
+// GC objects up to this size are carved out of page-sized chunks, with one free list per size class, instead of each one
+// being a separate call to the memory function.
+#define CROC_SLAB_MAX_SIZE 256
+#define CROC_SLAB_GRANULARITY 16
+#define CROC_SLAB_CLASSES (CROC_SLAB_MAX_SIZE / CROC_SLAB_GRANULARITY)
+#define CROC_SLAB_CHUNK_SIZE 4096
+// Up to this many empty slab chunks are kept around for reuse by any size class; see slabFree.
+#define CROC_SLAB_FREE_CHUNKS 16
+
+// Nursery objects are bump-allocated out of pages this big. See NurseryPage.
+#define CROC_NURSERY_PAGE_SIZE (32 * 1024)
+#endif
+
 namespace croc
 {
+	struct AllocProfiler;
+
+#ifndef CROC_NO_SLAB_ALLOCATOR
+	// The header at the start of each slab chunk. A chunk holds slots of one size class and has its own free list, so
+	// that once every slot in it is free, it can be given back or reused for another size class.
+	struct SlabChunk
+	{
+		SlabChunk* next;
+		SlabChunk* prev;
+		void* freeList;
+		uint32_t live;
+		uint32_t cls;
+	};
+
+	// The header at the start of each nursery page. Objects are never moved, so a page can't be reused until every
+	// object on it has been freed. Pages whose objects all die in the nursery are recycled as soon as the nursery is
+	// swept; pages with survivors are pinned until the last survivor is freed.
+	struct NurseryPage
+	{
+		NurseryPage* next;
+		NurseryPage* prev;
+		uint8_t* top;
+		size_t live;
+		bool active;
+	};
+#endif
+
+	// Where a MemoryError is in being thrown. Making the exception needs memory, and so does the code that catches it,
+	// but the interpreter only gets to a safe point, where the GC can free memory, after allocating.
+	enum LimitError
+	{
+		LimitError_None,
+		LimitError_Making, // the MemoryError is being made and thrown
+		LimitError_Thrown  // it's been thrown, but there hasn't been a safe point since
+	};
+
 	struct Memory
 	{
 		CrocMemFunc memFunc;
@@ -16,7 +68,9 @@ namespace croc
 
 		Deque modBuffer;
 		Deque decBuffer;
+#ifdef CROC_NO_SLAB_ALLOCATOR
 		Deque nursery;
+#endif
 
 		// 0 for enabled, positive for disabled
 		size_t gcDisabled;
@@ -28,6 +82,71 @@ namespace croc
 		size_t cycleCollectCountdown;
 		size_t nextCycleCollect;
 		size_t cycleMetadataLimit;
+		// Limits on how long a normal GC cycle's cycle collection can go on for, in microseconds and in objects
+		// visited; 0 means no limit. If it runs out, the collection picks up where it left off next GC cycle.
+		size_t cyclePauseTime;
+		size_t cyclePauseObjects;
+		bool cycleCollectUnfinished;
+		// Whether normal GC cycles hand cycle detection off to a background thread; see cycledetector.hpp.
+		bool concurrentCycles;
+		// Adaptive tuning of the limits above; see adaptLimits in gc.cpp. The averages are kept whether or not there's
+		// a goal. Pauses are in microseconds; the rest are fractions.
+		CrocGCGoal gcGoal;
+		size_t gcGoalTarget;
+		uint64_t lastCycleEnd;
+		size_t promotedBytes;
+		double avgPause;
+		double avgGCFraction;
+		double avgSurvival;
+		// GC telemetry. The event log is a ring buffer of the last gcEventLogSize GC cycles; gcEventNext is where the
+		// next one goes, and gcEventCount is how many are in it.
+		CrocGCStats stats;
+		CrocGCEvent* gcEvents;
+		size_t gcEventLogSize;
+		size_t gcEventNext;
+		size_t gcEventCount;
+		// The allocation profiler, if it's been started; see allocprofiler.hpp. It's told about every GC object that's
+		// allocated or freed.
+		AllocProfiler* profiler;
+		size_t lastLayoutID;
+		// Deque chunks that aren't in use by any deque. Up to a cycle's worth are kept around for reuse; see
+		// trimDequeChunks. numDequeChunks counts all of them, in use or not.
+		DequeChunk* dequeChunkPool;
+		size_t numPooledDequeChunks;
+		size_t numDequeChunks;
+		// Memory limits; 0 means no limit. Going over the hard limit calls limitHook, which throws a MemoryError,
+		// unless limitExempt is positive (for allocations that can't be allowed to fail) or the GC is disabled. The
+		// limit is also lifted from when a MemoryError is made until the next safe point after it's thrown; see
+		// LimitError. Safe points run a full collection once totalBytes reaches limitCollectAt, which is set after each
+		// collection to halfway between the heap size and the hard limit. softLimitHit is set once the soft limit
+		// callback has been called, and cleared when the heap shrinks back under the soft limit. The limits are compared
+		// against totalBytes only, so the slab and page overhead (slabBytes and pageBytes) isn't counted.
+		size_t hardLimit;
+		size_t softLimit;
+		size_t limitCollectAt;
+		size_t limitExempt;
+		LimitError limitError;
+		bool softLimitHit;
+		void (*limitHook)(void* ctx, size_t size);
+		void* limitCtx;
+#ifndef CROC_NO_SLAB_ALLOCATOR
+		// Chunks with free slots are on their size class's list, and full ones are on slabFullChunks. Empty chunks are
+		// kept on slabFreeChunks, up to CROC_SLAB_FREE_CHUNKS of them. totalBytes only counts the slots that are in use;
+		// slabBytes is how much memory the chunks themselves take up.
+		SlabChunk* slabChunks[CROC_SLAB_CLASSES];
+		SlabChunk* slabFullChunks;
+		SlabChunk* slabFreeChunks;
+		size_t numSlabFreeChunks;
+		size_t slabBytes;
+
+		// Active pages make up the nursery; the first one is the one being allocated out of. Pinned pages hold
+		// survivors. Free pages are kept around for reuse, up to nurseryLimit's worth.
+		NurseryPage* activePages;
+		NurseryPage* pinnedPages;
+		NurseryPage* freePages;
+		size_t numFreePages;
+		size_t pageBytes;
+#endif
 		LEAK_DETECT(LeakDetector leaks;)
 
 		void init(CrocMemFunc func, void* context);
@@ -36,12 +155,33 @@ namespace croc
 		{
 			return
 				nurseryBytes >= nurseryLimit ||
-				(modBuffer.length() + decBuffer.length()) * sizeof(GCObject*) >= metadataLimit;
+				(modBuffer.length() + decBuffer.length()) * sizeof(GCObject*) >= metadataLimit ||
+				(softLimit != 0 && !softLimitHit && totalBytes > softLimit);
+		}
+
+		inline bool nearHardLimit() const
+		{
+			return hardLimit != 0 && totalBytes >= limitCollectAt;
 		}
 
+		inline void checkLimit(size_t size)
+		{
+			if(hardLimit != 0 && totalBytes + size > hardLimit && limitExempt == 0 && gcDisabled == 0 &&
+				limitHook != nullptr)
+				limitHook(limitCtx, size);
+		}
+
+		void updateLimitCollectAt();
+
+		DequeChunk* allocDequeChunk();
+		void releaseDequeChunk(DequeChunk* chunk);
+		void trimDequeChunks();
+
 		void resizeNurserySpace(size_t newSize);
+		void foreachNursery(std::function<void(GCObject*)> dg);
 		void clearNurserySpace();
 		void cleanup();
+		void resizeEventLog(size_t size);
 
 		GCObject* allocate(size_t size, bool acyclic TYPEID_PARAM);
 		GCObject* allocateFinalizable(size_t size TYPEID_PARAM);
@@ -56,6 +196,16 @@ namespace croc
 		GCObject* allocateRC(size_t size, bool acyclic TYPEID_PARAM);
 		GCObject* allocateGCObject(size_t size, bool acyclic, uint32_t gcflags);
 		void* realloc(void* p, size_t oldSize, size_t newSize);
+		void outOfMemory(size_t size);
+#ifndef CROC_NO_SLAB_ALLOCATOR
+		void* slabAlloc(size_t size, uint32_t& chunkOffset);
+		void slabFree(void* p, size_t chunkOffset, size_t size);
+		void freeSlabs();
+		GCObject* allocateInPage(size_t size, bool acyclic);
+		void freeInPage(void* p, size_t pageOffset, size_t size);
+		void releasePage(NurseryPage* page);
+		void freePageList(NurseryPage*& list);
+#endif
 	};
 }
 
@@ -9,4 +9,166 @@ namespace croc
 		INSTRUCTION_LIST(POOP)
 	};
 #undef POOP
+
+	// Gives the number of shorts that an instruction with the given opcode takes up. See the instruction format comment
+	// in opcodes.hpp.
+	size_t instructionSize(Op opcode)
+	{
+		switch(opcode)
+		{
+			case Op_PopEH:
+			case Op_EndFinal:
+			case Op_Ret:
+			case Op_CheckParams:
+			case Op_CheckRets:
+			case Op_Inc:
+			case Op_Dec:
+			case Op_VargLen:
+			case Op_NewTable:
+			case Op_Close:
+			case Op_ObjParamFail:
+			case Op_AssertFail:
+			case Op_Unwind:
+			case Op_ObjRetFail:
+			case Op_RetAsFloat:
+				return 1;
+
+			case Op_AddEq:
+			case Op_SubEq:
+			case Op_MulEq:
+			case Op_DivEq:
+			case Op_ModEq:
+			case Op_AndEq:
+			case Op_OrEq:
+			case Op_XorEq:
+			case Op_ShlEq:
+			case Op_ShrEq:
+			case Op_UShrEq:
+			case Op_Neg:
+			case Op_Com:
+			case Op_Not:
+			case Op_Move:
+			case Op_VargIndex:
+			case Op_Length:
+			case Op_LengthAssign:
+			case Op_Append:
+			case Op_SuperOf:
+			case Op_CustomParamFail:
+			case Op_Slice:
+			case Op_SliceAssign:
+			case Op_AsBool:
+			case Op_AsInt:
+			case Op_AsFloat:
+			case Op_AsString:
+			case Op_For:
+			case Op_ForLoop:
+			case Op_Foreach:
+			case Op_PushCatch:
+			case Op_PushFinally:
+			case Op_Vararg:
+			case Op_SaveRets:
+			case Op_Closure:
+			case Op_ClosureWithEnv:
+			case Op_NewGlobal:
+			case Op_GetGlobal:
+			case Op_SetGlobal:
+			case Op_GetUpval:
+			case Op_SetUpval:
+			case Op_NewArray:
+			case Op_NamespaceNP:
+			case Op_MoveRet:
+			case Op_Throw:
+			case Op_Switch:
+			case Op_SwitchDense:
+			case Op_SwitchSorted:
+			case Op_CustomRetFail:
+			case Op_Jmp:
+			case Op_MoveMove:
+			case Op_MoveCall:
+			case Op_GetUpvalMove:
+			case Op_GetGlobalMove:
+			case Op_NotIsTrue:
+			case Op_SaveRetsRet:
+			case Op_AddEqII:
+			case Op_SubEqII:
+			case Op_AddEqFF:
+			case Op_SubEqFF:
+				return 2;
+
+			case Op_Add:
+			case Op_Sub:
+			case Op_Mul:
+			case Op_Div:
+			case Op_Mod:
+			case Op_Cmp3:
+			case Op_And:
+			case Op_Or:
+			case Op_Xor:
+			case Op_Shl:
+			case Op_Shr:
+			case Op_UShr:
+			case Op_Index:
+			case Op_IndexAssign:
+			case Op_VargIndexAssign:
+			case Op_Cat:
+			case Op_CatEq:
+			case Op_CheckObjParam:
+			case Op_ForeachLoop:
+			case Op_Call:
+			case Op_TailCall:
+			case Op_Yield:
+			case Op_SetArray:
+			case Op_Namespace:
+			case Op_IsTrue:
+			case Op_CheckObjRet:
+			case Op_AddII:
+			case Op_SubII:
+			case Op_MulII:
+			case Op_AddFF:
+			case Op_SubFF:
+			case Op_MulFF:
+				return 3;
+
+			case Op_Cmp:
+			case Op_Equals:
+			case Op_Is:
+			case Op_In:
+			case Op_SwitchCmp:
+			case Op_Field:
+			case Op_FieldAssign:
+			case Op_AddMember:
+			case Op_Class:
+				return 4;
+
+			case Op_Method:
+			case Op_TailMethod:
+				return 6;
+
+			default:
+				assert(false);
+				return 0;
+		}
+	}
+
+	// Gives the superinstruction that the given pair of instructions can be fused into, or Op_NUM_OPCODES if there is
+	// none. The pairs were picked from opcode pair histograms of real programs (build with CROC_OPCODE_PAIR_STATS to
+	// get one).
+	Op fusedOpcode(Op first, Op second)
+	{
+		switch(first)
+		{
+			case Op_Move:
+				if(second == Op_Move) return Op_MoveMove;
+				if(second == Op_Call) return Op_MoveCall;
+				break;
+
+			case Op_GetUpval:  if(second == Op_Move)   return Op_GetUpvalMove;  break;
+			case Op_GetGlobal: if(second == Op_Move)   return Op_GetGlobalMove; break;
+			case Op_Not:       if(second == Op_IsTrue) return Op_NotIsTrue;     break;
+			case Op_SaveRets:  if(second == Op_Ret)    return Op_SaveRetsRet;   break;
+			default: break;
+		}
+
+		return Op_NUM_OPCODES;
+	}
 }
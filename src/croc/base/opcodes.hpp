@@ -7,9 +7,9 @@
 namespace croc
 {
 /*
-Instruction format is variable length. Each instruction is composed of between 1 and 5 shorts.
+Instruction format is variable length. Each instruction is composed of between 1 and 6 shorts.
 
-First component is rd/op (lower 7 bits are op, upper 9 are rd), followed by 0-4 additional shorts, each of which can be
+First component is rd/op (lower 7 bits are op, upper 9 are rd), followed by 0-5 additional shorts, each of which can be
 either a const-tagged reg/const index, or a signed/unsigned immediate.
 
 Const-tagging: if the top bit is set, the lower 15 bits are an index into the constant table. If the top bit is clear,
@@ -84,6 +84,8 @@ TWO SHORTS:
 (rdimm, rs)
 	throw:         throw the value in rs; rd == 0 means normal throw, rd == 1 means rethrow
 	switch:        switch on the value in rs using switch table index rd
+	dswitch:       like switch, but the cases are all ints and dense, so look the value up in a jump table
+	sswitch:       like switch, but the cases are all ints and sparse, so binary search for the value
 	customretfail: give error message about return rdimm not satisfying the constraint whose name is in rs
 (rdimm, imm)
 	jmp: if rd == 1, jump by imm, otherwise no-op
@@ -95,8 +97,6 @@ THREE SHORTS:
 	idx:    rd = rs[rt]
 	idxa:   rd[rs] = rt
 	in:     rd = rs in rt
-	field:  rd = rs.(rt)
-	fielda: rd.(rs) = rt
 (__, rs, rt)
 	vargidxa: vararg[rs] = rt
 (rd, rs, uimm)
@@ -126,14 +126,42 @@ FOUR SHORTS:
 (__, rs, rt, imm)
 	swcmp: if(switchcmp(rs, rt)) jump by imm
 (rd, rs, rt, uimm)
+	field:  rd = rs.(rt); uimm is the index of this instruction's field cache, or INST_NO_CACHE
+	fielda: rd.(rs) = rt; uimm is the same as for field
 	addember: add field/method named rs to class in rd with value rt. uimm bit 0 is field(0)/method(1) and bit 1 is override or not.
 	class:  rd = class rs : (rt + 0, rt + 1 .. rt + uimm - 1) {}
 
-FIVE SHORTS:
+SIX SHORTS:
 
-(rd, rs, rt, uimm1, uimm2)
-	method:  rd is base reg, rs is object, rt is method name, uimm1 is number of params, uimm2 is number of expected returns.
+(rd, rs, rt, uimm1, uimm2, uimm3)
+	method:  rd is base reg, rs is object, rt is method name, uimm1 is number of params, uimm2 is number of expected returns,
+	         uimm3 is the index of this instruction's method cache, or INST_NO_CACHE.
 	tmethod: same as above, but does a tailcall. uimm2 is unused, but this makes codegen easier
+
+SUPERINSTRUCTIONS:
+
+These are never emitted by codegen directly. After a function is generated, pairs of instructions which commonly appear
+together (and are on the same line) are fused by replacing the opcode of the first one with one of these. The second
+instruction is left untouched, so jumps to it still work, and the instructions keep their original formats and lengths.
+The interpreter runs the first half, skips the second instruction's first short, and runs the second half without going
+through dispatch again.
+
+	movmov:      mov + mov
+	movcall:     mov + call
+	getumov:     getu + mov
+	getgmov:     getg + mov
+	notistrue:   not + istrue
+	saveretsret: saverets + ret
+
+QUICKENED INSTRUCTIONS:
+
+These are never emitted by codegen either. When the interpreter runs a generic arithmetic instruction whose operands are
+both ints or both floats, it rewrites the instruction's opcode in place to one of these, which only have to check the
+operand types and do the operation. If the types don't match, the instruction is rewritten back to the generic version
+and the generic operation is done. They have the same formats and lengths as the instructions they replace.
+
+	addii, subii, mulii, addff, subff, mulff:    quickened add, sub, mul
+	addeqii, subeqii, addeqff, subeqff:          quickened addeq, subeq
 */
 
 #define INSTRUCTION_LIST(X)\
@@ -236,7 +264,25 @@ FIVE SHORTS:
 	X(AsInt),\
 	X(AsFloat),\
 	X(AsString),\
-	X(RetAsFloat)
+	X(RetAsFloat),\
+	X(MoveMove),\
+	X(MoveCall),\
+	X(GetUpvalMove),\
+	X(GetGlobalMove),\
+	X(NotIsTrue),\
+	X(SaveRetsRet),\
+	X(AddII),\
+	X(SubII),\
+	X(MulII),\
+	X(AddFF),\
+	X(SubFF),\
+	X(MulFF),\
+	X(AddEqII),\
+	X(SubEqII),\
+	X(AddEqFF),\
+	X(SubEqFF),\
+	X(SwitchDense),\
+	X(SwitchSorted)
 
 #define POOP(x) Op_ ## x
 	enum Op
@@ -248,6 +294,9 @@ FIVE SHORTS:
 
 	extern const char* OpNames[];
 
+	size_t instructionSize(Op opcode);
+	Op fusedOpcode(Op first, Op second);
+
 	enum Comparison
 	{
 		Comparison_LT,
@@ -286,12 +335,15 @@ FIVE SHORTS:
 #define INST_MAX_EH_DEPTH INST_RD_MAX
 #define INST_MAX_SWITCH_TABLE INST_RD_MAX
 #define INST_MAX_INNER_FUNC INST_UIMM_MAX
+#define INST_NO_CACHE INST_UIMM_MAX
+#define INST_MAX_CACHE (INST_NO_CACHE - 1)
 
 #define INST_ARRAY_SET_FIELDS 30
 #define INST_MAX_ARRAY_FIELDS (INST_ARRAY_SET_FIELDS * INST_UIMM_MAX)
 
 #define INST_GET_OPCODE(n) (((n).uimm & INST_OPCODE_MASK) >> INST_OPCODE_SHIFT)
 #define INST_GET_RD(n) (((n).uimm & INST_RD_MASK) >> INST_RD_SHIFT)
+#define INST_SET_OPCODE(n, op) ((n).uimm = ((n).uimm & ~INST_OPCODE_MASK) | (((op) << INST_OPCODE_SHIFT) & INST_OPCODE_MASK))
 
 	union Instruction
 	{
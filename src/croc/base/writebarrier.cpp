@@ -50,7 +50,7 @@ namespace croc
 				CLEAR_BOTH_MODIFIED(n);
 			}
 		}
-		else
+		else if(o->weakMode == CrocWeakMode_None)
 		{
 			for(auto n: o->data)
 			{
@@ -58,6 +58,18 @@ namespace croc
 				VALUE_CALLBACK(n->value);
 			}
 		}
+		else
+		{
+			// Weakly-held objects aren't counted as references (and never have their modified bits set above).
+			for(auto n: o->data)
+			{
+				if(!o->weakKey(n->key))
+					VALUE_CALLBACK(n->key);
+
+				if(!o->weakValue(n->value))
+					VALUE_CALLBACK(n->value);
+			}
+		}
 	}
 
 	void visitNamespace(Namespace* o, WBCallback callback, bool isModifyPhase)
@@ -351,11 +363,12 @@ namespace croc
 		COND_CALLBACK(vm->exception);
 		callback(vm->registry);
 		callback(vm->unhandledEx);
+		COND_CALLBACK(vm->baseline);
 
 		for(auto n: vm->refTab)
 			callback(n->value);
 
-		callback(vm->location);
+		COND_CALLBACK(vm->location); // null in a VM being opened from a snapshot
 
 		for(auto n: vm->stdExceptions)
 		{
@@ -346,6 +346,14 @@ namespace croc
 				c.semException(mLocation, "Too many switches");
 
 			setRD(s.switchPC, switchIdx);
+
+			switch(Funcdef::SwitchTable::kindOf(s.offsets))
+			{
+				case Funcdef::SwitchTable::Hashed: break;
+				case Funcdef::SwitchTable::Dense:  setOpcode(s.switchPC, Op_SwitchDense); break;
+				case Funcdef::SwitchTable::Sorted: setOpcode(s.switchPC, Op_SwitchSorted); break;
+				default: assert(false);
+			}
 		}
 		else
 		{
@@ -1333,6 +1341,7 @@ namespace croc
 		codeRC(name);
 		codeUImm(numArgs);
 		codeUImm(0);
+		codeMethodCache(name);
 
 		pushExp(ExpType::Call, inst);
 	}
@@ -1961,7 +1970,9 @@ namespace croc
 			case Op_PushCatch:
 			case Op_PushFinally:
 			case Op_Jmp:
-			case Op_Switch:        return dest - (srcIndex + 2);
+			case Op_Switch:
+			case Op_SwitchDense:
+			case Op_SwitchSorted:  return dest - (srcIndex + 2);
 
 			case Op_ForeachLoop:
 			case Op_IsTrue:
@@ -2132,6 +2143,7 @@ namespace croc
 					codeRD(loc, Op_FieldAssign, d1);
 					codeRC(d2);
 					codeRC(getExp(-1));
+					codeFieldCache(d2);
 					break;
 				}
 				case ExpType::VarargIndex: {
@@ -2192,6 +2204,7 @@ namespace croc
 				auto s2 = unpackRegOrConst(src.index2);
 				codeRC(s1);
 				codeRC(s2);
+				codeFieldCache(s2);
 				break;
 			}
 			case ExpType::Slice: {
@@ -2333,6 +2346,24 @@ namespace croc
 		addInst(i);
 	}
 
+	// Only field accesses and method calls with constant names get a cache, since those are the only ones where the name
+	// can't change.
+	void FuncBuilder::codeFieldCache(Exp& name)
+	{
+		if(name.type == ExpType::Const && mNumFieldCaches <= INST_MAX_CACHE)
+			codeUImm(mNumFieldCaches++);
+		else
+			codeUImm(INST_NO_CACHE);
+	}
+
+	void FuncBuilder::codeMethodCache(Exp& name)
+	{
+		if(name.type == ExpType::Const && mNumMethodCaches <= INST_MAX_CACHE)
+			codeUImm(mNumMethodCaches++);
+		else
+			codeUImm(INST_NO_CACHE);
+	}
+
 	uword FuncBuilder::addInst(uword line, Instruction i)
 	{
 		mLineInfo.add(line);
@@ -2387,6 +2418,39 @@ namespace croc
 		return mCode[index].imm;
 	}
 
+	// =================================================================================================================
+	// Superinstructions
+
+	// Replaces common pairs of instructions with superinstructions (see opcodes.hpp). Only the first instruction of
+	// each pair is changed, so no jumps have to be fixed up. Pairs that span lines are left alone so that line hooks
+	// still see every line.
+	void FuncBuilder::fuseInstructions()
+	{
+#ifndef CROC_NO_SUPERINSTRUCTIONS
+		uword i = 0;
+
+		while(i < mCode.length())
+		{
+			auto op = cast(Op)getOpcode(i);
+			auto next = i + instructionSize(op);
+
+			if(next < mCode.length() && mLineInfo[i] == mLineInfo[next])
+			{
+				auto nextOp = cast(Op)getOpcode(next);
+				auto fused = fusedOpcode(op, nextOp);
+
+				if(fused != Op_NUM_OPCODES)
+				{
+					setOpcode(i, fused);
+					next += instructionSize(nextOp);
+				}
+			}
+
+			i = next;
+		}
+#endif
+	}
+
 	// =================================================================================================================
 	// Conversion to function definition
 
@@ -2397,6 +2461,8 @@ namespace croc
 			fflush(stdout);
 		})
 
+		fuseInstructions();
+
 		auto ret = Funcdef::create(c.mem());
 		push(t, Value::from(ret));
 
@@ -2429,6 +2495,9 @@ namespace croc
 
 		ret->constants = mConstants.toArrayView().dup(c.mem());
 		ret->code = mCode.toArrayView().dup(c.mem());
+		ret->fieldCaches.resize(c.mem(), mNumFieldCaches);
+		ret->methodCaches.resize(c.mem(), mNumMethodCaches);
+		ret->globalCaches.resize(c.mem(), ret->constants.length);
 		ret->switchTables.resize(c.mem(), mSwitchTables.length());
 
 		i = 0;
@@ -2436,6 +2505,7 @@ namespace croc
 		{
 			ret->switchTables[i].offsets = s.offsets;
 			ret->switchTables[i].defaultOffset = s.defaultOffset;
+			ret->switchTables[i].buildIntCases(c.mem());
 			i++;
 		}
 
@@ -2656,6 +2726,8 @@ namespace croc
 			// (rdimm, rs)
 			case Op_Throw: if(INST_GET_RD(i)) { printf("re"); } printf("throw"); rcNoComma(); break;
 			case Op_Switch:        printf("switch"); goto _7;
+			case Op_SwitchDense:   printf("dswitch"); goto _7;
+			case Op_SwitchSorted:  printf("sswitch"); goto _7;
 			case Op_CustomRetFail: printf("customretfail"); goto _7;
 			_7: rdimm(i); rc(); break;
 
@@ -2677,8 +2749,6 @@ namespace croc
 			case Op_UShr: printf("ushr"); goto _8;
 			case Op_Index:       printf("idx"); goto _8;
 			case Op_IndexAssign: printf("idxa"); goto _8;
-			case Op_Field:       printf("field"); goto _8;
-			case Op_FieldAssign: printf("fielda"); goto _8;
 			_8: rd(i); rc(); rc(); break;
 
 			// (__, rs, rt)
@@ -2729,13 +2799,15 @@ namespace croc
 			case Op_SwitchCmp: printf("swcmp"); rcNoComma(); rc(); imm(); break;
 
 			// (rd, rs, rt, uimm)
-			case Op_AddMember: printf("addmember"); goto _12;
-			case Op_Class:     printf("class"); goto _12;
+			case Op_Field:       printf("field"); goto _12;
+			case Op_FieldAssign: printf("fielda"); goto _12;
+			case Op_AddMember:   printf("addmember"); goto _12;
+			case Op_Class:       printf("class"); goto _12;
 			_12: rd(i); rc(); rc(); uimm(); break;
 
-			// (rd, rs, rt, uimm, uimm)
-			case Op_Method:     printf("method"); rd(i); rc(); rc(); uimm(); uimm(); break;
-			case Op_TailMethod: printf("tmethod"); rd(i); rc(); rc(); uimm(); nextIns(); break;
+			// (rd, rs, rt, uimm, uimm, uimm)
+			case Op_Method:     printf("method"); rd(i); rc(); rc(); uimm(); uimm(); uimm(); break;
+			case Op_TailMethod: printf("tmethod"); rd(i); rc(); rc(); uimm(); nextIns(); uimm(); break;
 
 			default: printf("no case for opcode %d\n", INST_GET_OPCODE(i)); assert(false);
 		}
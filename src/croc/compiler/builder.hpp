@@ -287,6 +287,8 @@ namespace croc
 		List<SwitchDesc, 2> mSwitchTables;
 		List<uword, 64> mLineInfo;
 		List<LocVarDesc, 16> mLocVars;
+		uword mNumFieldCaches;
+		uword mNumMethodCaches;
 
 		uword mDummyNameCounter = 0;
 
@@ -319,6 +321,8 @@ namespace croc
 			mSwitchTables(c),
 			mLineInfo(c),
 			mLocVars(c),
+			mNumFieldCaches(0),
+			mNumMethodCaches(0),
 			mDummyNameCounter(0)
 		{
 			// let's just always make null const 0
@@ -484,6 +488,8 @@ namespace croc
 		void codeImm(int imm);
 		void codeUImm(uword uimm);
 		void codeRC(Exp& src);
+		void codeFieldCache(Exp& name);
+		void codeMethodCache(Exp& name);
 		uword addInst(uword line, Instruction i);
 		void addInst(Instruction i);
 		void setOpcode(uword index, uword opcode);
@@ -493,6 +499,7 @@ namespace croc
 		uword getOpcode(uword index);
 		uword getRD(uword index);
 		int getImm(uword index);
+		void fuseInstructions();
 		Funcdef* toFuncDef();
 		void showMe();
 		void disasm(Instruction*& pc, uword& insOffset, DArray<uint32_t> lineInfo);
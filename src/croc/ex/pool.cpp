@@ -0,0 +1,113 @@
+#include <string.h>
+
+#include "croc/api.h"
+#include "croc/types/base.hpp"
+
+using namespace croc;
+
+extern "C"
+{
+	/** Initializes a \ref CrocVMPool.
+
+	A pool hands out VMs which all start out as copies of the base VM, as it is when this is called. So you'd open the
+	base VM, load your libraries and run your setup code in it, and then make a pool from it. After that, each request
+	(or whatever) gets its own VM like so:
+
+	\code{.c}
+	CrocThread* t = croc_ex_pool_acquire(&pool);
+	// ...use t...
+	croc_ex_pool_release(&pool, t);
+	\endcode
+
+	Releasing a VM resets it with \ref croc_vm_reset and keeps it around for the next acquire, which is much cheaper
+	than opening and closing a VM each time. New VMs are only opened when there are no idle ones left, and they're
+	opened from a snapshot of the base VM which is taken once, here.
+
+	The pool is not thread-safe; if several host threads share it, they have to lock around these functions. The VMs
+	that it hands out are independent of each other, so they can be used by different threads at the same time.
+
+	\param base is the VM which the pool's VMs are copies of. The snapshot is allocated in this VM, so it has to stay
+		open until \ref croc_ex_pool_free is called.
+	\param memFunc is the memory allocation function used for the pool's VMs, as with \ref croc_vm_open.
+	\param ctx is the context pointer passed to memFunc.
+	\param maxIdle is how many released VMs the pool keeps for reuse. VMs released when there are already this many
+		idle ones are closed.
+	\throws[ValueError] if the base VM can't be snapshotted (see \ref croc_vm_snapshot). */
+	void croc_ex_pool_init(CrocVMPool* p, CrocThread* base, CrocMemFunc memFunc, void* ctx, uword_t maxIdle)
+	{
+		p->base = base;
+		p->memFunc = memFunc;
+		p->ctx = ctx;
+		p->numIdle = 0;
+		p->maxIdle = maxIdle;
+
+		croc_vm_snapshot(base);
+		uword_t size;
+		auto data = croc_memblock_getDatan(base, -1, &size);
+
+		// The idle list and the snapshot share one block, so that there's nothing to leak if allocating it throws a
+		// MemoryError.
+		auto idleSize = maxIdle * sizeof(CrocThread*);
+		auto block = cast(char*)croc_mem_alloc(base, idleSize + size);
+		p->idle = maxIdle == 0 ? nullptr : cast(CrocThread**)block;
+		p->snapshot = block + idleSize;
+		p->snapshotSize = size;
+		memcpy(p->snapshot, data, size);
+		croc_popTop(base);
+	}
+
+	/** \returns the main thread of a VM from the pool. It'll be a fresh copy of the base VM, either an idle one that was
+	released earlier or a new one. Give it back with \ref croc_ex_pool_release when you're done with it.
+
+	Returns NULL if a new VM was needed and the pool's snapshot couldn't be opened (see \ref croc_vm_openSnapshot). */
+	CrocThread* croc_ex_pool_acquire(CrocVMPool* p)
+	{
+		if(p->numIdle > 0)
+			return p->idle[--p->numIdle];
+
+		auto t = croc_vm_openSnapshot(p->memFunc, p->ctx, p->snapshot, p->snapshotSize);
+
+		if(t != nullptr)
+			croc_vm_setBaseline(t);
+
+		return t;
+	}
+
+	/** Gives a VM back to the pool. It's reset to its starting state with \ref croc_vm_reset, so no code can be
+	running on it. If the pool already has as many idle VMs as it's allowed, the VM is closed instead.
+
+	Resetting the VM runs a full collection, which runs the finalizers of any instances that have become garbage, so
+	this can throw. If it does, the VM is not put back in the pool, and it's still yours to close with \ref
+	croc_vm_close.
+
+	\throws[StateError] if code is running on the VM's main thread.
+	\throws[FinalizerError] if a finalizer threw an exception. */
+	void croc_ex_pool_release(CrocVMPool* p, CrocThread* t)
+	{
+		t = croc_vm_getMainThread(t);
+
+		if(p->numIdle < p->maxIdle)
+		{
+			croc_vm_reset(t);
+			p->idle[p->numIdle++] = t;
+		}
+		else
+			croc_vm_close(t);
+	}
+
+	/** Closes all the pool's idle VMs and frees its memory. VMs which are still acquired have to be closed with \ref
+	croc_vm_close by you. Do this before closing the base VM. */
+	void croc_ex_pool_free(CrocVMPool* p)
+	{
+		for(uword_t i = 0; i < p->numIdle; i++)
+			croc_vm_close(p->idle[i]);
+
+		uword_t idleSize = p->maxIdle * sizeof(CrocThread*);
+		uword_t blockSize = idleSize + p->snapshotSize;
+		void* block = p->snapshot - idleSize;
+		croc_mem_free(p->base, &block, &blockSize);
+		p->snapshot = nullptr;
+		p->idle = nullptr;
+		p->numIdle = 0;
+	}
+}
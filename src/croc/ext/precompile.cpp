@@ -0,0 +1,163 @@
+// Compiles the script parts of the stdlib into bytecode (see croc/stdlib/helpers/bytecode.hpp) and writes it out as a
+// header for croc/stdlib/helpers/precompiled.cpp. This is linked against the rest of the library, so the bytecode it
+// makes matches that library exactly.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "croc/api.h"
+#include "croc/stdlib/helpers/bytecode.hpp"
+#include "croc/types/base.hpp"
+
+#include "croc/stdlib/console.croc.hpp"
+#include "croc/stdlib/docs.croc.hpp"
+#include "croc/stdlib/doctools_console.croc.hpp"
+#include "croc/stdlib/doctools_output.croc.hpp"
+#include "croc/stdlib/doctools_trac.croc.hpp"
+#include "croc/stdlib/hash_weaktables.croc.hpp"
+#include "croc/stdlib/modules.croc.hpp"
+#include "croc/stdlib/repl.croc.hpp"
+#include "croc/stdlib/serialization.croc.hpp"
+#include "croc/stdlib/stream.croc.hpp"
+#include "croc/stdlib/text.croc.hpp"
+
+using namespace croc;
+
+namespace
+{
+struct StdlibSource
+{
+	const char* sourceName; // must match what the library passes to registerModuleFromString or compileStdlibStmts
+	const char* modName;    // null if it's a list of statements instead of a module
+	const char* text;
+	size_t length;
+};
+
+#define SOURCE(sourceName, modName, file) {sourceName, modName, file##_croc_text, file##_croc_length}
+
+const StdlibSource Sources[] =
+{
+	SOURCE("console.croc",          "console",          console),
+	SOURCE("docs.croc",             "docs",             docs),
+	SOURCE("doctools/console.croc", "doctools.console", doctools_console),
+	SOURCE("doctools/output.croc",  "doctools.output",  doctools_output),
+	SOURCE("doctools/trac.croc",    "doctools.trac",    doctools_trac),
+	SOURCE("hash_weaktables.croc",  nullptr,            hash_weaktables),
+	SOURCE("modules.croc",          "modules",          modules),
+	SOURCE("repl.croc",             "repl",             repl),
+	SOURCE("serialization.croc",    "serialization",    serialization),
+	SOURCE("stream.croc",           "stream",           stream),
+	SOURCE("text.croc",             "text",             text),
+};
+
+#undef SOURCE
+
+FILE* output;
+
+word_t precompile(CrocThread* t)
+{
+	// Same flags the stdlib is compiled with in croc_vm_open.
+#ifdef CROC_BUILTIN_DOCS
+	croc_compiler_setFlags(t, CrocCompilerFlags_AllDocs);
+#endif
+	fprintf(output, "// Generated by croc/ext/precompile.cpp. Do not edit.\n\n");
+
+	size_t i = 0;
+	for(auto &src: Sources)
+	{
+		croc_pushStringn(t, src.text, src.length);
+		word_t num;
+
+		if(src.modName != nullptr)
+		{
+			const char* modName;
+			croc_compiler_compileModuleEx(t, src.sourceName, &modName);
+
+			if(strcmp(src.modName, modName) != 0)
+				croc_eh_throwStd(t, "ImportException", "%s: expected module %s, not %s", src.sourceName, src.modName,
+					modName);
+
+			num = 1;
+		}
+		else
+		{
+#ifdef CROC_BUILTIN_DOCS
+			croc_compiler_compileStmtsDTEx(t, src.sourceName);
+			num = 2;
+#else
+			croc_compiler_compileStmtsEx(t, src.sourceName);
+			num = 1;
+#endif
+		}
+
+		fprintf(output, "const unsigned char precompiled_%u[] =\n{", cast(unsigned)i);
+		size_t col = 0;
+
+		writeBytecode(t, -num, num, [&](crocstr data)
+		{
+			for(auto c: data)
+			{
+				if((col++ % 20) == 0)
+					fprintf(output, "\n\t");
+
+				fprintf(output, "%#04x, ", c);
+			}
+		});
+
+		fprintf(output, "\n};\n\n");
+		croc_pop(t, num);
+		i++;
+	}
+
+	fprintf(output, "const PrecompiledModule precompiledModules[] =\n{\n");
+
+	i = 0;
+	for(auto &src: Sources)
+	{
+		fprintf(output, "\t{\"%s\", precompiled_%u, sizeof(precompiled_%u)},\n", src.sourceName, cast(unsigned)i,
+			cast(unsigned)i);
+		i++;
+	}
+
+	fprintf(output, "\t{nullptr, nullptr, 0}\n};\n");
+	return 0;
+}
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 2)
+	{
+		fprintf(stderr, "Usage: precompile outfile\n");
+		return EXIT_FAILURE;
+	}
+
+	output = fopen(argv[1], "w");
+
+	if(output == nullptr)
+	{
+		fprintf(stderr, "Could not open %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	auto t = croc_vm_openDefault();
+	auto slot = croc_function_new(t, "precompile", 0, &precompile, 0);
+	croc_pushNull(t);
+	auto ret = EXIT_SUCCESS;
+
+	if(croc_tryCall(t, slot, 0) == CrocCallRet_Error)
+	{
+		croc_pushToString(t, -1);
+		fprintf(stderr, "Error precompiling the stdlib: %s\n", croc_getString(t, -1));
+		ret = EXIT_FAILURE;
+	}
+
+	croc_vm_close(t);
+	fclose(output);
+
+	if(ret != EXIT_SUCCESS)
+		remove(argv[1]);
+
+	return ret;
+}
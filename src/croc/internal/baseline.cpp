@@ -0,0 +1,239 @@
+#include "croc/api.h"
+#include "croc/internal/baseline.hpp"
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+	namespace
+	{
+	// A baseline is an array. The first slot is an array of the type metatables, the second is the unhandled exception
+	// handler, and after that come pairs of a container and a shallow copy of it. The containers are all the
+	// namespaces, tables, and arrays that can be reached from the globals, the registry, and the type metatables by
+	// going only through other containers. Namespaces are copied into namespaces, since their values can be null.
+	const uword MetaTabsSlot = 0;
+	const uword UnhandledExSlot = 1;
+	const uword FirstContainerSlot = 2;
+
+	struct BaselineRecorder
+	{
+		VM* vm;
+		Array* baseline;
+		Hash<GCObject*, bool> seen;
+
+		BaselineRecorder(VM* vm, Array* baseline) :
+			vm(vm),
+			baseline(baseline),
+			seen()
+		{}
+
+		void addContainer(Value v)
+		{
+			switch(v.type)
+			{
+				case CrocType_Namespace:
+				case CrocType_Array:
+					break;
+
+				case CrocType_Table:
+					// A copy would hold on to a weak table's contents strongly.
+					if(v.mTable->weakMode != CrocWeakMode_None)
+						return;
+					break;
+
+				default:
+					return;
+			}
+
+			if(seen.lookup(v.toGCObject()) != nullptr)
+				return;
+
+			*seen.insert(vm->mem, v.toGCObject()) = true;
+			baseline->append(vm->mem, v);
+			baseline->append(vm->mem, Value::nullValue); // filled in by copyContainer
+		}
+
+		// Copies the container in the given slot, and adds any containers inside it to the end of the baseline.
+		void copyContainer(uword slot)
+		{
+			auto &mem = vm->mem;
+			auto v = baseline->toDArray()[slot].value;
+
+			switch(v.type)
+			{
+				case CrocType_Namespace: {
+					auto ns = v.mNamespace;
+					auto copy = Namespace::create(mem, ns->name);
+					baseline->idxa(mem, slot + 1, Value::from(copy));
+
+					for(auto node: ns->data)
+					{
+						copy->set(mem, node->key, node->value);
+						addContainer(node->value);
+					}
+					break;
+				}
+				case CrocType_Table: {
+					auto tab = v.mTable;
+					baseline->idxa(mem, slot + 1, Value::from(tab->dup(vm)));
+
+					for(auto node: tab->data)
+					{
+						addContainer(node->key);
+						addContainer(node->value);
+					}
+					break;
+				}
+				case CrocType_Array: {
+					auto arr = v.mArray;
+					baseline->idxa(mem, slot + 1, Value::from(arr->slice(mem, 0, arr->length)));
+
+					for(auto &s: arr->toDArray())
+						addContainer(s.value);
+					break;
+				}
+				default: assert(false);
+			}
+		}
+	};
+
+	// Removes the keys which aren't in the copy. Clearing the container and putting everything back would be simpler,
+	// but it would make every value in it a possible cycle root, and the next collection would have to scan them all.
+	template<typename HashType, typename Remove>
+	void removeNewKeys(Memory& mem, HashType& data, HashType& src, Remove remove)
+	{
+		typedef decltype(HashType::NodeType::key) KeyType;
+		uword numNew = 0;
+
+		for(auto node: data)
+		{
+			if(src.lookupNode(node->key) == nullptr)
+				numNew++;
+		}
+
+		if(numNew == 0)
+			return;
+
+		auto newKeys = DArray<KeyType>::alloc(mem, numNew);
+		uword i = 0;
+
+		for(auto node: data)
+		{
+			if(src.lookupNode(node->key) == nullptr)
+				newKeys[i++] = node->key;
+		}
+
+		for(auto key: newKeys)
+			remove(key);
+
+		newKeys.free(mem);
+	}
+
+	// Only the slots that changed are assigned, for the same reason.
+	void restoreContainer(VM* vm, Value container, Value copy)
+	{
+		auto &mem = vm->mem;
+
+		switch(container.type)
+		{
+			case CrocType_Namespace: {
+				auto ns = container.mNamespace;
+				auto src = copy.mNamespace;
+				removeNewKeys(mem, ns->data, src->data, [&](String* key) { ns->remove(mem, key); });
+
+				for(auto node: src->data)
+					ns->set(mem, node->key, node->value);
+				break;
+			}
+			case CrocType_Table: {
+				auto tab = container.mTable;
+				auto src = copy.mTable;
+				removeNewKeys(mem, tab->data, src->data, [&](Value key) { tab->idxa(vm, key, Value::nullValue); });
+
+				for(auto node: src->data)
+					tab->idxa(vm, node->key, node->value);
+				break;
+			}
+			case CrocType_Array: {
+				auto arr = container.mArray;
+				auto src = copy.mArray;
+				arr->resize(mem, src->length);
+
+				for(uword i = 0; i < src->length; i++)
+					arr->idxa(mem, i, src->data[i].value);
+				break;
+			}
+			default: assert(false);
+		}
+	}
+	}
+
+	// Records the VM's current state as the baseline which resetToBaseline goes back to. Nothing here runs a collection,
+	// so the new objects are safe until the baseline is rooted at the end.
+	void recordBaseline(Thread* t)
+	{
+		auto vm = t->vm;
+		auto &mem = vm->mem;
+
+		// It's bookkeeping, like the weak table list, so it doesn't count against the memory limit.
+		mem.limitExempt++;
+		auto baseline = Array::create(mem, FirstContainerSlot);
+		auto metaTabs = Array::create(mem, vm->metaTabs.length);
+		baseline->idxa(mem, MetaTabsSlot, Value::from(metaTabs));
+		baseline->idxa(mem, UnhandledExSlot, Value::from(vm->unhandledEx));
+
+		BaselineRecorder rec(vm, baseline);
+		rec.addContainer(Value::from(vm->globals));
+		rec.addContainer(Value::from(vm->registry));
+
+		for(uword i = 0; i < vm->metaTabs.length; i++)
+		{
+			if(auto mt = vm->metaTabs[i])
+			{
+				metaTabs->idxa(mem, i, Value::from(mt));
+				rec.addContainer(Value::from(mt));
+			}
+		}
+
+		// The baseline grows as this goes.
+		for(uword i = FirstContainerSlot; i < baseline->length; i += 2)
+			rec.copyContainer(i);
+
+		rec.seen.clear(mem);
+		vm->baseline = baseline;
+		mem.limitExempt--;
+	}
+
+	// Puts the globals, registry, type metatables, and everything recorded along with them back the way they were when
+	// the baseline was recorded, then collects everything that was made since. The memory for the main thread's
+	// stacks, the string table, and the allocator's slabs is kept, so the VM is ready to use again right away.
+	void resetToBaseline(Thread* t)
+	{
+		auto vm = t->vm;
+
+		if(vm->baseline == nullptr)
+			croc_eh_throwStd(*t, "StateError", "No baseline has been set for this VM");
+
+		if(t != vm->mainThread || t->arIndex != 0)
+			croc_eh_throwStd(*t, "StateError", "A VM can only be reset from its main thread when no code is running");
+
+		t->stack.slice(1, t->stackIndex).fill(Value::nullValue);
+		t->stackIndex = 1;
+		t->resultIndex = 0;
+
+		auto slots = vm->baseline->toDArray();
+		auto metaTabs = slots[MetaTabsSlot].value.mArray->toDArray();
+
+		for(uword i = 0; i < vm->metaTabs.length; i++)
+		{
+			auto mt = metaTabs[i].value;
+			vm->metaTabs[i] = mt.type == CrocType_Null ? nullptr : mt.mNamespace;
+		}
+
+		vm->unhandledEx = slots[UnhandledExSlot].value.mFunction;
+
+		for(uword i = FirstContainerSlot; i < slots.length; i += 2)
+			restoreContainer(vm, slots[i].value, slots[i + 1].value);
+
+		croc_gc_collectFull(*t);
+	}
+}
@@ -0,0 +1,12 @@
+#ifndef CROC_INTERNAL_BASELINE_HPP
+#define CROC_INTERNAL_BASELINE_HPP
+
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+	void recordBaseline(Thread* t);
+	void resetToBaseline(Thread* t);
+}
+
+#endif
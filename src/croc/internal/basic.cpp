@@ -8,6 +8,7 @@
 #include "croc/internal/calls.hpp"
 #include "croc/internal/interpreter.hpp"
 #include "croc/internal/stack.hpp"
+#include "croc/internal/variables.hpp"
 #include "croc/types/base.hpp"
 
 #define BUFFERLENGTH 120
@@ -63,7 +64,7 @@ namespace croc
 				case CrocType_Null:      return croc_pushString(*t, "null");
 				case CrocType_Bool:      return croc_pushString(*t, v.mBool ? "true" : "false");
 				case CrocType_Int:       return PUSHFMT("%" CROC_INTEGER_FORMAT, v.mInt);
-				case CrocType_Float:     return PUSHFMT("%f", v.mFloat);
+				case CrocType_Float:     return croc_pushFormat(*t, "%f", v.mFloat); // can be longer than the buffer
 				case CrocType_String:    return push(t, v);
 				case CrocType_Nativeobj:
 				case CrocType_Weakref:   return PUSHFMT("%s 0x%p", typeToString(v.type), cast(void*)v.mGCObj);
@@ -605,7 +606,7 @@ namespace croc
 		if(key.type == CrocType_Null)
 			croc_eh_throwStd(*t, "TypeError", "Attempting to index-assign a table with a key of type 'null'");
 
-		container->idxa(t->vm->mem, key, value);
+		container->idxa(t->vm, key, value);
 	}
 
 	namespace
@@ -762,6 +763,9 @@ namespace croc
 			case CrocType_Namespace: {
 				auto v = container.mNamespace->get(name);
 
+				if(v == nullptr && loadLazyGlobal(t, container.mNamespace, name))
+					v = container.mNamespace->get(name);
+
 				if(v == nullptr)
 				{
 					toStringImpl(t, container, false);
@@ -838,6 +842,24 @@ namespace croc
 		}
 	}
 
+	// Points the cache at whatever name refers to in i's class. If it's neither a field nor a method, the cache is left
+	// alone (it'll go through opField/opFieldAssign) and this returns false.
+	bool fillFieldCache(Funcdef::FieldCache& cache, Instance* i, String* name)
+	{
+		if(auto n = i->fields->lookupNode(name))
+		{
+			cache.slot = cast(uword)n->value.mInt;
+			cache.method = nullptr;
+		}
+		else if(auto m = i->getMethod(name))
+			cache.method = m;
+		else
+			return false;
+
+		cache.layoutID = i->parent->layoutID;
+		return true;
+	}
+
 	void lenImpl(Thread* t, AbsStack dest, Value src)
 	{
 		switch(src.type)
@@ -1115,7 +1137,10 @@ namespace croc
 
 	void stringConcat(Thread* t, Value first, DArray<Value> vals, uword len, uword cpLen)
 	{
-		auto tmpBuffer = ustring::alloc(t->vm->mem, len);
+		// The buffer would leak if making the string ran into the memory limit, so check for room for both up front.
+		auto &mem = t->vm->mem;
+		mem.checkLimit(len * 2);
+		auto tmpBuffer = ustring::alloc(mem, len);
 		uword i = 0;
 
 		auto add = [&](Value& v)
@@ -1130,8 +1155,10 @@ namespace croc
 		for(auto &v: vals)
 			add(v);
 
+		mem.limitExempt++;
 		vals[vals.length - 1] = Value::from(String::createUnverified(t->vm, tmpBuffer, cpLen));
-		tmpBuffer.free(t->vm->mem);
+		mem.limitExempt--;
+		tmpBuffer.free(mem);
 	}
 
 	void catEqImpl(Thread* t, AbsStack dest, AbsStack firstSlot, uword num)
@@ -22,6 +22,7 @@ namespace croc
 	void sliceaImpl(Thread* t, Value container, Value lo, Value hi, Value value);
 	void fieldImpl(Thread* t, AbsStack dest, Value container, String* name, bool raw);
 	void fieldaImpl(Thread* t, AbsStack container, String* name, Value value, bool raw);
+	bool fillFieldCache(Funcdef::FieldCache& cache, Instance* i, String* name);
 	void lenImpl(Thread* t, AbsStack dest, Value src);
 	void lenaImpl(Thread* t, Value dest, Value len);
 	void catImpl(Thread* t, AbsStack dest, AbsStack firstSlot, uword num);
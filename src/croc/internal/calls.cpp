@@ -9,6 +9,7 @@
 #include "croc/internal/stack.hpp"
 #include "croc/internal/thread.hpp"
 #include "croc/internal/eh.hpp"
+#include "croc/internal/variables.hpp"
 
 namespace croc
 {
@@ -49,6 +50,8 @@ namespace croc
 			case CrocType_Namespace:
 				if(auto ret = v.mNamespace->get(name))
 					return *ret;
+				else if(loadLazyGlobal(t, v.mNamespace, name))
+					return lookupMethod(t, v, name);
 				else
 					return Value::nullValue;
 
@@ -214,6 +217,43 @@ namespace croc
 		assert(t->stackIndex > 0);
 	}
 
+	// A shortcut for saveResults followed by callEpilogue, for when a script function returns and no hooks are set. The
+	// results are copied straight from the stack into place, instead of going through the results array.
+	void scriptReturn(Thread* t, AbsStack firstResult, uword numResults)
+	{
+		assert(t->hooks == 0);
+
+		auto destSlot = t->currentAR->returnSlot;
+		auto expectedResults = t->currentAR->expectedResults;
+
+		popARTo(t, t->arIndex - 1);
+
+		bool isMultRet = expectedResults == -1;
+
+		if(isMultRet)
+			expectedResults = numResults;
+
+		auto stk = t->stack;
+		auto slotAfterRets = destSlot + expectedResults;
+
+		if(cast(uword)expectedResults <= numResults)
+			memmove(&stk[destSlot], &stk[firstResult], expectedResults * sizeof(Value));
+		else
+		{
+			memmove(&stk[destSlot], &stk[firstResult], numResults * sizeof(Value));
+			stk.slice(destSlot + numResults, slotAfterRets).fill(Value::nullValue);
+		}
+
+		t->numYields = numResults;
+
+		if(t->arIndex == 0 || isMultRet || t->currentAR->savedTop < slotAfterRets)
+			t->stackIndex = slotAfterRets;
+		else
+			t->stackIndex = t->currentAR->savedTop;
+
+		assert(t->stackIndex > 0);
+	}
+
 	void saveResults(Thread* t, Thread* from, AbsStack first, uword num)
 	{
 		if(num == 0)
@@ -349,6 +389,37 @@ namespace croc
 		}
 	}
 
+	// A cut-down funcCallPrologue for the common case of a script calling a script function which isn't vararg, with
+	// a known number of parameters which the function can take, when no hooks are set. There's nothing for the
+	// interpreter to do afterwards either: calls don't allocate, so there's no need to poll the GC.
+	void scriptCallPrologue(Thread* t, Function* func, AbsStack slot, word expectedResults, uword numParams)
+	{
+		auto funcdef = func->scriptFunc;
+		assert(!func->isNative && !funcdef->isVararg && numParams <= func->maxParams && t->hooks == 0);
+
+		auto base = slot + 1;
+		auto top = base + funcdef->stackSize;
+		checkStack(t, top - 1);
+
+		auto ar = pushAR(t);
+		ar->base = base;
+		ar->vargBase = base;
+		ar->returnSlot = slot;
+		ar->func = func;
+		ar->pc = funcdef->code.ptr;
+		ar->expectedResults = expectedResults;
+		ar->numTailcalls = 0;
+		ar->firstResult = 0;
+		ar->numResults = 0;
+		ar->savedTop = top;
+		ar->unwindCounter = 0;
+		ar->unwindReturn = nullptr;
+
+		t->stack.slice(base + numParams, top).fill(Value::nullValue);
+		t->stackBase = base;
+		t->stackIndex = top;
+	}
+
 	bool funcCallPrologue(Thread* t, Function* func, AbsStack returnSlot, word expectedResults, AbsStack paramSlot,
 		uword numParams, bool isTailcall)
 	{
@@ -496,9 +567,36 @@ namespace croc
 	}
 
 	bool methodCallPrologue(Thread* t, AbsStack slot, Value self, String* methodName, word numReturns, uword numParams,
-		bool isTailcall)
+		bool isTailcall, Funcdef::MethodCache* cache)
 	{
-		auto method = lookupMethod(t, self, methodName);
+		Value method;
+		Class* cls = nullptr;
+
+		if(cache)
+		{
+			if(self.type == CrocType_Instance)
+				cls = self.mInstance->parent;
+			else if(self.type == CrocType_Class && self.mClass->isFrozen)
+				cls = self.mClass;
+		}
+
+		// The method table of a frozen class only changes shape when its layoutID does, so a method cache can point
+		// right at the method's slot in it.
+		if(cls)
+		{
+			if(cache->layoutID != cls->layoutID)
+			{
+				if(auto m = cls->getMethod(methodName))
+				{
+					cache->layoutID = cls->layoutID;
+					cache->method = m;
+				}
+			}
+
+			method = cache->layoutID == cls->layoutID ? *cache->method : Value::nullValue;
+		}
+		else
+			method = lookupMethod(t, self, methodName);
 
 		// Idea is like this:
 
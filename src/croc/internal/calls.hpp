@@ -18,14 +18,16 @@ namespace croc
 	// void popAR(Thread* t);
 	void popARTo(Thread* t, uword removeTo);
 	void callEpilogue(Thread* t);
+	void scriptReturn(Thread* t, AbsStack firstResult, uword numResults);
 	void saveResults(Thread* t, Thread* from, AbsStack first, uword num);
 	DArray<Value> loadResults(Thread* t);
 	bool callPrologue(Thread* t, AbsStack slot, word expectedResults, uword numParams, bool isTailcall = false);
+	void scriptCallPrologue(Thread* t, Function* func, AbsStack slot, word expectedResults, uword numParams);
 	bool funcCallPrologue(Thread* t, Function* func, AbsStack returnSlot, word expectedResults, AbsStack paramSlot,
 		uword numParams, bool isTailcall = false);
 	uword commonCall(Thread* t, AbsStack slot, word numReturns, bool isScript);
 	bool methodCallPrologue(Thread* t, AbsStack slot, Value self, String* methodName, word numReturns, uword numParams,
-		bool isTailcall = false);
+		bool isTailcall = false, Funcdef::MethodCache* cache = nullptr);
 	bool tryMMDest(Thread* t, Metamethod mm, AbsStack dest, Value src1);
 	bool tryMMDest(Thread* t, Metamethod mm, AbsStack dest, Value src1, Value src2);
 	bool tryMMDest(Thread* t, Metamethod mm, AbsStack dest, Value src1, Value src2, Value src3);
@@ -191,6 +191,10 @@ namespace croc
 		}
 
 		auto vm = t->vm;
+
+		if(vm->mem.limitError == LimitError_Making)
+			vm->mem.limitError = LimitError_Thrown;
+
 		vm->exception = ex.mInstance;
 		auto jumpFrame = vm->currentEH;
 		auto destThread = jumpFrame ? jumpFrame->t : nullptr;
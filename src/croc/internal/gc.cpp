@@ -53,6 +53,52 @@ namespace croc
 
 		t->hooksEnabled = hooksEnabled;
 		t->vm->enableGC();
-		t->vm->toFinalize.reset();
+		t->vm->toFinalize.clear(mem);
+	}
+
+	// Called by the memory manager when an allocation would go over the hard limit, or when the memory function fails.
+	// The GC can't run here, since the native code that's allocating might be holding onto objects that aren't rooted
+	// yet, so the only thing to do is throw. If the GC is in the middle of a cycle, or there's no thread to throw on,
+	// this returns; an allocation over the limit is let through, and a failed one is fatal.
+	void memoryLimitHook(void* ctx, size_t size)
+	{
+		auto vm = cast(VM*)ctx;
+
+		if(vm->inGCCycle || vm->curThread == nullptr)
+			return;
+
+		throwMemoryError(vm->curThread, size);
+	}
+
+	// Throws a MemoryError. size is how much was being allocated, or 0 if nothing was. The limit is lifted until the
+	// first safe point after the exception is caught (see croc_gc_maybeCollect).
+	void throwMemoryError(Thread* t, size_t size)
+	{
+		auto &mem = t->vm->mem;
+
+		if(mem.limitError == LimitError_None)
+			mem.limitExempt++;
+
+		mem.limitError = LimitError_Making;
+
+		if(size != 0 && (mem.hardLimit == 0 || mem.totalBytes + size <= mem.hardLimit))
+		{
+			croc_eh_throwStd(*t, "MemoryError",
+				"Out of memory: could not allocate %" CROC_SIZE_T_FORMAT " bytes (%" CROC_SIZE_T_FORMAT
+				" are allocated)", size, mem.totalBytes);
+		}
+		else if(size == 0)
+		{
+			croc_eh_throwStd(*t, "MemoryError",
+				"Out of memory: %" CROC_SIZE_T_FORMAT " bytes are allocated, but the limit is %" CROC_SIZE_T_FORMAT,
+				mem.totalBytes, mem.hardLimit);
+		}
+		else
+		{
+			croc_eh_throwStd(*t, "MemoryError",
+				"Out of memory: allocating %" CROC_SIZE_T_FORMAT " bytes would go over the limit of %"
+				CROC_SIZE_T_FORMAT " (%" CROC_SIZE_T_FORMAT " are allocated)",
+				size, mem.hardLimit, mem.totalBytes);
+		}
 	}
 }
\ No newline at end of file
@@ -6,6 +6,8 @@
 namespace croc
 {
 	void runFinalizers(Thread* t);
+	void memoryLimitHook(void* ctx, size_t size);
+	void throwMemoryError(Thread* t, size_t size);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,352 @@
+#ifndef CROC_INTERNAL_IMAGE_HPP
+#define CROC_INTERNAL_IMAGE_HPP
+
+#include <functional>
+#include <string.h>
+
+#include "croc/api.h"
+#include "croc/base/opcodes.hpp"
+#include "croc/types/base.hpp"
+
+// Pieces shared by the binary images of Croc objects: the stdlib's bytecode (croc/stdlib/helpers/bytecode.cpp) and VM
+// snapshots (croc/internal/snapshot.cpp). Numbers other than floats are LEB128 varints (zigzagged if signed), and
+// instructions are stored as-is, so an image is only readable by a library built from the same source with the same
+// options as the one that wrote it.
+
+namespace croc
+{
+	// Changes whenever the instruction set or the shape of the compiler's output does, as far as we can tell.
+	inline uword imageBuildSignature()
+	{
+#ifdef CROC_BUILTIN_DOCS
+		return (Op_NUM_OPCODES << 1) | 1;
+#else
+		return Op_NUM_OPCODES << 1;
+#endif
+	}
+
+	struct ImageWriter
+	{
+		std::function<void(crocstr)> output;
+		bool collecting; // if set, nothing is output; used by writers that walk their input once before writing it
+
+		explicit ImageWriter(std::function<void(crocstr)> output) :
+			output(output),
+			collecting(false)
+		{}
+
+		void writeBlock(crocstr data)
+		{
+			if(!collecting)
+				output(data);
+		}
+
+		void writeByte(uint8_t b)
+		{
+			writeBlock(crocstr::n(&b, 1));
+		}
+
+		void writeVarint(uint64_t v)
+		{
+			uint8_t buf[10];
+			uword len = 0;
+
+			do
+			{
+				buf[len] = v & 0x7F;
+				v >>= 7;
+
+				if(v != 0)
+					buf[len] |= 0x80;
+
+				len++;
+			} while(v != 0);
+
+			writeBlock(crocstr::n(buf, len));
+		}
+
+		void writeLength(uword v)
+		{
+			writeVarint(v);
+		}
+
+		void writeInt(crocint v)
+		{
+			writeVarint((cast(uint64_t)v << 1) ^ cast(uint64_t)(v >> 63));
+		}
+
+		void writeFloat(crocfloat v)
+		{
+			writeBlock(crocstr::n(cast(const uint8_t*)&v, sizeof(crocfloat)));
+		}
+	};
+
+	// This only checks enough to keep from reading out of bounds. Images are meant to be read by the library that wrote
+	// them, so the objects in them aren't checked for sanity.
+	struct ImageReader
+	{
+		Thread* t;
+		const uint8_t* pos;
+		const uint8_t* end;
+
+		ImageReader(Thread* t, crocstr data) :
+			t(t),
+			pos(data.ptr),
+			end(data.ptr + data.length)
+		{}
+
+		void malformed()
+		{
+			croc_eh_throwStd(*t, "ValueError", "Malformed image");
+		}
+
+		// Checks the magic bytes, version, and build signature.
+		bool readHeader(crocstr magic, uword version)
+		{
+			if(cast(uword)(end - pos) < magic.length || memcmp(pos, magic.ptr, magic.length) != 0)
+				return false;
+
+			pos += magic.length;
+			return readLength() == version && readLength() == imageBuildSignature();
+		}
+
+		uint8_t readByte()
+		{
+			if(pos == end)
+				malformed();
+
+			return *pos++;
+		}
+
+		crocstr readBlock(uword len)
+		{
+			if(len > cast(uword)(end - pos))
+				malformed();
+
+			auto ret = crocstr::n(pos, len);
+			pos += len;
+			return ret;
+		}
+
+		uint64_t readVarint()
+		{
+			uint64_t ret = 0;
+
+			for(uword shift = 0; shift < 64; shift += 7)
+			{
+				auto b = readByte();
+				ret |= cast(uint64_t)(b & 0x7F) << shift;
+
+				if(!(b & 0x80))
+					return ret;
+			}
+
+			malformed();
+			return 0;
+		}
+
+		uword readLength()
+		{
+			auto ret = readVarint();
+
+			if(ret != cast(uword)ret)
+				malformed();
+
+			return cast(uword)ret;
+		}
+
+		// A length of a list of things which each take at least one byte.
+		uword readCount()
+		{
+			auto ret = readLength();
+
+			if(ret > cast(uword)(end - pos))
+				malformed();
+
+			return ret;
+		}
+
+		crocint readInt()
+		{
+			auto v = readVarint();
+			return cast(crocint)((v >> 1) ^ (~(v & 1) + 1));
+		}
+
+		crocfloat readFloat()
+		{
+			crocfloat ret;
+			memcpy(&ret, readBlock(sizeof(crocfloat)).ptr, sizeof(crocfloat));
+			return ret;
+		}
+	};
+
+	// Writes everything about a funcdef except its environment and cached function. W is an ImageWriter with
+	// writeString(String*), writeConstant(Value), and writeInnerFunc(Funcdef*) methods.
+	template<typename W>
+	void writeFuncdefBody(W& w, Funcdef* def)
+	{
+		w.writeString(def->locFile);
+		w.writeInt(def->locLine);
+		w.writeInt(def->locCol);
+		w.writeByte(cast(uint8_t)def->isVararg);
+		w.writeByte(cast(uint8_t)def->isVarret);
+		w.writeString(def->name);
+		w.writeLength(def->numParams);
+		w.writeLength(def->paramMasks.length);
+
+		for(auto mask: def->paramMasks)
+			w.writeLength(mask);
+
+		w.writeLength(def->numReturns);
+		w.writeLength(def->returnMasks.length);
+
+		for(auto mask: def->returnMasks)
+			w.writeLength(mask);
+
+		w.writeLength(def->upvals.length);
+
+		for(auto &uv: def->upvals)
+		{
+			w.writeByte(cast(uint8_t)uv.isUpval);
+			w.writeLength(uv.index);
+		}
+
+		w.writeLength(def->stackSize);
+		w.writeLength(def->innerFuncs.length);
+
+		for(auto func: def->innerFuncs)
+			w.writeInnerFunc(func);
+
+		w.writeLength(def->constants.length);
+
+		for(auto &val: def->constants)
+			w.writeConstant(val);
+
+		w.writeLength(def->code.length);
+		w.writeBlock(crocstr::n(cast(const uint8_t*)def->code.ptr, def->code.length * sizeof(Instruction)));
+		w.writeLength(def->fieldCaches.length);
+		w.writeLength(def->methodCaches.length);
+		w.writeLength(def->switchTables.length);
+
+		for(auto &st: def->switchTables)
+		{
+			w.writeLength(st.offsets.length());
+
+			for(auto node: st.offsets)
+			{
+				w.writeConstant(node->key);
+				w.writeInt(node->value);
+			}
+
+			w.writeInt(st.defaultOffset);
+		}
+
+		w.writeLength(def->lineInfo.length);
+
+		for(auto line: def->lineInfo)
+			w.writeLength(line);
+
+		w.writeLength(def->upvalNames.length);
+
+		for(auto name: def->upvalNames)
+			w.writeString(name);
+
+		w.writeLength(def->locVarDescs.length);
+
+		for(auto &desc: def->locVarDescs)
+		{
+			w.writeString(desc.name);
+			w.writeLength(desc.pcStart);
+			w.writeLength(desc.pcEnd);
+			w.writeLength(desc.reg);
+		}
+	}
+
+	// The inverse of writeFuncdefBody, filling in a funcdef made with Funcdef::create. R is an ImageReader with
+	// readString(), readConstant(), and readInnerFunc() methods. Nothing in here may be a GC safe point, since def
+	// doesn't have to be reachable from anything while it's being filled in (the compiler does the same).
+	template<typename R>
+	void readFuncdefBody(R& r, Memory& mem, Funcdef* def)
+	{
+		def->locFile = r.readString();
+		def->locLine = cast(word)r.readInt();
+		def->locCol = cast(word)r.readInt();
+		def->isVararg = r.readByte() != 0;
+		def->isVarret = r.readByte() != 0;
+		def->name = r.readString();
+		def->numParams = r.readLength();
+		def->paramMasks.resize(mem, r.readCount());
+
+		for(auto &mask: def->paramMasks)
+			mask = r.readLength();
+
+		def->numReturns = r.readLength();
+		def->returnMasks.resize(mem, r.readCount());
+
+		for(auto &mask: def->returnMasks)
+			mask = r.readLength();
+
+		def->upvals.resize(mem, r.readCount());
+
+		for(auto &uv: def->upvals)
+		{
+			uv.isUpval = r.readByte() != 0;
+			uv.index = r.readLength();
+		}
+
+		def->stackSize = r.readLength();
+		def->innerFuncs.resize(mem, r.readCount());
+
+		for(auto &func: def->innerFuncs)
+			func = r.readInnerFunc();
+
+		def->constants.resize(mem, r.readCount());
+		def->globalCaches.resize(mem, def->constants.length);
+
+		for(auto &val: def->constants)
+			val = r.readConstant();
+
+		def->code.resize(mem, r.readCount());
+		auto code = r.readBlock(def->code.length * sizeof(Instruction));
+		memcpy(def->code.ptr, code.ptr, code.length);
+		def->fieldCaches.resize(mem, r.readLength());
+		def->methodCaches.resize(mem, r.readLength());
+		def->switchTables.resize(mem, r.readCount());
+
+		for(auto &st: def->switchTables)
+		{
+			auto numOffsets = r.readCount();
+
+			for(uword i = 0; i < numOffsets; i++)
+			{
+				auto key = r.readConstant();
+				*st.offsets.insert(mem, key) = cast(word)r.readInt();
+			}
+
+			st.defaultOffset = cast(word)r.readInt();
+			st.buildIntCases(mem);
+		}
+
+		def->lineInfo.resize(mem, r.readCount());
+
+		for(auto &line: def->lineInfo)
+			line = r.readLength();
+
+		def->upvalNames.resize(mem, r.readCount());
+
+		for(auto &name: def->upvalNames)
+			name = r.readString();
+
+		def->locVarDescs.resize(mem, r.readCount());
+
+		for(auto &desc: def->locVarDescs)
+		{
+			desc.name = r.readString();
+			desc.pcStart = r.readLength();
+			desc.pcEnd = r.readLength();
+			desc.reg = r.readLength();
+		}
+	}
+}
+
+#endif
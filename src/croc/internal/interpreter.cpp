@@ -10,6 +10,7 @@
 #include "croc/internal/debug.hpp"
 #include "croc/internal/eh.hpp"
 #include "croc/internal/interpreter.hpp"
+#include "croc/internal/jit.hpp"
 #include "croc/internal/stack.hpp"
 #include "croc/internal/thread.hpp"
 #include "croc/internal/variables.hpp"
@@ -31,9 +32,163 @@
 			RT = &t->stack[stackBase + (*pc)->uimm]; (*pc)++;\
 	} while(false)
 
+// The slow path can import a lazily-loaded module, which can move the activation records (and the stack).
+#define GetGlobalRD(idx)\
+	do {\
+		auto _name = constTable[(idx)].mString;\
+		if(auto _node = getGlobalNode(_name, env, globalCaches[(idx)]))\
+			t->stack[stackBase + rd] = _node->value;\
+		else\
+		{\
+			auto _val = getGlobalImpl(t, _name, env);\
+			pc = &t->currentAR->pc;\
+			t->stack[stackBase + rd] = _val;\
+		}\
+	} while(false)
+
 #define GetUImm() (((*pc)++)->uimm)
 #define GetImm() (((*pc)++)->imm)
 
+// Dispatch. When built with GCC, every handler ends by decoding the next instruction and jumping straight to its handler
+// through a table of label addresses (threaded code), rather than going back around a loop to one big switch. Define
+// CROC_NO_COMPUTED_GOTO to get the portable switch-based loop instead.
+#if defined(__GNUC__) && !defined(CROC_NO_COMPUTED_GOTO)
+#define CROC_COMPUTED_GOTO
+#endif
+
+#ifdef CROC_OPCODE_PAIR_STATS
+#define CountPair()\
+	do {\
+		t->vm->opPairCounts[t->vm->lastOpcode][opcode]++;\
+		t->vm->lastOpcode = opcode;\
+	} while(false)
+#else
+#define CountPair() do {} while(false)
+#endif
+
+#define Fetch()\
+	do {\
+		auto _i = (*pc)++;\
+		opcode = cast(Op)INST_GET_OPCODE(*_i);\
+		rd = INST_GET_RD(*_i);\
+		CountPair();\
+	} while(false)
+
+#ifdef CROC_COMPUTED_GOTO
+#define Case(x) _op_ ## x:
+#define Next()\
+	do {\
+		Fetch();\
+		assert(opcode < Op_NUM_OPCODES);\
+		goto *dispatch[opcode];\
+	} while(false)
+#define SetDispatch() dispatch = hooked ? hookTable : opTable
+#define FallThrough() do {} while(false)
+#else
+#define Case(x) case Op_ ## x:
+#define Next() break
+#define SetDispatch() do {} while(false)
+#if defined(__GNUC__) && __GNUC__ >= 7
+#define FallThrough() __attribute__((fallthrough))
+#else
+#define FallThrough() do {} while(false)
+#endif
+#endif
+
+// Halting and instruction hooks are only checked for at safepoints: on (re)entry, which happens on every call and return,
+// and on backward jumps. While hooks are enabled, each instruction goes through the hook code as well.
+#define Safepoint()\
+	do {\
+		if(t->shouldHalt)\
+			croc_eh_throwStd(*t, "HaltException", "Thread halted");\
+\
+		hooked = t->hooksEnabled && t->hooks;\
+		SetDispatch();\
+	} while(false)
+
+// With the JIT, safepoints are also where native code gets entered, once the function is hot enough. When native code
+// returns, there's another safepoint since it stops at backward jumps if the thread should halt or hooks were enabled.
+#ifdef CROC_JIT
+#define JitEnter()\
+	do {\
+		if(!hooked)\
+		{\
+			auto _fd = t->currentAR->func->scriptFunc;\
+\
+			if(_fd->jitCode == nullptr && ++_fd->hotness == CROC_JIT_THRESHOLD)\
+				jitCompile(t, _fd);\
+\
+			if(jitCanEnter(_fd, *pc))\
+			{\
+				*pc = jitRun(t, _fd, *pc, &t->stack[stackBase]);\
+				Safepoint();\
+			}\
+		}\
+	} while(false)
+#else
+#define JitEnter() do {} while(false)
+#endif
+
+#define Jump(offs)\
+	do {\
+		auto _offs = (offs);\
+		(*pc) += _offs;\
+\
+		if(_offs < 0)\
+		{\
+			Safepoint();\
+			JitEnter();\
+		}\
+	} while(false)
+
+// A superinstruction is the first instruction of a fused pair; the second is still in the code stream as-is. Once the
+// first half is done, this skips over the second instruction's first short so the second half can be run in place.
+// While hooked, the second instruction is dispatched on its own instead, so that delay counts and line hooks don't
+// depend on whether the pair was fused. (Not wrapped in do/while, since Next() is a 'break' in switch mode.)
+#define SkipFused(x)\
+	if(hooked)\
+		Next();\
+	else do {\
+		auto _i = (*pc)++;\
+		assert(INST_GET_OPCODE(*_i) == Op_ ## x);\
+		opcode = Op_ ## x;\
+		rd = INST_GET_RD(*_i);\
+	} while(false)
+
+// Quickened arithmetic. If the operands are not both of type 'ty', the instruction is de-quickened back to the generic
+// opcode 'gen' and the generic operation is done instead.
+#define QuickBinOp(ty, member, op, gen)\
+	do {\
+		auto _inst = *pc - 1;\
+		GetRS();\
+		GetRT();\
+\
+		if(RS->type != ty || RT->type != ty)\
+		{\
+			INST_SET_OPCODE(*_inst, Op_ ## gen);\
+			binOpImpl(t, Op_ ## gen, stackBase + rd, *RS, *RT);\
+		}\
+		else\
+			t->stack[stackBase + rd] = Value::from(RS->member op RT->member);\
+	} while(false);\
+	Next()
+
+#define QuickReflBinOp(ty, member, op, gen)\
+	do {\
+		auto _inst = *pc - 1;\
+		GetRS();\
+		auto &_dest = t->stack[stackBase + rd];\
+\
+		if(_dest.type != ty || RS->type != ty)\
+		{\
+			INST_SET_OPCODE(*_inst, Op_ ## gen);\
+			reflBinOpImpl(t, Op_ ## gen, stackBase + rd, *RS);\
+		}\
+		else\
+			_dest.member op RS->member;\
+	} while(false);\
+	Next()
+
 #define AdjustParams()\
 	do {\
 		if(numParams == 0)\
@@ -49,6 +204,38 @@ namespace croc
 {
 	namespace
 	{
+		// Gives the quickened version of a generic arithmetic instruction for the given operand types, or
+		// Op_NUM_OPCODES if there isn't one. See the instruction format comment in opcodes.hpp.
+		Op quickenedOpcode(Op operation, CrocType a, CrocType b)
+		{
+			if(a == CrocType_Int && b == CrocType_Int)
+			{
+				switch(operation)
+				{
+					case Op_Add:   return Op_AddII;
+					case Op_Sub:   return Op_SubII;
+					case Op_Mul:   return Op_MulII;
+					case Op_AddEq: return Op_AddEqII;
+					case Op_SubEq: return Op_SubEqII;
+					default:       break;
+				}
+			}
+			else if(a == CrocType_Float && b == CrocType_Float)
+			{
+				switch(operation)
+				{
+					case Op_Add:   return Op_AddFF;
+					case Op_Sub:   return Op_SubFF;
+					case Op_Mul:   return Op_MulFF;
+					case Op_AddEq: return Op_AddEqFF;
+					case Op_SubEq: return Op_SubEqFF;
+					default:       break;
+				}
+			}
+
+			return Op_NUM_OPCODES;
+		}
+
 		void binOpImpl(Thread* t, Op operation, AbsStack dest, Value RS, Value RT)
 		{
 			crocfloat f1;
@@ -305,6 +492,36 @@ namespace croc
 			croc_eh_throwStd(*t, "TypeError", "Attempting to bitwise %s-assign a '%s' and a '%s'",
 				name, croc_getString(*t, -2), croc_getString(*t, -1));
 		}
+
+		void instructionHooks(Thread* t, Instruction* oldPC)
+		{
+			if(t->hooks & CrocThreadHook_Delay)
+			{
+				assert(t->hookCounter > 0);
+				t->hookCounter--;
+
+				if(t->hookCounter == 0)
+				{
+					t->hookCounter = t->hookDelay;
+					callHook(t, CrocThreadHook_Delay);
+				}
+			}
+
+			if(t->hooks & CrocThreadHook_Line)
+			{
+				auto curPC = t->currentAR->pc - 1;
+
+				// when oldPC is null, it means we've either just started executing this func,
+				// or we've come back from a yield, or we've just caught an exception, or something
+				// like that.
+				// When curPC < oldPC, we've jumped back, like to the beginning of a loop.
+
+				if(curPC == t->currentAR->func->scriptFunc->code.ptr ||
+					curPC < oldPC ||
+					pcToLine(t->currentAR, curPC) != pcToLine(t->currentAR, oldPC))
+					callHook(t, CrocThreadHook_Line);
+			}
+		}
 	}
 
 	void execute(Thread* t, uword startARIndex)
@@ -327,89 +544,124 @@ namespace croc
 		assert(!t->currentAR->func->isNative);
 		auto stackBase = t->stackBase;
 		auto constTable = t->currentAR->func->scriptFunc->constants;
+		auto globalCaches = t->currentAR->func->scriptFunc->globalCaches;
 		auto env = t->currentAR->func->environment;
 		auto upvals = t->currentAR->func->scriptUpvals();
 		auto pc = &t->currentAR->pc;
 		Instruction* oldPC = nullptr;
+		Op opcode;
+		int rd;
+		bool hooked;
+#ifdef CROC_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define LABEL_ADDR(x) &&_op_ ## x
+#define HOOK_ADDR(x) &&_hookedDispatch
+		static const void* const opTable[INST_OPCODE_MAX + 1] = { INSTRUCTION_LIST(LABEL_ADDR) };
+		static const void* const hookTable[INST_OPCODE_MAX + 1] = { INSTRUCTION_LIST(HOOK_ADDR) };
+#undef LABEL_ADDR
+#undef HOOK_ADDR
+		const void* const* dispatch;
+#endif
+		Safepoint();
+		JitEnter();
+
+#ifdef CROC_COMPUTED_GOTO
+		Next();
 
-		while(true)
 		{
-			if(t->shouldHalt)
-				croc_eh_throwStd(*t, "HaltException", "Thread halted");
-
-			// assert(pc == &t->currentAR->pc);
-			// pc = &t->currentAR->pc;
-			Instruction* i = (*pc)++;
-
+		_hookedDispatch:
 			if(t->hooksEnabled && t->hooks)
 			{
-				if(t->hooks & CrocThreadHook_Delay)
-				{
-					assert(t->hookCounter > 0);
-					t->hookCounter--;
+				instructionHooks(t, oldPC);
+				oldPC = *pc;
+			}
+			else
+				Safepoint();
 
-					if(t->hookCounter == 0)
-					{
-						t->hookCounter = t->hookDelay;
-						callHook(t, CrocThreadHook_Delay);
-					}
-				}
+			goto *opTable[opcode];
+#else
+		while(true)
+		{
+			Fetch();
 
-				if(t->hooks & CrocThreadHook_Line)
+			if(hooked)
+			{
+				if(t->hooksEnabled && t->hooks)
 				{
-					auto curPC = t->currentAR->pc - 1;
-
-					// when oldPC is null, it means we've either just started executing this func,
-					// or we've come back from a yield, or we've just caught an exception, or something
-					// like that.
-					// When curPC < oldPC, we've jumped back, like to the beginning of a loop.
-
-					if(curPC == t->currentAR->func->scriptFunc->code.ptr ||
-						curPC < oldPC ||
-						pcToLine(t->currentAR, curPC) != pcToLine(t->currentAR, oldPC))
-						callHook(t, CrocThreadHook_Line);
+					instructionHooks(t, oldPC);
+					oldPC = *pc;
 				}
+				else
+					Safepoint();
 			}
 
-			oldPC = *pc;
-
-			auto opcode = cast(Op)INST_GET_OPCODE(*i);
-			auto rd = INST_GET_RD(*i);
-
 			switch(opcode)
 			{
+#endif
 				// Binary Arithmetic
-				case Op_Add:
-				case Op_Sub:
-				case Op_Mul:
-				case Op_Div:
-				case Op_Mod: GetRS(); GetRT(); binOpImpl(t, opcode, stackBase + rd, *RS, *RT); break;
+				Case(Add)
+				Case(Sub)
+				Case(Mul)
+				Case(Div)
+				Case(Mod) {
+					auto inst = *pc - 1;
+					GetRS();
+					GetRT();
+					auto quick = quickenedOpcode(opcode, RS->type, RT->type);
+					binOpImpl(t, opcode, stackBase + rd, *RS, *RT);
+
+					if(quick != Op_NUM_OPCODES)
+						INST_SET_OPCODE(*inst, quick);
+
+					Next();
+				}
+				Case(AddII) QuickBinOp(CrocType_Int, mInt, +, Add);
+				Case(SubII) QuickBinOp(CrocType_Int, mInt, -, Sub);
+				Case(MulII) QuickBinOp(CrocType_Int, mInt, *, Mul);
+				Case(AddFF) QuickBinOp(CrocType_Float, mFloat, +, Add);
+				Case(SubFF) QuickBinOp(CrocType_Float, mFloat, -, Sub);
+				Case(MulFF) QuickBinOp(CrocType_Float, mFloat, *, Mul);
 
 				// Reflexive Arithmetic
-				case Op_AddEq:
-				case Op_SubEq:
-				case Op_MulEq:
-				case Op_DivEq:
-				case Op_ModEq: GetRS(); reflBinOpImpl(t, opcode, stackBase + rd, *RS); break;
+				Case(AddEq)
+				Case(SubEq)
+				Case(MulEq)
+				Case(DivEq)
+				Case(ModEq) {
+					auto inst = *pc - 1;
+					GetRS();
+					auto quick = quickenedOpcode(opcode, t->stack[stackBase + rd].type, RS->type);
+					reflBinOpImpl(t, opcode, stackBase + rd, *RS);
+
+					if(quick != Op_NUM_OPCODES)
+						INST_SET_OPCODE(*inst, quick);
+
+					Next();
+				}
+				Case(AddEqII) QuickReflBinOp(CrocType_Int, mInt, +=, AddEq);
+				Case(SubEqII) QuickReflBinOp(CrocType_Int, mInt, -=, SubEq);
+				Case(AddEqFF) QuickReflBinOp(CrocType_Float, mFloat, +=, AddEq);
+				Case(SubEqFF) QuickReflBinOp(CrocType_Float, mFloat, -=, SubEq);
 
 				// Binary Bitwise
-				case Op_And:
-				case Op_Or:
-				case Op_Xor:
-				case Op_Shl:
-				case Op_Shr:
-				case Op_UShr: GetRS(); GetRT(); binaryBinOpImpl(t, opcode, stackBase + rd, *RS, *RT); break;
+				Case(And)
+				Case(Or)
+				Case(Xor)
+				Case(Shl)
+				Case(Shr)
+				Case(UShr) GetRS(); GetRT(); binaryBinOpImpl(t, opcode, stackBase + rd, *RS, *RT); Next();
 
 				// Reflexive Bitwise
-				case Op_AndEq:
-				case Op_OrEq:
-				case Op_XorEq:
-				case Op_ShlEq:
-				case Op_ShrEq:
-				case Op_UShrEq: GetRS(); reflBinaryBinOpImpl(t, opcode, stackBase + rd, *RS); break;
+				Case(AndEq)
+				Case(OrEq)
+				Case(XorEq)
+				Case(ShlEq)
+				Case(ShrEq)
+				Case(UShrEq) GetRS(); reflBinaryBinOpImpl(t, opcode, stackBase + rd, *RS); Next();
 
 				// Unary ops
-				case Op_Neg:
+				Case(Neg)
 					GetRS();
 
 					if(RS->type == CrocType_Int)
@@ -421,9 +673,9 @@ namespace croc
 						pushTypeStringImpl(t, *RS);
 						croc_eh_throwStd(*t, "TypeError", "Cannot perform negation on a '%s'", croc_getString(*t, -1));
 					}
-					break;
+					Next();
 
-				case Op_Com:
+				Case(Com)
 					GetRS();
 
 					if(RS->type == CrocType_Int)
@@ -434,14 +686,14 @@ namespace croc
 						croc_eh_throwStd(*t, "TypeError", "Cannot perform bitwise complement on a '%s'",
 							croc_getString(*t, -1));
 					}
-					break;
+					Next();
 
-				case Op_AsBool:
+				Case(AsBool)
 					GetRS();
 					t->stack[stackBase + rd] = Value::from(!RS->isFalse());
-					break;
+					Next();
 
-				case Op_AsInt:
+				Case(AsInt)
 					GetRS();
 
 					switch(RS->type)
@@ -454,9 +706,9 @@ namespace croc
 							pushTypeStringImpl(t, *RS);
 							croc_eh_throwStd(*t, "TypeError", "Cannot convert type '%s' to int", croc_getString(*t, -1));
 					}
-					break;
+					Next();
 
-				case Op_AsFloat:
+				Case(AsFloat)
 					GetRS();
 
 					switch(RS->type)
@@ -468,17 +720,17 @@ namespace croc
 							pushTypeStringImpl(t, *RS);
 							croc_eh_throwStd(*t, "TypeError", "Cannot convert type '%s' to float", croc_getString(*t, -1));
 					}
-					break;
+					Next();
 
-				case Op_AsString:
+				Case(AsString)
 					GetRS();
 					toStringImpl(t, *RS, false);
 					t->stack[stackBase + rd] = t->stack[t->stackIndex - 1];
 					t->stackIndex--;
-					break;
+					Next();
 
 				// Crements
-				case Op_Inc: {
+				Case(Inc) {
 					auto dest = stackBase + rd;
 
 					if(t->stack[dest].type == CrocType_Int)
@@ -490,9 +742,9 @@ namespace croc
 						pushTypeStringImpl(t, t->stack[dest]);
 						croc_eh_throwStd(*t, "TypeError", "Cannot increment a '%s'", croc_getString(*t, -1));
 					}
-					break;
+					Next();
 				}
-				case Op_Dec: {
+				Case(Dec) {
 					auto dest = stackBase + rd;
 
 					if(t->stack[dest].type == CrocType_Int)
@@ -504,46 +756,70 @@ namespace croc
 						pushTypeStringImpl(t, t->stack[dest]);
 						croc_eh_throwStd(*t, "TypeError", "Cannot decrement a '%s'", croc_getString(*t, -1));
 					}
-					break;
+					Next();
 				}
 				// Data Transfer
-				case Op_Move:
+				Case(MoveMove)
+					GetRS();
+					t->stack[stackBase + rd] = *RS;
+					SkipFused(Move);
+					FallThrough();
+				Case(Move)
 					GetRS();
 					t->stack[stackBase + rd] = *RS;
-					break;
+					Next();
 
-				case Op_NewGlobal:
-					newGlobalImpl(t, constTable[GetUImm()].mString, env, t->stack[stackBase + rd]);
-					break;
+				Case(GetUpvalMove)
+					t->stack[stackBase + rd] = *upvals[GetUImm()]->value;
+					SkipFused(Move);
+					GetRS();
+					t->stack[stackBase + rd] = *RS;
+					Next();
+
+				Case(GetGlobalMove) {
+					auto idx = GetUImm();
+					GetGlobalRD(idx);
+					SkipFused(Move);
+					GetRS();
+					t->stack[stackBase + rd] = *RS;
+					Next();
+				}
 
-				case Op_GetGlobal:
-					t->stack[stackBase + rd] = getGlobalImpl(t, constTable[GetUImm()].mString, env);
-					break;
+				Case(NewGlobal)
+					newGlobalImpl(t, constTable[GetUImm()].mString, env, t->stack[stackBase + rd]);
+					Next();
 
-				case Op_SetGlobal:
-					setGlobalImpl(t, constTable[GetUImm()].mString, env, t->stack[stackBase + rd]);
-					break;
+				Case(GetGlobal) {
+					auto idx = GetUImm();
+					GetGlobalRD(idx);
+					Next();
+				}
+				Case(SetGlobal) {
+					auto idx = GetUImm();
+					setGlobalImpl(t, constTable[idx].mString, env, globalCaches[idx], t->stack[stackBase + rd]);
+					Next();
+				}
 
-				case Op_GetUpval:  t->stack[stackBase + rd] = *upvals[GetUImm()]->value; break;
-				case Op_SetUpval: {
+				Case(GetUpval)  t->stack[stackBase + rd] = *upvals[GetUImm()]->value; Next();
+				Case(SetUpval) {
 					auto uv = upvals[GetUImm()];
 					WRITE_BARRIER(t->vm->mem, uv);
 					*uv->value = t->stack[stackBase + rd];
-					break;
+					Next();
 				}
 				// Logical and Control Flow
-				case Op_Not:
+				Case(Not)
 					GetRS();
 					t->stack[stackBase + rd] = Value::from(RS->isFalse());
-					break;
+					Next();
 
-				case Op_Cmp3:
+				Case(Cmp3)
 					GetRS();
 					GetRT();
 					t->stack[stackBase + rd] = Value::from(cmpImpl(t, *RS, *RT));
-					break;
+					Next();
 
-				case Op_Cmp: {
+				Case(Cmp) {
 					GetRS();
 					GetRT();
 					auto jump = GetImm();
@@ -552,70 +828,75 @@ namespace croc
 
 					switch(cast(Comparison)rd)
 					{
-						case Comparison_LT: if(cmpValue < 0) (*pc) += jump; break;
-						case Comparison_LE: if(cmpValue <= 0) (*pc) += jump; break;
-						case Comparison_GT: if(cmpValue > 0) (*pc) += jump; break;
-						case Comparison_GE: if(cmpValue >= 0) (*pc) += jump; break;
+						case Comparison_LT: if(cmpValue < 0) Jump(jump); break;
+						case Comparison_LE: if(cmpValue <= 0) Jump(jump); break;
+						case Comparison_GT: if(cmpValue > 0) Jump(jump); break;
+						case Comparison_GE: if(cmpValue >= 0) Jump(jump); break;
 						default: assert(false);
 					}
-					break;
+					Next();
 				}
-				case Op_SwitchCmp: {
+				Case(SwitchCmp) {
 					GetRS();
 					GetRT();
 					auto jump = GetImm();
 
 					if(switchCmpImpl(t, *RS, *RT))
-						(*pc) += jump;
-					break;
+						Jump(jump);
+					Next();
 				}
-				case Op_Equals: {
+				Case(Equals) {
 					GetRS();
 					GetRT();
 					auto jump = GetImm();
 
 					if(equalsImpl(t, *RS, *RT) == cast(bool)rd)
-						(*pc) += jump;
-					break;
+						Jump(jump);
+					Next();
 				}
-				case Op_Is: {
+				Case(Is) {
 					GetRS();
 					GetRT();
 					auto jump = GetImm();
 
 					if((*RS == *RT) == cast(bool)rd)
-						(*pc) += jump;
+						Jump(jump);
 
-					break;
+					Next();
 				}
-				case Op_In: {
+				Case(In) {
 					GetRS();
 					GetRT();
 					auto jump = GetImm();
 
 					if(inImpl(t, *RS, *RT) == cast(bool)rd)
-						(*pc) += jump;
-					break;
+						Jump(jump);
+					Next();
 				}
-				case Op_IsTrue: {
+				Case(NotIsTrue)
+					GetRS();
+					t->stack[stackBase + rd] = Value::from(RS->isFalse());
+					SkipFused(IsTrue);
+					FallThrough();
+				Case(IsTrue) {
 					GetRS();
 					auto jump = GetImm();
 
 					if(RS->isFalse() != cast(bool)rd)
-						(*pc) += jump;
+						Jump(jump);
 
-					break;
+					Next();
 				}
-				case Op_Jmp: {
+				Case(Jmp) {
 					// If we ever change the format of this opcode, check that it's the same length as Switch (codegen
 					// can turn Switch into Jmp)!
 					auto jump = GetImm();
 
 					if(rd != 0)
-						(*pc) += jump;
-					break;
+						Jump(jump);
+					Next();
 				}
-				case Op_Switch: {
+				Case(Switch) {
 					// If we ever change the format of this opcode, check that it's the same length as Jmp (codegen can
 					// turn Switch into Jmp)!
 					auto st = &t->currentAR->func->scriptFunc->switchTables[rd];
@@ -630,11 +911,65 @@ namespace croc
 
 						(*pc) += st->defaultOffset;
 					}
-					break;
+					Next();
+				}
+				Case(SwitchDense) {
+					auto st = &t->currentAR->func->scriptFunc->switchTables[rd];
+					GetRS();
+					auto offs = st->defaultOffset;
+
+					if(RS->type == CrocType_Int)
+					{
+						// Unsigned, so values below denseMin wrap around and fail the bounds check.
+						auto idx = cast(uint64_t)RS->mInt - cast(uint64_t)st->denseMin;
+
+						if(idx < st->denseOffsets.length)
+							offs = st->denseOffsets[cast(uword)idx];
+					}
+
+					if(offs == -1)
+						croc_eh_throwStd(*t, "SwitchError", "Switch without default");
+
+					(*pc) += offs;
+					Next();
 				}
-				case Op_Close: closeUpvals(t, stackBase + rd); break;
+				Case(SwitchSorted) {
+					auto st = &t->currentAR->func->scriptFunc->switchTables[rd];
+					GetRS();
+					auto offs = st->defaultOffset;
 
-				case Op_For: {
+					if(RS->type == CrocType_Int)
+					{
+						auto val = RS->mInt;
+						uword lo = 0;
+						uword hi = st->sortedCases.length;
+
+						while(lo < hi)
+						{
+							auto mid = lo + (hi - lo) / 2;
+							auto &c = st->sortedCases[mid];
+
+							if(c.value < val)
+								lo = mid + 1;
+							else if(c.value > val)
+								hi = mid;
+							else
+							{
+								offs = c.offset;
+								break;
+							}
+						}
+					}
+
+					if(offs == -1)
+						croc_eh_throwStd(*t, "SwitchError", "Switch without default");
+
+					(*pc) += offs;
+					Next();
+				}
+				Case(Close) closeUpvals(t, stackBase + rd); Next();
+
+				Case(For) {
 					auto jump = GetImm();
 					auto idx = &t->stack[stackBase + rd];
 					auto hi = idx + 1;
@@ -664,10 +999,10 @@ namespace croc
 					}
 
 					*step = Value::from(intStep);
-					(*pc) += jump;
-					break;
+					Jump(jump);
+					Next();
 				}
-				case Op_ForLoop: {
+				Case(ForLoop) {
 					auto jump = GetImm();
 					auto idx = t->stack[stackBase + rd].mInt;
 					auto hi = t->stack[stackBase + rd + 1].mInt;
@@ -679,7 +1014,7 @@ namespace croc
 						{
 							t->stack[stackBase + rd + 3] = Value::from(idx);
 							t->stack[stackBase + rd] = Value::from(idx + step);
-							(*pc) += jump;
+							Jump(jump);
 						}
 					}
 					else
@@ -688,12 +1023,12 @@ namespace croc
 						{
 							t->stack[stackBase + rd + 3] = Value::from(idx);
 							t->stack[stackBase + rd] = Value::from(idx + step);
-							(*pc) += jump;
+							Jump(jump);
 						}
 					}
-					break;
+					Next();
 				}
-				case Op_Foreach: {
+				Case(Foreach) {
 					auto jump = GetImm();
 					auto src = t->stack[stackBase + rd];
 
@@ -730,10 +1065,10 @@ namespace croc
 						croc_eh_throwStd(*t, "StateError",
 							"Attempting to iterate over a thread that is not in the 'initial' state");
 
-					(*pc) += jump;
-					break;
+					Jump(jump);
+					Next();
 				}
-				case Op_ForeachLoop: {
+				Case(ForeachLoop) {
 					auto numIndices = GetUImm();
 					auto jump = GetImm();
 
@@ -754,35 +1089,35 @@ namespace croc
 						if(t->stack[stackBase + funcReg].type != CrocType_Null)
 						{
 							t->stack[stackBase + rd + 2] = t->stack[stackBase + funcReg];
-							(*pc) += jump;
+							Jump(jump);
 						}
 					}
 					else
 					{
 						if(src->mThread->state != CrocThreadState_Dead)
-							(*pc) += jump;
+							Jump(jump);
 					}
-					break;
+					Next();
 				}
 				// Exception Handling
-				case Op_PushCatch:
-				case Op_PushFinally: {
+				Case(PushCatch)
+				Case(PushFinally) {
 					auto offs = GetImm();
 					pushScriptEHFrame(t, opcode == Op_PushCatch, cast(RelStack)rd, t->currentAR->pc + offs);
-					break;
+					Next();
 				}
-				case Op_PopEH: popScriptEHFrame(t); break;
+				Case(PopEH) popScriptEHFrame(t); Next();
 
-				case Op_EndFinal:
+				Case(EndFinal)
 					if(t->vm->exception != nullptr)
 						throwImpl(t, Value::from(t->vm->exception), true);
 
 					if(t->currentAR->unwindReturn != nullptr)
 						unwind(t);
 
-					break;
+					Next();
 
-				case Op_Throw:
+				Case(Throw)
 					GetRS();
 					throwImpl(t, *RS, cast(bool)rd);
 					assert(false); // should never get here
@@ -793,14 +1128,16 @@ namespace croc
 				bool isTailcall;
 				word numResults;
 				uword numParams;
+				uword cacheIdx;
 
-				case Op_TailMethod:
-				case Op_Method:
+				Case(TailMethod)
+				Case(Method)
 					isTailcall = opcode == Op_TailMethod;
 					GetRS();
 					GetRT();
 					numParams = GetUImm();
 					numResults = GetUImm() - 1;
+					cacheIdx = GetUImm();
 
 					if(isTailcall)
 						numResults = -1; // the second uimm is a dummy for these opcodes
@@ -815,17 +1152,34 @@ namespace croc
 
 					AdjustParams();
 					isScript = methodCallPrologue(t, stackBase + rd, *RS, RT->mString, numResults, numParams,
-						isTailcall);
+						isTailcall, cacheIdx == INST_NO_CACHE ? nullptr :
+							&t->currentAR->func->scriptFunc->methodCaches[cacheIdx]);
 					goto _commonCall;
 
-				case Op_Call:
-				case Op_TailCall:
+				Case(MoveCall)
+					GetRS();
+					t->stack[stackBase + rd] = *RS;
+					SkipFused(Call);
+					FallThrough();
+				Case(Call)
+				Case(TailCall)
 					isTailcall = opcode == Op_TailCall;
 					numParams = GetUImm();
 					numResults = GetUImm() - 1;
 
 					if(isTailcall)
 						numResults = -1; // second uimm is a dummy
+					else if(numParams != 0 && t->hooks == 0)
+					{
+						auto &func = t->stack[stackBase + rd];
+
+						if(func.type == CrocType_Function && !func.mFunction->isNative &&
+							!func.mFunction->scriptFunc->isVararg && numParams - 1 <= func.mFunction->maxParams)
+						{
+							scriptCallPrologue(t, func.mFunction, stackBase + rd, numResults, numParams - 1);
+							goto _reentry;
+						}
+					}
 
 					AdjustParams();
 					isScript = callPrologue(t, stackBase + rd, numResults, numParams, isTailcall);
@@ -842,10 +1196,21 @@ namespace croc
 					goto _reentry;
 			}
 
-				case Op_SaveRets: {
+				Case(SaveRets)
+				Case(SaveRetsRet) {
 					auto numResults = GetUImm();
 					auto firstResult = stackBase + rd;
 
+					if(numResults != 0 && t->hooks == 0 && t->currentAR->numResults == 0 && INST_GET_OPCODE(**pc) == Op_Ret)
+					{
+						scriptReturn(t, firstResult, numResults - 1);
+
+						if(t->arIndex < startARIndex)
+							goto _return;
+
+						goto _reentry;
+					}
+
 					if(numResults == 0)
 					{
 						saveResults(t, t, firstResult, t->stackIndex - firstResult);
@@ -853,9 +1218,14 @@ namespace croc
 					}
 					else
 						saveResults(t, t, firstResult, numResults - 1);
-					break;
+
+					if(opcode == Op_SaveRets)
+						Next();
+
+					SkipFused(Ret);
+					FallThrough();
 				}
-				case Op_Ret: {
+				Case(Ret) {
 					callEpilogue(t);
 
 					if(t->arIndex < startARIndex)
@@ -863,13 +1233,13 @@ namespace croc
 
 					goto _reentry;
 				}
-				case Op_Unwind:
+				Case(Unwind)
 					t->currentAR->unwindReturn = (*pc);
 					t->currentAR->unwindCounter = rd;
 					unwind(t);
-					break;
+					Next();
 
-				case Op_Vararg: {
+				Case(Vararg) {
 					uword numNeeded = GetUImm();
 					auto numVarargs = stackBase - t->currentAR->vargBase;
 					auto dest = stackBase + rd;
@@ -893,13 +1263,13 @@ namespace croc
 						t->stack.slice(dest + numVarargs, dest + numNeeded).fill(Value::nullValue);
 					}
 
-					break;
+					Next();
 				}
-				case Op_VargLen:
+				Case(VargLen)
 					t->stack[stackBase + rd] = Value::from(cast(crocint)(stackBase - t->currentAR->vargBase));
-					break;
+					Next();
 
-				case Op_VargIndex: {
+				Case(VargIndex) {
 					GetRS();
 
 					auto numVarargs = stackBase - t->currentAR->vargBase;
@@ -922,9 +1292,9 @@ namespace croc
 							index, numVarargs);
 
 					t->stack[stackBase + rd] = t->stack[t->currentAR->vargBase + cast(uword)index];
-					break;
+					Next();
 				}
-				case Op_VargIndexAssign: {
+				Case(VargIndexAssign) {
 					GetRS();
 					GetRT();
 
@@ -948,9 +1318,9 @@ namespace croc
 							index, numVarargs);
 
 					t->stack[t->currentAR->vargBase + cast(uword)index] = *RT;
-					break;
+					Next();
 				}
-				case Op_Yield: {
+				Case(Yield) {
 					auto numParams = cast(word)GetUImm() - 1;
 					auto numResults = cast(word)GetUImm() - 1;
 
@@ -965,7 +1335,7 @@ namespace croc
 					yieldImpl(t, stackBase + rd, numParams, numResults);
 					goto _return;
 				}
-				case Op_CheckParams: {
+				Case(CheckParams) {
 					auto val = &t->stack[stackBase];
 					auto masks = t->currentAR->func->scriptFunc->paramMasks;
 
@@ -986,15 +1356,15 @@ namespace croc
 
 						val++;
 					}
-					break;
+					Next();
 				}
-				case Op_CheckObjParam: {
+				Case(CheckObjParam) {
 					auto RD = &t->stack[stackBase + rd];
 					GetRS();
 					auto jump = GetImm();
 
 					if(RD->type != CrocType_Instance)
-						(*pc) += jump;
+						Jump(jump);
 					else
 					{
 						if(RS->type != CrocType_Class)
@@ -1012,11 +1382,11 @@ namespace croc
 						}
 
 						if(RD->mInstance->derivesFrom(RS->mClass))
-							(*pc) += jump;
+							Jump(jump);
 					}
-					break;
+					Next();
 				}
-				case Op_ObjParamFail: {
+				Case(ObjParamFail) {
 					pushTypeStringImpl(t, t->stack[stackBase + rd]);
 
 					if(rd == 0)
@@ -1026,9 +1396,9 @@ namespace croc
 						croc_eh_throwStd(*t, "TypeError", "Parameter %d: type '%s' is not allowed",
 							rd, croc_getString(*t, -1));
 
-					break;
+					Next();
 				}
-				case Op_CustomParamFail: {
+				Case(CustomParamFail) {
 					GetRS();
 
 					if(rd == 0)
@@ -1038,9 +1408,9 @@ namespace croc
 						croc_eh_throwStd(*t, "TypeError",
 							"Parameter %d: value does not satisfy constraint '%s'",
 							rd, RS->mString->toCString());
-					break;
+					Next();
 				}
-				case Op_CheckRets: {
+				Case(CheckRets) {
 					auto val = &t->results[t->currentAR->firstResult];
 					auto actualReturns = t->currentAR->numResults;
 					auto func = t->currentAR->func->scriptFunc;
@@ -1071,9 +1441,9 @@ namespace croc
 
 						val++;
 					}
-					break;
+					Next();
 				}
-				case Op_CheckObjRet: {
+				Case(CheckObjRet) {
 					auto returns = &t->results[t->currentAR->firstResult];
 					auto actualReturns = t->currentAR->numResults;
 					auto val = (cast(uword)rd < actualReturns) ? &returns[rd] : &Value::nullValue;
@@ -1081,7 +1451,7 @@ namespace croc
 					auto jump = GetImm();
 
 					if(val->type != CrocType_Instance)
-						(*pc) += jump;
+						Jump(jump);
 					else
 					{
 						if(RS->type != CrocType_Class)
@@ -1094,11 +1464,11 @@ namespace croc
 						}
 
 						if(val->mInstance->derivesFrom(RS->mClass))
-							(*pc) += jump;
+							Jump(jump);
 					}
-					break;
+					Next();
 				}
-				case Op_ObjRetFail: {
+				Case(ObjRetFail) {
 					auto returns = &t->results[t->currentAR->firstResult];
 					auto actualReturns = t->currentAR->numResults;
 					auto val = (cast(uword)rd < actualReturns) ? &returns[rd] : &Value::nullValue;
@@ -1107,24 +1477,24 @@ namespace croc
 					croc_eh_throwStd(*t, "TypeError", "Return %d: type '%s' is not allowed",
 						rd + 1, croc_getString(*t, -1));
 
-					break;
+					Next();
 				}
-				case Op_CustomRetFail: {
+				Case(CustomRetFail) {
 					GetRS();
 
 					croc_eh_throwStd(*t, "TypeError", "Return %d: value does not satisfy constraint '%s'",
 						rd + 1, RS->mString->toCString());
-					break;
+					Next();
 				}
-				case Op_MoveRet: {
+				Case(MoveRet) {
 					auto ret = GetUImm();
 					auto returns = &t->results[t->currentAR->firstResult];
 					auto actualReturns = t->currentAR->numResults;
 					auto val = (cast(uword)ret < actualReturns) ? &returns[ret] : &Value::nullValue;
 					t->stack[stackBase + rd] = *val;
-					break;
+					Next();
 				}
-				case Op_RetAsFloat: {
+				Case(RetAsFloat) {
 					auto returns = &t->results[t->currentAR->firstResult];
 					auto actualReturns = t->currentAR->numResults;
 					auto val = (cast(uword)rd < actualReturns) ? &returns[rd] : &Value::nullValue;
@@ -1138,9 +1508,9 @@ namespace croc
 							pushTypeStringImpl(t, *val);
 							croc_eh_throwStd(*t, "TypeError", "Cannot convert type '%s' to float", croc_getString(*t, -1));
 					}
-					break;
+					Next();
 				}
-				case Op_AssertFail: {
+				Case(AssertFail) {
 					auto msg = t->stack[stackBase + rd];
 
 					if(msg.type != CrocType_String)
@@ -1154,11 +1524,11 @@ namespace croc
 					assert(false);
 				}
 				// Array and List Operations
-				case Op_Length:       GetRS(); lenImpl(t, stackBase + rd, *RS);  break;
-				case Op_LengthAssign: GetRS(); lenaImpl(t, t->stack[stackBase + rd], *RS); break;
-				case Op_Append:       GetRS(); t->stack[stackBase + rd].mArray->append(t->vm->mem, *RS); break;
+				Case(Length)       GetRS(); lenImpl(t, stackBase + rd, *RS);  Next();
+				Case(LengthAssign) GetRS(); lenaImpl(t, t->stack[stackBase + rd], *RS); Next();
+				Case(Append)       GetRS(); t->stack[stackBase + rd].mArray->append(t->vm->mem, *RS); Next();
 
-				case Op_SetArray: {
+				Case(SetArray) {
 					auto numVals = GetUImm();
 					auto block = GetUImm();
 					auto sliceBegin = stackBase + rd + 1;
@@ -1172,28 +1542,29 @@ namespace croc
 					else
 						a->setBlock(t->vm->mem, block, t->stack.slice(sliceBegin, sliceBegin + numVals - 1));
 
-					break;
+					Next();
 				}
-				case Op_Cat: {
+				Case(Cat) {
 					auto rs = GetUImm();
 					auto numVals = GetUImm();
 					catImpl(t, stackBase + rd, stackBase + rs, numVals);
 					croc_gc_maybeCollect(*t);
-					break;
+					Next();
 				}
-				case Op_CatEq: {
+				Case(CatEq) {
 					auto rs = GetUImm();
 					auto numVals = GetUImm();
 					catEqImpl(t, stackBase + rd, stackBase + rs, numVals);
 					croc_gc_maybeCollect(*t);
-					break;
+					Next();
 				}
-				case Op_Index:       GetRS(); GetRT(); idxImpl(t, stackBase + rd, *RS, *RT);  break;
-				case Op_IndexAssign: GetRS(); GetRT(); idxaImpl(t, stackBase + rd, *RS, *RT); break;
+				Case(Index)       GetRS(); GetRT(); idxImpl(t, stackBase + rd, *RS, *RT);  Next();
+				Case(IndexAssign) GetRS(); GetRT(); idxaImpl(t, stackBase + rd, *RS, *RT); Next();
 
-				case Op_Field: {
+				Case(Field) {
 					GetRS();
 					GetRT();
+					auto cacheIdx = GetUImm();
 
 					if(RT->type != CrocType_String)
 					{
@@ -1202,12 +1573,27 @@ namespace croc
 							croc_getString(*t, -1));
 					}
 
+					if(RS->type == CrocType_Instance && cacheIdx != INST_NO_CACHE)
+					{
+						auto &cache = t->currentAR->func->scriptFunc->fieldCaches[cacheIdx];
+						auto inst = RS->mInstance;
+
+						if(cache.layoutID == inst->parent->layoutID || fillFieldCache(cache, inst, RT->mString))
+						{
+							t->stack[stackBase + rd] = cache.method ? *cache.method : *inst->getFieldSlot(cache.slot);
+							Next();
+						}
+					}
+
+					// Getting a field from the global namespace can import a lazily-loaded module; see GetGlobalRD.
 					fieldImpl(t, stackBase + rd, *RS, RT->mString, false);
-					break;
+					pc = &t->currentAR->pc;
+					Next();
 				}
-				case Op_FieldAssign: {
+				Case(FieldAssign) {
 					GetRS();
 					GetRT();
+					auto cacheIdx = GetUImm();
 
 					if(RS->type != CrocType_String)
 					{
@@ -1216,35 +1602,50 @@ namespace croc
 							croc_getString(*t, -1));
 					}
 
+					auto cont = &t->stack[stackBase + rd];
+
+					if(cont->type == CrocType_Instance && cacheIdx != INST_NO_CACHE)
+					{
+						auto &cache = t->currentAR->func->scriptFunc->fieldCaches[cacheIdx];
+						auto inst = cont->mInstance;
+
+						if((cache.layoutID == inst->parent->layoutID || fillFieldCache(cache, inst, RS->mString)) &&
+							cache.method == nullptr)
+						{
+							inst->setFieldSlot(t->vm->mem, cache.slot, *RT);
+							Next();
+						}
+					}
+
 					fieldaImpl(t, stackBase + rd, RS->mString, *RT, false);
-					break;
+					Next();
 				}
-				case Op_Slice: {
+				Case(Slice) {
 					auto rs = GetUImm();
 					auto base = &t->stack[stackBase + rs];
 					sliceImpl(t, stackBase + rd, base[0], base[1], base[2]);
-					break;
+					Next();
 				}
-				case Op_SliceAssign: {
+				Case(SliceAssign) {
 					GetRS();
 					auto base = &t->stack[stackBase + rd];
 					sliceaImpl(t, base[0], base[1], base[2], *RS);
-					break;
+					Next();
 				}
 				// Value Creation
-				case Op_NewArray: {
+				Case(NewArray) {
 					auto size = cast(uword)constTable[GetUImm()].mInt;
 					t->stack[stackBase + rd] = Value::from(Array::create(t->vm->mem, size));
 					croc_gc_maybeCollect(*t);
-					break;
+					Next();
 				}
-				case Op_NewTable: {
+				Case(NewTable) {
 					t->stack[stackBase + rd] = Value::from(Table::create(t->vm->mem));
 					croc_gc_maybeCollect(*t);
-					break;
+					Next();
 				}
-				case Op_Closure:
-				case Op_ClosureWithEnv: {
+				Case(Closure)
+				Case(ClosureWithEnv) {
 					auto closureIdx = GetUImm();
 					auto newDef = t->currentAR->func->scriptFunc->innerFuncs[closureIdx];
 					auto funcEnv = (opcode == Op_Closure) ? env : t->stack[stackBase + rd].mNamespace;
@@ -1271,9 +1672,9 @@ namespace croc
 
 					t->stack[stackBase + rd] = Value::from(n);
 					croc_gc_maybeCollect(*t);
-					break;
+					Next();
 				}
-				case Op_Class: {
+				Case(Class) {
 					GetRS();
 					GetRT();
 
@@ -1294,9 +1695,9 @@ namespace croc
 
 					t->stack[stackBase + rd] = Value::from(cls);
 					croc_gc_maybeCollect(*t);
-					break;
+					Next();
 				}
-				case Op_Namespace: {
+				Case(Namespace) {
 					auto name = constTable[GetUImm()].mString;
 					GetRT();
 
@@ -1314,20 +1715,20 @@ namespace croc
 					}
 
 					croc_gc_maybeCollect(*t);
-					break;
+					Next();
 				}
-				case Op_NamespaceNP: {
+				Case(NamespaceNP) {
 					auto name = constTable[GetUImm()].mString;
 					t->stack[stackBase + rd] = Value::from(Namespace::create(t->vm->mem, name, env));
 					croc_gc_maybeCollect(*t);
-					break;
+					Next();
 				}
-				case Op_SuperOf: {
+				Case(SuperOf) {
 					GetRS();
 					t->stack[stackBase + rd] = superOfImpl(t, *RS);
-					break;
+					Next();
 				}
-				case Op_AddMember: {
+				Case(AddMember) {
 					auto cls = &t->stack[stackBase + rd];
 					GetRS();
 					GetRT();
@@ -1357,12 +1758,17 @@ namespace croc
 								"Attempting to add a %s '%s' which already exists to class '%s'",
 								isMethod ? "method" : "field", name, clsName);
 					}
-					break;
+					Next();
 				}
+#ifdef CROC_COMPUTED_GOTO
+		}
+#pragma GCC diagnostic pop
+#else
 				default:
 					croc_eh_throwStd(*t, "VMError", "Unimplemented opcode %s", OpNames[cast(uword)opcode]);
 			}
 		}
+#endif
 		}
 		else // catch!
 		{
@@ -0,0 +1,634 @@
+#include "croc/internal/jit.hpp"
+
+#ifdef CROC_JIT
+
+#include <initializer_list>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "croc/base/opcodes.hpp"
+#include "croc/types/base.hpp"
+
+/*
+A baseline JIT for x86-64 Linux. Each instruction of a function is translated to a fixed template of machine code, one
+after another. Templates only handle the common case inline (int/int and float/float arithmetic, int comparisons,
+numeric for loops, moves, jumps). When a template sees anything else, or when an instruction has no template at all,
+the native code returns the pc of that instruction and the interpreter carries on from there. So the native code never
+calls back into the VM, never allocates, and never throws, which means it needs nothing from the EH machinery: an
+exception can only happen once the interpreter has taken over again.
+
+The interpreter enters native code at safepoints (function entry, returning to a function, and backward jumps), when
+hooks are off. Native backward jumps check the thread's halt flag and hooks, and go back to the interpreter if either
+needs attention.
+
+While native code runs, these registers are fixed:
+
+	rbx: &t->stack[stackBase]
+	r12: the thread
+	r13: the function's constant table
+	r14: the function's code, so that exits can compute a pc
+*/
+
+namespace croc
+{
+	namespace
+	{
+		enum Reg
+		{
+			RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+			R8 = 8, R12 = 12, R13 = 13, R14 = 14
+		};
+
+		enum Cond
+		{
+			CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF, CC_ALWAYS = 0x10
+		};
+
+		const int FRAME = RBX;
+		const int THREAD = R12;
+		const int CONSTS = R13;
+		const int CODE = R14;
+
+		const int32_t TYPE = offsetof(Value, type);
+		const int32_t PAYLOAD = offsetof(Value, mInt);
+		const int32_t VSIZE = sizeof(Value);
+
+		static_assert(sizeof(Value) == 16 || sizeof(Value) == 12, "JIT doesn't know how to copy values");
+		static_assert(sizeof(CrocType) == 4, "JIT assumes 32-bit type tags");
+
+		struct Operand
+		{
+			int base;
+			int32_t disp;
+		};
+
+		inline Operand reg(uword idx)
+		{
+			return {FRAME, cast(int32_t)(idx * VSIZE)};
+		}
+
+		inline Operand regOrConst(uint16_t uimm)
+		{
+			if(uimm & INST_CONSTBIT)
+				return {CONSTS, cast(int32_t)((uimm & ~INST_CONSTBIT) * VSIZE)};
+			else
+				return {FRAME, cast(int32_t)(uimm * VSIZE)};
+		}
+
+		struct Emitter
+		{
+			Memory& mem;
+			DArray<uint8_t> buf;
+			uword len;
+
+			Emitter(Memory& mem) : mem(mem), buf(), len(0) {}
+
+			void byte(uint8_t x)
+			{
+				if(len == buf.length)
+					buf.resize(mem, buf.length ? buf.length * 2 : 1024);
+
+				buf[len++] = x;
+			}
+
+			void dword(uint32_t x)
+			{
+				for(int i = 0; i < 4; i++)
+					byte((x >> (i * 8)) & 0xFF);
+			}
+
+			void qword(uint64_t x)
+			{
+				dword(cast(uint32_t)x);
+				dword(cast(uint32_t)(x >> 32));
+			}
+
+			void bytes(std::initializer_list<uint8_t> bs)
+			{
+				for(auto b: bs)
+					byte(b);
+			}
+
+			// Makes the rel32 at 'at' point to 'target'.
+			void patch(uword at, uword target)
+			{
+				auto rel = cast(int32_t)(cast(word)target - cast(word)(at + 4));
+
+				for(int i = 0; i < 4; i++)
+					buf[at + i] = (cast(uint32_t)rel >> (i * 8)) & 0xFF;
+			}
+
+			void rex(bool w, int reg, int base)
+			{
+				uint8_t r = 0x40 | (w ? 8 : 0) | ((reg >> 3) << 2) | (base >> 3);
+
+				if(r != 0x40)
+					byte(r);
+			}
+
+			// ModRM (and SIB) for [base + disp32].
+			void modrm(int reg, Operand o, int32_t extra)
+			{
+				byte(0x80 | ((reg & 7) << 3) | (o.base & 7));
+
+				if((o.base & 7) == RSP)
+					byte(0x24);
+
+				dword(cast(uint32_t)(o.disp + extra));
+			}
+
+			// op reg, [o + extra] (or the other way around, depending on the opcode).
+			void rm(bool w, uint8_t op, int reg, Operand o, int32_t extra = 0)
+			{
+				rex(w, reg, o.base);
+				byte(op);
+				modrm(reg, o, extra);
+			}
+
+			// Scalar double op xmm, [o + extra].
+			void sd(uint8_t op, int xmm, Operand o, int32_t extra = PAYLOAD)
+			{
+				byte(0xF2);
+				rex(false, xmm, o.base);
+				byte(0x0F);
+				byte(op);
+				modrm(xmm, o, extra);
+			}
+
+			void movLoad(int reg, Operand o, int32_t extra = PAYLOAD) { rm(true, 0x8B, reg, o, extra); }
+			void movStore(Operand o, int reg, int32_t extra = PAYLOAD) { rm(true, 0x89, reg, o, extra); }
+
+			void cmpType(Operand o, CrocType type)
+			{
+				rm(false, 0x81, 7, o, TYPE);
+				dword(type);
+			}
+
+			void setType(Operand o, CrocType type)
+			{
+				rm(false, 0xC7, 0, o, TYPE);
+				dword(type);
+			}
+
+			void copyValue(Operand dest, Operand src)
+			{
+				movLoad(RAX, src, 0);
+				rm(sizeof(Value) == 16, 0x8B, RCX, src, 8);
+				movStore(dest, RAX, 0);
+				rm(sizeof(Value) == 16, 0x89, RCX, dest, 8);
+			}
+
+			// Emits a jump (or conditional jump) with a rel32 to be patched, and returns where the rel32 is.
+			uword jump(int cc = CC_ALWAYS)
+			{
+				if(cc == CC_ALWAYS)
+					byte(0xE9);
+				else
+				{
+					byte(0x0F);
+					byte(0x80 | cc);
+				}
+
+				dword(0);
+				return len - 4;
+			}
+
+			void jumpTo(uword target, int cc = CC_ALWAYS)
+			{
+				patch(jump(cc), target);
+			}
+		};
+
+		// Maps quickened instructions and superinstructions to the instruction whose template handles them. For a
+		// superinstruction, that's its first half; the second half is a normal instruction in the code stream.
+		Op templateOpcode(Op op)
+		{
+			switch(op)
+			{
+				case Op_AddII: case Op_AddFF: return Op_Add;
+				case Op_SubII: case Op_SubFF: return Op_Sub;
+				case Op_MulII: case Op_MulFF: return Op_Mul;
+				case Op_AddEqII: case Op_AddEqFF: return Op_AddEq;
+				case Op_SubEqII: case Op_SubEqFF: return Op_SubEq;
+				case Op_MoveMove: case Op_MoveCall: return Op_Move;
+				default: return op;
+			}
+		}
+
+		struct Compiler
+		{
+			Emitter e;
+			Funcdef* fd;
+			DArray<uint32_t> offsets; // native offset of each instruction, indexed by short
+			uword exitOffset;
+
+			struct Fixup
+			{
+				uword at;
+				uword target;
+			};
+
+			DArray<Fixup> fixups;
+			uword numFixups;
+			DArray<Fixup> safepoints;
+			uword numSafepoints;
+
+			int32_t haltOffset;
+			int32_t hooksEnabledOffset;
+			int32_t hooksOffset;
+
+			Compiler(Memory& mem, Thread* t, Funcdef* fd) :
+				e(mem),
+				fd(fd),
+				offsets(DArray<uint32_t>::alloc(mem, fd->code.length)),
+				exitOffset(0),
+				fixups(),
+				numFixups(0),
+				safepoints(),
+				numSafepoints(0)
+			{
+				auto base = cast(uint8_t*)t;
+				haltOffset = cast(uint8_t*)&t->shouldHalt - base;
+				hooksEnabledOffset = cast(uint8_t*)&t->hooksEnabled - base;
+				hooksOffset = cast(uint8_t*)&t->hooks - base;
+			}
+
+			void free()
+			{
+				e.buf.free(e.mem);
+				offsets.free(e.mem);
+				fixups.free(e.mem);
+				safepoints.free(e.mem);
+			}
+
+			void addFixup(DArray<Fixup>& arr, uword& num, uword at, uword target)
+			{
+				if(num == arr.length)
+					arr.resize(e.mem, arr.length ? arr.length * 2 : 16);
+
+				arr[num++] = {at, target};
+			}
+
+			// Return pc = code + idx to the interpreter.
+			void exitTo(uword idx)
+			{
+				e.rm(true, 0x8D, RAX, {CODE, cast(int32_t)(idx * sizeof(Instruction))}); // lea rax, [r14 + idx * 2]
+				e.jumpTo(exitOffset);
+			}
+
+			// Jump to the instruction at short index 'target' if 'cc' holds. Backward jumps go through a safepoint.
+			void branch(uword idx, uword target, int cc = CC_ALWAYS)
+			{
+				if(target <= idx)
+					addFixup(safepoints, numSafepoints, e.jump(cc), target);
+				else
+					addFixup(fixups, numFixups, e.jump(cc), target);
+			}
+
+			void prologue()
+			{
+				e.bytes({0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56}); // push rbx, r12, r13, r14
+				e.bytes({0x48, 0x89, 0xFB});                         // mov rbx, rdi
+				e.bytes({0x49, 0x89, 0xF4});                         // mov r12, rsi
+				e.bytes({0x49, 0x89, 0xD5});                         // mov r13, rdx
+				e.bytes({0x49, 0x89, 0xCE});                         // mov r14, rcx
+				e.bytes({0x41, 0xFF, 0xE0});                         // jmp r8
+				exitOffset = e.len;
+				e.bytes({0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B}); // pop r14, r13, r12, rbx
+				e.byte(0xC3);                                        // ret
+			}
+
+			// Templates. Each one exits to the interpreter at the instruction if it can't handle the operands.
+
+			void arith(uword idx, Op op, Operand a, Operand b, Operand dest)
+			{
+				e.cmpType(a, CrocType_Int);
+				auto notInt = e.jump(CC_NE);
+				e.cmpType(b, CrocType_Int);
+				auto slow1 = e.jump(CC_NE);
+				e.movLoad(RAX, a);
+
+				switch(op)
+				{
+					case Op_Add: e.rm(true, 0x03, RAX, b, PAYLOAD); break;
+					case Op_Sub: e.rm(true, 0x2B, RAX, b, PAYLOAD); break;
+					default:
+						e.rex(true, RAX, b.base);
+						e.bytes({0x0F, 0xAF}); // imul
+						e.modrm(RAX, b, PAYLOAD);
+						break;
+				}
+
+				e.movStore(dest, RAX);
+				e.setType(dest, CrocType_Int);
+				auto done1 = e.jump();
+
+				e.patch(notInt, e.len);
+				e.cmpType(a, CrocType_Float);
+				auto slow2 = e.jump(CC_NE);
+				e.cmpType(b, CrocType_Float);
+				auto slow3 = e.jump(CC_NE);
+				e.sd(0x10, 0, a); // movsd xmm0, a
+
+				switch(op)
+				{
+					case Op_Add: e.sd(0x58, 0, b); break;
+					case Op_Sub: e.sd(0x5C, 0, b); break;
+					default:     e.sd(0x59, 0, b); break;
+				}
+
+				e.sd(0x11, 0, dest); // movsd dest, xmm0
+				e.setType(dest, CrocType_Float);
+				auto done2 = e.jump();
+
+				e.patch(slow1, e.len);
+				e.patch(slow2, e.len);
+				e.patch(slow3, e.len);
+				exitTo(idx);
+				e.patch(done1, e.len);
+				e.patch(done2, e.len);
+			}
+
+			void crement(uword idx, bool inc, Operand dest)
+			{
+				e.cmpType(dest, CrocType_Int);
+				auto notInt = e.jump(CC_NE);
+				e.rm(true, 0x83, inc ? 0 : 5, dest, PAYLOAD); // add/sub qword [dest], 1
+				e.byte(1);
+				auto done1 = e.jump();
+
+				e.patch(notInt, e.len);
+				e.cmpType(dest, CrocType_Float);
+				auto slow = e.jump(CC_NE);
+				e.sd(0x10, 0, dest);
+				e.bytes({0x48, 0xB8});                     // mov rax, 1.0
+				e.qword(0x3FF0000000000000ULL);
+				e.bytes({0x66, 0x48, 0x0F, 0x6E, 0xC8});   // movq xmm1, rax
+				e.bytes({0xF2, 0x0F, cast(uint8_t)(inc ? 0x58 : 0x5C), 0xC1}); // addsd/subsd xmm0, xmm1
+				e.sd(0x11, 0, dest);
+				auto done2 = e.jump();
+
+				e.patch(slow, e.len);
+				exitTo(idx);
+				e.patch(done1, e.len);
+				e.patch(done2, e.len);
+			}
+
+			// Int/int comparison which jumps to target if 'cc' holds.
+			void intCompare(uword idx, Operand a, Operand b, int cc, uword target)
+			{
+				e.cmpType(a, CrocType_Int);
+				auto slow1 = e.jump(CC_NE);
+				e.cmpType(b, CrocType_Int);
+				auto slow2 = e.jump(CC_NE);
+				e.movLoad(RAX, a);
+				e.rm(true, 0x3B, RAX, b, PAYLOAD); // cmp rax, b
+				branch(idx, target, cc);
+				auto done = e.jump();
+				e.patch(slow1, e.len);
+				e.patch(slow2, e.len);
+				exitTo(idx);
+				e.patch(done, e.len);
+			}
+
+			void isTrue(uword idx, Operand src, bool jumpIfTrue, uword target)
+			{
+				// Each of these jumps to either the "false" or "true" outcome.
+				uword toFalse[3], toTrue[3];
+
+				e.cmpType(src, CrocType_Null);
+				toFalse[0] = e.jump(CC_E);
+
+				e.cmpType(src, CrocType_Bool);
+				auto notBool = e.jump(CC_NE);
+				e.rm(false, 0x80, 7, src, PAYLOAD); // cmp byte [src], 0
+				e.byte(0);
+				toFalse[1] = e.jump(CC_E);
+				toTrue[0] = e.jump();
+
+				e.patch(notBool, e.len);
+				e.cmpType(src, CrocType_Int);
+				auto notInt = e.jump(CC_NE);
+				e.rm(true, 0x83, 7, src, PAYLOAD); // cmp qword [src], 0
+				e.byte(0);
+				toFalse[2] = e.jump(CC_E);
+				toTrue[1] = e.jump();
+
+				e.patch(notInt, e.len);
+				e.cmpType(src, CrocType_Float);
+				auto slow = e.jump(CC_E);
+				toTrue[2] = e.jump(); // everything else is true
+
+				e.patch(slow, e.len);
+				exitTo(idx);
+
+				auto taken = jumpIfTrue ? toTrue : toFalse;
+				auto notTaken = jumpIfTrue ? toFalse : toTrue;
+
+				for(int i = 0; i < 3; i++)
+					e.patch(taken[i], e.len);
+
+				branch(idx, target);
+
+				for(int i = 0; i < 3; i++)
+					e.patch(notTaken[i], e.len);
+			}
+
+			void forLoop(uword idx, int rd, uword target)
+			{
+				auto idxReg = reg(rd), hiReg = reg(rd + 1), stepReg = reg(rd + 2), indexReg = reg(rd + 3);
+				e.movLoad(RAX, idxReg);
+				e.movLoad(RCX, hiReg);
+				e.movLoad(RDX, stepReg);
+				e.bytes({0x48, 0x85, 0xD2}); // test rdx, rdx
+				auto neg = e.jump(CC_LE);
+				e.bytes({0x48, 0x39, 0xC8}); // cmp rax, rcx
+				auto done1 = e.jump(CC_GE);
+				auto body = e.jump();
+				e.patch(neg, e.len);
+				e.bytes({0x48, 0x39, 0xC8}); // cmp rax, rcx
+				auto done2 = e.jump(CC_L);
+				e.patch(body, e.len);
+				e.movStore(indexReg, RAX);
+				e.setType(indexReg, CrocType_Int);
+				e.bytes({0x48, 0x01, 0xD0}); // add rax, rdx
+				e.movStore(idxReg, RAX);
+				e.setType(idxReg, CrocType_Int);
+				branch(idx, target);
+				e.patch(done1, e.len);
+				e.patch(done2, e.len);
+			}
+
+			// Emits the template for an instruction. Returns false if there isn't one, in which case all that's emitted is an
+			// exit to the interpreter.
+			bool instruction(uword idx, Op op)
+			{
+				auto i = &fd->code[idx];
+				int rd = INST_GET_RD(i[0]);
+
+				switch(templateOpcode(op))
+				{
+					case Op_Move:
+						e.copyValue(reg(rd), regOrConst(i[1].uimm));
+						return true;
+
+					case Op_Add:
+					case Op_Sub:
+					case Op_Mul:
+						arith(idx, templateOpcode(op), regOrConst(i[1].uimm), regOrConst(i[2].uimm), reg(rd));
+						return true;
+
+					case Op_AddEq:
+					case Op_SubEq:
+					case Op_MulEq: {
+						auto o = templateOpcode(op);
+						auto binOp = o == Op_AddEq ? Op_Add : o == Op_SubEq ? Op_Sub : Op_Mul;
+						arith(idx, binOp, reg(rd), regOrConst(i[1].uimm), reg(rd));
+						return true;
+					}
+					case Op_Inc: crement(idx, true, reg(rd)); return true;
+					case Op_Dec: crement(idx, false, reg(rd)); return true;
+
+					case Op_Cmp: {
+						int cc;
+
+						switch(cast(Comparison)rd)
+						{
+							case Comparison_LT: cc = CC_L; break;
+							case Comparison_LE: cc = CC_LE; break;
+							case Comparison_GT: cc = CC_G; break;
+							case Comparison_GE: cc = CC_GE; break;
+							default: assert(false); return false;
+						}
+
+						intCompare(idx, regOrConst(i[1].uimm), regOrConst(i[2].uimm), cc, idx + 4 + i[3].imm);
+						return true;
+					}
+					case Op_Equals:
+						intCompare(idx, regOrConst(i[1].uimm), regOrConst(i[2].uimm), rd ? CC_E : CC_NE,
+							idx + 4 + i[3].imm);
+						return true;
+
+					case Op_IsTrue:
+						isTrue(idx, regOrConst(i[1].uimm), rd != 0, idx + 3 + i[2].imm);
+						return true;
+
+					case Op_Jmp:
+						if(rd != 0)
+							branch(idx, idx + 2 + i[1].imm);
+						return true;
+
+					case Op_ForLoop:
+						forLoop(idx, rd, idx + 2 + i[1].imm);
+						return true;
+
+					default:
+						exitTo(idx);
+						return false;
+				}
+			}
+
+			// Safepoint for a backward jump: go back to the interpreter if the thread should halt or has hooks.
+			void safepoint(Fixup& f)
+			{
+				e.patch(f.at, e.len);
+				e.rm(false, 0x80, 7, {THREAD, haltOffset}); // cmp byte [r12 + shouldHalt], 0
+				e.byte(0);
+				auto exit1 = e.jump(CC_NE);
+				e.rm(false, 0x80, 7, {THREAD, hooksEnabledOffset});
+				e.byte(0);
+				auto go = e.jump(CC_E);
+				e.rm(false, 0x80, 7, {THREAD, hooksOffset});
+				e.byte(0);
+				auto exit2 = e.jump(CC_NE);
+				e.patch(go, e.len);
+				e.jumpTo(offsets[f.target]);
+				e.patch(exit1, e.len);
+				e.patch(exit2, e.len);
+				exitTo(f.target);
+			}
+
+			bool compile()
+			{
+				prologue();
+
+				auto code = fd->code;
+				auto entries = DArray<uint32_t>::alloc(e.mem, code.length);
+				bool any = false;
+
+				for(uword idx = 0; idx < code.length; idx += instructionSize(cast(Op)INST_GET_OPCODE(code[idx])))
+				{
+					offsets[idx] = e.len;
+
+					if(instruction(idx, cast(Op)INST_GET_OPCODE(code[idx])))
+					{
+						entries[idx] = offsets[idx];
+						any = true;
+					}
+				}
+
+				for(uword i = 0; i < numFixups; i++)
+					e.patch(fixups[i].at, offsets[fixups[i].target]);
+
+				for(uword i = 0; i < numSafepoints; i++)
+					safepoint(safepoints[i]);
+
+				if(!any)
+				{
+					entries.free(e.mem);
+					return false;
+				}
+
+				auto mem = mmap(nullptr, e.len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+				if(mem == MAP_FAILED)
+				{
+					entries.free(e.mem);
+					return false;
+				}
+
+				memcpy(mem, e.buf.ptr, e.len);
+
+				if(mprotect(mem, e.len, PROT_READ | PROT_EXEC) != 0)
+				{
+					munmap(mem, e.len);
+					entries.free(e.mem);
+					return false;
+				}
+
+				fd->jitCode = cast(uint8_t*)mem;
+				fd->jitCodeSize = e.len;
+				fd->jitEntries = entries;
+				return true;
+			}
+		};
+	}
+
+	// Compiles the given function to native code. If it can't be compiled (or there's no point), fd->jitCode is left
+	// null and the function is only ever interpreted.
+	// The compiler's buffers would leak if one of them ran into the memory limit partway through, so there's one check
+	// up front, for the two tables that are as big as the code, and the rest is exempt.
+	void jitCompile(Thread* t, Funcdef* fd)
+	{
+		auto &mem = t->vm->mem;
+		mem.checkLimit(fd->code.length * sizeof(uint32_t) * 2);
+		mem.limitExempt++;
+		Compiler c(mem, t, fd);
+		c.compile();
+		c.free();
+		mem.limitExempt--;
+	}
+
+	void jitFree(Memory& mem, Funcdef* fd)
+	{
+		if(fd->jitCode)
+		{
+			munmap(fd->jitCode, fd->jitCodeSize);
+			fd->jitCode = nullptr;
+			fd->jitEntries.free(mem);
+		}
+	}
+}
+
+#endif
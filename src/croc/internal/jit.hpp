@@ -0,0 +1,39 @@
+#ifndef CROC_INTERNAL_JIT_HPP
+#define CROC_INTERNAL_JIT_HPP
+
+#include "croc/types/base.hpp"
+
+#ifdef CROC_JIT
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "The JIT only supports x86-64 Linux"
+#endif
+
+// How many times a function has to be entered (or jump backwards) before the JIT compiles it.
+#define CROC_JIT_THRESHOLD 1000
+
+namespace croc
+{
+	typedef Instruction* (*JitEntry)(Value* frame, Thread* t, Value* consts, Instruction* code, uint8_t* target);
+
+	void jitCompile(Thread* t, Funcdef* fd);
+	void jitFree(Memory& mem, Funcdef* fd);
+
+	// Whether the JIT has native code for the instruction at pc.
+	inline bool jitCanEnter(Funcdef* fd, Instruction* pc)
+	{
+		return fd->jitCode != nullptr && fd->jitEntries[pc - fd->code.ptr] != 0;
+	}
+
+	// Runs native code starting at the instruction at pc, which must be one that jitCanEnter is true for. The native
+	// code runs until it gets to something it can't do, and returns the pc of the instruction to continue
+	// interpreting from.
+	inline Instruction* jitRun(Thread* t, Funcdef* fd, Instruction* pc, Value* frame)
+	{
+		auto entry = cast(JitEntry)fd->jitCode;
+		return entry(frame, t, fd->constants.ptr, fd->code.ptr, fd->jitCode + fd->jitEntries[pc - fd->code.ptr]);
+	}
+}
+
+#endif
+#endif
@@ -0,0 +1,1781 @@
+#include <string.h>
+
+#include "croc/api.h"
+#include "croc/internal/basic.hpp"
+#include "croc/internal/class.hpp"
+#include "croc/internal/eh.hpp"
+#include "croc/internal/serialization.hpp"
+#include "croc/internal/stack.hpp"
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+	namespace
+	{
+	// The format is a signature followed by the root value. Each value is a one-byte tag (its CrocType, or one of the
+	// two tags below) followed by its contents. Ints and lengths are signed LEB128. Reference objects get an index
+	// in the order they're first written, and showing up again writes a backref to that index instead.
+	const uint8_t TransientTag = 254;
+	const uint8_t BackrefTag = 255;
+
+	// This gets bumped any time the serialization format changes.
+	const crocint SerialVersion = 3;
+
+	// How much is buffered before it's handed to a stream. Blocks bigger than this go straight to the stream.
+	const uword StreamBufferSize = 64 * 1024;
+
+	uint8_t endianness()
+	{
+		union
+		{
+			uint32_t i;
+			char c[4];
+		} test = {0x01020304};
+
+		return test.c[0] == 4 ? 0 : 1; // 1 for big-endian, 0 for little
+	}
+
+	// Looks up a value in the transients, which can be a table or an instance with opIndex. Null if it's not there.
+	Value lookupTransient(Thread* t, Value trans, Value key)
+	{
+		if(trans.type == CrocType_Table)
+		{
+			auto ret = trans.mTable->get(key);
+			return ret ? *ret : Value::nullValue;
+		}
+
+		auto slot = croc_pushNull(*t);
+		idxImpl(t, fakeToAbs(t, slot), trans, key);
+		auto ret = *getValue(t, slot);
+		croc_popTop(*t);
+		return ret;
+	}
+
+	// Makes a memblock which views some native memory just for the duration of a stream call, and then views nothing,
+	// so that a stream which holds on to it can't get at the memory afterwards.
+	struct ScratchView
+	{
+		Thread* t;
+		Memblock* mb;
+
+		ScratchView(Thread* t) :
+			t(t),
+			mb(nullptr)
+		{}
+
+		Value view(uint8_t* ptr, uword len)
+		{
+			if(mb == nullptr)
+				mb = Memblock::createView(t->vm->mem, DArray<uint8_t>::n(ptr, len));
+			else
+				mb->view(t->vm->mem, DArray<uint8_t>::n(ptr, len));
+
+			return Value::from(mb);
+		}
+
+		void release()
+		{
+			if(mb)
+				mb->view(t->vm->mem, DArray<uint8_t>::n(nullptr, 0));
+		}
+	};
+
+	// Calls stream.Stream.writeExact (func) on stream, for len bytes of the native memory at ptr.
+	void streamExact(Thread* t, ScratchView& scratch, Value func, Value stream, uint8_t* ptr, uword len)
+	{
+		auto slot = push(t, func);
+		push(t, stream);
+		push(t, scratch.view(ptr, len));
+		croc_call(*t, slot, 0);
+		scratch.release();
+	}
+
+	// =================================================================================================================
+	// Serializer
+
+	word_t serializeCallback(CrocThread* t);
+
+	struct Serializer
+	{
+		Thread* t;
+		VM* vm;
+		Value trans;
+		Value output;
+		bool toStream;
+		Value writeExact;
+		Value memblockStream; // the stream given to opSerialize when writing into a memblock; made when first needed
+		Function* serializeFunc;
+		String* opSerializeName;
+		ScratchView scratch;
+		Hash<GCObject*, uword> objTable;
+		uword objIndex;
+
+		// When writing into a memblock, buf is that memblock's data and the written part is buf[0 .. used]; the rest is
+		// room to grow, which is trimmed off whenever script code gets to see the memblock. When writing to a stream,
+		// buf is a native buffer which is flushed to the stream whenever it fills up.
+		Memblock* outMemblock;
+		DArray<uint8_t> buf;
+		uword used;
+		uword origLength;
+
+		Serializer(Thread* t, Value trans, Value output) :
+			t(t),
+			vm(t->vm),
+			trans(trans),
+			output(output),
+			toStream(output.type != CrocType_Memblock),
+			writeExact(Value::nullValue),
+			memblockStream(Value::nullValue),
+			serializeFunc(nullptr),
+			opSerializeName(nullptr),
+			scratch(t),
+			objTable(),
+			objIndex(0),
+			outMemblock(nullptr),
+			buf(DArray<uint8_t>::n(nullptr, 0)),
+			used(0),
+			origLength(0)
+		{}
+
+		void begin()
+		{
+			if(toStream)
+			{
+				croc_ex_lookup(*t, "stream.Stream.writeExact");
+				writeExact = *getValue(t, -1);
+				croc_popTop(*t);
+				buf = DArray<uint8_t>::alloc(vm->mem, StreamBufferSize);
+			}
+			else
+			{
+				outMemblock = output.mMemblock;
+				buf = outMemblock->data;
+				used = origLength = buf.length;
+			}
+
+			croc_pushNativeobj(*t, this);
+			croc_function_new(*t, "serialize", 1, &serializeCallback, 1);
+			serializeFunc = getFunction(t, -1);
+			croc_popTop(*t);
+			opSerializeName = String::create(vm, ATODA("opSerialize"));
+		}
+
+		void finish()
+		{
+			if(toStream)
+			{
+				flush();
+				push(t, output);
+				croc_pushNull(*t);
+				croc_methodCall(*t, -2, "flush", 0);
+			}
+			else
+			{
+				outMemblock->resize(vm->mem, used);
+				buf = outMemblock->data;
+			}
+		}
+
+		// Runs whether or not serialization succeeded. When writing into a memblock, it's put back the way it was on
+		// failure.
+		void cleanup(bool failed)
+		{
+			if(serializeFunc)
+				serializeFunc->setNativeUpval(vm->mem, 0, Value::nullValue);
+
+			if(toStream)
+				buf.free(vm->mem);
+			else if(failed && outMemblock->ownData)
+				outMemblock->resize(vm->mem, origLength);
+
+			objTable.clear(vm->mem);
+		}
+
+		// -------------------------------------------------------------------------------------------------------------
+		// Raw output
+
+		void flush()
+		{
+			if(used > 0)
+			{
+				streamExact(t, scratch, writeExact, output, buf.ptr, used);
+				used = 0;
+			}
+		}
+
+		// Makes sure there are at least n bytes free in buf. n has to be no bigger than StreamBufferSize.
+		void makeRoom(uword n)
+		{
+			if(buf.length - used >= n)
+				return;
+
+			if(toStream)
+				flush();
+			else
+			{
+				auto newLen = buf.length * 2;
+
+				if(newLen < used + n)
+					newLen = used + n;
+
+				if(newLen < 256)
+					newLen = 256;
+
+				outMemblock->resize(vm->mem, newLen);
+				buf = outMemblock->data;
+			}
+		}
+
+		inline void writeByte(uint8_t b)
+		{
+			if(used == buf.length)
+				makeRoom(1);
+
+			buf.ptr[used++] = b;
+		}
+
+		void writeInt(crocint v)
+		{
+			makeRoom(10);
+			bool more;
+
+			do
+			{
+				uint8_t b = v & 0x7F;
+				v >>= 7;
+				more = !((v == 0 && (b & 0x40) == 0) || (v == -1 && (b & 0x40) != 0));
+
+				if(more)
+					b |= 0x80;
+
+				buf.ptr[used++] = b;
+			} while(more);
+		}
+
+		void writeFloat(crocfloat f)
+		{
+			makeRoom(sizeof(crocfloat));
+			memcpy(buf.ptr + used, &f, sizeof(crocfloat));
+			used += sizeof(crocfloat);
+		}
+
+		void writeBlock(const uint8_t* ptr, uword len)
+		{
+			if(buf.length - used < len)
+			{
+				if(toStream && len >= StreamBufferSize)
+				{
+					flush();
+					streamExact(t, scratch, writeExact, output, cast(uint8_t*)ptr, len);
+					return;
+				}
+
+				makeRoom(len);
+			}
+
+			memcpy(buf.ptr + used, ptr, len);
+			used += len;
+		}
+
+		void writeSignature()
+		{
+			writeByte(endianness());
+			writeInt(sizeof(uword) * 8);
+			writeInt(sizeof(crocint));
+			writeInt(sizeof(crocfloat));
+			writeInt(SerialVersion);
+		}
+
+		// -------------------------------------------------------------------------------------------------------------
+		// Going back and forth with script code
+
+		// Gets the output stream ready for opSerialize to write to directly, and returns it.
+		Value enterScript()
+		{
+			if(toStream)
+			{
+				flush();
+				return output;
+			}
+
+			outMemblock->resize(vm->mem, used);
+			buf = outMemblock->data;
+
+			if(memblockStream.type == CrocType_Null)
+			{
+				auto slot = croc_ex_lookup(*t, "stream.MemblockStream");
+				croc_pushNull(*t);
+				push(t, output);
+				croc_call(*t, slot, 1);
+				memblockStream = *getValue(t, -1);
+				croc_popTop(*t);
+			}
+
+			push(t, memblockStream);
+			croc_pushNull(*t);
+			croc_pushInt(*t, 0);
+			croc_pushString(*t, "e");
+			croc_methodCall(*t, -4, "seek", 0);
+			return memblockStream;
+		}
+
+		// Picks up after opSerialize (or the callback it was given) has written to the output stream.
+		void leaveScript()
+		{
+			if(!toStream)
+			{
+				if(!outMemblock->ownData)
+					croc_eh_throwStd(*t, "StateError", "The output memblock was made into a view during serialization");
+
+				buf = outMemblock->data;
+				used = buf.length;
+			}
+		}
+
+		// -------------------------------------------------------------------------------------------------------------
+		// Values
+
+		bool alreadyWritten(GCObject* o)
+		{
+			if(auto idx = objTable.lookup(o))
+			{
+				writeByte(BackrefTag);
+				writeInt(cast(crocint)*idx);
+				return true;
+			}
+
+			*objTable.insert(vm->mem, o) = objIndex++;
+			return false;
+		}
+
+		void serialize(Value v)
+		{
+			auto replacement = lookupTransient(t, trans, v);
+
+			if(!replacement.isFalse())
+			{
+				writeByte(TransientTag);
+				serialize(replacement);
+				return;
+			}
+
+			switch(v.type)
+			{
+				case CrocType_Null:
+					writeByte(CrocType_Null);
+					return;
+
+				case CrocType_Bool:
+					writeByte(CrocType_Bool);
+					writeByte(cast(uint8_t)v.mBool);
+					return;
+
+				case CrocType_Int:
+					writeByte(CrocType_Int);
+					writeInt(v.mInt);
+					return;
+
+				case CrocType_Float:
+					writeByte(CrocType_Float);
+					writeFloat(v.mFloat);
+					return;
+
+				case CrocType_Nativeobj:
+					croc_eh_throwStd(*t, "TypeError", "Attempting to serialize a nativeobj. Please use the transients table.");
+					return;
+
+				case CrocType_String:    serializeString(v.mString);       return;
+				case CrocType_Weakref:   serializeWeakref(v.mWeakref);     return;
+				case CrocType_Table:     serializeTable(v.mTable);         return;
+				case CrocType_Namespace: serializeNamespace(v.mNamespace); return;
+				case CrocType_Array:     serializeArray(v.mArray);         return;
+				case CrocType_Memblock:  serializeMemblock(v.mMemblock);   return;
+				case CrocType_Function:  serializeFunction(v.mFunction);   return;
+				case CrocType_Funcdef:   serializeFuncdef(v.mFuncdef);     return;
+				case CrocType_Class:     serializeClass(v.mClass);         return;
+				case CrocType_Instance:  serializeInstance(v.mInstance);   return;
+				case CrocType_Upval:     serializeUpval(v.mUpval);         return;
+
+				case CrocType_Thread:
+					croc_eh_throwStd(*t, "TypeError", "Attempting to serialize a thread. Please use the transients table.");
+					return;
+
+				default: assert(false);
+			}
+		}
+
+		void serializeString(String* v)
+		{
+			if(alreadyWritten(v))
+				return;
+
+			writeByte(CrocType_String);
+			writeInt(cast(crocint)v->length);
+			writeBlock(v->toUString(), v->length);
+		}
+
+		// Although weakrefs are implemented as objects, their value-ness means that really the only way to properly
+		// serialize/deserialize them is to treat them like a value: just embed them every time they show up.
+		void serializeWeakref(Weakref* v)
+		{
+			writeByte(CrocType_Weakref);
+
+			if(v->obj == nullptr)
+				writeByte(0);
+			else
+			{
+				writeByte(1);
+				serialize(Value::from(v->obj));
+			}
+		}
+
+		void serializeTable(Table* v)
+		{
+			if(alreadyWritten(v))
+				return;
+
+			writeByte(CrocType_Table);
+			writeByte(v->weakMode);
+			writeInt(cast(crocint)v->length());
+
+			size_t idx = 0;
+			Value* key;
+			Value* val;
+
+			while(v->next(idx, key, val))
+			{
+				// Copied, since serializing them can run code that changes the table.
+				auto k = *key;
+				auto value = *val;
+				serialize(k);
+				serialize(value);
+			}
+		}
+
+		void serializeNamespace(Namespace* v)
+		{
+			if(alreadyWritten(v))
+				return;
+
+			writeByte(CrocType_Namespace);
+			serialize(Value::from(v->name));
+
+			if(v->parent == nullptr)
+				writeByte(0);
+			else
+			{
+				writeByte(1);
+				serialize(Value::from(v->parent));
+			}
+
+			writeInt(cast(crocint)v->length());
+
+			uword idx = 0;
+			String** key;
+			Value* val;
+
+			while(v->next(idx, key, val))
+			{
+				auto k = *key;
+				auto value = *val;
+				serialize(Value::from(k));
+				serialize(value);
+			}
+		}
+
+		void serializeArray(Array* v)
+		{
+			if(alreadyWritten(v))
+				return;
+
+			writeByte(CrocType_Array);
+			auto len = v->length;
+			writeInt(cast(crocint)len);
+
+			// If serializing an element shrinks the array, the rest are written as null to keep the data well-formed.
+			for(uword i = 0; i < len; i++)
+				serialize(i < v->length ? v->data[i].value : Value::nullValue);
+		}
+
+		void serializeMemblock(Memblock* v)
+		{
+			if(alreadyWritten(v))
+				return;
+
+			if(!v->ownData)
+				croc_eh_throwStd(*t, "ValueError", "Attempting to serialize a memblock which does not own its data");
+
+			if(v == outMemblock)
+				croc_eh_throwStd(*t, "ValueError", "Attempting to serialize the memblock being serialized into");
+
+			writeByte(CrocType_Memblock);
+			writeInt(cast(crocint)v->data.length);
+			writeBlock(v->data.ptr, v->data.length);
+		}
+
+		void serializeFunction(Function* v)
+		{
+			if(alreadyWritten(v))
+				return;
+
+			if(v->isNative)
+				croc_eh_throwStd(*t, "ValueError", "Attempting to serialize a native function '%s'", v->name->toCString());
+
+			writeByte(CrocType_Function);
+
+			// we do this first so we can allocate it at the beginning of deserialization
+			writeInt(cast(crocint)v->numUpvals);
+			serialize(Value::from(v->scriptFunc));
+
+			if(v->environment == vm->globals)
+				writeByte(0);
+			else
+			{
+				writeByte(1);
+				serialize(Value::from(v->environment));
+			}
+
+			for(auto upval: v->scriptUpvals())
+				serializeUpval(upval);
+		}
+
+		void serializeFuncdef(Funcdef* v)
+		{
+			if(alreadyWritten(v))
+				return;
+
+			writeByte(CrocType_Funcdef);
+			serialize(Value::from(v->locFile));
+			writeInt(v->locLine);
+			writeInt(v->locCol);
+			writeByte(cast(uint8_t)v->isVararg);
+			writeByte(cast(uint8_t)v->isVarret);
+			serialize(Value::from(v->name));
+			writeInt(cast(crocint)v->numParams);
+			writeUwords(v->paramMasks);
+			writeInt(cast(crocint)v->numReturns);
+			writeUwords(v->returnMasks);
+
+			writeInt(cast(crocint)v->upvals.length);
+
+			for(auto &uv: v->upvals)
+			{
+				writeByte(cast(uint8_t)uv.isUpval);
+				writeInt(cast(crocint)uv.index);
+			}
+
+			writeInt(cast(crocint)v->stackSize);
+
+			writeInt(cast(crocint)v->innerFuncs.length);
+
+			for(auto func: v->innerFuncs)
+				serialize(Value::from(func));
+
+			writeInt(cast(crocint)v->constants.length);
+
+			for(auto &val: v->constants)
+				serialize(val);
+
+			writeInt(cast(crocint)v->code.length);
+			auto code = v->code.template as<uint8_t>();
+			writeBlock(code.ptr, code.length);
+			writeInt(cast(crocint)v->fieldCaches.length);
+			writeInt(cast(crocint)v->methodCaches.length);
+
+			if(auto e = v->environment)
+			{
+				writeByte(1);
+				serialize(Value::from(e));
+			}
+			else
+				writeByte(0);
+
+			if(auto f = v->cachedFunc)
+			{
+				writeByte(1);
+				serialize(Value::from(f));
+			}
+			else
+				writeByte(0);
+
+			writeInt(cast(crocint)v->switchTables.length);
+
+			for(auto &st: v->switchTables)
+			{
+				writeInt(cast(crocint)st.offsets.length());
+
+				for(auto node: st.offsets)
+				{
+					serialize(node->key);
+					writeInt(node->value);
+				}
+
+				writeInt(st.defaultOffset);
+			}
+
+			writeInt(cast(crocint)v->lineInfo.length);
+			auto lineInfo = v->lineInfo.template as<uint8_t>();
+			writeBlock(lineInfo.ptr, lineInfo.length);
+
+			writeInt(cast(crocint)v->upvalNames.length);
+
+			for(auto name: v->upvalNames)
+				serialize(Value::from(name));
+
+			writeInt(cast(crocint)v->locVarDescs.length);
+
+			for(auto &desc: v->locVarDescs)
+			{
+				serialize(Value::from(desc.name));
+				writeInt(cast(crocint)desc.pcStart);
+				writeInt(cast(crocint)desc.pcEnd);
+				writeInt(cast(crocint)desc.reg);
+			}
+		}
+
+		void writeUwords(DArray<uword> arr)
+		{
+			writeInt(cast(crocint)arr.length);
+
+			for(auto val: arr)
+				writeInt(cast(crocint)val);
+		}
+
+		template<typename Next>
+		void writeMembers(uword count, Next next)
+		{
+			writeInt(cast(crocint)count);
+
+			uword idx = 0;
+			String** key;
+			Value* val;
+
+			while(next(idx, key, val))
+			{
+				auto k = *key;
+				auto value = *val;
+				serialize(Value::from(k));
+				serialize(value);
+			}
+		}
+
+		void serializeClass(Class* v)
+		{
+			if(alreadyWritten(v))
+				return;
+
+			writeByte(CrocType_Class);
+			serialize(Value::from(v->name));
+
+			// TODO: relax the finalizer restriction, since finalizers aren't "native-only" any more
+			if(v->isFrozen && v->finalizer != nullptr)
+			{
+				croc_eh_throwStd(*t, "ValueError", "Attempting to serialize class '%s' which has a finalizer",
+					v->name->toCString());
+			}
+
+			writeMembers(v->methods.length(), [&](uword& i, String**& k, Value*& val) { return v->nextMethod(i, k, val); });
+			writeMembers(v->fields.length(), [&](uword& i, String**& k, Value*& val) { return v->nextField(i, k, val); });
+			writeMembers(v->hiddenFields.length(),
+				[&](uword& i, String**& k, Value*& val) { return v->nextHiddenField(i, k, val); });
+			writeByte(cast(uint8_t)v->isFrozen);
+		}
+
+		void serializeInstance(Instance* v)
+		{
+			if(alreadyWritten(v))
+				return;
+
+			writeByte(CrocType_Instance);
+			writeInt(cast(crocint)(v->parent->numInstanceFields * sizeof(Array::Slot))); // so we can allocate it
+			serialize(Value::from(v->parent));
+
+			auto s = v->getField(opSerializeName);
+
+			if(s == nullptr)
+				s = v->getMethod(opSerializeName);
+
+			if(s != nullptr)
+			{
+				if(s->type == CrocType_Function)
+				{
+					writeByte(1);
+					auto stream = enterScript();
+					auto slot = push(t, Value::from(v));
+					croc_pushNull(*t);
+					push(t, stream);
+					push(t, Value::from(serializeFunc));
+					croc_methodCall(*t, slot, "opSerialize", 0);
+					leaveScript();
+					return;
+				}
+				else if(s->type == CrocType_Bool)
+				{
+					if(!s->mBool)
+					{
+						croc_pushToStringRaw(*t, push(t, Value::from(v)));
+						croc_eh_throwStd(*t, "ValueError", "Attempting to serialize '%s' whose opSerialize field is false",
+							croc_getString(*t, -1));
+					}
+					// fall out, serialize literally
+				}
+				else
+				{
+					croc_pushToStringRaw(*t, push(t, Value::from(v)));
+					croc_pushTypeString(*t, push(t, *s));
+					croc_eh_throwStd(*t, "TypeError",
+						"Attempting to serialize '%s' whose opSerialize field is '%s', not bool or function",
+						croc_getString(*t, -3), croc_getString(*t, -1));
+				}
+			}
+
+			// TODO: relax the finalizer restriction, since finalizers aren't "native-only" any more
+			if(v->parent->finalizer != nullptr)
+			{
+				croc_pushToStringRaw(*t, push(t, Value::from(v)));
+				croc_eh_throwStd(*t, "ValueError", "Attempting to serialize '%s' which has a finalizer",
+					croc_getString(*t, -1));
+			}
+
+			writeByte(0);
+			writeMembers(v->fields->length(), [&](uword& i, String**& k, Value*& val) { return v->nextField(i, k, val); });
+
+			if(v->hiddenFieldsData == nullptr)
+				writeInt(0);
+			else
+			{
+				writeMembers(v->parent->hiddenFields.length(),
+					[&](uword& i, String**& k, Value*& val) { return v->nextHiddenField(i, k, val); });
+			}
+		}
+
+		void serializeUpval(Upval* uv)
+		{
+			if(alreadyWritten(uv))
+				return;
+
+			writeByte(CrocType_Upval);
+			serialize(*uv->value);
+		}
+	};
+
+	// The callback given to opSerialize. Its only upvalue is the Serializer, or null once serialization is over.
+	word_t serializeCallback(CrocThread* t)
+	{
+		croc_pushUpval(t, 0);
+
+		if(croc_isNull(t, -1))
+			croc_eh_throwStd(t, "StateError", "Attempting to use a serialization callback after serialization is over");
+
+		auto s = cast(Serializer*)croc_getNativeobj(t, -1);
+		croc_popTop(t);
+
+		auto val = croc_getStackSize(t) > 1 ? *getValue(Thread::from(t), 1) : Value::nullValue;
+		auto oldThread = s->t;
+		s->t = Thread::from(t);
+		s->leaveScript();
+		s->serialize(val);
+		s->enterScript();
+		s->t = oldThread;
+		return 0;
+	}
+
+	// =================================================================================================================
+	// Deserializer
+
+	word_t deserializeCallback(CrocThread* t);
+
+	struct Deserializer
+	{
+		Thread* t;
+		VM* vm;
+		Value trans;
+		Value input;
+		bool fromStream;
+		bool seekable;
+		Value memblockStream; // the stream given to opDeserialize when reading from a memblock; made when first needed
+		Function* deserializeFunc;
+		ScratchView scratch;
+		Array* objTable;
+		Table* dummyObj;
+		DArray<uint8_t> strBuf;
+
+		// When reading from a memblock, buf is that memblock's data. When reading from a stream, buf is a native buffer
+		// that's filled from the stream; for a seekable stream, it's filled as much as possible and whatever wasn't
+		// used is given back by seeking backwards before any script code sees the stream. The unread data is
+		// buf[pos .. end].
+		Memblock* inMemblock;
+		DArray<uint8_t> buf;
+		uword pos;
+		uword end;
+
+		Deserializer(Thread* t, Value trans, Value input) :
+			t(t),
+			vm(t->vm),
+			trans(trans),
+			input(input),
+			fromStream(input.type != CrocType_Memblock),
+			seekable(false),
+			memblockStream(Value::nullValue),
+			deserializeFunc(nullptr),
+			scratch(t),
+			objTable(nullptr),
+			dummyObj(nullptr),
+			strBuf(DArray<uint8_t>::n(nullptr, 0)),
+			inMemblock(nullptr),
+			buf(DArray<uint8_t>::n(nullptr, 0)),
+			pos(0),
+			end(0)
+		{}
+
+		void begin()
+		{
+			if(fromStream)
+			{
+				push(t, input);
+				croc_pushNull(*t);
+				croc_methodCall(*t, -2, "seekable", 1);
+				seekable = !getValue(t, -1)->isFalse();
+				croc_popTop(*t);
+
+				buf = DArray<uint8_t>::alloc(vm->mem, StreamBufferSize);
+			}
+			else
+			{
+				inMemblock = input.mMemblock;
+				buf = inMemblock->data;
+				end = buf.length;
+			}
+
+			croc_pushNativeobj(*t, this);
+			croc_function_new(*t, "deserialize", 1, &deserializeCallback, 1);
+			deserializeFunc = getFunction(t, -1);
+			croc_popTop(*t);
+			objTable = Array::create(vm->mem, 0);
+		}
+
+		void finish()
+		{
+			if(fromStream)
+				giveBack();
+		}
+
+		void cleanup(bool failed)
+		{
+			if(failed && objTable)
+				finishInstances();
+
+			if(deserializeFunc)
+				deserializeFunc->setNativeUpval(vm->mem, 0, Value::nullValue);
+
+			if(fromStream)
+				buf.free(vm->mem);
+
+			strBuf.free(vm->mem);
+		}
+
+		// Instances which never got their class (because the data was cut off or bad before then) are given an empty one,
+		// since the GC expects every instance to have a class.
+		void finishInstances()
+		{
+			Class* empty = nullptr;
+
+			for(auto &slot: objTable->toDArray())
+			{
+				auto v = slot.value;
+
+				if(v.type != CrocType_Instance || v.mInstance->parent != nullptr)
+					continue;
+
+				if(empty == nullptr)
+				{
+					empty = Class::create(vm->mem, String::create(vm, ATODA("Unfinished")));
+					empty->freeze(vm->mem);
+				}
+
+				v.mInstance->parent = empty;
+				v.mInstance->fields = &empty->fields;
+			}
+		}
+
+		// -------------------------------------------------------------------------------------------------------------
+		// Raw input
+
+		void endOfData()
+		{
+			croc_eh_throwStd(*t, "ValueError", "Malformed data (unexpected end of data)");
+		}
+
+		// Seeks a seekable input stream back to just after the data that's actually been used.
+		void giveBack()
+		{
+			if(seekable && end > pos)
+			{
+				push(t, input);
+				croc_pushNull(*t);
+				croc_pushInt(*t, -cast(crocint)(end - pos));
+				croc_pushString(*t, "c");
+				croc_methodCall(*t, -4, "seek", 0);
+			}
+
+			pos = end = 0;
+		}
+
+		// Makes sure there are at least n bytes in buf[pos .. end]. n has to be no bigger than StreamBufferSize.
+		void fill(uword n)
+		{
+			if(end - pos >= n)
+				return;
+
+			if(!fromStream)
+				endOfData();
+
+			memmove(buf.ptr, buf.ptr + pos, end - pos);
+			end -= pos;
+			pos = 0;
+
+			while(end < n)
+			{
+				// A stream that can't seek back can't be read ahead of what's needed.
+				end += readStream(buf.ptr + end, seekable ? buf.length - end : n - end);
+			}
+		}
+
+		// Does one read of at most want bytes from the input stream into dest, and returns how many it got. Running
+		// out of data is an error, so that's always at least one.
+		uword readStream(uint8_t* dest, uword want)
+		{
+			auto slot = push(t, input);
+			croc_pushNull(*t);
+			push(t, scratch.view(dest, want));
+			croc_methodCall(*t, slot, "read", 1);
+			scratch.release();
+			auto got = croc_getInt(*t, -1);
+			croc_popTop(*t);
+
+			if(got < 0 || cast(uword)got > want)
+				croc_eh_throwStd(*t, "ValueError", "Input stream's read method returned an invalid size");
+			else if(got == 0)
+				endOfData();
+
+			return cast(uword)got;
+		}
+
+		inline uint8_t readByte()
+		{
+			if(pos == end)
+				fill(1);
+
+			return buf.ptr[pos++];
+		}
+
+		crocint readInt()
+		{
+			uint64_t ret = 0;
+			uword shift = 0;
+			uint8_t b;
+
+			while(true)
+			{
+				if(shift >= sizeof(crocint) * 8)
+					croc_eh_throwStd(*t, "ValueError", "Malformed data (overlong integer)");
+
+				b = readByte();
+				ret |= cast(uint64_t)(b & 0x7F) << shift;
+				shift += 7;
+
+				if((b & 0x80) == 0)
+					break;
+			}
+
+			if(shift < sizeof(crocint) * 8 && (b & 0x40))
+				ret |= ~cast(uint64_t)0 << shift;
+
+			return cast(crocint)ret;
+		}
+
+		uword readLength()
+		{
+			auto ret = readInt();
+
+			if(ret < 0 || ret > 0xFFFFFFFF)
+			{
+				croc_eh_throwStd(*t, "ValueError", "Malformed data (length field has a value of %" CROC_INTEGER_FORMAT ")",
+					ret);
+			}
+
+			return cast(uword)ret;
+		}
+
+		// A count of things which each take at least a byte. When reading from a memblock, this catches bogus counts
+		// before they turn into huge allocations.
+		uword readCount()
+		{
+			auto ret = readLength();
+
+			if(!fromStream && ret > end - pos)
+				endOfData();
+
+			return ret;
+		}
+
+		// How many of count things to make room for before reading them. From a memblock, readCount has already made
+		// sure they're all there. A stream can't be checked ahead of time, so room is made for at most a buffer's worth
+		// up front and the rest as they're read, and a bogus count runs into the end of the data instead of into a huge
+		// allocation.
+		uword initialRoom(uword count)
+		{
+			return fromStream && count > StreamBufferSize ? StreamBufferSize : count;
+		}
+
+		// Resizes arr to count things and reads them with read(T&), making room as it goes (see initialRoom).
+		template<typename T, typename Read>
+		void readArray(DArray<T>& arr, uword count, Read read)
+		{
+			arr.resize(vm->mem, initialRoom(count));
+
+			for(uword i = 0; i < count; i++)
+			{
+				if(i == arr.length)
+					arr.resize(vm->mem, count - i < i ? count : i * 2);
+
+				read(arr[i]);
+			}
+		}
+
+		// Resizes arr to count things and reads their raw bytes into it, making room as it goes (see initialRoom).
+		template<typename T>
+		void readRaw(DArray<T>& arr, uword count)
+		{
+			arr.resize(vm->mem, initialRoom(count));
+			uword done = 0;
+
+			while(true)
+			{
+				auto bytes = arr.template as<uint8_t>();
+				readBlock(bytes.ptr + done * sizeof(T), (arr.length - done) * sizeof(T));
+				done = arr.length;
+
+				if(done == count)
+					break;
+
+				arr.resize(vm->mem, count - done < done ? count : done * 2);
+			}
+		}
+
+		crocfloat readFloat()
+		{
+			fill(sizeof(crocfloat));
+			crocfloat ret;
+			memcpy(&ret, buf.ptr + pos, sizeof(crocfloat));
+			pos += sizeof(crocfloat);
+			return ret;
+		}
+
+		void readBlock(uint8_t* dest, uword len)
+		{
+			auto avail = end - pos;
+
+			if(len <= avail)
+			{
+				memcpy(dest, buf.ptr + pos, len);
+				pos += len;
+				return;
+			}
+
+			if(!fromStream)
+				endOfData();
+
+			memcpy(dest, buf.ptr + pos, avail);
+			pos = end = 0;
+			dest += avail;
+			len -= avail;
+
+			if(!seekable || len >= StreamBufferSize / 2)
+			{
+				while(len > 0)
+				{
+					auto got = readStream(dest, len);
+					dest += got;
+					len -= got;
+				}
+			}
+			else
+			{
+				fill(len);
+				memcpy(dest, buf.ptr, len);
+				pos = len;
+			}
+		}
+
+		void readSignature()
+		{
+			if(readByte() != endianness())
+				croc_eh_throwStd(*t, "ValueError", "Data was serialized with a different endianness");
+
+			auto bits = readInt();
+
+			if(bits != cast(crocint)(sizeof(uword) * 8))
+			{
+				croc_eh_throwStd(*t, "ValueError",
+					"Data was serialized on a %" CROC_INTEGER_FORMAT "-bit platform; this is a %" CROC_SIZE_T_FORMAT
+						"-bit platform",
+					bits, sizeof(uword) * 8);
+			}
+
+			auto size = readInt();
+
+			if(size != cast(crocint)sizeof(crocint))
+			{
+				croc_eh_throwStd(*t, "ValueError",
+					"Data was serialized from a Croc build with %" CROC_INTEGER_FORMAT "-bit ints; this build has %"
+						CROC_SIZE_T_FORMAT "-bit ints",
+					size, sizeof(crocint));
+			}
+
+			size = readInt();
+
+			if(size != cast(crocint)sizeof(crocfloat))
+			{
+				croc_eh_throwStd(*t, "ValueError",
+					"Data was serialized from a Croc build with %" CROC_INTEGER_FORMAT "-bit floats; this build has %"
+						CROC_SIZE_T_FORMAT "-bit floats",
+					size, sizeof(crocfloat));
+			}
+
+			if(readInt() != SerialVersion)
+				croc_eh_throwStd(*t, "ValueError", "Data was serialized from a Croc build with a different serial data format");
+		}
+
+		// -------------------------------------------------------------------------------------------------------------
+		// Going back and forth with script code
+
+		// Gets the input stream ready for opDeserialize to read from directly, and returns it.
+		Value enterScript()
+		{
+			if(fromStream)
+			{
+				giveBack();
+				return input;
+			}
+
+			if(memblockStream.type == CrocType_Null)
+			{
+				auto slot = croc_ex_lookup(*t, "stream.MemblockStream");
+				croc_pushNull(*t);
+				push(t, input);
+				croc_call(*t, slot, 1);
+				memblockStream = *getValue(t, -1);
+				croc_popTop(*t);
+			}
+
+			push(t, memblockStream);
+			croc_pushNull(*t);
+			croc_pushInt(*t, cast(crocint)pos);
+			croc_pushString(*t, "b");
+			croc_methodCall(*t, -4, "seek", 0);
+			return memblockStream;
+		}
+
+		// Picks up after opDeserialize (or the callback it was given) has read from the input stream.
+		void leaveScript()
+		{
+			if(fromStream)
+				return;
+
+			push(t, memblockStream);
+			croc_pushNull(*t);
+			croc_pushInt(*t, 0);
+			croc_pushString(*t, "c");
+			croc_methodCall(*t, -4, "seek", 1);
+			auto newPos = croc_getInt(*t, -1);
+			croc_popTop(*t);
+
+			buf = inMemblock->data;
+			end = buf.length;
+			pos = newPos < 0 ? 0 : cast(uword)newPos;
+
+			if(pos > end)
+				pos = end;
+		}
+
+		// -------------------------------------------------------------------------------------------------------------
+		// Values
+
+		void addObject(GCObject* o)
+		{
+			objTable->append(vm->mem, Value::from(o));
+		}
+
+		Value deserialize()
+		{
+			return deserializeTagged(readByte());
+		}
+
+		Value deserializeTagged(uint8_t tag)
+		{
+			switch(tag)
+			{
+				case CrocType_Null:      return Value::nullValue;
+				case CrocType_Bool:      return Value::from(readByte() != 0);
+				case CrocType_Int:       return Value::from(readInt());
+				case CrocType_Float:     return Value::from(readFloat());
+				case CrocType_String:    return Value::from(deserializeStringImpl());
+				case CrocType_Weakref:   return deserializeWeakrefImpl();
+				case CrocType_Table:     return Value::from(deserializeTableImpl());
+				case CrocType_Namespace: return Value::from(deserializeNamespaceImpl());
+				case CrocType_Array:     return Value::from(deserializeArrayImpl());
+				case CrocType_Memblock:  return Value::from(deserializeMemblockImpl());
+				case CrocType_Function:  return Value::from(deserializeFunctionImpl());
+				case CrocType_Funcdef:   return Value::from(deserializeFuncdefImpl());
+				case CrocType_Class:     return Value::from(deserializeClassImpl());
+				case CrocType_Instance:  return Value::from(deserializeInstanceImpl());
+				case CrocType_Upval:     return Value::from(cast(GCObject*)deserializeUpvalImpl());
+				case TransientTag:       return deserializeTransientImpl();
+				case BackrefTag:         return deserializeBackrefImpl();
+
+				default:
+					croc_eh_throwStd(*t, "ValueError", "Malformed data (invalid type tag)");
+					return Value::nullValue; // dummy
+			}
+		}
+
+		// Reads a value which has to be of the given type. Backrefs and transients are allowed, as long as what they
+		// refer to is of that type.
+		Value deserializeAs(CrocType wanted)
+		{
+			auto tag = readByte();
+
+			if(tag == wanted)
+				return deserializeTagged(tag);
+
+			Value ret;
+
+			if(tag == BackrefTag)
+				ret = deserializeBackrefImpl();
+			else if(tag == TransientTag)
+				ret = deserializeTransientImpl();
+			else if(tag < CrocType_NUMTYPES)
+			{
+				croc_eh_throwStd(*t, "ValueError", "Malformed data (expected object of type '%s' but found '%s' instead)",
+					typeToString(wanted), typeToString(cast(CrocType)tag));
+			}
+			else
+			{
+				croc_eh_throwStd(*t, "ValueError",
+					"Malformed data (expected object of type '%s' but found garbage instead)", typeToString(wanted));
+			}
+
+			// The backref might be to an object that's still being read, so don't try to describe it any further.
+			if(ret.type != wanted)
+			{
+				croc_eh_throwStd(*t, "ValueError",
+					"Malformed data (expected type '%s' but found a backref to type '%s' instead)",
+					typeToString(wanted), typeToString(ret.type));
+			}
+
+			return ret;
+		}
+
+		String* deserializeString()
+		{
+			return deserializeAs(CrocType_String).mString;
+		}
+
+		Value deserializeTransientImpl()
+		{
+			auto key = deserialize();
+			auto ret = lookupTransient(t, trans, key);
+
+			if(ret.type == CrocType_Null)
+			{
+				croc_pushToStringRaw(*t, push(t, key));
+				croc_eh_throwStd(*t, "ValueError",
+					"Malformed data or invalid transient table (transient key %s does not exist)", croc_getString(*t, -1));
+			}
+
+			return ret;
+		}
+
+		Value deserializeBackrefImpl()
+		{
+			auto idx = readInt();
+
+			if(idx < 0 || cast(uword)idx >= objTable->length)
+				croc_eh_throwStd(*t, "ValueError", "Malformed data (invalid back-reference)");
+
+			return objTable->data[cast(uword)idx].value;
+		}
+
+		String* deserializeStringImpl()
+		{
+			auto len = readLength();
+			String* ret;
+
+			if(len <= end - pos || (fromStream && len <= StreamBufferSize))
+			{
+				fill(len);
+				ret = String::tryCreate(vm, crocstr::n(buf.ptr + pos, len));
+				pos += len;
+			}
+			else
+			{
+				if(!fromStream)
+					endOfData();
+
+				readRaw(strBuf, len);
+				ret = String::tryCreate(vm, crocstr::n(strBuf.ptr, len));
+			}
+
+			if(ret == nullptr)
+				croc_eh_throwStd(*t, "ValueError", "Malformed data (invalid UTF-8 in string)");
+
+			addObject(ret);
+			return ret;
+		}
+
+		Value deserializeWeakrefImpl()
+		{
+			if(readByte() != 0)
+				return Weakref::makeref(vm, deserialize());
+
+			if(dummyObj == nullptr)
+				dummyObj = Table::create(vm->mem);
+
+			return Weakref::makeref(vm, Value::from(dummyObj));
+		}
+
+		Table* deserializeTableImpl()
+		{
+			auto mode = readByte();
+
+			if(mode > CrocWeakMode_Ephemeron)
+				croc_eh_throwStd(*t, "ValueError", "Malformed data (invalid table weak mode)");
+
+			auto len = readCount();
+			auto ret = Table::createWeak(vm, cast(CrocWeakMode)mode);
+			addObject(ret);
+
+			for(uword i = 0; i < len; i++)
+			{
+				auto key = deserialize();
+				auto value = deserialize();
+
+				if(key.type == CrocType_Null)
+					croc_eh_throwStd(*t, "ValueError", "Malformed data (table key is null)");
+
+				tableIdxaImpl(t, ret, key, value);
+			}
+
+			return ret;
+		}
+
+		Namespace* deserializeNamespaceImpl()
+		{
+			auto ret = Namespace::createPartial(vm->mem);
+			addObject(ret);
+
+			auto name = deserializeString();
+			Namespace* parent = nullptr;
+
+			if(readByte() != 0)
+				parent = deserializeAs(CrocType_Namespace).mNamespace;
+
+			Namespace::finishCreate(ret, name, parent);
+
+			auto len = readCount();
+
+			for(uword i = 0; i < len; i++)
+			{
+				auto key = deserializeString();
+				auto value = deserialize();
+				ret->set(vm->mem, key, value);
+			}
+
+			return ret;
+		}
+
+		Array* deserializeArrayImpl()
+		{
+			auto len = readCount();
+			auto room = initialRoom(len);
+			auto ret = Array::create(vm->mem, room);
+			addObject(ret);
+
+			for(uword i = 0; i < len; i++)
+			{
+				auto value = deserialize();
+
+				if(i == room)
+				{
+					room++;
+
+					if(ret->length == i)
+						ret->resize(vm->mem, room);
+				}
+
+				// opDeserialize could have gotten a backref to this array and resized it.
+				if(i < ret->length)
+					ret->idxa(vm->mem, i, value);
+			}
+
+			return ret;
+		}
+
+		Memblock* deserializeMemblockImpl()
+		{
+			auto len = readCount();
+			auto ret = Memblock::create(vm->mem, 0);
+			addObject(ret);
+			readRaw(ret->data, len);
+			return ret;
+		}
+
+		Function* deserializeFunctionImpl()
+		{
+			auto numUpvals = readLength();
+
+			if(numUpvals > INST_MAX_UPVALUE)
+				croc_eh_throwStd(*t, "ValueError", "Malformed data (function has too many upvalues)");
+
+			auto ret = Function::createPartial(vm->mem, numUpvals);
+			addObject(ret);
+
+			auto def = deserializeAs(CrocType_Funcdef).mFuncdef;
+			auto env = vm->globals;
+
+			if(readByte() != 0)
+				env = deserializeAs(CrocType_Namespace).mNamespace;
+
+			if(def->upvals.length != numUpvals)
+				croc_eh_throwStd(*t, "ValueError", "Malformed data (function's upvalue count doesn't match its funcdef)");
+
+			Function::finishCreate(vm->mem, ret, env, def);
+
+			for(auto &uv: ret->scriptUpvals())
+				uv = deserializeAs(CrocType_Upval).mUpval;
+
+			return ret;
+		}
+
+		void readUwords(DArray<uword>& arr)
+		{
+			readArray(arr, readCount(), [&](uword& val) { val = readLength(); });
+		}
+
+		// Each cache is used by at least one instruction, so there can't be more of them than that.
+		uword readCacheCount(Funcdef* def)
+		{
+			auto ret = readLength();
+
+			if(ret > def->code.length)
+				croc_eh_throwStd(*t, "ValueError", "Malformed data (funcdef has more caches than instructions)");
+
+			return ret;
+		}
+
+		Funcdef* deserializeFuncdefImpl()
+		{
+			auto &mem = vm->mem;
+			auto def = Funcdef::create(mem);
+			addObject(def);
+
+			def->locFile = deserializeString();
+			def->locLine = readLength();
+			def->locCol = readLength();
+			def->isVararg = readByte() != 0;
+			def->isVarret = readByte() != 0;
+			def->name = deserializeString();
+			def->numParams = readLength();
+			readUwords(def->paramMasks);
+			def->numReturns = readLength();
+			readUwords(def->returnMasks);
+
+			readArray(def->upvals, readCount(), [&](Funcdef::UpvalDesc& uv)
+			{
+				uv.isUpval = readByte() != 0;
+				uv.index = readLength();
+			});
+
+			def->stackSize = readLength();
+
+			readArray(def->innerFuncs, readCount(), [&](Funcdef*& func)
+			{
+				func = deserializeAs(CrocType_Funcdef).mFuncdef;
+			});
+
+			readArray(def->constants, readCount(), [&](Value& val) { val = deserialize(); });
+			def->globalCaches.resize(mem, def->constants.length);
+
+			readRaw(def->code, readCount());
+			def->fieldCaches.resize(mem, readCacheCount(def));
+			def->methodCaches.resize(mem, readCacheCount(def));
+
+			if(readByte() != 0)
+				def->environment = deserializeAs(CrocType_Namespace).mNamespace;
+
+			if(readByte() != 0)
+				def->cachedFunc = deserializeAs(CrocType_Function).mFunction;
+
+			readArray(def->switchTables, readCount(), [&](Funcdef::SwitchTable& st)
+			{
+				auto numOffsets = readCount();
+
+				for(uword i = 0; i < numOffsets; i++)
+				{
+					auto key = deserialize();
+					*st.offsets.insert(mem, key) = cast(word)readInt();
+				}
+
+				st.defaultOffset = cast(word)readInt();
+				st.buildIntCases(mem);
+			});
+
+			readRaw(def->lineInfo, readCount());
+			readArray(def->upvalNames, readCount(), [&](String*& name) { name = deserializeString(); });
+
+			readArray(def->locVarDescs, readCount(), [&](Funcdef::LocVarDesc& desc)
+			{
+				desc.name = deserializeString();
+				desc.pcStart = readLength();
+				desc.pcEnd = readLength();
+				desc.reg = readLength();
+			});
+
+			return def;
+		}
+
+		template<typename Add>
+		void readMembers(Class* v, const char* what, Add add)
+		{
+			auto num = readCount();
+
+			for(uword i = 0; i < num; i++)
+			{
+				auto name = deserializeString();
+				auto value = deserialize();
+
+				if(!add(name, value))
+				{
+					croc_eh_throwStd(*t, "ValueError", "Malformed data (class %s already has a %s '%s')",
+						v->name->toCString(), what, name->toCString());
+				}
+			}
+		}
+
+		Class* deserializeClassImpl()
+		{
+			auto &mem = vm->mem;
+			// It gets a temporary name so error messages don't choke on it if the data is bad and refers back to it.
+			auto v = Class::create(mem, String::create(vm, ATODA("<partial>")));
+			addObject(v);
+
+			v->name = deserializeString();
+			readMembers(v, "method", [&](String* name, Value val) { return v->addMethod(mem, name, val, false); });
+			readMembers(v, "field", [&](String* name, Value val) { return v->addField(mem, name, val, false); });
+			readMembers(v, "hidden field", [&](String* name, Value val) { return v->addHiddenField(mem, name, val); });
+
+			if(readByte() != 0)
+				freezeImpl(t, v);
+
+			return v;
+		}
+
+		Instance* deserializeInstanceImpl()
+		{
+			auto size = readLength();
+
+			// This is the size of the instance's fields. 1MB should be a reasonably insane upper bound :P
+			if(size % sizeof(Array::Slot) != 0 || size >= (1 << 20))
+				croc_eh_throwStd(*t, "ValueError", "Malformed data (invalid instance size)");
+
+			auto v = Instance::createPartial(vm->mem, size, false); // always false for now, might change later
+			addObject(v);
+
+			auto parent = deserializeAs(CrocType_Class).mClass;
+
+			// Instantiating a class freezes it. One which came from the transients might not have been instantiated yet.
+			freezeImpl(t, parent);
+
+			if(!Instance::finishCreate(v, parent))
+			{
+				croc_eh_throwStd(*t, "ValueError",
+					"Malformed data (instance size %" CROC_SIZE_T_FORMAT
+						" does not match base class size %" CROC_SIZE_T_FORMAT ")",
+					v->memSize, sizeof(Instance) + parent->numInstanceFields * sizeof(Array::Slot));
+			}
+
+			if(readByte() != 0)
+			{
+				auto slot = push(t, Value::from(v));
+
+				if(!croc_hasMethod(*t, slot, "opDeserialize"))
+				{
+					croc_pushTypeString(*t, slot);
+					croc_eh_throwStd(*t, "ValueError",
+						"'%s' was serialized with opSerialize, but does not have a matching opDeserialize",
+						croc_getString(*t, -1));
+				}
+
+				croc_pushNull(*t);
+				push(t, enterScript());
+				push(t, Value::from(deserializeFunc));
+				croc_methodCall(*t, slot, "opDeserialize", 0);
+				leaveScript();
+				return v;
+			}
+
+			auto numFields = readCount();
+
+			for(uword i = 0; i < numFields; i++)
+			{
+				auto name = deserializeString();
+				auto value = deserialize();
+
+				if(!v->setField(vm->mem, name, value))
+				{
+					croc_eh_throwStd(*t, "ValueError", "Malformed data (no field '%s' in instance of class '%s')",
+						name->toCString(), parent->name->toCString());
+				}
+			}
+
+			auto numHiddenFields = readCount();
+
+			for(uword i = 0; i < numHiddenFields; i++)
+			{
+				auto name = deserializeString();
+				auto value = deserialize();
+
+				if(!v->setHiddenField(vm->mem, name, value))
+				{
+					croc_eh_throwStd(*t, "ValueError", "Malformed data (no hidden field '%s' in instance of class '%s')",
+						name->toCString(), parent->name->toCString());
+				}
+			}
+
+			return v;
+		}
+
+		Upval* deserializeUpvalImpl()
+		{
+			auto uv = ALLOC_OBJ(vm->mem, Upval);
+			uv->type = CrocType_Upval;
+			uv->nextuv = nullptr;
+			uv->value = &uv->closedValue;
+			uv->closedValue = Value::nullValue;
+			addObject(uv);
+			uv->closedValue = deserialize();
+			return uv;
+		}
+	};
+
+	// The callback given to opDeserialize. Its only upvalue is the Deserializer, or null once deserialization is over.
+	word_t deserializeCallback(CrocThread* t)
+	{
+		croc_pushUpval(t, 0);
+
+		if(croc_isNull(t, -1))
+			croc_eh_throwStd(t, "StateError", "Attempting to use a deserialization callback after deserialization is over");
+
+		auto d = cast(Deserializer*)croc_getNativeobj(t, -1);
+		croc_popTop(t);
+
+		auto wanted = CrocType_NUMTYPES;
+
+		if(croc_getStackSize(t) > 1 && !croc_isNull(t, 1))
+		{
+			auto name = croc_ex_checkStringParam(t, 1);
+
+			for(uword i = 0; i < CrocType_NUMTYPES; i++)
+			{
+				if(strcmp(name, typeToString(cast(CrocType)i)) == 0)
+				{
+					wanted = cast(CrocType)i;
+					break;
+				}
+			}
+
+			if(wanted == CrocType_NUMTYPES)
+				croc_eh_throwStd(t, "ValueError", "Invalid requested type '%s'", name);
+		}
+
+		auto oldThread = d->t;
+		d->t = Thread::from(t);
+		d->leaveScript();
+		auto ret = wanted == CrocType_NUMTYPES ? d->deserialize() : d->deserializeAs(wanted);
+		d->enterScript();
+		d->t = oldThread;
+		push(Thread::from(t), ret);
+		return 1;
+	}
+	}
+
+	// Serializes the object graph rooted at the value in slot val into output, which is either a memblock (which the
+	// data is appended to) or an output stream. All the slots are absolute. The GC is off the whole time, so that
+	// nothing in the graph can be collected and have its address reused while the objects' indices are being tracked
+	// (opSerialize methods are free to change the graph as they go).
+	void serializeGraph(Thread* t, word val, word transients, word output)
+	{
+		auto v = *getValue(t, val);
+		auto trans = *getValue(t, transients);
+
+		if(v == trans)
+			croc_eh_throwStd(*t, "ValueError", "Object to serialize is the same as the transients table");
+
+		auto out = *getValue(t, output);
+
+		if(out.type == CrocType_Memblock && !out.mMemblock->ownData)
+			croc_eh_throwStd(*t, "ValueError", "Attempting to serialize into a memblock which does not own its data");
+
+		Serializer s(t, trans, out);
+		t->vm->disableGC();
+
+		auto slot = croc_pushNull(*t);
+		auto failed = tryCode(t, slot, [&]
+		{
+			s.begin();
+			s.writeSignature();
+			s.serialize(v);
+			s.finish();
+		});
+
+		t->vm->enableGC();
+		s.cleanup(failed);
+
+		if(failed)
+			croc_eh_rethrow(*t);
+
+		croc_popTop(*t);
+	}
+
+	// Deserializes an object graph from input, which is either a memblock (which is read from the beginning) or an
+	// input stream, and pushes its root. All the slots are absolute. Returns the stack index of the pushed value.
+	word deserializeGraph(Thread* t, word transients, word input)
+	{
+		Deserializer d(t, *getValue(t, transients), *getValue(t, input));
+		t->vm->disableGC();
+
+		Value ret;
+		auto slot = croc_pushNull(*t);
+		auto failed = tryCode(t, slot, [&]
+		{
+			d.begin();
+			d.readSignature();
+			ret = d.deserialize();
+			d.finish();
+		});
+
+		d.cleanup(failed);
+
+		if(failed)
+		{
+			t->vm->enableGC();
+			croc_eh_rethrow(*t);
+		}
+
+		croc_popTop(*t);
+		auto retSlot = push(t, ret);
+		t->vm->enableGC();
+		return retSlot;
+	}
+}
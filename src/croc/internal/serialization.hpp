@@ -0,0 +1,12 @@
+#ifndef CROC_INTERNAL_SERIALIZATION_HPP
+#define CROC_INTERNAL_SERIALIZATION_HPP
+
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+	void serializeGraph(Thread* t, word val, word transients, word output);
+	word deserializeGraph(Thread* t, word transients, word input);
+}
+
+#endif
@@ -0,0 +1,899 @@
+#include <functional>
+#include <string.h>
+
+#include "croc/api.h"
+#include "croc/internal/class.hpp"
+#include "croc/internal/eh.hpp"
+#include "croc/internal/image.hpp"
+#include "croc/internal/snapshot.hpp"
+#include "croc/internal/stack.hpp"
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+	namespace
+	{
+	// A snapshot is the header, then the objects, then the VM's roots, then a checksum of all that. Each object is
+	// written twice: first with just enough to allocate it, and then (after every object has been allocated) with its
+	// contents. Objects refer to each other by their index plus one, with 0 meaning null.
+	const uint8_t Magic[] = { 'C', 'r', 'o', 'c', 'S', 'S' };
+	const uword FormatVersion = 1;
+
+	// FNV-1a, but a word at a time, since snapshots are big. The data can be added in pieces of any size.
+	struct Checksum
+	{
+		uint64_t hash;
+		uint8_t partial[sizeof(uint64_t)];
+		uword partialLen;
+
+		Checksum() :
+			hash(14695981039346656037ULL),
+			partialLen(0)
+		{}
+
+		void add(crocstr data)
+		{
+			auto p = data.ptr;
+			auto end = data.ptr + data.length;
+
+			if(partialLen > 0)
+			{
+				for(; p < end && partialLen < sizeof(partial); p++)
+					partial[partialLen++] = *p;
+
+				if(partialLen < sizeof(partial))
+					return;
+
+				addWord(partial);
+				partialLen = 0;
+			}
+
+			for(; cast(uword)(end - p) >= sizeof(uint64_t); p += sizeof(uint64_t))
+				addWord(p);
+
+			for(; p < end; p++)
+				partial[partialLen++] = *p;
+		}
+
+		uint64_t finish()
+		{
+			for(uword i = 0; i < partialLen; i++)
+				hash = (hash ^ partial[i]) * 1099511628211ULL;
+
+			partialLen = 0;
+			return hash;
+		}
+
+	private:
+		void addWord(const uint8_t* p)
+		{
+			uint64_t w;
+			memcpy(&w, p, sizeof(w));
+			hash = (hash ^ w) * 1099511628211ULL;
+		}
+	};
+
+	// Native functions are stored as offsets from an API function, so that they can be found again when the library is
+	// loaded at a different address. This only works for native functions in the same executable or shared library as
+	// Croc itself; the offset of another API function is stored in the header to check that the library is the same.
+	inline uintptr_t codeBase()
+	{
+		return cast(uintptr_t)&croc_vm_open;
+	}
+
+	inline crocint codeOffset(uintptr_t p)
+	{
+		return cast(crocint)(p - codeBase());
+	}
+
+	inline crocint codeCheck()
+	{
+		return codeOffset(cast(uintptr_t)&croc_vm_close);
+	}
+
+	// The contents of objects are written in passes: functions need their funcdefs to be filled in first, and instances
+	// need their classes to be frozen first.
+	const uword NumFillPasses = 3;
+
+	inline uword fillPass(CrocType type)
+	{
+		switch(type)
+		{
+			case CrocType_Function: return 1;
+			case CrocType_Instance: return 2;
+			default:                return 0;
+		}
+	}
+
+	struct SnapshotWriter : public ImageWriter
+	{
+	private:
+		Thread* t;
+		VM* vm;
+		Hash<GCObject*, uword> ids;
+		DArray<GCObject*> objects;
+		uword numObjects;
+
+	public:
+		SnapshotWriter(Thread* t, std::function<void(crocstr)> output) :
+			ImageWriter(output),
+			t(t),
+			vm(t->vm),
+			ids(),
+			objects(),
+			numObjects(0)
+		{}
+
+		// The objects are walked twice: once to number them (breadth-first from the roots), and again to write them.
+		void write()
+		{
+			collecting = true;
+			writeRoots();
+
+			for(uword i = 0; i < numObjects; i++)
+			{
+				writeAlloc(objects[i]);
+				writeContents(objects[i]);
+			}
+
+			collecting = false;
+			writeBlock(crocstr::n(Magic, sizeof(Magic)));
+			writeLength(FormatVersion);
+			writeLength(imageBuildSignature());
+			writeInt(codeCheck());
+			writeLength(numObjects);
+
+			uword numStrings = 0;
+
+			for(uword i = 0; i < numObjects; i++)
+			{
+				if(objects[i]->type == CrocType_String)
+					numStrings++;
+			}
+
+			writeLength(numStrings);
+
+			for(uword i = 0; i < numObjects; i++)
+				writeAlloc(objects[i]);
+
+			for(uword pass = 0; pass < NumFillPasses; pass++)
+			{
+				for(uword i = 0; i < numObjects; i++)
+				{
+					if(fillPass(objects[i]->type) == pass)
+						writeContents(objects[i]);
+				}
+			}
+
+			writeRoots();
+		}
+
+		void cleanup()
+		{
+			ids.clear(vm->mem);
+			objects.free(vm->mem);
+		}
+
+		void writeString(String* s)
+		{
+			writeRef(s);
+		}
+
+		void writeConstant(Value v)
+		{
+			writeValue(v);
+		}
+
+		void writeInnerFunc(Funcdef* def)
+		{
+			writeRef(def);
+		}
+
+	private:
+		void writeRef(GCObject* o)
+		{
+			if(o == nullptr)
+			{
+				writeLength(0);
+				return;
+			}
+
+			auto id = ids.lookup(o);
+
+			if(id == nullptr)
+			{
+				assert(collecting);
+				checkWritable(o);
+
+				if(numObjects == objects.length)
+					objects.resize(vm->mem, objects.length == 0 ? 256 : objects.length * 2);
+
+				objects[numObjects] = o;
+				id = ids.insert(vm->mem, o);
+				*id = ++numObjects;
+			}
+
+			writeLength(*id);
+		}
+
+		void checkWritable(GCObject* o)
+		{
+			switch(o->type)
+			{
+				case CrocType_Thread:
+					if(o != vm->mainThread)
+						croc_eh_throwStd(*t, "ValueError", "Can't snapshot threads other than the main thread");
+					break;
+
+				case CrocType_Memblock:
+					if(!(cast(Memblock*)o)->ownData)
+						croc_eh_throwStd(*t, "ValueError", "Can't snapshot a memblock which views native memory");
+					break;
+
+				case CrocType_Upval:
+					if((cast(Upval*)o)->value != &(cast(Upval*)o)->closedValue)
+						croc_eh_throwStd(*t, "ValueError", "Can't snapshot a closure over a local of a function that's still running");
+					break;
+
+				default:
+					break;
+			}
+		}
+
+		void writeValue(Value v)
+		{
+			writeByte(cast(uint8_t)v.type);
+
+			switch(v.type)
+			{
+				case CrocType_Null: break;
+				case CrocType_Bool: writeByte(cast(uint8_t)v.mBool); break;
+				case CrocType_Int: writeInt(v.mInt); break;
+				case CrocType_Float: writeFloat(v.mFloat); break;
+				// Written as is; see croc_vm_snapshot for why this is only safe for some nativeobjs.
+				case CrocType_Nativeobj: writeVarint(cast(uintptr_t)v.mNativeobj); break;
+				default: writeRef(v.mGCObj); break;
+			}
+		}
+
+		void writeAlloc(GCObject* o)
+		{
+			writeByte(cast(uint8_t)o->type);
+
+			switch(o->type)
+			{
+				case CrocType_String: {
+					auto s = cast(String*)o;
+					writeLength(s->length);
+					writeLength(s->cpLength);
+					writeBlock(s->toDArray());
+					break;
+				}
+				case CrocType_Table: {
+					auto tab = cast(Table*)o;
+					writeByte(tab->weakMode);
+					writeLength(tab->length());
+					break;
+				}
+				case CrocType_Array:
+					writeLength((cast(Array*)o)->length);
+					break;
+
+				case CrocType_Memblock: {
+					auto data = (cast(Memblock*)o)->data;
+					writeLength(data.length);
+					writeBlock(crocstr::n(data.ptr, data.length));
+					break;
+				}
+				case CrocType_Function: {
+					auto f = cast(Function*)o;
+					writeByte(cast(uint8_t)f->isNative);
+					writeLength(f->numUpvals);
+
+					if(f->isNative)
+						writeInt(codeOffset(cast(uintptr_t)f->nativeFunc));
+					break;
+				}
+				case CrocType_Instance:
+					writeLength(o->memSize - sizeof(Instance));
+					writeByte(cast(uint8_t)(GCOBJ_FINALIZABLE(o) && !GCOBJ_FINALIZED(o)));
+					break;
+
+				default:
+					break;
+			}
+		}
+
+		void writeContents(GCObject* o)
+		{
+			switch(o->type)
+			{
+				case CrocType_Weakref:
+					writeRef((cast(Weakref*)o)->obj);
+					break;
+
+				case CrocType_Table: {
+					auto tab = cast(Table*)o;
+					writeLength(tab->length());
+
+					size_t idx = 0;
+					Value* key;
+					Value* val;
+
+					while(tab->next(idx, key, val))
+					{
+						writeValue(*key);
+						writeValue(*val);
+					}
+					break;
+				}
+				case CrocType_Namespace: {
+					auto ns = cast(Namespace*)o;
+					writeRef(ns->name);
+					writeRef(ns->parent);
+					writeLength(ns->length());
+
+					uword idx = 0;
+					String** key;
+					Value* val;
+
+					while(ns->next(idx, key, val))
+					{
+						writeRef(*key);
+						writeValue(*val);
+					}
+					break;
+				}
+				case CrocType_Array:
+					for(auto &slot: (cast(Array*)o)->toDArray())
+						writeValue(slot.value);
+					break;
+
+				case CrocType_Function: {
+					auto f = cast(Function*)o;
+					writeRef(f->environment);
+
+					if(f->isNative)
+					{
+						writeRef(f->name);
+						writeLength(f->numParams);
+						writeLength(f->maxParams);
+
+						for(auto &val: f->nativeUpvals())
+							writeValue(val);
+					}
+					else
+					{
+						writeRef(f->scriptFunc);
+
+						for(auto uv: f->scriptUpvals())
+							writeRef(uv);
+					}
+					break;
+				}
+				case CrocType_Funcdef: {
+					auto def = cast(Funcdef*)o;
+					writeFuncdefBody(*this, def);
+					writeRef(def->environment);
+					writeRef(def->cachedFunc);
+					break;
+				}
+				case CrocType_Class: {
+					auto c = cast(Class*)o;
+					writeRef(c->name);
+					writeByte(cast(uint8_t)c->isFrozen);
+					writeMembers(c->methods.length(), [&](uword& idx, String**& k, Value*& v)
+						{ return c->nextMethod(idx, k, v); });
+					writeMembers(c->fields.length(), [&](uword& idx, String**& k, Value*& v)
+						{ return c->nextField(idx, k, v); });
+					writeMembers(c->hiddenFields.length(), [&](uword& idx, String**& k, Value*& v)
+						{ return c->nextHiddenField(idx, k, v); });
+					break;
+				}
+				case CrocType_Instance: {
+					auto i = cast(Instance*)o;
+					writeRef(i->parent);
+					writeMembers(i->fields->length(), [&](uword& idx, String**& k, Value*& v)
+						{ return i->nextField(idx, k, v); });
+					writeMembers(i->hiddenFieldsData ? i->parent->hiddenFields.length() : 0,
+						[&](uword& idx, String**& k, Value*& v) { return i->nextHiddenField(idx, k, v); });
+					break;
+				}
+				case CrocType_Upval:
+					writeValue((cast(Upval*)o)->closedValue);
+					break;
+
+				default:
+					break;
+			}
+		}
+
+		void writeMembers(uword num, std::function<bool(uword&, String**&, Value*&)> next)
+		{
+			writeLength(num);
+
+			uword idx = 0;
+			String** key;
+			Value* val;
+
+			while(next(idx, key, val))
+			{
+				writeRef(*key);
+				writeValue(*val);
+			}
+		}
+
+		void writeRoots()
+		{
+			writeRef(vm->globals);
+			writeRef(vm->registry);
+			writeRef(vm->unhandledEx);
+			writeRef(vm->location);
+
+			for(auto ns: vm->metaTabs)
+				writeRef(ns);
+
+			writeLength(vm->stdExceptions.length());
+
+			for(auto node: vm->stdExceptions)
+			{
+				writeRef(node->key);
+				writeRef(node->value);
+			}
+
+			writeVarint(vm->currentRef);
+			writeLength(vm->refTab.length());
+
+			for(auto node: vm->refTab)
+			{
+				writeVarint(node->key);
+				writeRef(node->value);
+			}
+		}
+	};
+
+	struct SnapshotReader : public ImageReader
+	{
+	private:
+		VM* vm;
+		Memory& mem;
+		DArray<GCObject*> objects;
+
+	public:
+		SnapshotReader(Thread* t, crocstr data) :
+			ImageReader(t, data),
+			vm(t->vm),
+			mem(t->vm->mem),
+			objects()
+		{}
+
+		// Allocates every object, fills them in, and then points the VM's roots at them.
+		void read()
+		{
+			objects = DArray<GCObject*>::alloc(mem, readCount());
+
+			// Most of the objects are strings, and growing the string table a bit at a time is slow.
+			vm->stringTab.prealloc(mem, vm->stringTab.length() + readCount());
+
+			for(auto &o: objects)
+				o = readAlloc();
+
+			for(uword pass = 0; pass < NumFillPasses; pass++)
+			{
+				for(auto o: objects)
+				{
+					if(fillPass(o->type) == pass)
+						readContents(o);
+				}
+			}
+
+			// The roots of namespaces can only be found once all their parents are set.
+			for(auto o: objects)
+			{
+				if(o->type == CrocType_Namespace)
+				{
+					auto ns = cast(Namespace*)o;
+					Namespace::finishCreate(ns, ns->name, ns->parent);
+				}
+			}
+
+			readRoots();
+
+			if(pos != end)
+				malformed();
+		}
+
+		void cleanup()
+		{
+			objects.free(mem);
+		}
+
+		String* readString()
+		{
+			return readRef<String>(CrocType_String);
+		}
+
+		Value readConstant()
+		{
+			return readValue();
+		}
+
+		Funcdef* readInnerFunc()
+		{
+			return readNonNull<Funcdef>(CrocType_Funcdef);
+		}
+
+	private:
+		GCObject* readRef()
+		{
+			auto id = readLength();
+
+			if(id > objects.length)
+				malformed();
+
+			return id == 0 ? nullptr : objects[id - 1];
+		}
+
+		template<typename T>
+		T* readRef(CrocType type)
+		{
+			auto ret = readRef();
+
+			if(ret != nullptr && ret->type != type)
+				malformed();
+
+			return cast(T*)ret;
+		}
+
+		template<typename T>
+		T* readNonNull(CrocType type)
+		{
+			auto ret = readRef<T>(type);
+
+			if(ret == nullptr)
+				malformed();
+
+			return ret;
+		}
+
+		Value readValue()
+		{
+			auto tag = readByte();
+
+			switch(tag)
+			{
+				case CrocType_Null: return Value::nullValue;
+				case CrocType_Bool: return Value::from(readByte() != 0);
+				case CrocType_Int: return Value::from(readInt());
+				case CrocType_Float: return Value::from(readFloat());
+				case CrocType_Nativeobj: return Value::from(cast(void*)cast(uintptr_t)readVarint());
+				default: return Value::from(readNonNull<GCObject>(cast(CrocType)tag));
+			}
+		}
+
+		GCObject* readAlloc()
+		{
+			auto tag = readByte();
+
+			switch(tag)
+			{
+				case CrocType_String: {
+					auto len = readLength();
+					auto cpLen = readLength();
+					return String::createUnverified(vm, readBlock(len), cpLen);
+				}
+				case CrocType_Weakref: {
+					// The referent is filled in later, since it might not exist yet.
+					auto r = ALLOC_OBJ_ACYC(mem, Weakref);
+					r->type = CrocType_Weakref;
+					r->obj = nullptr;
+					return r;
+				}
+				case CrocType_Table: {
+					auto mode = readByte();
+
+					if(mode > CrocWeakMode_Ephemeron)
+						malformed();
+
+					return Table::createWeak(vm, cast(CrocWeakMode)mode, readCount());
+				}
+				case CrocType_Namespace:
+					return Namespace::createPartial(mem);
+
+				case CrocType_Array:
+					return Array::create(mem, readCount());
+
+				case CrocType_Memblock: {
+					auto m = Memblock::create(mem, readLength());
+					auto data = readBlock(m->data.length);
+					memcpy(m->data.ptr, data.ptr, data.length);
+					return m;
+				}
+				case CrocType_Function: {
+					auto isNative = readByte() != 0;
+					auto numUpvals = readCount();
+
+					if(isNative)
+					{
+						auto func = cast(CrocNativeFunc)(codeBase() + cast(uintptr_t)readInt());
+						return Function::create(mem, nullptr, nullptr, 0, func, numUpvals);
+					}
+					else
+						return Function::createPartial(mem, numUpvals);
+				}
+				case CrocType_Funcdef:
+					return Funcdef::create(mem);
+
+				case CrocType_Class:
+					return Class::create(mem, nullptr);
+
+				case CrocType_Instance: {
+					auto extraSize = readLength();
+					auto finalizable = readByte() != 0;
+					return Instance::createPartial(mem, extraSize, finalizable);
+				}
+				case CrocType_Thread:
+					return vm->mainThread;
+
+				case CrocType_Upval: {
+					auto uv = ALLOC_OBJ(mem, Upval);
+					uv->type = CrocType_Upval;
+					uv->nextuv = nullptr;
+					uv->value = &uv->closedValue;
+					return uv;
+				}
+				default:
+					malformed();
+					return nullptr;
+			}
+		}
+
+		void readContents(GCObject* o)
+		{
+			switch(o->type)
+			{
+				case CrocType_Weakref:
+					if(auto obj = readRef())
+					{
+						(cast(Weakref*)o)->obj = obj;
+						*vm->weakrefTab.insert(mem, obj) = cast(Weakref*)o;
+					}
+					break;
+
+				case CrocType_Table: {
+					auto tab = cast(Table*)o;
+					auto num = readCount();
+
+					for(uword i = 0; i < num; i++)
+					{
+						auto key = readValue();
+						auto val = readValue();
+
+						if(key.type == CrocType_Null)
+							malformed();
+
+						tab->idxa(vm, key, val);
+					}
+					break;
+				}
+				case CrocType_Namespace: {
+					// Only the name and parent are set here; see read().
+					auto ns = cast(Namespace*)o;
+					ns->name = readNonNull<String>(CrocType_String);
+					ns->parent = readRef<Namespace>(CrocType_Namespace);
+					auto num = readCount();
+
+					for(uword i = 0; i < num; i++)
+					{
+						auto key = readString();
+
+						if(key == nullptr)
+							malformed();
+
+						ns->set(mem, key, readValue());
+					}
+					break;
+				}
+				case CrocType_Array: {
+					auto arr = cast(Array*)o;
+
+					for(uword i = 0; i < arr->length; i++)
+						arr->idxa(mem, i, readValue());
+					break;
+				}
+				case CrocType_Function: {
+					auto f = cast(Function*)o;
+					auto env = readNonNull<Namespace>(CrocType_Namespace);
+
+					if(f->isNative)
+					{
+						f->environment = env;
+						f->name = readNonNull<String>(CrocType_String);
+						f->numParams = readLength();
+						f->maxParams = readLength();
+
+						for(uword i = 0; i < f->numUpvals; i++)
+							f->setNativeUpval(mem, i, readValue());
+					}
+					else
+					{
+						auto def = readNonNull<Funcdef>(CrocType_Funcdef);
+
+						if(def->upvals.length != f->numUpvals)
+							malformed();
+
+						Function::finishCreate(mem, f, env, def);
+
+						for(auto &uv: f->scriptUpvals())
+							uv = readNonNull<Upval>(CrocType_Upval);
+					}
+					break;
+				}
+				case CrocType_Funcdef: {
+					auto def = cast(Funcdef*)o;
+					readFuncdefBody(*this, mem, def);
+					def->environment = readRef<Namespace>(CrocType_Namespace);
+					def->cachedFunc = readRef<Function>(CrocType_Function);
+					break;
+				}
+				case CrocType_Class: {
+					auto c = cast(Class*)o;
+					c->name = readString();
+					auto isFrozen = readByte() != 0;
+
+					readMembers([&](String* name, Value val) { return c->addMethod(mem, name, val, false); });
+					readMembers([&](String* name, Value val) { return c->addField(mem, name, val, false); });
+					readMembers([&](String* name, Value val) { return c->addHiddenField(mem, name, val); });
+
+					if(isFrozen)
+						freezeImpl(t, c);
+					break;
+				}
+				case CrocType_Instance: {
+					auto i = cast(Instance*)o;
+					auto parent = readNonNull<Class>(CrocType_Class);
+
+					if(!parent->isFrozen || !Instance::finishCreate(i, parent))
+						malformed();
+
+					readMembers([&](String* name, Value val) { return i->setField(mem, name, val); });
+					readMembers([&](String* name, Value val) { return i->setHiddenField(mem, name, val); });
+					break;
+				}
+				case CrocType_Upval:
+					(cast(Upval*)o)->closedValue = readValue();
+					break;
+
+				default:
+					break;
+			}
+		}
+
+		void readMembers(std::function<bool(String*, Value)> add)
+		{
+			auto num = readCount();
+
+			for(uword i = 0; i < num; i++)
+			{
+				auto name = readNonNull<String>(CrocType_String);
+
+				if(!add(name, readValue()))
+					malformed();
+			}
+		}
+
+		void readRoots()
+		{
+			vm->globals = readNonNull<Namespace>(CrocType_Namespace);
+			vm->registry = readNonNull<Namespace>(CrocType_Namespace);
+			vm->unhandledEx = readNonNull<Function>(CrocType_Function);
+			vm->location = readRef<Class>(CrocType_Class);
+
+			for(auto &ns: vm->metaTabs)
+				ns = readRef<Namespace>(CrocType_Namespace);
+
+			auto numExceptions = readCount();
+
+			for(uword i = 0; i < numExceptions; i++)
+			{
+				auto name = readNonNull<String>(CrocType_String);
+				*vm->stdExceptions.insert(mem, name) = readNonNull<Class>(CrocType_Class);
+			}
+
+			vm->currentRef = readVarint();
+			auto numRefs = readCount();
+
+			for(uword i = 0; i < numRefs; i++)
+			{
+				auto ref = readVarint();
+				auto obj = readRef();
+
+				if(obj == nullptr)
+					malformed();
+
+				*vm->refTab.insert(mem, ref) = obj;
+			}
+		}
+	};
+	}
+
+	// Pushes a memblock holding an image of everything reachable from the VM's roots. Throws a ValueError if anything
+	// reachable can't be written.
+	word writeSnapshot(Thread* t)
+	{
+		auto ret = croc_memblock_new(*t, 0);
+		auto mb = getMemblock(t, ret);
+		uword used = 0;
+		Checksum sum;
+
+		auto append = [&](crocstr data)
+		{
+			if(used + data.length > mb->data.length)
+			{
+				auto newLength = mb->data.length * 2;
+				mb->resize(t->vm->mem, used + data.length > newLength ? used + data.length : newLength);
+			}
+
+			memcpy(mb->data.ptr + used, data.ptr, data.length);
+			used += data.length;
+		};
+
+		auto slot = croc_pushNull(*t);
+		bool failed;
+
+		// The writer has to be gone before rethrowing, since that skips destructors.
+		{
+			SnapshotWriter w(t, [&](crocstr data)
+			{
+				sum.add(data);
+				append(data);
+			});
+
+			failed = tryCode(t, slot, [&]
+			{
+				w.write();
+			});
+
+			w.cleanup();
+		}
+
+		if(failed)
+			croc_eh_rethrow(*t);
+
+		croc_popTop(*t); // dummy eh slot
+		auto hash = sum.finish();
+		append(crocstr::n(cast(const uint8_t*)&hash, sizeof(hash)));
+		mb->resize(t->vm->mem, used);
+		return ret;
+	}
+
+	// Fills in a freshly-opened VM (one with no libraries loaded, and its GC disabled) from an image written by
+	// writeSnapshot. Returns false, without touching the VM, if the image was written by an incompatible build or is
+	// damaged. The checksum makes sure the image is what writeSnapshot wrote, so the data is otherwise trusted (the VM
+	// doesn't even have exception classes to throw yet).
+	bool readSnapshot(Thread* t, crocstr data)
+	{
+		uint64_t hash;
+
+		if(data.length < sizeof(hash))
+			return false;
+
+		auto body = crocstr::n(data.ptr, data.length - sizeof(hash));
+		memcpy(&hash, body.ptr + body.length, sizeof(hash));
+
+		Checksum sum;
+		sum.add(body);
+
+		if(sum.finish() != hash)
+			return false;
+
+		SnapshotReader r(t, body);
+
+		if(!r.readHeader(crocstr::n(Magic, sizeof(Magic)), FormatVersion) || r.readInt() != codeCheck())
+			return false;
+
+		r.read();
+		r.cleanup();
+		return true;
+	}
+}
@@ -0,0 +1,12 @@
+#ifndef CROC_INTERNAL_SNAPSHOT_HPP
+#define CROC_INTERNAL_SNAPSHOT_HPP
+
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+	word writeSnapshot(Thread* t);
+	bool readSnapshot(Thread* t, crocstr data);
+}
+
+#endif
@@ -1,10 +1,57 @@
 
 #include "croc/api.h"
+#include "croc/internal/stack.hpp"
 #include "croc/internal/variables.hpp"
 #include "croc/types/base.hpp"
 
 namespace croc
 {
+	// Registry table mapping from global names to arrays of names of lazily-loaded modules that define them.
+	const char* LazyGlobalsRegistry = "modules.lazyGlobals";
+
+	// If ns is the global namespace and name is a global defined by a lazily-loaded stdlib module that hasn't been
+	// loaded yet, imports that module and returns true. Each global only gets one shot at this, so a module that
+	// doesn't define it can't loop.
+	bool loadLazyGlobal(Thread* t, Namespace* ns, String* name)
+	{
+		if(ns != t->vm->globals)
+			return false;
+
+		auto reg = croc_vm_pushRegistry(*t);
+		croc_pushString(*t, LazyGlobalsRegistry);
+
+		if(!croc_in(*t, -1, reg))
+		{
+			croc_pop(*t, 2);
+			return false;
+		}
+
+		auto lazy = croc_fieldStk(*t, reg);
+		push(t, Value::from(name));
+
+		if(!croc_in(*t, -1, lazy))
+		{
+			croc_pop(*t, 3);
+			return false;
+		}
+
+		croc_dupTop(*t);
+		croc_idx(*t, lazy);
+		croc_swapTop(*t);
+		croc_removeKey(*t, lazy);
+		auto mods = croc_absIndex(*t, -1);
+
+		for(crocint i = 0, len = croc_len(*t, mods); i < len; i++)
+		{
+			croc_idxi(*t, mods, i);
+			croc_ex_importStk(*t, -1);
+			croc_popTop(*t);
+		}
+
+		croc_pop(*t, 3);
+		return true;
+	}
+
 	Value getGlobalImpl(Thread* t, String* name, Namespace* env)
 	{
 		if(auto glob = env->get(name))
@@ -16,6 +63,9 @@ namespace croc
 				return *glob;
 		}
 
+		if(loadLazyGlobal(t, t->vm->globals, name))
+			return getGlobalImpl(t, name, env);
+
 		croc_eh_throwStd(*t, "NameError", "Attempting to get a nonexistent global '%s'", name->toCString());
 		assert(false);
 		return Value::nullValue; // dummy
@@ -33,6 +83,32 @@ namespace croc
 		assert(false);
 	}
 
+	// Slow path of getGlobalNode. Looks the global up and fills in the cache, or returns null if it doesn't exist.
+	Namespace::HashType::NodeType* lookupGlobalNode(String* name, Namespace* env,
+		Funcdef::GlobalCache& cache)
+	{
+		if(auto node = env->data.lookupNode(name))
+		{
+			cache.envLayout = env->layoutID;
+			cache.rootLayout = 0;
+			cache.node = node;
+			return node;
+		}
+
+		if(env->root)
+		{
+			if(auto node = env->root->data.lookupNode(name))
+			{
+				cache.envLayout = env->layoutID;
+				cache.rootLayout = env->root->layoutID;
+				cache.node = node;
+				return node;
+			}
+		}
+
+		return nullptr;
+	}
+
 	void newGlobalImpl(Thread* t, String* name, Namespace* env, Value val)
 	{
 		if(env->contains(name))
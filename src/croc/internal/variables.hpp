@@ -5,9 +5,42 @@
 
 namespace croc
 {
+	extern const char* LazyGlobalsRegistry;
+
+	bool loadLazyGlobal(Thread* t, Namespace* ns, String* name);
+
 	Value getGlobalImpl(Thread* t, String* name, Namespace* env);
 	void setGlobalImpl(Thread* t, String* name, Namespace* env, Value val);
 	void newGlobalImpl(Thread* t, String* name, Namespace* env, Value val);
+	Namespace::HashType::NodeType* lookupGlobalNode(String* name, Namespace* env,
+		Funcdef::GlobalCache& cache);
+
+	// Gets the node holding the global 'name' as seen from 'env', through the given cache, or null if there is no
+	// such global. Only hashes on a cache miss.
+	inline Namespace::HashType::NodeType* getGlobalNode(String* name, Namespace* env,
+		Funcdef::GlobalCache& cache)
+	{
+		if(cache.envLayout == env->layoutID && (cache.rootLayout == 0 || cache.rootLayout == env->root->layoutID))
+			return cache.node;
+
+		return lookupGlobalNode(name, env, cache);
+	}
+
+	inline Value getGlobalImpl(Thread* t, String* name, Namespace* env, Funcdef::GlobalCache& cache)
+	{
+		if(auto node = getGlobalNode(name, env, cache))
+			return node->value;
+
+		return getGlobalImpl(t, name, env); // throws
+	}
+
+	inline void setGlobalImpl(Thread* t, String* name, Namespace* env, Funcdef::GlobalCache& cache, Value val)
+	{
+		if(auto node = getGlobalNode(name, env, cache))
+			(cache.rootLayout == 0 ? env : env->root)->setNode(t->vm->mem, node, val);
+		else
+			setGlobalImpl(t, name, env, val); // throws
+	}
 }
 
 #endif
\ No newline at end of file
@@ -464,15 +464,8 @@ const StdlibRegister _globalFuncs[] =
 	word loader(CrocThread* t)
 	{
 		registerGlobals(t, _globalFuncs);
-		return 0;
-	}
-	}
-
-	void initAsciiLib(CrocThread* t)
-	{
-		registerModule(t, "ascii", &loader);
-		croc_pushGlobal(t, "ascii");
 #ifdef CROC_BUILTIN_DOCS
+		croc_dup(t, 0);
 		CrocDoc doc;
 		croc_ex_doc_init(t, &doc, __FILE__);
 		croc_ex_doc_push(&doc,
@@ -488,7 +481,14 @@ const StdlibRegister _globalFuncs[] =
 			docFields(&doc, _globalFuncs);
 		croc_ex_doc_pop(&doc, -1);
 		croc_ex_doc_finish(&doc);
-#endif
 		croc_popTop(t);
+#endif
+		return 0;
+	}
+	}
+
+	void initAsciiLib(CrocThread* t)
+	{
+		registerLazyModule(t, "ascii", &loader);
 	}
 }
\ No newline at end of file
@@ -535,15 +535,8 @@ const StdlibRegister _globalFuncs[] =
 word loader(CrocThread* t)
 {
 	registerGlobals(t, _globalFuncs);
-	return 0;
-}
-}
-
-void initCompilerLib(CrocThread* t)
-{
-	registerModule(t, "compiler", &loader);
-	croc_pushGlobal(t, "compiler");
 #ifdef CROC_BUILTIN_DOCS
+	croc_dup(t, 0);
 	CrocDoc doc;
 	croc_ex_doc_init(t, &doc, __FILE__);
 	croc_ex_doc_push(&doc,
@@ -554,7 +547,14 @@ void initCompilerLib(CrocThread* t)
 		docFields(&doc, _globalFuncs);
 	croc_ex_doc_pop(&doc, -1);
 	croc_ex_doc_finish(&doc);
-#endif
 	croc_popTop(t);
+#endif
+	return 0;
+}
+}
+
+void initCompilerLib(CrocThread* t)
+{
+	registerLazyModule(t, "compiler", &loader);
 }
 }
\ No newline at end of file
@@ -10,9 +10,8 @@ namespace croc
 	namespace
 	{
 #include "croc/stdlib/console.croc.hpp"
-	}
 
-	void initConsoleLib(CrocThread* t)
+	word loader(CrocThread* t)
 	{
 		croc_table_new(t, 0);
 			auto in = oscompat::getStdin(t);
@@ -32,11 +31,21 @@ namespace croc
 			croc_pushNativeobj(t, cast(void*)cast(uword)err); croc_fielda(t, -2, "stderr");
 		croc_newGlobal(t, "_consoletmp");
 
-		registerModuleFromString(t, "console", console_croc_text, "console.croc");
+		loadModuleFromString(t, "console", console_croc_text, "console.croc");
 
-		croc_vm_pushGlobals(t);
 		croc_pushString(t, "_consoletmp");
-		croc_removeKey(t, -2);
-		croc_popTop(t);
+		croc_removeKey(t, 0);
+		return 0;
+	}
+	}
+
+	void initConsoleLib(CrocThread* t)
+	{
+		registerLazyModule(t, "console", &loader);
+		registerLazyGlobal(t, "write", "console");
+		registerLazyGlobal(t, "writeln", "console");
+		registerLazyGlobal(t, "writef", "console");
+		registerLazyGlobal(t, "writefln", "console");
+		registerLazyGlobal(t, "readln", "console");
 	}
 }
\ No newline at end of file
@@ -1110,22 +1110,22 @@ const StdlibRegister _globalFuncs[] =
 word loader(CrocThread* t)
 {
 	registerGlobals(t, _globalFuncs);
-	return 0;
-}
-}
-
-void initDebugLib(CrocThread* t)
-{
-	croc_ex_makeModule(t, "debug", &loader);
-	croc_ex_importNS(t, "debug");
 #ifdef CROC_BUILTIN_DOCS
+	croc_dup(t, 0);
 	CrocDoc doc;
 	croc_ex_doc_init(t, &doc, __FILE__);
 	croc_ex_doc_push(&doc, ModuleDocs);
 		docFields(&doc, _globalFuncs);
 	croc_ex_doc_pop(&doc, -1);
 	croc_ex_doc_finish(&doc);
-#endif
 	croc_popTop(t);
+#endif
+	return 0;
+}
+}
+
+void initDebugLib(CrocThread* t)
+{
+	registerLazyModule(t, "debug", &loader);
 }
 }
\ No newline at end of file
@@ -67,19 +67,32 @@ namespace croc
 		{"getMetatable",     1, &_getMetatable    },
 		{nullptr, 0, nullptr}
 	};
-	}
 
-	void initDocsLib(CrocThread* t)
+	word loader(CrocThread* t)
 	{
 		croc_table_new(t, 0);
 			croc_ex_registerFields(t, _globalFuncs);
+			// Ephemeron so that documenting something doesn't keep it alive forever.
+			croc_table_newWeak(t, CrocWeakMode_Ephemeron, 0);
+			croc_fielda(t, -2, "docTables");
 		croc_newGlobal(t, "_docstmp");
 
-		registerModuleFromString(t, "docs", docs_croc_text, "docs.croc");
+		loadModuleFromString(t, "docs", docs_croc_text, "docs.croc");
 
-		croc_vm_pushGlobals(t);
 		croc_pushString(t, "_docstmp");
-		croc_removeKey(t, -2);
-		croc_popTop(t);
+		croc_removeKey(t, 0);
+		return 0;
+	}
+	}
+
+	void initDocsLib(CrocThread* t)
+	{
+#ifdef CROC_BUILTIN_DOCS
+		// Every other lib's docs go through _doc_, so this has to be loaded up front.
+		registerModule(t, "docs", &loader);
+#else
+		registerLazyModule(t, "docs", &loader);
+		registerLazyGlobal(t, "_doc_", "docs");
+#endif
 	}
 }
\ No newline at end of file
@@ -11,12 +11,30 @@ namespace croc
 #include "croc/stdlib/doctools_output.croc.hpp"
 #include "croc/stdlib/doctools_console.croc.hpp"
 #include "croc/stdlib/doctools_trac.croc.hpp"
+
+	word outputLoader(CrocThread* t)
+	{
+		loadModuleFromString(t, "doctools.output", doctools_output_croc_text, "doctools/output.croc");
+		return 0;
+	}
+
+	word consoleLoader(CrocThread* t)
+	{
+		loadModuleFromString(t, "doctools.console", doctools_console_croc_text, "doctools/console.croc");
+		return 0;
+	}
+
+	word tracLoader(CrocThread* t)
+	{
+		loadModuleFromString(t, "doctools.trac", doctools_trac_croc_text, "doctools/trac.croc");
+		return 0;
+	}
 	}
 
 	void initDoctoolsLibs(CrocThread* t)
 	{
-		registerModuleFromString(t, "doctools.output", doctools_output_croc_text, "doctools/output.croc");
-		registerModuleFromString(t, "doctools.console", doctools_console_croc_text, "doctools/console.croc");
-		registerModuleFromString(t, "doctools.trac", doctools_trac_croc_text, "doctools/trac.croc");
+		registerLazyModule(t, "doctools.output", &outputLoader);
+		registerLazyModule(t, "doctools.console", &consoleLoader);
+		registerLazyModule(t, "doctools.trac", &tracLoader);
 	}
 }
\ No newline at end of file
@@ -95,15 +95,8 @@ const StdlibRegister _globalFuncs[] =
 word loader(CrocThread* t)
 {
 	registerGlobals(t, _globalFuncs);
-	return 0;
-}
-}
-
-void initEnvLib(CrocThread* t)
-{
-	registerModule(t, "env", &loader);
-	croc_pushGlobal(t, "env");
 #ifdef CROC_BUILTIN_DOCS
+	croc_dup(t, 0);
 	CrocDoc doc;
 	croc_ex_doc_init(t, &doc, __FILE__);
 	croc_ex_doc_push(&doc,
@@ -112,7 +105,14 @@ void initEnvLib(CrocThread* t)
 		docFields(&doc, _globalFuncs);
 	croc_ex_doc_pop(&doc, -1);
 	croc_ex_doc_finish(&doc);
-#endif
 	croc_popTop(t);
+#endif
+	return 0;
+}
+}
+
+void initEnvLib(CrocThread* t)
+{
+	registerLazyModule(t, "env", &loader);
 }
 }
\ No newline at end of file
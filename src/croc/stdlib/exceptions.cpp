@@ -118,6 +118,11 @@ struct ExDesc
 	{"VMError", Docstr(DClass("VMError") DBase("Throwable")
 		R"(Thrown for some kinds of internal VM errors.)")
 	},
+	{"MemoryError", Docstr(DClass("MemoryError") DBase("Throwable")
+		R"(Thrown when an allocation would go over the VM's hard memory limit (see \link{gc.limit}). It can be caught like
+		any other exception; the limit is relaxed a little until the catching code gets going again, so that it has room
+		to clean up.)")
+	},
 
 	{nullptr, nullptr}
 };
@@ -931,15 +931,8 @@ const StdlibRegister _globalFuncs[] =
 word loader(CrocThread* t)
 {
 	registerGlobals(t, _globalFuncs);
-	return 0;
-}
-}
-
-void initFileLib(CrocThread* t)
-{
-	croc_ex_makeModule(t, "file", &loader);
-	croc_ex_importNS(t, "file");
 #ifdef CROC_BUILTIN_DOCS
+	croc_dup(t, 0);
 	CrocDoc doc;
 	croc_ex_doc_init(t, &doc, __FILE__);
 	croc_ex_doc_push(&doc,
@@ -953,7 +946,14 @@ void initFileLib(CrocThread* t)
 		docFields(&doc, _globalFuncs);
 	croc_ex_doc_pop(&doc, -1);
 	croc_ex_doc_finish(&doc);
-#endif
 	croc_popTop(t);
+#endif
+	return 0;
+}
+}
+
+void initFileLib(CrocThread* t)
+{
+	registerLazyModule(t, "file", &loader);
 }
 }
\ No newline at end of file
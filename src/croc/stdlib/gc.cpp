@@ -21,11 +21,80 @@ CrocGCLimit stringToLimit(CrocThread* t, word slot)
 	if(s == ATODA("nurserySizeCutoff")) return CrocGCLimit_NurserySizeCutoff;
 	if(s == ATODA("cycleCollectInterval")) return CrocGCLimit_CycleCollectInterval;
 	if(s == ATODA("cycleMetadataLimit")) return CrocGCLimit_CycleMetadataLimit;
+	if(s == ATODA("hardLimit")) return CrocGCLimit_HardLimit;
+	if(s == ATODA("softLimit")) return CrocGCLimit_SoftLimit;
 
 	return cast(CrocGCLimit)croc_eh_throwStd(t, "ValueError", "Invalid limit type '%.*s'",
 		cast(int)s.length, s.ptr);
 }
 
+CrocGCBudget stringToBudget(CrocThread* t, word slot)
+{
+	auto s = getCrocstr(t, slot);
+
+	if(s == ATODA("time")) return CrocGCBudget_Time;
+	if(s == ATODA("objects")) return CrocGCBudget_Objects;
+
+	return cast(CrocGCBudget)croc_eh_throwStd(t, "ValueError", "Invalid budget type '%.*s'",
+		cast(int)s.length, s.ptr);
+}
+
+CrocGCGoal stringToGoal(CrocThread* t, word slot)
+{
+	auto s = getCrocstr(t, slot);
+
+	if(s == ATODA("none")) return CrocGCGoal_None;
+	if(s == ATODA("pause")) return CrocGCGoal_Pause;
+	if(s == ATODA("throughput")) return CrocGCGoal_Throughput;
+
+	return cast(CrocGCGoal)croc_eh_throwStd(t, "ValueError", "Invalid goal type '%.*s'",
+		cast(int)s.length, s.ptr);
+}
+
+const char* goalToString(CrocGCGoal goal)
+{
+	switch(goal)
+	{
+		case CrocGCGoal_Pause:      return "pause";
+		case CrocGCGoal_Throughput: return "throughput";
+		default:                    return "none";
+	}
+}
+
+CrocAllocMetric stringToMetric(CrocThread* t, word slot)
+{
+	auto s = getCrocstr(t, slot);
+
+	if(s == ATODA("allocBytes")) return CrocAllocMetric_AllocBytes;
+	if(s == ATODA("allocCount")) return CrocAllocMetric_AllocCount;
+	if(s == ATODA("liveBytes")) return CrocAllocMetric_LiveBytes;
+	if(s == ATODA("liveCount")) return CrocAllocMetric_LiveCount;
+
+	return cast(CrocAllocMetric)croc_eh_throwStd(t, "ValueError", "Invalid metric '%.*s'",
+		cast(int)s.length, s.ptr);
+}
+
+const char* PhaseNames[CrocGCPhase_NUMPHASES] =
+{
+	"roots",
+	"modBuffer",
+	"decBuffer",
+	"nursery",
+	"cycles",
+};
+
+// Pushes a table of phase name to time.
+void pushPhaseTimes(CrocThread* t, const uint64_t* times)
+{
+	auto tab = croc_table_new(t, CrocGCPhase_NUMPHASES);
+
+	for(uword i = 0; i < CrocGCPhase_NUMPHASES; i++)
+	{
+		croc_pushInt(t, cast(crocint)times[i]);
+		croc_fielda(t, tab, PhaseNames[i]);
+	}
+}
+
 const StdlibRegisterInfo _collect_info =
 {
 	Docstr(DFunc("collect")
@@ -135,6 +204,14 @@ const StdlibRegisterInfo _limit_info =
 			decrease to a non-zero value are candidates for cycle collection. Of course, this is only a heuristic, and
 			can have false positives, meaning non-cyclic objects (living or dead) can be scanned by the cycle collector
 			as well. Thus the cycle collector must be run to reclaim ALL dead objects.
+		\li{\tt{"hardLimit"}} The most memory, in bytes, that the VM may have allocated at once. Defaults to 0, which
+			means no limit. An allocation that would go over it throws a \link{MemoryError} instead. Before that
+			happens, the GC runs full collections as the heap gets closer to the limit, so that a \link{MemoryError}
+			only happens if there really isn't enough garbage to free. Only the objects themselves count against the
+			limit, not the allocator's overhead, so the process can use somewhat more memory than this.
+		\li{\tt{"softLimit"}} A memory size, in bytes, that the program would like to stay under. Defaults to 0, which
+			means no limit. If a collection leaves the heap over it, the function set with
+			\link{gc.softLimitCallback} is called, once each time the heap goes over.
 	\endlist)"),
 
 	"limit", 2
@@ -160,15 +237,441 @@ word_t _limit(CrocThread* t)
 	return 1;
 }
 
+const StdlibRegisterInfo _setBudget_info =
+{
+	Docstr(DFunc("setBudget") DParam("type", "string") DParam("budget", "int")
+	R"(Limits how long the cycle collector can run during a normal GC cycle. Collecting a lot of buffered potential
+	cyclic garbage at once can cause a long pause; with a budget, the cycle collector works through it in batches,
+	stops once the budget is used up, and continues where it left off during the next GC cycle. The budget is only
+	checked between batches, so a pause can go somewhat over it. \link{gc.collectFull} ignores the budget.
+
+	\param[type] is the kind of budget to set, and can be one of the following:
+	\dlist
+		\li{\tt{"time"}} The time, in microseconds, that one GC cycle can spend collecting cycles.
+		\li{\tt{"objects"}} The number of objects that one GC cycle's cycle collection can visit.
+	\endlist
+
+	\param[budget] is the new budget. Both kinds default to 0, which means there is no limit.
+
+	\returns the previous value of the budget.)"),
+
+	"setBudget", 2
+};
+
+word_t _setBudget(CrocThread* t)
+{
+	croc_ex_checkParam(t, 1, CrocType_String);
+	auto budgetType = stringToBudget(t, 1);
+	auto budget = croc_ex_checkIntParam(t, 2);
+
+	if(budget < 0 || cast(uword)budget > std::numeric_limits<uword_t>::max())
+		croc_eh_throwStd(t, "RangeError", "Invalid budget (%" CROC_INTEGER_FORMAT ")", budget);
+
+	croc_pushInt(t, croc_gc_setPauseBudget(t, budgetType, cast(uword_t)budget));
+	return 1;
+}
+
+const StdlibRegisterInfo _getBudget_info =
+{
+	Docstr(DFunc("getBudget") DParam("type", "string")
+	R"(\returns the current value of the given kind of budget, as explained in \link{gc.setBudget}.)"),
+
+	"getBudget", 1
+};
+
+word_t _getBudget(CrocThread* t)
+{
+	croc_ex_checkParam(t, 1, CrocType_String);
+	croc_pushInt(t, croc_gc_getPauseBudget(t, stringToBudget(t, 1)));
+	return 1;
+}
+
+const StdlibRegisterInfo _concurrentCycles_info =
+{
+	Docstr(DFunc("concurrentCycles") DParamD("enable", "bool", "null")
+	R"(Gets or sets whether cyclic garbage is looked for on a background thread. It's off by default.
+
+	When it's on, normal GC cycles don't look for cyclic garbage themselves. Instead, they take a snapshot of the part of
+	the heap that might be cyclic garbage, and a background thread works out what's garbage from that. A later GC cycle
+	checks what the thread found against the heap as it is then, and frees what's still garbage. This uses another
+	core, and cyclic garbage hangs around a little longer, but it makes GC cycles shorter. \link{gc.collectFull} still
+	collects cycles itself.
+
+	If called with no parameters, returns whether it's on. If \tt{enable} is given, turns it on or off, and returns
+	whether it was on before. Turning it off takes effect at the next GC cycle.)"),
+
+	"concurrentCycles", 1
+};
+
+word_t _concurrentCycles(CrocThread* t)
+{
+	if(croc_isValidIndex(t, 1))
+	{
+		auto enable = croc_ex_checkBoolParam(t, 1);
+		croc_pushBool(t, croc_gc_setConcurrentCycles(t, enable));
+	}
+	else
+		croc_pushBool(t, croc_gc_getConcurrentCycles(t));
+
+	return 1;
+}
+
+const StdlibRegisterInfo _setGoal_info =
+{
+	Docstr(DFunc("setGoal") DParam("goal", "string") DParamD("target", "int", "0")
+	R"(Makes the GC tune its own limits towards a goal, instead of you having to find the right values for
+	\link{gc.limit} by hand. After every GC cycle, the GC looks at how long it took, how much of the time is being spent
+	in the GC, and how much of the nursery survived, and resizes the nursery (and the \tt{"metadataLimit"} along with
+	it) to get closer to the goal. It also changes the \tt{"cycleCollectInterval"} and \tt{"cycleMetadataLimit"}
+	depending on how much garbage each cycle collection finds. Whatever the limits are set to when you call this is
+	where the tuning starts from. \link{gc.tuning} tells you what it's chosen.
+
+	\param[goal] is what to tune for, and can be one of the following:
+	\dlist
+		\li{\tt{"none"}} Don't tune anything. This is the default.
+		\li{\tt{"pause"}} Keep GC pauses under \tt{target} microseconds, using as big a nursery as that allows. This
+			also sets the cycle collector's \tt{"time"} budget (see \link{gc.setBudget}) to half of \tt{target}.
+		\li{\tt{"throughput"}} Keep the time spent in the GC under \tt{target} percent of the total. It has to be
+			between 1 and 99.
+	\endlist
+
+	\param[target] is the goal's target, as explained above.)"),
+
+	"setGoal", 2
+};
+
+word_t _setGoal(CrocThread* t)
+{
+	croc_ex_checkParam(t, 1, CrocType_String);
+	auto goal = stringToGoal(t, 1);
+	auto target = croc_ex_optIntParam(t, 2, 0);
+
+	if(target < 0 || cast(uword)target > std::numeric_limits<uword_t>::max())
+		croc_eh_throwStd(t, "RangeError", "Invalid target (%" CROC_INTEGER_FORMAT ")", target);
+
+	croc_gc_setGoal(t, goal, cast(uword_t)target);
+	return 0;
+}
+
+const StdlibRegisterInfo _getGoal_info =
+{
+	Docstr(DFunc("getGoal")
+	R"(\returns two values: the goal the GC is tuning its limits for, as a string, and its target. See
+	\link{gc.setGoal}.)"),
+
+	"getGoal", 0
+};
+
+word_t _getGoal(CrocThread* t)
+{
+	uword_t target;
+	auto goal = croc_gc_getGoal(t, &target);
+	croc_pushString(t, goalToString(goal));
+	croc_pushInt(t, target);
+	return 2;
+}
+
+const StdlibRegisterInfo _tuning_info =
+{
+	Docstr(DFunc("tuning")
+	R"(\returns a table of what the GC has measured and the limits it's using now. The measurements are running
+	averages over recent GC cycles, and are kept up to date whether or not there's a goal set with \link{gc.setGoal}.
+
+	The table has these fields:
+	\dlist
+		\li{\tt{goal}, \tt{target}} The same as what \link{gc.getGoal} returns.
+		\li{\tt{nurseryLimit}, \tt{metadataLimit}, \tt{cycleCollectInterval}, \tt{cycleMetadataLimit}} The same as
+			what \link{gc.limit} returns for them.
+		\li{\tt{pauseTime}} How long a GC cycle takes, in microseconds.
+		\li{\tt{gcTimeFraction}} How much of the time is spent in the GC, between 0 and 1.
+		\li{\tt{survivalRate}} How much of the nursery survives a GC cycle, between 0 and 1.
+	\endlist)"),
+
+	"tuning", 0
+};
+
+word_t _tuning(CrocThread* t)
+{
+	auto &mem = Thread::from(t)->vm->mem;
+	auto tab = croc_table_new(t, 0);
+
+	auto setInt = [&](const char* name, crocint value) { croc_pushInt(t, value); croc_fielda(t, tab, name); };
+	auto setFloat = [&](const char* name, crocfloat value) { croc_pushFloat(t, value); croc_fielda(t, tab, name); };
+
+	croc_pushString(t, goalToString(mem.gcGoal));
+	croc_fielda(t, tab, "goal");
+	setInt("target", mem.gcGoalTarget);
+	setInt("nurseryLimit", mem.nurseryLimit);
+	setInt("metadataLimit", mem.metadataLimit);
+	setInt("cycleCollectInterval", mem.nextCycleCollect);
+	setInt("cycleMetadataLimit", mem.cycleMetadataLimit);
+	setFloat("pauseTime", mem.avgPause);
+	setFloat("gcTimeFraction", mem.avgGCFraction);
+	setFloat("survivalRate", mem.avgSurvival);
+	return 1;
+}
+
+const StdlibRegisterInfo _stats_info =
+{
+	Docstr(DFunc("stats")
+	R"(\returns a table of statistics about the GC. All times are in nanoseconds. The counts and times are totals since
+	the VM was started or since \link{gc.resetStats} was last called.
+
+	The table has these fields:
+	\dlist
+		\li{\tt{cycles}} How many GC cycles there have been.
+		\li{\tt{totalTime}, \tt{maxTime}, \tt{lastTime}} How long they took altogether, how long the longest one took,
+			and how long the most recent one took.
+		\li{\tt{phaseTime}, \tt{lastPhaseTime}} Tables of how long each phase of a GC cycle took altogether, and in
+			the most recent cycle. The phases are \tt{"roots"}, \tt{"modBuffer"}, \tt{"decBuffer"}, \tt{"nursery"},
+			and \tt{"cycles"}; the last is cycle collection.
+		\li{\tt{promoted}} How many objects have been moved out of the nursery.
+		\li{\tt{freed}} How many objects have been freed.
+		\li{\tt{finalized}} How many objects have been queued to have their finalizers run.
+		\li{\tt{cycleCollected}} How many of the freed objects were freed by cycle collection.
+		\li{\tt{nurseryBytes}, \tt{rcBytes}} How many bytes are allocated in the nursery and outside it right now.
+	\endlist)"),
+
+	"stats", 0
+};
+
+word_t _stats(CrocThread* t)
+{
+	CrocGCStats stats;
+	croc_gc_getStats(t, &stats);
+
+	auto tab = croc_table_new(t, 0);
+	auto setInt = [&](const char* name, uint64_t value) { croc_pushInt(t, cast(crocint)value); croc_fielda(t, tab, name); };
+
+	setInt("cycles", stats.cycles);
+	setInt("totalTime", stats.totalTime);
+	setInt("maxTime", stats.maxTime);
+	setInt("lastTime", stats.lastTime);
+	pushPhaseTimes(t, stats.phaseTime);
+	croc_fielda(t, tab, "phaseTime");
+	pushPhaseTimes(t, stats.lastPhaseTime);
+	croc_fielda(t, tab, "lastPhaseTime");
+	setInt("promoted", stats.promoted);
+	setInt("freed", stats.freed);
+	setInt("finalized", stats.finalized);
+	setInt("cycleCollected", stats.cycleCollected);
+	setInt("nurseryBytes", stats.nurseryBytes);
+	setInt("rcBytes", stats.rcBytes);
+	return 1;
+}
+
+const StdlibRegisterInfo _resetStats_info =
+{
+	Docstr(DFunc("resetStats")
+	R"(Resets the counts and times in \link{gc.stats} to 0.)"),
+
+	"resetStats", 0
+};
+
+word_t _resetStats(CrocThread* t)
+{
+	croc_gc_resetStats(t);
+	return 0;
+}
+
+const StdlibRegisterInfo _eventLog_info =
+{
+	Docstr(DFunc("eventLog") DParamD("size", "int", "null")
+	R"(Gets or sets the size of the GC event log. The event log keeps a record of each of the most recent GC cycles,
+	which you can get with \link{gc.events}. It's off (its size is 0) by default.
+
+	If called with no parameters, returns the size. If \tt{size} is given, sets the size (which throws away the events
+	already in the log), and returns the previous size. A size of 0 turns the log off.)"),
+
+	"eventLog", 1
+};
+
+word_t _eventLog(CrocThread* t)
+{
+	if(croc_isValidIndex(t, 1))
+	{
+		auto size = croc_ex_checkIntParam(t, 1);
+
+		if(size < 0 || cast(uword)size > std::numeric_limits<uword_t>::max() / sizeof(CrocGCEvent))
+			croc_eh_throwStd(t, "RangeError", "Invalid size (%" CROC_INTEGER_FORMAT ")", size);
+
+		croc_pushInt(t, croc_gc_setEventLogSize(t, cast(uword_t)size));
+	}
+	else
+		croc_pushInt(t, croc_gc_getEventLogSize(t));
+
+	return 1;
+}
+
+const StdlibRegisterInfo _events_info =
+{
+	Docstr(DFunc("events")
+	R"(\returns an array of the events in the GC event log (see \link{gc.eventLog}), oldest first. Each is a table with
+	these fields:
+
+	\dlist
+		\li{\tt{cycle}} Which GC cycle it was, counting from 1.
+		\li{\tt{startTime}} When it started, in nanoseconds on a clock that only means anything compared to other
+			events' start times.
+		\li{\tt{time}} How long it took, in nanoseconds.
+		\li{\tt{phaseTime}} A table of how long each phase took, as in \link{gc.stats}.
+		\li{\tt{promoted}, \tt{freed}, \tt{finalized}, \tt{cycleCollected}} How many objects it did each of those
+			things to, as in \link{gc.stats}.
+		\li{\tt{nurseryBytes}} How many bytes were in the nursery when it started.
+		\li{\tt{rcBytes}} How many bytes were allocated outside the nursery after it.
+		\li{\tt{full}} Whether it was a full collection.
+	\endlist)"),
+
+	"events", 0
+};
+
+word_t _events(CrocThread* t)
+{
+	auto size = croc_gc_getEventLogSize(t);
+	auto arr = croc_array_new(t, 0);
+
+	if(size == 0)
+		return 1;
+
+	// Copy them out first, since making the tables could cause a GC cycle that adds to the log.
+	auto mb = croc_memblock_new(t, size * sizeof(CrocGCEvent));
+	auto events = cast(CrocGCEvent*)croc_memblock_getData(t, mb);
+	auto num = croc_gc_getEvents(t, events, size);
+
+	for(uword i = 0; i < num; i++)
+	{
+		auto &e = events[i];
+		auto tab = croc_table_new(t, 0);
+		auto setInt = [&](const char* name, uint64_t value) { croc_pushInt(t, cast(crocint)value); croc_fielda(t, tab, name); };
+
+		setInt("cycle", e.cycle);
+		setInt("startTime", e.startTime);
+		setInt("time", e.time);
+		pushPhaseTimes(t, e.phaseTime);
+		croc_fielda(t, tab, "phaseTime");
+		setInt("promoted", e.promoted);
+		setInt("freed", e.freed);
+		setInt("finalized", e.finalized);
+		setInt("cycleCollected", e.cycleCollected);
+		setInt("nurseryBytes", e.nurseryBytes);
+		setInt("rcBytes", e.rcBytes);
+		croc_pushBool(t, e.full);
+		croc_fielda(t, tab, "full");
+		croc_cateq(t, arr, 1);
+	}
+
+	croc_popTop(t);
+	return 1;
+}
+
+const StdlibRegisterInfo _startProfiler_info =
+{
+	Docstr(DFunc("startProfiler")
+	R"(Starts the allocation profiler. While it's running, it records the call stack of every object that's allocated,
+	and keeps totals of how many objects and bytes have been allocated from each call stack, and how many of them are
+	still alive. Use \link{gc.profile} to get the results.
+
+	This slows allocation down a lot, so only turn it on when you're looking for something. If it was stopped with
+	\link{gc.stopProfiler}, it picks up where it left off.)"),
+
+	"startProfiler", 0
+};
+
+word_t _startProfiler(CrocThread* t)
+{
+	croc_gc_startProfiler(t);
+	return 0;
+}
+
+const StdlibRegisterInfo _stopProfiler_info =
+{
+	Docstr(DFunc("stopProfiler")
+	R"(Stops the allocation profiler from recording new allocations. What it's recorded so far is kept, and the live
+	counts still go down as those objects are freed.)"),
+
+	"stopProfiler", 0
+};
+
+word_t _stopProfiler(CrocThread* t)
+{
+	croc_gc_stopProfiler(t);
+	return 0;
+}
+
+const StdlibRegisterInfo _resetProfiler_info =
+{
+	Docstr(DFunc("resetProfiler")
+	R"(Stops the allocation profiler and throws away everything it's recorded.)"),
+
+	"resetProfiler", 0
+};
+
+word_t _resetProfiler(CrocThread* t)
+{
+	croc_gc_resetProfiler(t);
+	return 0;
+}
+
+const StdlibRegisterInfo _isProfiling_info =
+{
+	Docstr(DFunc("isProfiling")
+	R"(\returns whether the allocation profiler is recording allocations.)"),
+
+	"isProfiling", 0
+};
+
+word_t _isProfiling(CrocThread* t)
+{
+	croc_pushBool(t, croc_gc_isProfiling(t));
+	return 1;
+}
+
+const StdlibRegisterInfo _profile_info =
+{
+	Docstr(DFunc("profile") DParamD("metric", "string", "\"allocBytes\"")
+	R"(\returns what the allocation profiler has recorded, as a string in the "folded stacks" format that flame graph
+	tools (such as \tt{flamegraph.pl}, \tt{inferno}, and speedscope) read. You can write it to a file and give it to one
+	of them.
+
+	Each line is one allocation site: the frames of its call stack from outermost to innermost separated by semicolons,
+	then the type of object in square brackets, then a space and a number. Script frames look like
+	\tt{name (file:line)}, and native frames look like \tt{name (native)}.
+
+	\param[metric] is which number to give for each site. It can be one of:
+	\dlist
+		\li{\tt{"allocBytes"}} how many bytes have been allocated there.
+		\li{\tt{"allocCount"}} how many objects have been allocated there.
+		\li{\tt{"liveBytes"}} how many of the bytes allocated there are still in use.
+		\li{\tt{"liveCount"}} how many of the objects allocated there are still alive.
+	\endlist
+
+	Sites whose number is 0 are left out.
+
+	\throws[ValueError] if \tt{metric} is not one of the above.)"),
+
+	"profile", 1
+};
+
+word_t _profile(CrocThread* t)
+{
+	auto metric = CrocAllocMetric_AllocBytes;
+
+	if(croc_ex_optParam(t, 1, CrocType_String))
+		metric = stringToMetric(t, 1);
+
+	croc_gc_pushProfile(t, metric);
+	return 1;
+}
+
 const StdlibRegisterInfo _postCallback_info =
 {
 	Docstr(DFunc("postCallback") DParam("cb", "function")
 	R"(The Croc GC can maintain a list of callback functions which are called whenever the GC completes a cycle.
 	Sometimes this can be a useful feature, but it's probably best not to overuse it; after all, the GC can run
-	arbitrarily, and each time it's run, these callbacks are run as well. The standard library uses a post-GC callback
-	to clean out empty entries from weak tables (defined in the hash library). Post-GC callbacks are a nice time to
-	clean out caches and such, but it's also probably a good idea to count the number of times your callback is called
-	and only perform its action once in a while instead of every GC cycle, so you don't make the GC take a long time.
+	arbitrarily, and each time it's run, these callbacks are run as well. Post-GC callbacks are a nice time to clean out
+	caches and such (though \link[hash.weakTable]{weak tables} clean themselves out without one), but it's also probably
+	a good idea to count the number of times your callback is called and only perform its action once in a while instead
+	of every GC cycle, so you don't make the GC take a long time.
 
 	When the callbacks are called, everything is safe; these are not like finalizer functions in which the GC is
 	disabled and errors are fatal. By the time the callbacks are called, the GC has completed its cycle.
@@ -228,14 +731,52 @@ word_t _removePostCallback(CrocThread* t)
 	return 0;
 }
 
+const StdlibRegisterInfo _softLimitCallback_info =
+{
+	Docstr(DFunc("softLimitCallback") DParam("cb", "null|function")
+	R"(Sets the function to be called when a collection leaves the heap over the \tt{"softLimit"} (see \link{gc.limit}).
+	It's called with two parameters, the number of bytes allocated and the soft limit, and won't be called again until
+	the heap has gone back under the soft limit and then over it again. This is a good time to drop caches or stop taking
+	on new work. Pass \tt{null} to remove the callback.)"),
+
+	"softLimitCallback", 1
+};
+
+word_t _softLimitCallback(CrocThread* t)
+{
+	croc_ex_checkAnyParam(t, 1);
+
+	if(!croc_isNull(t, 1) && !croc_isFunction(t, 1))
+		croc_ex_paramTypeError(t, 1, "null|function");
+
+	croc_gc_setSoftLimitCallback(t, 1);
+	return 0;
+}
+
 const StdlibRegister _globalFuncs[] =
 {
 	_DListItem(_collect),
 	_DListItem(_collectFull),
 	_DListItem(_allocated),
 	_DListItem(_limit),
+	_DListItem(_setBudget),
+	_DListItem(_getBudget),
+	_DListItem(_concurrentCycles),
+	_DListItem(_setGoal),
+	_DListItem(_getGoal),
+	_DListItem(_tuning),
+	_DListItem(_stats),
+	_DListItem(_resetStats),
+	_DListItem(_eventLog),
+	_DListItem(_events),
+	_DListItem(_startProfiler),
+	_DListItem(_stopProfiler),
+	_DListItem(_resetProfiler),
+	_DListItem(_isProfiling),
+	_DListItem(_profile),
 	_DListItem(_postCallback),
 	_DListItem(_removePostCallback),
+	_DListItem(_softLimitCallback),
 	_DListEnd
 };
 
@@ -55,7 +55,8 @@ const StdlibRegisterInfo _dup_info =
 	Docstr(DFunc("dup") DParam("t", "table")
 	R"(Makes a shallow duplicate of a table.
 
-	\returns a new table that has the same key-value pairs as \tt{t}.)"),
+	\returns a new table that has the same key-value pairs as \tt{t}. If \tt{t} is a weak table, so is the new one, with the
+	same mode.)"),
 
 	"dup", 1
 };
@@ -64,7 +65,7 @@ word_t _dup(CrocThread* t)
 {
 	croc_ex_checkParam(t, 1, CrocType_Table);
 	auto t_ = Thread::from(t);
-	push(t_, Value::from(getTable(t_, 1)->dup(t_->vm->mem)));
+	push(t_, Value::from(getTable(t_, 1)->dup(t_->vm)));
 	return 1;
 }
 
@@ -167,7 +168,7 @@ word_t _apply(CrocThread* t)
 		if(croc_isNull(t, -1))
 			croc_eh_throwStd(t, "TypeError", "Callback function returned null");
 
-		tab->idxa(t_->vm->mem, node->key, *getValue(t_, -1));
+		tab->idxa(t_->vm, node->key, *getValue(t_, -1));
 		croc_popTop(t);
 	}
 
@@ -204,7 +205,7 @@ word_t _map(CrocThread* t)
 		croc_pushNull(t);
 		push(t_, node->value);
 		croc_call(t, -3, 1);
-		newTab->idxa(t_->vm->mem, node->key, *getValue(t_, -1));
+		newTab->idxa(t_->vm, node->key, *getValue(t_, -1));
 		croc_popTop(t);
 	}
 
@@ -313,7 +314,7 @@ word_t _filter(CrocThread* t)
 		}
 
 		if(croc_getBool(t, -1))
-			newTab->idxa(t_->vm->mem, node->key, node->value);
+			newTab->idxa(t_->vm, node->key, node->value);
 
 		croc_popTop(t);
 	}
@@ -341,7 +342,7 @@ word_t _takeImpl(CrocThread* t)
 			push(t_, *v);
 
 			if(remove)
-				tab->idxa(t_->vm->mem, *k, Value::nullValue);
+				tab->idxa(t_->vm, *k, Value::nullValue);
 		}
 		else
 			croc_eh_throwStd(t, "ValueError", "Attempting to take from an empty table");
@@ -442,6 +443,89 @@ word_t _remove(CrocThread* t)
 	return 0;
 }
 
+const StdlibRegisterInfo _weakTable_info =
+{
+	Docstr(DFunc("weakTable") DParamD("mode", "string", "\"keys\"") DParamD("size", "int", "0")
+	R"(Creates a new weak table. A weak table is a normal table in every way, except that some of the objects in it don't
+	keep themselves alive just by being in it. When a weakly-held object is collected, the key-value pairs that held it
+	are removed from the table. Only objects of reference types (tables, namespaces, arrays, memblocks, functions,
+	funcdefs, classes, instances, and threads) are held weakly; other values, including strings, are held normally.
+
+	Whether a table is weak (and how) is fixed when it's created. \link{dup} makes weak tables from weak tables.
+
+	Since key-value pairs can disappear during any garbage collection, iterating over a weak table without the
+	\tt{"modify"} iteration mode may skip some of them.
+
+	\param[mode] is how the table holds its keys and values. It can be one of the following:
+	\dlist
+		\li{\tt{"keys"}} Weak keys and strong values. Useful for associating data with objects. Be careful: if a value
+			refers to its key, even indirectly, the key will never be collected.
+		\li{\tt{"values"}} Strong keys and weak values. Useful for caches of objects.
+		\li{\tt{"both"}} Weak keys and weak values.
+		\li{\tt{"ephemeron"}} Like \tt{"keys"}, but a value only stays alive as long as its key is alive, so a value
+			that refers to its key doesn't keep the key-value pair alive forever. This is the best kind of table for
+			associating data with objects.
+	\endlist
+	\param[size] is a hint of how many key-value pairs to preallocate space for.
+
+	\returns the new table.
+
+	\throws[ValueError] if \tt{mode} is invalid.
+	\throws[RangeError] if \tt{size} is negative.)"),
+
+	"weakTable", 2
+};
+
+word_t _weakTable(CrocThread* t)
+{
+	auto mode = CrocWeakMode_Keys;
+
+	if(croc_ex_optParam(t, 1, CrocType_String))
+	{
+		auto s = getCrocstr(t, 1);
+
+		if(s == ATODA("keys"))           mode = CrocWeakMode_Keys;
+		else if(s == ATODA("values"))    mode = CrocWeakMode_Values;
+		else if(s == ATODA("both"))      mode = CrocWeakMode_KeysValues;
+		else if(s == ATODA("ephemeron")) mode = CrocWeakMode_Ephemeron;
+		else
+			croc_eh_throwStd(t, "ValueError", "Invalid weak table mode '%.*s'", cast(int)s.length, s.ptr);
+	}
+
+	auto size = croc_ex_optIntParam(t, 2, 0);
+
+	if(size < 0)
+		croc_eh_throwStd(t, "RangeError", "Invalid size: %" CROC_INTEGER_FORMAT, size);
+
+	croc_table_newWeak(t, mode, cast(uword)size);
+	return 1;
+}
+
+const StdlibRegisterInfo _weakMode_info =
+{
+	Docstr(DFunc("weakMode") DParam("t", "table")
+	R"(\returns the mode that \tt{t} was made with as a string, as passed to \link{weakTable}, or \tt{null} if \tt{t}
+	isn't a weak table.)"),
+
+	"weakMode", 1
+};
+
+word_t _weakMode(CrocThread* t)
+{
+	croc_ex_checkParam(t, 1, CrocType_Table);
+
+	switch(croc_table_getWeakMode(t, 1))
+	{
+		case CrocWeakMode_Keys:       croc_pushString(t, "keys");      break;
+		case CrocWeakMode_Values:     croc_pushString(t, "values");    break;
+		case CrocWeakMode_KeysValues: croc_pushString(t, "both");      break;
+		case CrocWeakMode_Ephemeron:  croc_pushString(t, "ephemeron"); break;
+		default:                      croc_pushNull(t);                break;
+	}
+
+	return 1;
+}
+
 const StdlibRegisterInfo _newNamespace_info =
 {
 	Docstr(DFunc("newNamespace") DParam("name", "string") DParam("parent", "namespace|null")
@@ -504,6 +588,8 @@ const StdlibRegister _globalFuncs[] =
 	_DListItem(_clear),
 	_DListItem(_remove),
 	_DListItem(_newNamespace),
+	_DListItem(_weakTable),
+	_DListItem(_weakMode),
 	_DListEnd
 };
 
@@ -710,12 +796,8 @@ word loader(CrocThread* t)
 		registerFields(t, _namespaceMetamethods);
 	croc_vm_setTypeMT(t, CrocType_Namespace);
 
-	croc_pushStringn(t, hash_weaktables_croc_text, hash_weaktables_croc_length);
-#ifdef CROC_BUILTIN_DOCS
-	croc_compiler_compileStmtsDTEx(t, "hash_weaktables.croc");
-#else
-	croc_compiler_compileStmtsEx(t, "hash_weaktables.croc");
-#endif
+	compileStdlibStmts(t, crocstr::n(cast(const unsigned char*)hash_weaktables_croc_text, hash_weaktables_croc_length),
+		"hash_weaktables.croc");
 	croc_function_newScript(t, -1);
 	croc_pushNull(t);
 	croc_call(t, -2, 0);
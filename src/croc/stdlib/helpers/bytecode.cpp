@@ -0,0 +1,327 @@
+#include <functional>
+
+#include "croc/api.h"
+#include "croc/internal/eh.hpp"
+#include "croc/internal/image.hpp"
+#include "croc/internal/stack.hpp"
+#include "croc/stdlib/helpers/bytecode.hpp"
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+	namespace
+	{
+	// After the header, there's the string table: a count, and that many strings as byte length, codepoint length, and
+	// data. Then a count of values, and that many values, each a type tag followed by its contents. Strings in values
+	// are indices into the string table.
+	const uint8_t Magic[] = { 'C', 'r', 'o', 'c', 'B', 'C' };
+	const uword FormatVersion = 1;
+
+	inline bool isSimple(CrocType type)
+	{
+		return type == CrocType_Null || type == CrocType_Bool || type == CrocType_Int || type == CrocType_Float ||
+			type == CrocType_String;
+	}
+
+	struct BytecodeWriter : public ImageWriter
+	{
+	private:
+		Thread* t;
+
+	public:
+		Hash<String*, uword> stringIndices;
+		DArray<String*> strings;
+
+		BytecodeWriter(Thread* t, std::function<void(crocstr)> output) :
+			ImageWriter(output),
+			t(t),
+			stringIndices(),
+			strings()
+		{}
+
+		// The values are walked twice: once to build the string table, and again to write them out.
+		void write(word first, uword num)
+		{
+			collecting = true;
+
+			for(uword i = 0; i < num; i++)
+				writeValue(*getValue(t, first + i));
+
+			strings = DArray<String*>::alloc(t->vm->mem, stringIndices.length());
+
+			for(auto node: stringIndices)
+				strings[node->value] = node->key;
+
+			collecting = false;
+			writeBlock(crocstr::n(Magic, sizeof(Magic)));
+			writeLength(FormatVersion);
+			writeLength(imageBuildSignature());
+			writeLength(strings.length);
+
+			for(auto s: strings)
+			{
+				writeLength(s->length);
+				writeLength(s->cpLength);
+				writeBlock(s->toDArray());
+			}
+
+			writeLength(num);
+
+			for(uword i = 0; i < num; i++)
+				writeValue(*getValue(t, first + i));
+		}
+
+		void cleanup()
+		{
+			stringIndices.clear(t->vm->mem);
+			strings.free(t->vm->mem);
+		}
+
+		void writeString(String* s)
+		{
+			if(collecting)
+			{
+				if(stringIndices.lookup(s) == nullptr)
+				{
+					auto idx = stringIndices.length();
+					*stringIndices.insert(t->vm->mem, s) = idx;
+				}
+			}
+			else
+				writeLength(*stringIndices.lookup(s));
+		}
+
+		void writeConstant(Value v)
+		{
+			if(!isSimple(v.type))
+				cantWrite(v);
+
+			writeValue(v);
+		}
+
+		void writeInnerFunc(Funcdef* def)
+		{
+			writeFuncdef(def);
+		}
+
+	private:
+		void cantWrite(Value v)
+		{
+			croc_eh_throwStd(*t, "TypeError", "Can't write a value of type '%s' as bytecode", typeToString(v.type));
+		}
+
+		void writeValue(Value v)
+		{
+			writeByte(cast(uint8_t)v.type);
+
+			switch(v.type)
+			{
+				case CrocType_Null: break;
+				case CrocType_Bool: writeByte(cast(uint8_t)v.mBool); break;
+				case CrocType_Int: writeInt(v.mInt); break;
+				case CrocType_Float: writeFloat(v.mFloat); break;
+				case CrocType_String: writeString(v.mString); break;
+
+				case CrocType_Table: {
+					auto tab = v.mTable;
+
+					if(tab->weakMode != CrocWeakMode_None)
+						cantWrite(v);
+
+					writeLength(tab->length());
+
+					size_t idx = 0;
+					Value* key;
+					Value* val;
+
+					while(tab->next(idx, key, val))
+					{
+						writeConstant(*key);
+						writeValue(*val);
+					}
+					break;
+				}
+				case CrocType_Array:
+					writeLength(v.mArray->length);
+
+					for(auto &slot: v.mArray->toDArray())
+						writeValue(slot.value);
+					break;
+
+				case CrocType_Funcdef: writeFuncdef(v.mFuncdef); break;
+				default: cantWrite(v);
+			}
+		}
+
+		void writeFuncdef(Funcdef* def)
+		{
+			if(def->environment != nullptr || def->cachedFunc != nullptr)
+				croc_eh_throwStd(*t, "ValueError", "Can't write a funcdef that has been instantiated as bytecode");
+
+			writeFuncdefBody(*this, def);
+		}
+	};
+
+	struct BytecodeReader : public ImageReader
+	{
+	private:
+		Memory& mem;
+		Array* strings;
+
+	public:
+		BytecodeReader(Thread* t, crocstr data) :
+			ImageReader(t, data),
+			mem(t->vm->mem),
+			strings(nullptr)
+		{}
+
+		// Pushes the string table.
+		void readStrings()
+		{
+			auto num = readCount();
+			strings = Array::create(mem, num);
+			push(t, Value::from(strings));
+
+			for(uword i = 0; i < num; i++)
+			{
+				auto len = readLength();
+				auto cpLen = readLength();
+				auto s = String::createUnverified(t->vm, readBlock(len), cpLen);
+				strings->idxa(mem, i, Value::from(s));
+			}
+		}
+
+		// Pushes whatever the value is.
+		void readValue()
+		{
+			auto tag = readByte();
+
+			switch(tag)
+			{
+				case CrocType_Table: {
+					auto len = readCount();
+					auto tab = Table::create(mem, len);
+					push(t, Value::from(tab));
+
+					for(uword i = 0; i < len; i++)
+					{
+						auto key = readConstant();
+						readValue();
+						tab->idxa(t->vm, key, *getValue(t, -1));
+						croc_popTop(*t);
+					}
+					break;
+				}
+				case CrocType_Array: {
+					auto len = readCount();
+					auto arr = Array::create(mem, len);
+					push(t, Value::from(arr));
+
+					for(uword i = 0; i < len; i++)
+					{
+						readValue();
+						arr->idxa(mem, i, *getValue(t, -1));
+						croc_popTop(*t);
+					}
+					break;
+				}
+				case CrocType_Funcdef: readFuncdef(); break;
+				default: push(t, readSimple(tag)); break;
+			}
+		}
+
+		String* readString()
+		{
+			auto idx = readLength();
+
+			if(idx >= strings->length)
+				malformed();
+
+			return strings->data[idx].value.mString;
+		}
+
+		Value readConstant()
+		{
+			return readSimple(readByte());
+		}
+
+		// The parent funcdef is on the stack, so once the inner one is stored in it, it's reachable.
+		Funcdef* readInnerFunc()
+		{
+			readFuncdef();
+			auto ret = getFuncdef(t, -1);
+			croc_popTop(*t);
+			return ret;
+		}
+
+	private:
+		Value readSimple(uint8_t tag)
+		{
+			switch(tag)
+			{
+				case CrocType_Null: return Value::nullValue;
+				case CrocType_Bool: return Value::from(readByte() != 0);
+				case CrocType_Int: return Value::from(readInt());
+				case CrocType_Float: return Value::from(readFloat());
+				case CrocType_String: return Value::from(readString());
+				default: malformed(); return Value::nullValue;
+			}
+		}
+
+		// Pushes the funcdef.
+		void readFuncdef()
+		{
+			auto def = Funcdef::create(mem);
+			push(t, Value::from(def));
+			readFuncdefBody(*this, mem, def);
+		}
+	};
+	}
+
+	// Writes num values, starting at stack slot first, as bytecode. The output function is called with each piece of
+	// it in order.
+	void writeBytecode(CrocThread* t, word_t first, uword_t num, std::function<void(crocstr)> output)
+	{
+		first = croc_absIndex(t, first);
+		auto slot = croc_pushNull(t);
+		bool failed;
+
+		// The writer has to be gone before rethrowing, since that skips destructors.
+		{
+			BytecodeWriter w(Thread::from(t), output);
+
+			failed = tryCode(Thread::from(t), slot, [&]
+			{
+				w.write(first, num);
+			});
+
+			w.cleanup();
+		}
+
+		if(failed)
+			croc_eh_rethrow(t);
+
+		croc_popTop(t); // dummy eh slot
+	}
+
+	// Reads bytecode written by writeBytecode, pushing the values in it in the same order. Returns how many values were
+	// pushed, or -1 if the data was written by an incompatible build (or isn't bytecode at all), in which case nothing
+	// is pushed. Throws a ValueError if the data is cut off.
+	word_t readBytecode(CrocThread* t, crocstr data)
+	{
+		BytecodeReader r(Thread::from(t), data);
+
+		if(!r.readHeader(crocstr::n(Magic, sizeof(Magic)), FormatVersion))
+			return -1;
+
+		r.readStrings();
+		auto stringsSlot = croc_getStackSize(t) - 1;
+		auto num = r.readCount();
+
+		for(uword i = 0; i < num; i++)
+			r.readValue();
+
+		croc_remove(t, stringsSlot);
+		return cast(word_t)num;
+	}
+}
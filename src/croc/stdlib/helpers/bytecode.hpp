@@ -0,0 +1,19 @@
+#ifndef CROC_STDLIB_HELPERS_BYTECODE_HPP
+#define CROC_STDLIB_HELPERS_BYTECODE_HPP
+
+#include <functional>
+
+#include "croc/api.h"
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+	// A compact binary form of compiled code, used to embed the script parts of the stdlib in the library so that they
+	// don't have to be recompiled every time a VM is opened. It can hold funcdefs (without environments or cached
+	// functions), doc tables, and the value types that can appear in those. Since it stores instructions as-is, it's
+	// only readable by a library built from the same source with the same options as the one that wrote it.
+	void writeBytecode(CrocThread* t, word_t first, uword_t num, std::function<void(crocstr)> output);
+	word_t readBytecode(CrocThread* t, crocstr data);
+}
+
+#endif
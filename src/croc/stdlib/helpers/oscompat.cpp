@@ -47,6 +47,9 @@ namespace croc
 
 	namespace
 	{
+		// heapBuf is exempt from the memory limit, like the other transcoding buffers here. They're never much bigger
+		// than a string that's already on the heap and are freed before their callers return, but a MemoryError from a
+		// later allocation (even just the next path) would leak them.
 		wstring _utf8ToUtf16z(Memory& mem, crocstr src, wstring localBuf, wstring& heapBuf)
 		{
 			heapBuf = wstring();
@@ -56,7 +59,9 @@ namespace croc
 
 			if(size16 + 1 > localBuf.length) // +1 cause we need to put the terminating 0
 			{
+				mem.limitExempt++;
 				heapBuf = wstring::alloc(mem, size16 + 1);
+				mem.limitExempt--;
 				ret = Utf8ToUtf16(src, heapBuf, remaining);
 			}
 			else
@@ -72,7 +77,9 @@ namespace croc
 		{
 			auto &mem = Thread::from(t)->vm->mem;
 			auto size8 = fastUtf16GetUtf8Size(src);
+			mem.limitExempt++;
 			auto out = mcrocstr::alloc(mem, size8);
+			mem.limitExempt--;
 			cwstring remaining;
 			mcrocstr output;
 
@@ -80,7 +87,9 @@ namespace croc
 			{
 				assert(output.length == out.length);
 				assert(remaining.length == 0);
+				mem.limitExempt++;
 				pushCrocstr(t, out);
+				mem.limitExempt--;
 				out.free(mem);
 				return true;
 			}
@@ -397,7 +406,9 @@ namespace croc
 			}
 		}
 
+		mem.limitExempt++;
 		auto val16 = wstring::alloc(mem, valSize16);
+		mem.limitExempt--;
 		auto failed = GetEnvironmentVariableW(cast(LPCWSTR)name16.ptr, cast(LPWSTR)val16.ptr, valSize16) == 0;
 		nameBuf.free(mem);
 
@@ -575,10 +586,13 @@ namespace croc
 		}
 
 		auto &mem = Thread::from(t)->vm->mem;
+		mem.limitExempt++;
 		auto tmp = wstring::alloc(mem, len);
+		mem.limitExempt--;
 
 		if(GetCurrentDirectoryW(len, cast(LPWSTR)tmp.ptr) == 0)
 		{
+			tmp.free(mem);
 			pushSystemErrorMsg(t);
 			return false;
 		}
@@ -1169,16 +1183,20 @@ namespace croc
 
 	bool pushCurrentDir(CrocThread* t)
 	{
+		// buf would leak if growing it or making the string ran into the memory limit. Paths are short, so it's exempt.
 		auto t_ = Thread::from(t);
-		auto buf = DArray<char>::alloc(t_->vm->mem, 256);
+		auto &mem = t_->vm->mem;
+		mem.limitExempt++;
+		auto buf = DArray<char>::alloc(mem, 256);
 
 		while(getcwd(buf.ptr, buf.length) == nullptr)
 		{
 			if(errno == ERANGE)
-				buf.resize(t_->vm->mem, buf.length * 2);
+				buf.resize(mem, buf.length * 2);
 			else
 			{
-				buf.free(t_->vm->mem);
+				mem.limitExempt--;
+				buf.free(mem);
 				pushSystemErrorMsg(t);
 				return false;
 			}
@@ -1192,7 +1210,8 @@ namespace croc
 		if(ok == UtfError_OK)
 			push(t_, Value::from(String::createUnverified(t_->vm, slice, cpLen)));
 
-		buf.free(t_->vm->mem);
+		mem.limitExempt--;
+		buf.free(mem);
 
 		if(ok != UtfError_OK)
 			croc_eh_throwStd(t, "UnicodeError", "Invalid UTF-8 sequence");
@@ -1310,8 +1329,13 @@ namespace croc
 					}
 					else
 					{
-						auto mem = Thread::from(t)->vm->mem;
+						// A MemoryError here would leak the files, and one from pushing an error message would leak the
+						// buffer too, so it's exempt from the memory limit and freed before anything is pushed.
+						auto &mem = Thread::from(t)->vm->mem;
+						mem.limitExempt++;
 						auto buffer = DArray<uint8_t>::alloc(mem, 65536);
+						mem.limitExempt--;
+						int err = 0;
 
 						while(true)
 						{
@@ -1319,8 +1343,7 @@ namespace croc
 
 							if(bytesRead == -1)
 							{
-								pushSystemErrorMsg(t);
-								ret = false;
+								err = errno;
 								break;
 							}
 							else if(bytesRead == 0)
@@ -1335,8 +1358,7 @@ namespace croc
 
 								if(bytesWritten == -1)
 								{
-									pushSystemErrorMsg(t);
-									ret = false;
+									err = errno;
 									goto _breakOuter;
 								}
 
@@ -1345,7 +1367,15 @@ namespace croc
 							}
 						}
 
-					_breakOuter:;
+					_breakOuter:
+						buffer.free(mem);
+
+						if(err != 0)
+						{
+							errno = err;
+							pushSystemErrorMsg(t);
+							ret = false;
+						}
 					}
 
 					::close(dstfd);
@@ -0,0 +1,40 @@
+#include <string.h>
+
+#include "croc/stdlib/helpers/register.hpp"
+#include "croc/types/base.hpp"
+
+namespace croc
+{
+	namespace
+	{
+	struct PrecompiledModule
+	{
+		const char* sourceName;
+		const unsigned char* data;
+		size_t length;
+	};
+
+#ifdef CROC_NO_PRECOMPILED_STDLIB
+	const PrecompiledModule precompiledModules[] =
+	{
+		{nullptr, nullptr, 0}
+	};
+#else
+#include "croc/stdlib/precompiled.bc.hpp"
+#endif
+	}
+
+	// Gets the bytecode (see croc/stdlib/helpers/bytecode.hpp) for the script part of the stdlib with the given source
+	// name, as made at build time by croc/ext/precompile.cpp. Gives an empty array if there's none, which is always
+	// the case in the precompile tool itself.
+	crocstr getPrecompiledStdlib(const char* sourceName)
+	{
+		for(auto m = precompiledModules; m->sourceName != nullptr; m++)
+		{
+			if(strcmp(m->sourceName, sourceName) == 0)
+				return crocstr::n(m->data, m->length);
+		}
+
+		return crocstr();
+	}
+}
@@ -1,5 +1,7 @@
 
 #include "croc/api.h"
+#include "croc/internal/variables.hpp"
+#include "croc/stdlib/helpers/bytecode.hpp"
 #include "croc/stdlib/helpers/register.hpp"
 #include "croc/types/base.hpp"
 #include "croc/util/str.hpp"
@@ -31,6 +33,45 @@ namespace croc
 				}
 			});
 		}
+
+		// Pushes the precompiled values for sourceName if there are any and there are num of them.
+		bool pushPrecompiled(CrocThread* t, const char* sourceName, word num)
+		{
+			auto data = getPrecompiledStdlib(sourceName);
+
+			if(data.length == 0)
+				return false;
+
+			auto got = readBytecode(t, data);
+
+			if(got == num)
+				return true;
+
+			if(got > 0)
+				croc_pop(t, got);
+
+			return false;
+		}
+
+		void pushModuleFuncdef(CrocThread* t, const char* name, const char* source, const char* sourceName)
+		{
+			if(pushPrecompiled(t, sourceName, 1))
+				return;
+
+#ifdef CROC_BUILTIN_DOCS
+			// Lazily-loaded modules are compiled after croc_vm_open has turned the docs flag back off.
+			auto oldFlags = croc_compiler_setFlags(t, CrocCompilerFlags_AllDocs);
+#endif
+			croc_pushString(t, source);
+			const char* modName;
+			croc_compiler_compileModuleEx(t, sourceName, &modName);
+#ifdef CROC_BUILTIN_DOCS
+			croc_compiler_setFlags(t, oldFlags);
+#endif
+			if(strcmp(name, modName) != 0)
+				croc_eh_throwStd(t, "ImportException",
+					"Import name (%s) does not match name given in module statement (%s)", name, modName);
+		}
 	}
 
 	void registerModule(CrocThread* t, const char* name, CrocNativeFunc loader)
@@ -42,18 +83,70 @@ namespace croc
 		croc_call(t, -2, 0);
 	}
 
-	void registerModuleFromString(CrocThread* t, const char* name, const char* source, const char* sourceName)
+	// Registers a module which won't be loaded until it's imported or until its global (the first part of its name) is
+	// accessed. The loader works the same as with registerModule, but goes in modules.customLoaders, so this can't be
+	// used until the modules lib has been loaded.
+	void registerLazyModule(CrocThread* t, const char* name, CrocNativeFunc loader)
 	{
-		makeModuleNamespace(t, name);
+		croc_ex_makeModule(t, name, loader);
+
+		auto dot = strchr(name, '.');
 
-		croc_pushString(t, source);
-		const char* modName;
-		croc_compiler_compileModuleEx(t, sourceName, &modName);
+		if(dot == nullptr)
+			registerLazyGlobal(t, name, name);
+		else
+		{
+			croc_pushStringn(t, name, dot - name);
+			registerLazyGlobal(t, croc_getString(t, -1), name);
+			croc_popTop(t);
+		}
+	}
 
-		if(strcmp(name, modName) != 0)
-			croc_eh_throwStd(t, "ImportException",
-				"Import name (%s) does not match name given in module statement (%s)", name, modName);
+	// Makes accessing the global 'global' while it doesn't exist import the lazily-registered module 'name'. Modules
+	// which export things into the global namespace use this for each of them.
+	void registerLazyGlobal(CrocThread* t, const char* global, const char* name)
+	{
+		auto reg = croc_vm_pushRegistry(t);
+		croc_pushString(t, LazyGlobalsRegistry);
 
+		if(!croc_in(t, -1, reg))
+		{
+			croc_table_new(t, 0);
+			croc_fieldaStk(t, reg);
+			croc_pushString(t, LazyGlobalsRegistry);
+		}
+
+		auto lazy = croc_fieldStk(t, reg);
+		croc_pushString(t, global);
+
+		if(!croc_in(t, -1, lazy))
+		{
+			croc_array_new(t, 0);
+			croc_idxa(t, lazy);
+			croc_pushString(t, global);
+		}
+
+		croc_idx(t, lazy);
+		croc_pushString(t, name);
+		croc_cateq(t, -2, 1);
+		croc_pop(t, 3);
+	}
+
+	// For use inside a module loader. Runs the given Croc module (precompiled, if it was) in the loader's namespace.
+	void loadModuleFromString(CrocThread* t, const char* name, const char* source, const char* sourceName)
+	{
+		pushModuleFuncdef(t, name, source, sourceName);
+		croc_dup(t, 0);
+		croc_function_newScriptWithEnv(t, -2);
+		croc_dup(t, 0);
+		croc_call(t, -2, 0);
+		croc_popTop(t);
+	}
+
+	void registerModuleFromString(CrocThread* t, const char* name, const char* source, const char* sourceName)
+	{
+		makeModuleNamespace(t, name);
+		pushModuleFuncdef(t, name, source, sourceName);
 		croc_swapTop(t);
 		croc_dupTop(t);
 		croc_function_newScriptWithEnv(t, -3);
@@ -62,6 +155,25 @@ namespace croc
 		croc_popTop(t);
 	}
 
+	// Pushes the funcdef for a script part of the stdlib that's a list of statements rather than a module. With
+	// CROC_BUILTIN_DOCS, its doc table is pushed below it, like croc_compiler_compileStmtsDTEx.
+	void compileStdlibStmts(CrocThread* t, crocstr source, const char* sourceName)
+	{
+#ifdef CROC_BUILTIN_DOCS
+		if(!pushPrecompiled(t, sourceName, 2))
+		{
+			croc_pushStringn(t, cast(const char*)source.ptr, source.length);
+			croc_compiler_compileStmtsDTEx(t, sourceName);
+		}
+#else
+		if(!pushPrecompiled(t, sourceName, 1))
+		{
+			croc_pushStringn(t, cast(const char*)source.ptr, source.length);
+			croc_compiler_compileStmtsEx(t, sourceName);
+		}
+#endif
+	}
+
 #define MAKE_REGISTER_MULTI(Type)\
 	void register##Type##s(CrocThread* t, const StdlibRegister* funcs)\
 	{\
@@ -47,7 +47,12 @@ namespace croc
 	};
 
 	void registerModule(CrocThread* t, const char* name, CrocNativeFunc loader);
+	void registerLazyModule(CrocThread* t, const char* name, CrocNativeFunc loader);
+	void registerLazyGlobal(CrocThread* t, const char* global, const char* name);
+	void loadModuleFromString(CrocThread* t, const char* name, const char* source, const char* sourceName);
 	void registerModuleFromString(CrocThread* t, const char* name, const char* source, const char* sourceName);
+	void compileStdlibStmts(CrocThread* t, crocstr source, const char* sourceName);
+	crocstr getPrecompiledStdlib(const char* sourceName);
 	void registerGlobals(CrocThread* t, const StdlibRegister* funcs);
 	void registerFields(CrocThread* t, const StdlibRegister* funcs);
 	void registerMethods(CrocThread* t, const StdlibRegister* funcs);
@@ -125,15 +125,8 @@ const StdlibRegister _globalFuncs[] =
 word loader(CrocThread* t)
 {
 	registerGlobals(t, _globalFuncs);
-	return 0;
-}
-}
-
-void initJSONLib(CrocThread* t)
-{
-	registerModule(t, "json", &loader);
-	croc_pushGlobal(t, "json");
 #ifdef CROC_BUILTIN_DOCS
+	croc_dup(t, 0);
 	CrocDoc doc;
 	croc_ex_doc_init(t, &doc, __FILE__);
 	croc_ex_doc_push(&doc,
@@ -143,7 +136,14 @@ void initJSONLib(CrocThread* t)
 		docFields(&doc, _globalFuncs);
 	croc_ex_doc_pop(&doc, -1);
 	croc_ex_doc_finish(&doc);
-#endif
 	croc_popTop(t);
+#endif
+	return 0;
+}
+}
+
+void initJSONLib(CrocThread* t)
+{
+	registerLazyModule(t, "json", &loader);
 }
 }
\ No newline at end of file
@@ -239,15 +239,8 @@ word loader(CrocThread* t)
 		croc_pushNull(t); croc_class_addHField(t, -2, "stream");
 		registerMethods(t, _Process_methods);
 	croc_newGlobal(t, "Process");
-	return 0;
-}
-}
-
-void initOSLib(CrocThread* t)
-{
-	croc_ex_makeModule(t, "os", &loader);
-	croc_ex_importNS(t, "os");
 #ifdef CROC_BUILTIN_DOCS
+	croc_dup(t, 0);
 	CrocDoc doc;
 	croc_ex_doc_init(t, &doc, __FILE__);
 	croc_ex_doc_push(&doc, ModuleDocs);
@@ -260,7 +253,14 @@ void initOSLib(CrocThread* t)
 		croc_popTop(t);
 	croc_ex_doc_pop(&doc, -1);
 	croc_ex_doc_finish(&doc);
-#endif
 	croc_popTop(t);
+#endif
+	return 0;
+}
+}
+
+void initOSLib(CrocThread* t)
+{
+	registerLazyModule(t, "os", &loader);
 }
 }
\ No newline at end of file
@@ -9,10 +9,16 @@ namespace croc
 namespace
 {
 #include "croc/stdlib/repl.croc.hpp"
+
+word loader(CrocThread* t)
+{
+	loadModuleFromString(t, "repl", repl_croc_text, "repl.croc");
+	return 0;
+}
 }
 
 void initReplLib(CrocThread* t)
 {
-	registerModuleFromString(t, "repl", repl_croc_text, "repl.croc");
+	registerLazyModule(t, "repl", &loader);
 }
 }
\ No newline at end of file
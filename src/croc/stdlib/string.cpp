@@ -247,8 +247,12 @@ word_t _join(CrocThread* t)
 		i++;
 	}
 
+	// buf would leak if this ran into the memory limit.
+	auto &mem = Thread::from(t)->vm->mem;
+	mem.limitExempt++;
 	pushCrocstr(t, buf);
-	buf.free(Thread::from(t)->vm->mem);
+	mem.limitExempt--;
+	buf.free(mem);
 	return 1;
 }
 
@@ -515,9 +519,12 @@ word_t _reverse(CrocThread* t)
 	if(tmp.ptr)
 	{
 		assert(cast(uword)(b - tmp.ptr) == src.length);
+		// tmp would leak if this ran into the memory limit.
+		auto &mem = Thread::from(t)->vm->mem;
+		mem.limitExempt++;
 		croc_pushStringn(t, tmp.ptr, src.length);
-		// XXX: this might not run if croc_pushStringn fails, but it would only fail in an OOM situation, so..?
-		tmp.free(Thread::from(t)->vm->mem);
+		mem.limitExempt--;
+		tmp.free(mem);
 	}
 	else
 	{
@@ -102,6 +102,18 @@ dstring _toUtf32(crocstr str, dstring buf)
 	return ret;
 }
 
+// How big a buffer replacing every from in src with to needs. Replacements are done into a buffer that's already big
+// enough, since growing it from patternsRep's callback could throw, which would leak the callback.
+uword _replaceSize(cdstring src, cdstring from, cdstring to)
+{
+	if(from.length >= to.length)
+		return src.length;
+
+	uword ret = 0;
+	patternsRep(src, from, to, [&](cdstring piece) { ret += piece.length; });
+	return ret;
+}
+
 bool _isStringOrStringBuffer(CrocThread* t, word idx)
 {
 	croc_ex_checkAnyParam(t, idx);
@@ -115,7 +127,9 @@ bool _isStringOrStringBuffer(CrocThread* t, word idx)
 	return ret;
 }
 
-dstring _checkStringOrStringBuffer(CrocThread* t, word idx, dstring buf, dstring& tmp)
+// If the string at idx doesn't fit in buf, it's converted into a new memblock which is pushed onto the stack, so that
+// the GC frees it even if something throws before the caller is done with it.
+dstring _checkStringOrStringBuffer(CrocThread* t, word idx, dstring buf)
 {
 	croc_ex_checkAnyParam(t, idx);
 
@@ -128,8 +142,8 @@ dstring _checkStringOrStringBuffer(CrocThread* t, word idx, dstring buf, dstring
 			return _toUtf32(str, buf);
 		else
 		{
-			tmp = dstring::alloc(Thread::from(t)->vm->mem, strCPLen);
-			return _toUtf32(str, tmp);
+			croc_memblock_new(t, strCPLen << 2);
+			return _toUtf32(str, getMemblock(Thread::from(t), -1)->data.template as<dchar>());
 		}
 	}
 	else
@@ -1008,15 +1022,13 @@ word_t _commonFind(CrocThread* t)
 	auto src = _stringBufferAsUtf32(t, 0);
 	auto start = croc_ex_optIndexParam(t, 2, src.length, "start", reverse ? (src.length - 1) : 0);
 	dchar buf[64];
-	auto tmp = dstring();
-	auto pat = _checkStringOrStringBuffer(t, 1, dstring::n(buf, 64), tmp);
+	auto pat = _checkStringOrStringBuffer(t, 1, dstring::n(buf, 64));
 
 	if(reverse)
 		croc_pushInt(t, strRLocatePattern(src, pat, start));
 	else
 		croc_pushInt(t, strLocatePattern(src, pat, start));
 
-	tmp.free(Thread::from(t)->vm->mem);
 	return 1;
 }
 
@@ -1067,10 +1079,8 @@ word_t _startsWith(CrocThread* t)
 	auto self = _stringBufferAsUtf32(t, 0);
 
 	dchar buf[64];
-	auto tmp = dstring();
-	auto other = _checkStringOrStringBuffer(t, 1, dstring::n(buf, 64), tmp);
+	auto other = _checkStringOrStringBuffer(t, 1, dstring::n(buf, 64));
 	croc_pushBool(t, self.length >= other.length && self.slice(0, other.length) == other);
-	tmp.free(Thread::from(t)->vm->mem);
 	return 0;
 }
 
@@ -1087,10 +1097,8 @@ word_t _endsWith(CrocThread* t)
 	auto self = _stringBufferAsUtf32(t, 0);
 
 	dchar buf[64];
-	auto tmp = dstring();
-	auto other = _checkStringOrStringBuffer(t, 1, dstring::n(buf, 64), tmp);
+	auto other = _checkStringOrStringBuffer(t, 1, dstring::n(buf, 64));
 	croc_pushBool(t, self.length >= other.length && self.slice(self.length - other.length, self.length) == other);
-	tmp.free(Thread::from(t)->vm->mem);
 	return 0;
 }
 
@@ -1109,8 +1117,7 @@ word_t _split(CrocThread* t)
 	auto src = _stringBufferAsUtf32(t, 0);
 
 	dchar buf[64];
-	auto tmp = dstring();
-	auto splitter = _checkStringOrStringBuffer(t, 1, dstring::n(buf, 64), tmp);
+	auto splitter = _checkStringOrStringBuffer(t, 1, dstring::n(buf, 64));
 	auto ret = croc_array_new(t, 0);
 	uword num = 0;
 
@@ -1129,8 +1136,6 @@ word_t _split(CrocThread* t)
 	if(num > 0)
 		croc_cateq(t, ret, num);
 
-	tmp.free(Thread::from(t)->vm->mem);
-
 	return 1;
 }
 
@@ -1149,8 +1154,7 @@ word_t _vsplit(CrocThread* t)
 	auto src = _stringBufferAsUtf32(t, 0);
 
 	dchar buf[64];
-	auto tmp = dstring();
-	auto splitter = _checkStringOrStringBuffer(t, 1, dstring::n(buf, 64), tmp);
+	auto splitter = _checkStringOrStringBuffer(t, 1, dstring::n(buf, 64));
 	uword num = 0;
 
 	patterns(src, splitter, [&](DArray<const dchar> piece)
@@ -1159,15 +1163,10 @@ word_t _vsplit(CrocThread* t)
 		num++;
 
 		if(num > VSplitMax)
-		{
-			tmp.free(Thread::from(t)->vm->mem);
 			croc_eh_throwStd(t, "ValueError", "Too many (>%" CROC_SIZE_T_FORMAT ") parts when splitting",
 				VSplitMax);
-		}
 	});
 
-	tmp.free(Thread::from(t)->vm->mem);
-
 	return num;
 }
 
@@ -1421,36 +1420,21 @@ word_t _replace(CrocThread* t)
 	croc_call(t, -3, 1);
 
 	dchar buf1[64], buf2[64];
-	auto tmp1 = dstring(), tmp2 = dstring();
-	auto from = _checkStringOrStringBuffer(t, 1, dstring::n(buf1, 64), tmp1);
-	auto to = _checkStringOrStringBuffer(t, 2, dstring::n(buf2, 64), tmp2);
+	auto from = _checkStringOrStringBuffer(t, 1, dstring::n(buf1, 64));
+	auto to = _checkStringOrStringBuffer(t, 2, dstring::n(buf2, 64));
 	auto destmb = _getData(t, ret);
+	_ensureSize(t, destmb, _replaceSize(src, from, to));
 	auto dest = destmb->data.template as<dchar>();
-	// only have to grow if the 'to' string is bigger than the 'from' string
-	bool shouldCheckSize = from.length < to.length;
 	uword destIdx = 0;
-	auto t_ = Thread::from(t);
 
 	patternsRep(src, from, to, [&](DArray<const dchar> piece)
 	{
-		auto newEnd = destIdx + piece.length;
-
-		if(shouldCheckSize && newEnd > dest.length)
-		{
-			push(t_, Value::from(destmb));
-			croc_lenai(t, -1, sizeof(dchar) * (newEnd > dest.length * 2 ? newEnd : dest.length * 2));
-			croc_popTop(t);
-			dest = destmb->data.template as<dchar>();
-		}
-
-		dest.slicea(destIdx, newEnd, piece);
-		destIdx = newEnd;
+		dest.slicea(destIdx, destIdx + piece.length, piece);
+		destIdx += piece.length;
 	});
 
-	tmp1.free(t_->vm->mem);
-	tmp2.free(t_->vm->mem);
-
 	_setLength(t, destIdx, ret);
+	croc_dup(t, ret);
 	return 1;
 }
 
@@ -1602,26 +1586,19 @@ word_t _replace_ip(CrocThread* t)
 		croc_ex_paramTypeError(t, 2, "string|StringBuffer");
 
 	auto src = _stringBufferAsUtf32(t, 0);
-	auto &mem = Thread::from(t)->vm->mem;
 
 	dchar buf1[64], buf2[64];
-	auto tmp1 = dstring(), tmp2 = dstring();
-	auto from = _checkStringOrStringBuffer(t, 1, dstring::n(buf1, 64), tmp1);
-	auto to = _checkStringOrStringBuffer(t, 2, dstring::n(buf2, 64), tmp2);
-	auto buffer = dstring::alloc(mem, src.length);
-	// only have to grow if the 'to' string is bigger than the 'from' string
-	bool shouldCheckSize = from.length < to.length;
+	auto from = _checkStringOrStringBuffer(t, 1, dstring::n(buf1, 64));
+	auto to = _checkStringOrStringBuffer(t, 2, dstring::n(buf2, 64));
+	// The result is built in a memblock rather than a raw buffer, so that it doesn't leak if resizing this throws.
+	croc_memblock_new(t, _replaceSize(src, from, to) << 2);
+	auto buffer = getMemblock(Thread::from(t), -1)->data.template as<dchar>();
 	uword destIdx = 0;
 
 	patternsRep(src, from, to, [&](DArray<const dchar> piece)
 	{
-		auto newEnd = destIdx + piece.length;
-
-		if(shouldCheckSize && newEnd > buffer.length)
-			buffer.resize(mem, newEnd > buffer.length * 2 ? newEnd : buffer.length * 2);
-
-		buffer.slicea(destIdx, newEnd, piece);
-		destIdx = newEnd;
+		buffer.slicea(destIdx, destIdx + piece.length, piece);
+		destIdx += piece.length;
 	});
 
 	auto mb = _getData(t, 0);
@@ -1630,10 +1607,6 @@ word_t _replace_ip(CrocThread* t)
 	src = _stringBufferAsUtf32(t, 0); // has been invalidated!
 	src.slicea(0, destIdx, buffer.slice(0, destIdx));
 
-	tmp1.free(mem);
-	tmp2.free(mem);
-	buffer.free(mem);
-
 	croc_dup(t, 0);
 	return 1;
 }
@@ -402,16 +402,8 @@ word loader(CrocThread* t)
 		registerMethods(t, _Timer_methods);
 	croc_newGlobal(t, "Timer");
 
-	return 0;
-}
-}
-
-void initTimeLib(CrocThread* t)
-{
-	oscompat::initTime();
-	registerModule(t, "time", &loader);
-	croc_pushGlobal(t, "time");
 #ifdef CROC_BUILTIN_DOCS
+	croc_dup(t, 0);
 	CrocDoc doc;
 	croc_ex_doc_init(t, &doc, __FILE__);
 	croc_ex_doc_push(&doc, ModuleDocs);
@@ -424,7 +416,15 @@ void initTimeLib(CrocThread* t)
 		croc_popTop(t);
 	croc_ex_doc_pop(&doc, -1);
 	croc_ex_doc_finish(&doc);
-#endif
 	croc_popTop(t);
+#endif
+	return 0;
+}
+}
+
+void initTimeLib(CrocThread* t)
+{
+	oscompat::initTime();
+	registerLazyModule(t, "time", &loader);
 }
 }
\ No newline at end of file
@@ -34,7 +34,11 @@ namespace croc
 		}
 	}
 
+#ifdef CROC_COMPACT_VALUES
+	const Value Value::nullValue = {{ cast(crocint)0 }, CrocType_Null};
+#else
 	const Value Value::nullValue = {CrocType_Null, { cast(crocint)0 }};
+#endif
 
 	hash_t Value::toHash() const
 	{
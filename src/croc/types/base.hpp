@@ -32,6 +32,7 @@ namespace croc
 
 	// Forward decls :P
 	struct VM;
+	struct CycleDetector;
 	struct String;
 	struct Weakref;
 	struct Table;
@@ -48,9 +49,18 @@ namespace croc
 	// ========================================
 	// Value
 
+	// With CROC_COMPACT_VALUES, the payload is only 4-byte aligned, so a Value is 12 bytes instead of 16 on 64-bit
+	// builds. This shrinks the stack, array slots, constant tables and hash nodes at the cost of unaligned loads of
+	// the payload, which are cheap on x86. The type goes after the payload in that mode so that copies (which the
+	// compiler splits into an 8- and a 4-byte move) line up with later loads of the payload.
+#ifdef CROC_COMPACT_VALUES
+#pragma pack(push, 4)
+#endif
 	struct Value
 	{
+#ifndef CROC_COMPACT_VALUES
 		CrocType type;
+#endif
 
 		union
 		{
@@ -76,6 +86,9 @@ namespace croc
 
 			Upval* mUpval;
 		};
+#ifdef CROC_COMPACT_VALUES
+		CrocType type;
+#endif
 
 		static const Value nullValue;
 
@@ -171,6 +184,9 @@ namespace croc
 		MAKE_SET(Thread, Thread*)
 #undef MAKE_SET
 	};
+#ifdef CROC_COMPACT_VALUES
+#pragma pack(pop)
+#endif
 
 	struct String : public GCObject
 	{
@@ -232,11 +248,29 @@ namespace croc
 		static void free(VM* vm, Weakref* r);
 	};
 
+	// One key-value pair of a weak table that weakly holds some object. The VM keeps a list of these for every weakly
+	// held object (see VM::weakHolders), so that when the object dies, only the pairs that held it have to be removed.
+	// Entries aren't taken out when the pair changes, so they can be stale; they're checked before they're used. The key
+	// may be dead by then, so it's never looked at, only compared; hash is the key's hash from when the pair was put in.
+	struct WeakHolder
+	{
+		Table* table;
+		Value key;
+		hash_t hash;
+	};
+
+	struct WeakHolderList
+	{
+		DArray<WeakHolder> entries;
+		uword length;
+	};
+
 	struct Table : public GCObject
 	{
 		typedef Hash<Value, Value, MethodHasher> HashType;
 
 		HashType data;
+		uint8_t weakMode; // a CrocWeakMode; fixed when the table is created
 
 		// Get a pointer to the value of a key-value pair, or null if it doesn't exist.
 		inline Value* get(Value key)
@@ -261,11 +295,32 @@ namespace croc
 			return this->data.next(idx, key, val);
 		}
 
+		// Whether the given key or value would be held weakly by this table. Only objects of reference types are ever
+		// held weakly.
+		inline bool weakKey(Value key) const
+		{
+			return key.isRefType() && weakMode != CrocWeakMode_None && weakMode != CrocWeakMode_Values;
+		}
+
+		inline bool weakValue(Value val) const
+		{
+			return val.isRefType() && (weakMode == CrocWeakMode_Values || weakMode == CrocWeakMode_KeysValues);
+		}
+
 		static Table* create(Memory& mem, uword size = 0);
+		static Table* createWeak(VM* vm, CrocWeakMode mode, uword size = 0);
 		static void free(Memory& mem, Table* t);
-		Table* dup(Memory& mem);
-		void idxa(Memory& mem, Value key, Value val);
+		Table* dup(VM* vm);
+		void idxa(VM* vm, Value key, Value val);
 		void clear(Memory& mem);
+		bool holdsWeakly(const WeakHolder& e, GCObject* obj);
+		static void removeDead(VM* vm);
+		static void freeWeakHolders(VM* vm);
+
+	private:
+		void barrier(VM* vm, HashType::NodeType* node);
+		void removeHeld(VM* vm, const WeakHolder& e);
+		void addWeakHolder(VM* vm, Value key, GCObject* obj);
 	};
 
 	struct Namespace : public GCObject
@@ -278,6 +333,10 @@ namespace croc
 		String* name;
 		bool visitedOnce;
 
+		// Changes whenever a key is added or removed (but not when an existing key's value is changed). Taken from the
+		// same counter as Class::layoutID, so it's never reused and never 0; global caches rely on this.
+		uword layoutID;
+
 		// Get a pointer to the value of a key-value pair, or null if it doesn't exist.
 		inline Value* get(String* key)
 		{
@@ -306,6 +365,7 @@ namespace croc
 		static void free(Memory& mem, Namespace* ns);
 		void set(Memory& mem, String* key, Value value);
 		bool setIfExists(Memory& mem, String* key, Value value);
+		void setNode(Memory& mem, HashType::NodeType* node, Value value);
 		void remove(Memory& mem, String* key);
 		void clear(Memory& mem);
 	};
@@ -419,6 +479,38 @@ namespace croc
 		DArray<Value> constants;
 		DArray<Instruction> code;
 
+		// Inline cache for a field or fielda instruction with a constant name. If the container is an instance whose
+		// class's layoutID matches, the name refers to either field slot 'slot' of the instance or to *method.
+		struct FieldCache
+		{
+			uword layoutID;
+			uword slot;
+			Value* method;
+		};
+
+		DArray<FieldCache> fieldCaches;
+
+		// Inline cache for a method or tmethod instruction with a constant name. If the object is an instance of a class
+		// (or a frozen class) whose layoutID matches, the method is *method.
+		struct MethodCache
+		{
+			uword layoutID;
+			Value* method;
+		};
+
+		DArray<MethodCache> methodCaches;
+
+		// Cache for getglobal and setglobal, indexed by the constant index of the global's name. If the environment's
+		// layoutID is envLayout and rootLayout is 0 or the root namespace's layoutID, the global is node->value.
+		struct GlobalCache
+		{
+			uword envLayout;
+			uword rootLayout;
+			Namespace::HashType::NodeType* node;
+		};
+
+		DArray<GlobalCache> globalCaches;
+
 		Namespace* environment;
 		Function* cachedFunc;
 
@@ -427,6 +519,30 @@ namespace croc
 			typedef Hash<Value, word, MethodHasher> OffsetsType;
 			OffsetsType offsets;
 			word defaultOffset;
+
+			// Switches whose cases are all ints don't have to hash. If the cases are dense, the jump for value v is
+			// denseOffsets[v - denseMin], with the holes filled in with defaultOffset. Otherwise, sortedCases holds the
+			// cases sorted by value, for binary search. Both are derived from offsets by buildIntCases.
+			enum Kind
+			{
+				Hashed,
+				Dense,
+				Sorted
+			};
+
+			struct IntCase
+			{
+				crocint value;
+				word offset;
+			};
+
+			crocint denseMin;
+			DArray<word> denseOffsets;
+			DArray<IntCase> sortedCases;
+
+			static Kind kindOf(OffsetsType& offsets);
+			void buildIntCases(Memory& mem);
+			void freeIntCases(Memory& mem);
 		};
 
 		DArray<SwitchTable> switchTables;
@@ -445,6 +561,16 @@ namespace croc
 
 		DArray<LocVarDesc> locVarDescs;
 
+#ifdef CROC_JIT
+		// Counts entries and backward jumps until the function is compiled by the JIT (see croc/internal/jit.cpp).
+		// jitEntries gives the offset into jitCode of each instruction (indexed by short) that can be started at
+		// natively, or 0 for the others.
+		uword hotness;
+		uint8_t* jitCode;
+		uword jitCodeSize;
+		DArray<uint32_t> jitEntries;
+#endif
+
 		static Funcdef* create(Memory& mem);
 		static void free(Memory& mem, Funcdef* fd);
 	};
@@ -464,6 +590,9 @@ namespace croc
 		DArray<Array::Slot> frozenFields;
 		DArray<Array::Slot> frozenHiddenFields;
 		uword numInstanceFields;
+		// Nonzero once frozen, and changes whenever members are added to or removed from a frozen class. IDs are never
+		// reused, so field caches can use them to tell classes apart even if one is freed and another takes its place.
+		uword layoutID;
 
 		static Class* create(Memory& mem, String* name);
 		static Class::HashType::NodeType* derive(Memory& mem, Class* c, Class* parent, const char*& which);
@@ -511,6 +640,11 @@ namespace croc
 				return nullptr;
 		}
 
+		inline Value* getFieldSlot(uword idx)
+		{
+			return &(cast(Array::Slot*)(this + 1))[idx].value;
+		}
+
 		inline bool nextField(uword& idx, String**& key, Value*& val)
 		{
 			if(this->fields->next(idx, key, val))
@@ -556,6 +690,7 @@ namespace croc
 		static Instance* createPartial(Memory& mem, uword size, bool finalizable);
 		static bool finishCreate(Instance* i, Class* parent);
 		bool setField(Memory& mem, String* name, Value value);
+		void setFieldSlot(Memory& mem, uword idx, Value value);
 		bool setHiddenField(Memory& mem, String* name, Value value);
 	};
 
@@ -675,6 +810,7 @@ namespace croc
 		Namespace* registry;
 		Hash<uint64_t, GCObject*> refTab;
 		Function* unhandledEx;
+		Array* baseline; // what croc_vm_reset restores; null until croc_vm_setBaseline is called
 
 		// These point to "special" runtime classes
 		Class* location;
@@ -685,8 +821,12 @@ namespace croc
 		uint8_t oldRootIdx;
 		Deque roots[2];
 		Deque cycleRoots;
+		Deque cycleBatch;
+		uword cycleVisited;
 		Deque toFree;
 		Deque toFinalize;
+		Deque newEphemeronKeys;
+		CycleDetector* cycleDetector;
 		bool inGCCycle;
 
 		// EH stuff
@@ -697,6 +837,9 @@ namespace croc
 		// Others
 		Hash<crocstr, String*, MethodHasher, HashNodeWithHash<crocstr, String*> > stringTab;
 		Hash<GCObject*, Weakref*> weakrefTab;
+		Hash<Table*, bool> weakTables; // every live weak table
+		Hash<GCObject*, CrocType> deadWeak; // weakly-held objects that died this GC cycle, and their types; see gc.cpp
+		Hash<GCObject*, WeakHolderList> weakHolders; // the pairs of weak tables that hold each weakly-held object
 		Thread* allThreads;
 		Thread* curThread;
 		uint64_t currentRef;
@@ -705,6 +848,12 @@ namespace croc
 		unsigned char formatBuf[CROC_FORMAT_BUF_SIZE];
 		RNG rng;
 
+#ifdef CROC_OPCODE_PAIR_STATS
+		// Executed opcode pairs, indexed by [previous][current]. The extra row is for "no previous instruction."
+		uint64_t opPairCounts[Op_NUM_OPCODES + 1][Op_NUM_OPCODES];
+		uword lastOpcode;
+#endif
+
 		inline void disableGC() { this->mem.gcDisabled++; }
 		inline void enableGC()
 		{
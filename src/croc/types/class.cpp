@@ -84,6 +84,7 @@ namespace croc
 			return;
 
 		this->isFrozen = true;
+		this->layoutID = ++mem.lastLayoutID;
 
 		this->frozenFields = DArray<Array::Slot>::alloc(mem, this->fields.length());
 		uword i = 0;
@@ -220,6 +221,8 @@ namespace croc
 
 #define COMMON_ADD_MEMBER(memberName)\
 		CONTAINER_WRITE_BARRIER(mem, this);\
+		if(this->isFrozen)\
+			this->layoutID = ++mem.lastLayoutID;\
 		auto slot = this->memberName.insertNode(mem, name);\
 		slot->value = value;\
 		if(value.isGCObject())\
@@ -275,6 +278,10 @@ namespace croc
 			REMOVEKEYREF(mem, slot);\
 			REMOVEVALUEREF(mem, slot);\
 			this->memberName.remove(name);\
+\
+			if(this->isFrozen)\
+				this->layoutID = ++mem.lastLayoutID;\
+\
 			return true;\
 		}\
 		else\
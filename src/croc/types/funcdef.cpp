@@ -1,3 +1,6 @@
+#include <algorithm>
+
+#include "croc/internal/jit.hpp"
 #include "croc/types/base.hpp"
 
 namespace croc
@@ -18,14 +21,101 @@ namespace croc
 		fd->innerFuncs.free(mem);
 		fd->constants.free(mem);
 		fd->code.free(mem);
+		fd->fieldCaches.free(mem);
+		fd->methodCaches.free(mem);
+		fd->globalCaches.free(mem);
 
 		for(auto &st: fd->switchTables)
+		{
 			st.offsets.clear(mem);
+			st.freeIntCases(mem);
+		}
 
 		fd->switchTables.free(mem);
 		fd->lineInfo.free(mem);
 		fd->upvalNames.free(mem);
 		fd->locVarDescs.free(mem);
+#ifdef CROC_JIT
+		jitFree(mem, fd);
+#endif
 		FREE_OBJ(mem, Funcdef, fd);
 	}
+
+	// Decide how a switch with the given cases is looked up. Int-only switches get a jump table if at least half the
+	// slots between the lowest and highest case would be used, and are binary searched otherwise.
+	Funcdef::SwitchTable::Kind Funcdef::SwitchTable::kindOf(OffsetsType& offsets)
+	{
+		if(offsets.length() == 0)
+			return Hashed;
+
+		crocint lo = 0, hi = 0;
+		bool first = true;
+
+		for(auto node: offsets)
+		{
+			if(node->key.type != CrocType_Int)
+				return Hashed;
+
+			auto v = node->key.mInt;
+
+			if(first || v < lo) lo = v;
+			if(first || v > hi) hi = v;
+			first = false;
+		}
+
+		// Unsigned, since the subtraction can overflow a crocint.
+		if(cast(uint64_t)hi - cast(uint64_t)lo < cast(uint64_t)offsets.length() * 2)
+			return Dense;
+		else
+			return Sorted;
+	}
+
+	void Funcdef::SwitchTable::buildIntCases(Memory& mem)
+	{
+		freeIntCases(mem);
+
+		switch(kindOf(offsets))
+		{
+			case Hashed:
+				break;
+
+			case Dense: {
+				crocint lo = 0, hi = 0;
+				bool first = true;
+
+				for(auto node: offsets)
+				{
+					if(first || node->key.mInt < lo) lo = node->key.mInt;
+					if(first || node->key.mInt > hi) hi = node->key.mInt;
+					first = false;
+				}
+
+				denseMin = lo;
+				denseOffsets = DArray<word>::alloc(mem, cast(uword)(hi - lo) + 1);
+				denseOffsets.fill(defaultOffset);
+
+				for(auto node: offsets)
+					denseOffsets[cast(uword)(node->key.mInt - lo)] = node->value;
+				break;
+			}
+			case Sorted: {
+				sortedCases = DArray<IntCase>::alloc(mem, offsets.length());
+				uword i = 0;
+
+				for(auto node: offsets)
+					sortedCases[i++] = {node->key.mInt, node->value};
+
+				std::sort(sortedCases.ptr, sortedCases.ptr + sortedCases.length,
+					[](const IntCase& a, const IntCase& b) { return a.value < b.value; });
+				break;
+			}
+			default: assert(false);
+		}
+	}
+
+	void Funcdef::SwitchTable::freeIntCases(Memory& mem)
+	{
+		denseOffsets.free(mem);
+		sortedCases.free(mem);
+	}
 }
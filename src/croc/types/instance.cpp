@@ -87,28 +87,32 @@ namespace croc
 	{
 		if(auto slot = this->fields->lookupNode(name))
 		{
-			auto &fslot = (cast(Array::Slot*)(this + 1))[cast(uword)slot->value.mInt];
-
-			if(fslot.value != value)
-			{
-				REMOVEFROZENVALUEREF(mem, fslot);
-				fslot.value = value;
-
-				if(value.isGCObject())
-				{
-					CONTAINER_WRITE_BARRIER(mem, this);
-					fslot.modified = true;
-				}
-				else
-					fslot.modified = false;
-			}
-
+			this->setFieldSlot(mem, cast(uword)slot->value.mInt, value);
 			return true;
 		}
 
 		return false;
 	}
 
+	void Instance::setFieldSlot(Memory& mem, uword idx, Value value)
+	{
+		auto &fslot = (cast(Array::Slot*)(this + 1))[idx];
+
+		if(fslot.value != value)
+		{
+			REMOVEFROZENVALUEREF(mem, fslot);
+			fslot.value = value;
+
+			if(value.isGCObject())
+			{
+				CONTAINER_WRITE_BARRIER(mem, this);
+				fslot.modified = true;
+			}
+			else
+				fslot.modified = false;
+		}
+	}
+
 	bool Instance::setHiddenField(Memory& mem, String* name, Value value)
 	{
 		if(this->hiddenFieldsData == nullptr)
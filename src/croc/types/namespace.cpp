@@ -28,6 +28,7 @@ namespace croc
 	{
 		auto ret = ALLOC_OBJ(mem, Namespace);
 		ret->type = CrocType_Namespace;
+		ret->layoutID = ++mem.lastLayoutID;
 		return ret;
 	}
 
@@ -62,6 +63,7 @@ namespace croc
 		CONTAINER_WRITE_BARRIER(mem, this);
 		auto node = this->data.insertNode(mem, key);
 		node->value = value;
+		this->layoutID = ++mem.lastLayoutID;
 
 		if(value.isGCObject())
 			SET_BOTH_MODIFIED(node);
@@ -76,6 +78,13 @@ namespace croc
 		if(node == nullptr)
 			return false;
 
+		this->setNode(mem, node, value);
+		return true;
+	}
+
+	// Sets the value of a node which is already in this namespace.
+	void Namespace::setNode(Memory& mem, HashType::NodeType* node, Value value)
+	{
 		if(node->value != value)
 		{
 			REMOVEVALUEREF(mem, node);
@@ -89,8 +98,6 @@ namespace croc
 			else
 				CLEAR_VAL_MODIFIED(node);
 		}
-
-		return true;
 	}
 
 	// Remove a key-value pair from the namespace.
@@ -101,6 +108,7 @@ namespace croc
 			REMOVEKEYREF(mem, node);
 			REMOVEVALUEREF(mem, node);
 			this->data.remove(key);
+			this->layoutID = ++mem.lastLayoutID;
 		}
 	}
 
@@ -114,5 +122,6 @@ namespace croc
 		}
 
 		this->data.clear(mem);
+		this->layoutID = ++mem.lastLayoutID;
 	}
 }
\ No newline at end of file
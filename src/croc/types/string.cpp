@@ -32,7 +32,11 @@ namespace croc
 			ret->length = data.length;
 			ret->cpLength = cpLen;
 			ret->setData(data);
+
+			// Every string has to be in the string table, so this can't fail partway.
+			vm->mem.limitExempt++;
 			*vm->stringTab.insert(vm->mem, ret->toDArray()) = ret;
+			vm->mem.limitExempt--;
 			return ret;
 		}
 	}
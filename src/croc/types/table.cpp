@@ -1,20 +1,52 @@
 
+#include <algorithm>
+
 #include "croc/base/writebarrier.hpp"
 
 #define REMOVEKEYREF(mem, slot)\
 	do {\
-	if(!IS_KEY_MODIFIED(slot) && (slot)->key.isGCObject())\
+	if(!IS_KEY_MODIFIED(slot) && (slot)->key.isGCObject() && !this->weakKey((slot)->key))\
 		(mem).decBuffer.add((mem), (slot)->key.toGCObject());\
 	} while(false)
 
 #define REMOVEVALUEREF(mem, slot)\
 	do {\
-	if(!IS_VAL_MODIFIED(slot) && (slot)->value.isGCObject())\
+	if(!IS_VAL_MODIFIED(slot) && (slot)->value.isGCObject() && !this->weakValue((slot)->value))\
 		(mem).decBuffer.add((mem), (slot)->value.toGCObject());\
 	} while(false)
 
 namespace croc
 {
+	namespace
+	{
+		// Throws out the entries of obj's holder list that are stale (their table has died or the pair doesn't hold obj
+		// anymore) or that duplicate another entry.
+		void compactWeakHolders(VM* vm, GCObject* obj, WeakHolderList& list)
+		{
+			uword n = 0;
+
+			for(uword i = 0; i < list.length; i++)
+			{
+				auto& e = list.entries[i];
+
+				if(vm->weakTables.lookup(e.table) != nullptr && e.table->holdsWeakly(e, obj))
+					list.entries[n++] = e;
+			}
+
+			// Every entry left is in use by exactly one node, so sorting by node puts the duplicates next to each other.
+			auto nodeOf = [](const WeakHolder& e) { return e.table->data.lookupNode(e.key, e.hash); };
+			auto begin = list.entries.ptr;
+
+			std::sort(begin, begin + n, [&](const WeakHolder& a, const WeakHolder& b)
+				{ return std::less<Table::HashType::NodeType*>()(nodeOf(a), nodeOf(b)); });
+
+			auto end = std::unique(begin, begin + n, [&](const WeakHolder& a, const WeakHolder& b)
+				{ return nodeOf(a) == nodeOf(b); });
+
+			list.length = end - begin;
+		}
+	}
+
 	Table* Table::create(Memory& mem, uword size)
 	{
 		auto t = ALLOC_OBJ(mem, Table);
@@ -23,6 +55,23 @@ namespace croc
 		return t;
 	}
 
+	// Create a weak table. Weak tables are kept track of by the VM so that the GC can remove the key-value pairs whose
+	// weakly-held objects have died.
+	Table* Table::createWeak(VM* vm, CrocWeakMode mode, uword size)
+	{
+		auto t = create(vm->mem, size);
+		t->weakMode = mode;
+
+		if(mode != CrocWeakMode_None)
+		{
+			vm->mem.limitExempt++;
+			*vm->weakTables.insert(vm->mem, t) = true;
+			vm->mem.limitExempt--;
+		}
+
+		return t;
+	}
+
 	// Free a table object.
 	void Table::free(Memory& mem, Table* t)
 	{
@@ -30,11 +79,11 @@ namespace croc
 		FREE_OBJ(mem, Table, t);
 	}
 
-	// Duplicate an existing table efficiently.
-	Table* Table::dup(Memory& mem)
+	// Duplicate an existing table efficiently. The duplicate has the same weak mode.
+	Table* Table::dup(VM* vm)
 	{
-		auto newTab = ALLOC_OBJ(mem, Table);
-		newTab->type = CrocType_Table;
+		auto &mem = vm->mem;
+		auto newTab = createWeak(vm, cast(CrocWeakMode)this->weakMode);
 		newTab->data.prealloc(mem, this->data.capacity());
 
 		assert(newTab->data.capacity() == this->data.capacity());
@@ -45,23 +94,16 @@ namespace croc
 
 		for(auto node: newTab->data)
 		{
-			if(node->key.isGCObject() || node->value.isGCObject())
-			{
-				CONTAINER_WRITE_BARRIER(mem, newTab);
-
-				if(node->key.isGCObject())
-					SET_KEY_MODIFIED(node);
-
-				if(node->value.isGCObject())
-					SET_VAL_MODIFIED(node);
-			}
+			CLEAR_BOTH_MODIFIED(node);
+			newTab->barrier(vm, node);
 		}
 
 		return newTab;
 	}
 
-	void Table::idxa(Memory& mem, Value key, Value val)
+	void Table::idxa(VM* vm, Value key, Value val)
 	{
+		auto &mem = vm->mem;
 		auto node = this->data.lookupNode(key);
 
 		if(node != nullptr)
@@ -78,14 +120,8 @@ namespace croc
 				// Update
 				REMOVEVALUEREF(mem, node);
 				node->value = val;
-
-				if(val.isGCObject())
-				{
-					CONTAINER_WRITE_BARRIER(mem, this);
-					SET_VAL_MODIFIED(node);
-				}
-				else
-					CLEAR_VAL_MODIFIED(node);
+				CLEAR_VAL_MODIFIED(node);
+				this->barrier(vm, node);
 			}
 		}
 		else if(val.type != CrocType_Null)
@@ -93,17 +129,7 @@ namespace croc
 			// Insert
 			node = this->data.insertNode(mem, key);
 			node->value = val;
-
-			if(key.isGCObject() || val.isGCObject())
-			{
-				CONTAINER_WRITE_BARRIER(mem, this);
-
-				if(key.isGCObject())
-					SET_KEY_MODIFIED(node);
-
-				if(val.isGCObject())
-					SET_VAL_MODIFIED(node);
-			}
+			this->barrier(vm, node);
 		}
 
 		// otherwise, do nothing (val is null and key doesn't exist)
@@ -120,4 +146,131 @@ namespace croc
 
 		this->data.clear(mem);
 	}
-}
\ No newline at end of file
+
+	// Whether the key-value pair that e refers to is still in this table and holds obj weakly.
+	bool Table::holdsWeakly(const WeakHolder& e, GCObject* obj)
+	{
+		auto node = this->data.lookupNode(e.key, e.hash);
+
+		return node != nullptr &&
+			((weakKey(node->key) && node->key.toGCObject() == obj) ||
+			(weakValue(node->value) && node->value.toGCObject() == obj));
+	}
+
+	// Remove the key-value pairs which weakly held the objects in vm->deadWeak, which have died. The GC calls this at the
+	// end of each cycle. Only the pairs on the dead objects' holder lists are looked at. The objects may have been freed
+	// already, so they're only compared, never looked at.
+	void Table::removeDead(VM* vm)
+	{
+		for(auto n: vm->deadWeak)
+		{
+			auto obj = n->key;
+			auto list = vm->weakHolders.lookup(obj);
+
+			if(list == nullptr)
+				continue;
+
+			for(uword i = 0; i < list->length; i++)
+			{
+				auto& e = list->entries[i];
+
+				if(vm->weakTables.lookup(e.table) != nullptr && e.table->holdsWeakly(e, obj))
+					e.table->removeHeld(vm, e);
+			}
+
+			list->entries.free(vm->mem);
+			vm->weakHolders.remove(obj);
+		}
+	}
+
+	// Removes the key-value pair that e refers to. Like holdsWeakly, this never looks at the key, which may be dead.
+	void Table::removeHeld(VM* vm, const WeakHolder& e)
+	{
+		auto &mem = vm->mem;
+		auto node = this->data.lookupNode(e.key, e.hash);
+		assert(node != nullptr);
+		REMOVEKEYREF(mem, node);
+		REMOVEVALUEREF(mem, node);
+		this->data.remove(e.key, e.hash);
+	}
+
+	// Free all the holder lists, when the VM is closed.
+	void Table::freeWeakHolders(VM* vm)
+	{
+		for(auto n: vm->weakHolders)
+			n->value.entries.free(vm->mem);
+
+		vm->weakHolders.clear(vm->mem);
+	}
+
+	// Does the write barrier for a key-value pair which was just put in the table. Weakly-held objects aren't counted as
+	// references, so they don't go through the barrier; they're flagged instead, so that the GC knows to tell the weak
+	// tables when they die, and the pair is put on their holder lists.
+	void Table::barrier(VM* vm, HashType::NodeType* node)
+	{
+		auto &mem = vm->mem;
+
+		if(node->key.isGCObject())
+		{
+			if(weakKey(node->key))
+			{
+				GCOBJ_SETWEAKLYHELD(node->key.toGCObject());
+				this->addWeakHolder(vm, node->key, node->key.toGCObject());
+
+				if(this->weakMode == CrocWeakMode_Ephemeron)
+					GCOBJ_SETEPHEMERONKEY(node->key.toGCObject());
+			}
+			else
+			{
+				CONTAINER_WRITE_BARRIER(mem, this);
+				SET_KEY_MODIFIED(node);
+			}
+		}
+
+		if(node->value.isGCObject())
+		{
+			if(weakValue(node->value))
+			{
+				GCOBJ_SETWEAKLYHELD(node->value.toGCObject());
+				this->addWeakHolder(vm, node->key, node->value.toGCObject());
+			}
+			else
+			{
+				CONTAINER_WRITE_BARRIER(mem, this);
+				SET_VAL_MODIFIED(node);
+			}
+		}
+	}
+
+	// Puts the pair with the given key on obj's holder list. A full list is compacted before it's grown, and it's only
+	// grown if it's still at least half full, so lists don't grow without bound when the same pairs are removed and put
+	// back over and over.
+	void Table::addWeakHolder(VM* vm, Value key, GCObject* obj)
+	{
+		auto &mem = vm->mem;
+		mem.limitExempt++;
+
+		auto list = vm->weakHolders.lookup(obj);
+
+		if(list == nullptr)
+		{
+			list = vm->weakHolders.insert(mem, obj);
+			list->entries = DArray<WeakHolder>();
+			list->length = 0;
+		}
+
+		if(list->length == list->entries.length)
+		{
+			compactWeakHolders(vm, obj, *list);
+
+			if(list->length * 2 >= list->entries.length)
+				list->entries.resize(mem, list->entries.length < 4 ? 4 : list->entries.length * 2);
+		}
+
+		auto& e = list->entries[list->length++];
+		e.table = this;
+		e.key = key;
+		e.hash = key.toHash();
+		mem.limitExempt--;
+	}
+}
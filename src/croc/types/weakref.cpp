@@ -13,7 +13,9 @@ namespace croc
 		auto ret = ALLOC_OBJ_ACYC(vm->mem, Weakref);
 		ret->type = CrocType_Weakref;
 		ret->obj = obj;
+		vm->mem.limitExempt++;
 		*vm->weakrefTab.insert(vm->mem, obj) = ret;
+		vm->mem.limitExempt--;
 		return ret;
 	}
 